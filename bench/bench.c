@@ -0,0 +1,289 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* End-to-end benchmark of the scanner and the parser.
+   Every input is scanned and parsed a number of times by running the
+   programs as they are used; the median time gives MB/s, tokens/s and
+   nodes/s, with the token and node counts taken from parse -stats. The
+   results can be written as JSON and compared with an earlier file, and
+   a throughput lower than the baseline by more than the tolerance is a
+   regression: bench then exits with 1. */
+
+#define MAXFILES 256
+#define MAXRUNS 101
+#define TRUE 1
+#define FALSE 0
+
+typedef struct {
+	char* file;
+	const char* tool;
+	long long bytes, tokens, nodes;
+	double median, min;     /* seconds */
+	long rss;               /* peak kB of the largest run */
+} Result;
+
+static char* parseProg = "parse";
+static char* scanProg = "scan";
+static int runs = 5;
+static char outFile[64];    /* listing of the runs, thrown away */
+static char statsFile[64];
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* run a program with its output to /dev/null; returns the wall time and
+   the peak resident size in kB */
+static double run(char** argv, long* rss)
+{
+	struct rusage ru;
+	double start = now();
+	int status, fd;
+	pid_t pid = fork();
+
+	if (pid == 0) {
+		fd = open("/dev/null", O_RDWR);
+		dup2(fd, 0);
+		dup2(fd, 1);
+		execvp(argv[0], argv);
+		fprintf(stderr, "Unable to run %s\n", argv[0]);
+		_exit(127);
+	}
+	if (pid < 0 || wait4(pid, &status, 0, &ru) != pid) {
+		fprintf(stderr, "Unable to run %s\n", argv[0]);
+		exit(1);
+	}
+	if (WIFSIGNALED(status) || (WIFEXITED(status) && WEXITSTATUS(status) == 127)) {
+		fprintf(stderr, "%s failed\n", argv[0]);
+		exit(1);
+	}
+	*rss = ru.ru_maxrss;
+	return now() - start;
+}
+
+static int cmpDouble(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+/* the number after key in text, or -1 */
+static long long number(char* text, const char* key)
+{
+	char* p = text != NULL ? strstr(text, key) : NULL;
+	return p != NULL ? atoll(p + strlen(key)) : -1;
+}
+
+static char* readFile(char* path)
+{
+	FILE* f = fopen(path, "rb");
+	char* text;
+	long n;
+
+	if (f == NULL)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	n = ftell(f);
+	rewind(f);
+	text = (char*)malloc(n + 1);
+	if (text == NULL || fread(text, 1, n, f) != (size_t)n) {
+		fclose(f);
+		free(text);
+		return NULL;
+	}
+	text[n] = '\0';
+	fclose(f);
+	return text;
+}
+
+static void measure(Result* r, char** argv)
+{
+	double times[MAXRUNS];
+	long rss;
+	int i;
+
+	r->rss = 0;
+	run(argv, &rss);    /* warm up: the file is in the page cache after it */
+	for (i = 0; i < runs; i++) {
+		times[i] = run(argv, &rss);
+		if (rss > r->rss)
+			r->rss = rss;
+	}
+	qsort(times, runs, sizeof(double), cmpDouble);
+	r->median = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+	r->min = times[0];
+}
+
+static double perSecond(long long n, double seconds)
+{
+	return n < 0 || seconds <= 0 ? -1 : n / seconds;
+}
+
+/* a rate as JSON: null when unknown */
+static void jsonRate(FILE* f, const char* key, double rate)
+{
+	if (rate < 0)
+		fprintf(f, ", \"%s\": null", key);
+	else
+		fprintf(f, ", \"%s\": %.1f", key, rate);
+}
+
+static void writeJson(char* path, Result* res, int n)
+{
+	FILE* f = fopen(path, "w");
+	int i;
+
+	if (f == NULL) {
+		fprintf(stderr, "Unable to open %s\n", path);
+		exit(1);
+	}
+	fprintf(f, "{\"version\": 1, \"runs\": %d, \"results\": [\n", runs);
+	for (i = 0; i < n; i++) {
+		Result* r = &res[i];
+		fprintf(f, "  {\"file\": \"%s\", \"tool\": \"%s\", \"bytes\": %lld, \"tokens\": %lld, "
+			"\"nodes\": %lld, \"median_s\": %.6f, \"min_s\": %.6f", r->file, r->tool,
+			r->bytes, r->tokens, r->nodes, r->median, r->min);
+		jsonRate(f, "mb_per_s", perSecond(r->bytes, r->median) / 1e6);
+		jsonRate(f, "tokens_per_s", perSecond(r->tokens, r->median));
+		jsonRate(f, "nodes_per_s", perSecond(r->nodes, r->median));
+		fprintf(f, ", \"peak_rss_kb\": %ld}%s\n", r->rss, i + 1 < n ? "," : "");
+	}
+	fprintf(f, "]}\n");
+	fclose(f);
+}
+
+/* MB/s of file and tool in a result file written before, or -1 */
+static double baselineRate(char* text, Result* r)
+{
+	char key[600];
+	char* p;
+
+	snprintf(key, sizeof(key), "\"file\": \"%s\", \"tool\": \"%s\"", r->file, r->tool);
+	p = text != NULL ? strstr(text, key) : NULL;
+	if (p == NULL || (p = strstr(p, "\"mb_per_s\": ")) == NULL || !strncmp(p + 12, "null", 4))
+		return -1;
+	return atof(p + 12);
+}
+
+static void usage(char* prog)
+{
+	fprintf(stderr, "usage: %s [options] <input_file.c>...\n", prog);
+	fprintf(stderr, "  -parse <prog>     parser to run (parse)\n");
+	fprintf(stderr, "  -scan <prog>      scanner to run (scan)\n");
+	fprintf(stderr, "  -runs n           timed runs of each program on each input (5)\n");
+	fprintf(stderr, "  -o <file.json>    write the results\n");
+	fprintf(stderr, "  -baseline <file.json>  compare with results written before\n");
+	fprintf(stderr, "  -tolerance pct    slowdown below which there is no regression (5)\n");
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	static Result res[2 * MAXFILES];
+	char* results = NULL, * baseline = NULL, * text;
+	char* args[8];
+	double tolerance = 5, base, rate;
+	struct stat st;
+	int argi = 1, n = 0, i, regressions = 0;
+	long rss;
+
+	while (argi < argc && argv[argi][0] == '-') {
+		if (argi + 1 >= argc)
+			usage(argv[0]);
+		if (!strcmp(argv[argi], "-parse"))
+			parseProg = argv[++argi];
+		else if (!strcmp(argv[argi], "-scan"))
+			scanProg = argv[++argi];
+		else if (!strcmp(argv[argi], "-runs"))
+			runs = atoi(argv[++argi]);
+		else if (!strcmp(argv[argi], "-o"))
+			results = argv[++argi];
+		else if (!strcmp(argv[argi], "-baseline"))
+			baseline = argv[++argi];
+		else if (!strcmp(argv[argi], "-tolerance"))
+			tolerance = atof(argv[++argi]);
+		else
+			usage(argv[0]);
+		argi++;
+	}
+	if (argi == argc || argc - argi > MAXFILES || runs < 1 || runs > MAXRUNS)
+		usage(argv[0]);
+	/* short names: the scanner takes file names of up to 45 characters */
+	sprintf(outFile, "/tmp/bench%d.txt", (int)getpid());
+	sprintf(statsFile, "/tmp/bench%d.json", (int)getpid());
+	text = baseline != NULL ? readFile(baseline) : NULL;
+	if (baseline != NULL && text == NULL) {
+		fprintf(stderr, "Unable to read %s\n", baseline);
+		exit(1);
+	}
+
+	printf("%-24s %-6s %10s %9s %9s %12s %12s %9s\n", "file", "tool", "bytes", "median s",
+		"MB/s", "tokens/s", "nodes/s", "peak kB");
+	for (; argi < argc; argi++) {
+		char* file = argv[argi];
+		char* stats;
+		Result* p = &res[n], * s = &res[n + 1];
+
+		if (stat(file, &st) != 0 || strlen(file) > 45 || strchr(file, '"') != NULL) {
+			fprintf(stderr, "%s: no such file, or a name the scanner cannot take\n", file);
+			exit(1);
+		}
+
+		/* counts from one run with -stats, timed runs without */
+		args[0] = parseProg; args[1] = "-stats"; args[2] = statsFile;
+		args[3] = file; args[4] = outFile; args[5] = NULL;
+		remove(statsFile);
+		run(args, &rss);
+		stats = readFile(statsFile);
+		p->file = s->file = file;
+		p->tool = "parse";
+		s->tool = "scan";
+		p->bytes = s->bytes = (long long)st.st_size;
+		p->tokens = s->tokens = number(stats, "\"tokens\": {\"total\": ");
+		p->nodes = number(stats, "\"stmt_nodes\": {\"total\": ");
+		if (p->nodes >= 0)
+			p->nodes += number(stats, "\"exp_nodes\": {\"total\": ");
+		s->nodes = -1;
+		free(stats);
+
+		args[0] = parseProg; args[1] = file; args[2] = outFile; args[3] = NULL;
+		measure(p, args);
+		args[0] = scanProg;
+		measure(s, args);
+
+		for (i = n; i < n + 2; i++) {
+			Result* r = &res[i];
+			rate = perSecond(r->bytes, r->median) / 1e6;
+			printf("%-24s %-6s %10lld %9.4f %9.2f %12.0f %12.0f %9ld", r->file, r->tool, r->bytes,
+				r->median, rate, perSecond(r->tokens, r->median), perSecond(r->nodes, r->median), r->rss);
+			base = baselineRate(text, r);
+			if (base > 0) {
+				printf("  %+.1f%%", (rate / base - 1) * 100);
+				if (rate < base * (1 - tolerance / 100)) {
+					printf(" REGRESSION");
+					regressions++;
+				}
+			}
+			printf("\n");
+		}
+		n += 2;
+	}
+	remove(outFile);
+	remove(statsFile);
+	if (results != NULL)
+		writeJson(results, res, n);
+	if (regressions > 0)
+		fprintf(stderr, "%d regressions against %s\n", regressions, baseline);
+	return regressions > 0;
+}
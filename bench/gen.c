@@ -0,0 +1,527 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+/* Generator of C- programs for benchmarks.
+   The same seed and options always give the same program. Programs are
+   valid: every name is declared before it is used, calls have as many
+   arguments as the function has parameters, with arrays where it takes
+   arrays, and int functions return a value. With -errors some functions
+   get one syntax error. Only the last functions and globals are kept to
+   be called and used, so any size can be written in constant memory. */
+
+#define TRUE 1
+#define FALSE 0
+#define WINDOW 256      /* functions and globals that can be referred to */
+#define MAXPARAMS 4
+#define MAXLOCALS 64
+#define MAXNAME 64
+
+typedef struct {
+	int id;
+	int isInt;
+	int nparams;
+	int isArray[MAXPARAMS];
+} Func;
+
+typedef struct {
+	int id;
+	int isArray;
+	int size;
+} Var;
+
+/* options */
+static unsigned long long seed = 1;
+static long long targetSize = 64 * 1024;
+static long funcCount = 0;      /* > 0: exactly this many functions */
+static int maxDepth = 3;
+static int idLen = 6;
+static int commentPct = 10;
+static int errorPct = 0;
+
+static FILE* out;
+static long long written = 0;
+static int indent = 0;
+
+static Func funcs[WINDOW];
+static long nfuncs = 0;
+static Var globals[WINDOW];     /* globals[0], an array, is always kept */
+static long nglobals = 0;
+
+/* the function being written */
+static Var locals[MAXLOCALS];
+static int nlocals;
+static int errorAt;             /* statement that gets the syntax error, or -1 */
+static int nstmts;
+
+/* xorshift64*: the same numbers on every platform */
+static unsigned long long rng(void)
+{
+	seed ^= seed >> 12;
+	seed ^= seed << 25;
+	seed ^= seed >> 27;
+	return seed * 2685821657736338717ULL;
+}
+
+static int pick(int n)
+{
+	return (int)((rng() >> 33) % (unsigned long long)n);
+}
+
+static int chance(int pct)
+{
+	return pick(100) < pct;
+}
+
+static void emit(const char* fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vfprintf(out, fmt, ap);
+	va_end(ap);
+	if (n > 0)
+		written += n;
+}
+
+static void newline(void)
+{
+	int i;
+
+	emit("\n");
+	for (i = 0; i < indent; i++)
+		emit("\t");
+}
+
+/* C- names are letters only. The first letter tells the kind of name and
+   is one no reserved word or input/output starts with; the rest is the
+   number in base 25 (a-y), padded with z to the identifier length */
+static char* name(char kind, long id, char* buf)
+{
+	int n = 0, i;
+	char digits[16];
+
+	buf[n++] = kind;
+	i = 0;
+	do {
+		digits[i++] = (char)('a' + id % 25);
+		id /= 25;
+	} while (id > 0);
+	while (i > 0)
+		buf[n++] = digits[--i];
+	while (n < idLen && n < MAXNAME - 1)
+		buf[n++] = 'z';
+	buf[n] = '\0';
+	return buf;
+}
+
+static void expr(int depth);
+
+/* the global declared back places before the last one; globals[0] is
+   kept for good, the others in the rest of the array */
+static Var* global(long back)
+{
+	long k = nglobals - 1 - back;
+
+	return k == 0 ? &globals[0] : &globals[k % (WINDOW - 1) + 1];
+}
+
+static void use(char kind, Var* v, int depth)
+{
+	char buf[MAXNAME];
+
+	emit("%s", name(kind, v->id < 0 ? -v->id - 1 : v->id, buf));
+	if (v->isArray) {
+		emit("[");
+		expr(depth - 1);
+		emit("]");
+	}
+}
+
+/* a scalar variable or array element that can be assigned */
+static void lvalue(int depth)
+{
+	if (nlocals > 0 && chance(70)) {
+		Var* v = &locals[pick(nlocals)];
+		use(v->id < 0 ? 'q' : 'm', v, depth);
+	}
+	else
+		use('z', global(pick(nglobals < WINDOW - 1 ? (int)nglobals : WINDOW - 1)), depth);
+}
+
+/* a whole array, for an array parameter */
+static void arrayArg(void)
+{
+	char buf[MAXNAME];
+	int i;
+
+	for (i = 0; i < nlocals; i++)
+		if (locals[i].isArray && chance(50)) {
+			emit("%s", name(locals[i].id < 0 ? 'q' : 'm',
+				locals[i].id < 0 ? -locals[i].id - 1 : locals[i].id, buf));
+			return;
+		}
+	emit("%s", name('z', globals[0].id, buf));
+}
+
+/* a call of an earlier function; needInt: one returning int */
+static int call(int depth, int needInt)
+{
+	char buf[MAXNAME];
+	Func* f;
+	int i, tries, n = nfuncs < WINDOW ? (int)nfuncs : WINDOW;
+
+	for (tries = 0; tries < 8 && n > 0; tries++) {
+		f = &funcs[(nfuncs - 1 - pick(n)) % WINDOW];
+		if (needInt && !f->isInt)
+			continue;
+		emit("%s(", name('k', f->id, buf));
+		for (i = 0; i < f->nparams; i++) {
+			if (i > 0)
+				emit(", ");
+			if (f->isArray[i])
+				arrayArg();
+			else
+				expr(depth - 1);
+		}
+		emit(")");
+		return TRUE;
+	}
+	return FALSE;
+}
+
+static void expr(int depth)
+{
+	static const char* ops[] = { "+", "-", "*", "/" };
+	int r = depth <= 0 ? pick(2) : pick(7);
+
+	switch (r) {
+	case 0:
+		emit("%d", pick(1000));
+		break;
+	case 1:
+		lvalue(depth);
+		break;
+	case 2:
+	case 3:
+		expr(depth - 1);
+		emit(" %s ", ops[pick(4)]);
+		expr(depth - 1);
+		break;
+	case 4:
+		emit("(");
+		expr(depth - 1);
+		emit(")");
+		break;
+	case 5:
+		if (!call(depth, TRUE))
+			emit("%d", pick(1000));
+		break;
+	default:
+		/* in parentheses, since an operand cannot be an assignment */
+		emit("(");
+		lvalue(depth);
+		emit(" = ");
+		expr(depth - 1);
+		emit(")");
+		break;
+	}
+}
+
+static void condition(int depth)
+{
+	static const char* rel[] = { "<", "<=", ">", ">=", "==", "!=" };
+
+	expr(depth - 1);
+	emit(" %s ", rel[pick(6)]);
+	expr(depth - 1);
+}
+
+static void comment(void)
+{
+	static const char* words[] = { "check", "the", "value", "of", "each", "loop", "index",
+		"before", "using", "it", "again", "sum" };
+	int i, n = 1 + pick(8);
+
+	emit("/*");
+	for (i = 0; i < n; i++) {
+		if (i > 0 && chance(10)) {
+			newline();
+			emit("  ");
+		}
+		emit(" %s", words[pick(12)]);
+	}
+	emit(" */");
+	newline();
+}
+
+/* one syntax error in place of a statement */
+static void badStmt(void)
+{
+	switch (pick(4)) {
+	case 0:
+		lvalue(0);
+		emit(" = ");
+		expr(1);      /* no ';' */
+		break;
+	case 1:
+		emit("if (");
+		condition(1);
+		emit(" ;");
+		break;
+	case 2:
+		emit("%d%s = 1;", pick(100), "ab");
+		break;
+	default:
+		lvalue(0);
+		emit(" = @ 1;");
+		break;
+	}
+}
+
+static void localDecls(int max);
+static void stmt(int depth);
+
+static void compound(int depth)
+{
+	int i, n = 1 + pick(4), mark = nlocals;
+
+	emit("{");
+	indent++;
+	localDecls(2);
+	for (i = 0; i < n; i++) {
+		newline();
+		stmt(depth - 1);
+	}
+	indent--;
+	nlocals = mark;
+	newline();
+	emit("}");
+}
+
+static void body(int depth)
+{
+	if (chance(70)) {
+		newline();
+		compound(depth);
+	}
+	else {
+		indent++;
+		newline();
+		stmt(depth - 1);
+		indent--;
+	}
+}
+
+static void stmt(int depth)
+{
+	int r = depth <= 0 ? 3 + pick(3) : pick(8);
+
+	if (chance(commentPct))
+		comment();
+	if (nstmts++ == errorAt) {
+		badStmt();
+		return;
+	}
+	switch (r) {
+	case 0:
+		emit("if (");
+		condition(depth);
+		emit(")");
+		body(depth);
+		if (chance(40)) {
+			newline();
+			emit("else");
+			body(depth);
+		}
+		break;
+	case 1:
+		emit("while (");
+		condition(depth);
+		emit(")");
+		body(depth);
+		break;
+	case 2:
+		compound(depth);
+		break;
+	case 6:
+		if (call(depth, FALSE)) {
+			emit(";");
+			break;
+		}
+		/* no function yet: an assignment */
+		/* fall through */
+	default:
+		lvalue(depth);
+		emit(" = ");
+		expr(depth);
+		emit(";");
+		break;
+	}
+}
+
+static void localDecls(int max)
+{
+	char buf[MAXNAME];
+	int i, n = pick(max + 1);
+	static long localId = 0;
+
+	for (i = 0; i < n && nlocals < MAXLOCALS; i++) {
+		Var* v = &locals[nlocals++];
+		v->id = (int)(localId++ % 100000);
+		v->isArray = chance(20);
+		v->size = 1 + pick(100);
+		newline();
+		if (v->isArray)
+			emit("int %s[%d];", name('m', v->id, buf), v->size);
+		else
+			emit("int %s;", name('m', v->id, buf));
+	}
+}
+
+static void globalDecl(void)
+{
+	char buf[MAXNAME];
+	Var* v = nglobals == 0 ? &globals[0] : &globals[nglobals % (WINDOW - 1) + 1];
+
+	v->id = (int)nglobals++;
+	v->isArray = v == &globals[0] || chance(30);
+	v->size = 1 + pick(1000);
+	if (v->isArray)
+		emit("int %s[%d];\n", name('z', v->id, buf), v->size);
+	else
+		emit("int %s;\n", name('z', v->id, buf));
+}
+
+static void function(int isMain)
+{
+	char buf[MAXNAME];
+	Func f;
+	int i, n;
+
+	f.id = (int)nfuncs;
+	f.isInt = !isMain && chance(60);
+	f.nparams = isMain ? 0 : pick(MAXPARAMS + 1);
+	nlocals = 0;
+	nstmts = 0;
+	errorAt = !isMain && chance(errorPct) ? pick(8) : -1;
+
+	emit("\n");
+	if (chance(commentPct))
+		comment();
+	emit("%s %s(", f.isInt ? "int" : "void", isMain ? "main" : name('k', f.id, buf));
+	if (f.nparams == 0)
+		emit("void");
+	for (i = 0; i < f.nparams; i++) {
+		Var* v = &locals[nlocals++];
+		f.isArray[i] = chance(25);
+		v->id = -i - 1;     /* parameters are named q... */
+		v->isArray = f.isArray[i];
+		emit("%sint %s%s", i > 0 ? ", " : "", name('q', i, buf), v->isArray ? "[]" : "");
+	}
+	emit(")");
+	newline();
+	emit("{");
+	indent++;
+	localDecls(4);
+	n = 1 + pick(6);
+	for (i = 0; i < n; i++) {
+		newline();
+		stmt(maxDepth);
+	}
+	if (f.isInt) {
+		newline();
+		emit("return ");
+		expr(maxDepth);
+		emit(";");
+	}
+	indent--;
+	newline();
+	emit("}\n");
+
+	/* callable from the next functions on, not from itself */
+	funcs[nfuncs % WINDOW] = f;
+	nfuncs++;
+}
+
+static long long size(char* s)
+{
+	char* end;
+	long long n = strtoll(s, &end, 10);
+
+	if (*end == 'k' || *end == 'K')
+		n *= 1024;
+	else if (*end == 'm' || *end == 'M')
+		n *= 1024 * 1024;
+	else if (*end == 'g' || *end == 'G')
+		n *= 1024LL * 1024 * 1024;
+	return n;
+}
+
+static void usage(char* prog)
+{
+	fprintf(stderr, "usage: %s [options] [<output_file.c>]\n", prog);
+	fprintf(stderr, "  -seed n      random seed (1)\n");
+	fprintf(stderr, "  -size n[KMG] write about n bytes (64K)\n");
+	fprintf(stderr, "  -funcs n     write n functions instead, whatever the size\n");
+	fprintf(stderr, "  -depth n     nesting of statements and expressions (3)\n");
+	fprintf(stderr, "  -idlen n     length of identifiers (6)\n");
+	fprintf(stderr, "  -comments p percent of statements with a comment before them (10)\n");
+	fprintf(stderr, "  -errors p    percent of functions with a syntax error (0)\n");
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	int argi = 1, i;
+
+	while (argi < argc && argv[argi][0] == '-') {
+		char* opt = argv[argi] + 1;
+		if (argi + 1 >= argc)
+			usage(argv[0]);
+		if (!strcmp(opt, "seed"))
+			seed = strtoull(argv[++argi], NULL, 10);
+		else if (!strcmp(opt, "size"))
+			targetSize = size(argv[++argi]);
+		else if (!strcmp(opt, "funcs"))
+			funcCount = atol(argv[++argi]);
+		else if (!strcmp(opt, "depth"))
+			maxDepth = atoi(argv[++argi]);
+		else if (!strcmp(opt, "idlen"))
+			idLen = atoi(argv[++argi]);
+		else if (!strcmp(opt, "comments"))
+			commentPct = atoi(argv[++argi]);
+		else if (!strcmp(opt, "errors"))
+			errorPct = atoi(argv[++argi]);
+		else
+			usage(argv[0]);
+		argi++;
+	}
+	if (argc - argi > 1 || maxDepth < 0 || idLen >= MAXNAME || targetSize < 0)
+		usage(argv[0]);
+	if (seed == 0)
+		seed = 1;   /* xorshift stays at 0 */
+	out = argi < argc ? fopen(argv[argi], "w") : stdout;
+	if (out == NULL) {
+		fprintf(stderr, "Unable to open %s\n", argv[argi]);
+		exit(1);
+	}
+
+	emit("/* C- benchmark program: seed %llu, depth %d */\n", seed, maxDepth);
+	for (i = 0; i < 2; i++)
+		globalDecl();
+	while (funcCount > 0 ? nfuncs < funcCount : written < targetSize) {
+		if (chance(20))
+			globalDecl();
+		function(FALSE);
+	}
+	function(TRUE);
+	if (fclose(out) != 0) {
+		fprintf(stderr, "Unable to write the program\n");
+		exit(1);
+	}
+	return 0;
+}
@@ -0,0 +1,299 @@
+/* Microbenchmarks of the scanner and parser functions.
+   parse.c is compiled into this file with its main() renamed, so every
+   function is measured as the compiler has it, on a source kept in
+   memory. A benchmark runs a batch of operations; after the warm-up
+   batches each timed batch gives ns per operation, and the report has
+   the median, the median absolute deviation (MAD) and the fastest batch.
+
+   gcc -O2 -o micro bench/micro.c
+   micro [-reps n] [-warmup n] [-only name] [<input_file.c>] */
+
+#define main parse_main
+#include "../parser/parse.c"
+#undef main
+
+#define MAXREPS 1001
+
+/* the default input: the selection sort of parser/2.c, repeated */
+static const char* sample =
+	"/* A program to perform selection sort on a 10\n"
+	"   element array. */\n"
+	"\n"
+	"int x[10];\n"
+	"\n"
+	"int minloc ( int a[], int low, int high )\n"
+	"{\tint i; int x; int k;\n"
+	"\tk = low;\n"
+	"\tx = a[low];\n"
+	"\ti = low + 1;\n"
+	"\twhile (i < high)\n"
+	"\t{\tif (a[i] < x)\n"
+	"\t\t\t{ x = a[i];\n"
+	"\t\t\t  k = i;  }\n"
+	"\t\ti = i + 1;\n"
+	"\t}\n"
+	"\treturn k;\n"
+	"}\n"
+	"\n"
+	"void sort( int a[], int low, int high)\n"
+	"{\tint i; int k;\n"
+	"\ti = low;\n"
+	"\twhile (i < high-1)\n"
+	"\t{\tint t;\n"
+	"\t\tk = minloc(a,i,high,i);\n"
+	"\t\tt = a[k];\n"
+	"\t\ta[k] = a[i];\n"
+	"\t\ta[i] = t;\n"
+	"\t\ti = i + 1;\n"
+	"\t}\n"
+	"}\n";
+
+static char* source;            /* the input, in memory */
+static long sourceLen;
+static FILE* devNull;
+static char** lexemes;          /* tokenString of every token of the input */
+static TokenType* tokens;
+static int ntokens;
+static TreeNode* tree;          /* the input parsed, for printTree() */
+static long treeNodes;
+static void* ptrs[100000];      /* nodes and strings to free after a batch */
+
+static double nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* read the input from the start, as main() does with a file */
+static void openSource(void)
+{
+#ifdef _WIN32
+	fpIn = tmpfile();
+	fwrite(source, 1, sourceLen, fpIn);
+	rewind(fpIn);
+#else
+	fpIn = fmemopen(source, sourceLen, "r");
+#endif
+	fpOut = devNull;
+	lineno = 0;
+	linepos = bufsize = 0;
+	EOF_flag = FALSE;
+	scanState = START;
+	Error = FALSE;
+}
+
+static void closeSource(void)
+{
+	fclose(fpIn);
+}
+
+/* the benchmarks: each runs one batch and returns its operations */
+
+static long benchGetNextChar(void)
+{
+	long n = 0;
+
+	openSource();
+	while (getNextChar() != EOF)
+		n++;
+	closeSource();
+	return n;
+}
+
+static long benchGetToken(void)
+{
+	long n = 0;
+
+	openSource();
+	while (getToken() != ENDFILE)
+		n++;
+	closeSource();
+	return n;
+}
+
+static long benchReservedLookup(void)
+{
+	volatile TokenType t;
+	int i;
+
+	for (i = 0; i < ntokens; i++)
+		t = reservedLookup(lexemes[i]);
+	(void)t;
+	return ntokens;
+}
+
+static long benchNewNode(void)
+{
+	int i;
+
+	for (i = 0; i < 100000; i += 2) {
+		ptrs[i] = newExpNode(IdK);
+		ptrs[i + 1] = newStmtNode(CompoundK);
+	}
+	return 100000;
+}
+
+static long benchCopyString(void)
+{
+	int i, n = ntokens < 100000 ? ntokens : 100000;
+
+	for (i = 0; i < n; i++)
+		ptrs[i] = copyString(lexemes[i]);
+	return n;
+}
+
+static long benchPrintToken(void)
+{
+	int i;
+
+	fpOut = devNull;
+	for (i = 0; i < ntokens; i++)
+		printToken(tokens[i], lexemes[i]);
+	return ntokens;
+}
+
+static long benchPrintTree(void)
+{
+	fpOut = devNull;
+	indentno = 0;
+	printTree(tree);
+	return treeNodes;
+}
+
+/* after a batch of newExpNode()/newStmtNode() or copyString(), not timed */
+static void freePtrs(void)
+{
+	int i;
+
+	for (i = 0; i < 100000; i++) {
+		free(ptrs[i]);
+		ptrs[i] = NULL;
+	}
+}
+
+static struct {
+	const char* name;
+	long (*run)(void);
+	void (*after)(void);
+} benches[] = {
+	{ "getNextChar", benchGetNextChar, NULL },
+	{ "getToken", benchGetToken, NULL },
+	{ "reservedLookup", benchReservedLookup, NULL },
+	{ "newExpNode/newStmtNode", benchNewNode, freePtrs },
+	{ "copyString", benchCopyString, freePtrs },
+	{ "printToken", benchPrintToken, NULL },
+	{ "printTree", benchPrintTree, NULL },
+};
+
+static int cmpDouble(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+static double median(double* v, int n)
+{
+	qsort(v, n, sizeof(double), cmpDouble);
+	return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+static void microUsage(char* prog)
+{
+	fprintf(stderr, "usage: %s [-reps n] [-warmup n] [-only name] [<input_file.c>]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	static double ns[MAXREPS], dev[MAXREPS];
+	int argi = 1, reps = 31, warmup = 5, b, r, cap = 0, i;
+	char* only = NULL;
+	double start, med, mad, fastest;
+	long ops = 0;
+
+	while (argi < argc && argv[argi][0] == '-') {
+		if (argi + 1 >= argc)
+			microUsage(argv[0]);
+		if (!strcmp(argv[argi], "-reps"))
+			reps = atoi(argv[++argi]);
+		else if (!strcmp(argv[argi], "-warmup"))
+			warmup = atoi(argv[++argi]);
+		else if (!strcmp(argv[argi], "-only"))
+			only = argv[++argi];
+		else
+			microUsage(argv[0]);
+		argi++;
+	}
+	if (argc - argi > 1 || reps < 1 || reps > MAXREPS || warmup < 0)
+		microUsage(argv[0]);
+
+	if (argi < argc) {
+		FILE* f = fopen(argv[argi], "rb");
+		if (f == NULL) {
+			fprintf(stderr, "File %s not found\n", argv[argi]);
+			exit(1);
+		}
+		fseek(f, 0, SEEK_END);
+		sourceLen = ftell(f);
+		rewind(f);
+		source = (char*)malloc(sourceLen + 1);
+		if (source == NULL || fread(source, 1, sourceLen, f) != (size_t)sourceLen) {
+			fprintf(stderr, "Unable to read %s\n", argv[argi]);
+			exit(1);
+		}
+		fclose(f);
+	}
+	else {
+		/* about 30 KB */
+		int len = (int)strlen(sample);
+		source = (char*)malloc(64 * len + 1);
+		for (i = 0; i < 64; i++)
+			memcpy(source + i * len, sample, len);
+		sourceLen = 64 * len;
+	}
+	devNull = fopen("/dev/null", "w");
+	if (devNull == NULL)
+		devNull = tmpfile();
+
+	/* the tokens and the tree the other benchmarks start from */
+	openSource();
+	do {
+		tokens = (TokenType*)incGrow(tokens, &cap, ntokens + 1, sizeof(TokenType));
+		lexemes = (char**)realloc(lexemes, cap * sizeof(char*));
+		tokens[ntokens] = getToken();
+		lexemes[ntokens] = copyString(tokenString);
+	} while (tokens[ntokens++] != ENDFILE);
+	closeSource();
+	openSource();
+	tree = parse();
+	closeSource();
+	treeNodes = countNodes(tree);  /* parse.c's, from the optimizer */
+	if (Error)
+		fprintf(stderr, "the input has syntax errors\n");
+
+	printf("input: %ld bytes, %d tokens, %ld nodes; %d warm-up and %d timed batches\n",
+		sourceLen, ntokens, treeNodes, warmup, reps);
+	printf("%-24s %10s %12s %10s %7s %12s\n", "function", "ops/batch", "median ns/op",
+		"MAD ns/op", "MAD %", "fastest ns/op");
+	for (b = 0; b < (int)(sizeof(benches) / sizeof(benches[0])); b++) {
+		if (only != NULL && strstr(benches[b].name, only) == NULL)
+			continue;
+		for (r = -warmup; r < reps; r++) {
+			start = nowNs();
+			ops = benches[b].run();
+			if (r >= 0)
+				ns[r] = (nowNs() - start) / (ops > 0 ? ops : 1);
+			if (benches[b].after != NULL)
+				benches[b].after();
+		}
+		med = median(ns, reps);
+		fastest = ns[0];
+		for (r = 0; r < reps; r++)
+			dev[r] = ns[r] > med ? ns[r] - med : med - ns[r];
+		mad = median(dev, reps);
+		printf("%-24s %10ld %12.2f %10.2f %6.1f%% %12.2f\n", benches[b].name, ops, med, mad,
+			med > 0 ? 100 * mad / med : 0.0, fastest);
+	}
+	return 0;
+}
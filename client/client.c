@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* Client of the compile server (parse -server <socket>).
+   The working directory and the parse command line go to the server
+   together with stdin, stdout and stderr, so the request behaves like
+   running parse here; the exit status is the one of that compile. */
+
+#define MAXREQ 65536
+#define TRUE 1
+#define FALSE 0
+
+static char req[MAXREQ];
+
+/* send the request over a new connection; returns the exit status */
+static int request(char* path, int len)
+{
+	struct sockaddr_un addr;
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr* cm;
+	char control[CMSG_SPACE(3 * sizeof(int))];
+	int fds[3] = { 0, 1, 2 };
+	int s, code, n, sent;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	s = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0 || connect(s, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+		fprintf(stderr, "no server on %s\n", path);
+		exit(1);
+	}
+
+	/* the descriptors go with the first bytes */
+	memset(&msg, 0, sizeof(msg));
+	memset(control, 0, sizeof(control));
+	iov.iov_base = req;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(3 * sizeof(int));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+	sent = (int)sendmsg(s, &msg, 0);
+	while (sent > 0 && sent < len) {
+		n = (int)write(s, req + sent, len - sent);
+		sent = n > 0 ? sent + n : n;
+	}
+	if (sent != len || read(s, &code, sizeof(code)) != sizeof(code)) {
+		fprintf(stderr, "the server on %s did not answer\n", path);
+		exit(1);
+	}
+	close(s);
+	return code;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char* argv[])
+{
+	int argi = 1, times = 1, timeflag = FALSE, len, i, n, code = 0;
+	double start, t, total = 0, longest = 0;
+
+	while (argi < argc && argv[argi][0] == '-') {
+		if (!strcmp(argv[argi], "-t"))
+			timeflag = TRUE;
+		else if (!strcmp(argv[argi], "-n") && argi + 1 < argc)
+			times = atoi(argv[++argi]);
+		else
+			break;
+		argi++;
+	}
+	if (argc - argi < 3 || times < 1
+		|| strlen(argv[argi]) >= sizeof(((struct sockaddr_un*)0)->sun_path)) {
+		fprintf(stderr, "usage: %s [-t] [-n count] <socket> [parse options] <input_file.c> <output_file.txt>\n", argv[0]);
+		fprintf(stderr, "  -t  report the request latency to stderr\n");
+		fprintf(stderr, "  -n  send the request count times\n");
+		exit(1);
+	}
+
+	/* a 4-byte length, the directory, then the arguments, each ended by '\0' */
+	len = 4;
+	if (getcwd(req + len, MAXREQ - len) == NULL) {
+		fprintf(stderr, "working directory too long\n");
+		exit(1);
+	}
+	len += (int)strlen(req + len) + 1;
+	for (i = argi + 1; i < argc; i++) {
+		n = (int)strlen(argv[i]) + 1;
+		if (len + n > MAXREQ) {
+			fprintf(stderr, "command line too long\n");
+			exit(1);
+		}
+		memcpy(req + len, argv[i], n);
+		len += n;
+	}
+	memcpy(req, &len, 4);
+
+	for (i = 0; i < times; i++) {
+		start = now();
+		code = request(argv[argi], len);
+		t = now() - start;
+		total += t;
+		if (t > longest)
+			longest = t;
+	}
+	if (timeflag)
+		fprintf(stderr, "client: %d requests, %.1f us average, %.1f us longest\n",
+			times, total / times * 1e6, longest * 1e6);
+	return code;
+}
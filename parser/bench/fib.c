@@ -0,0 +1,10 @@
+/* Recursive Fibonacci numbers */
+
+int fib(int n)
+{	if (n < 2) return n;
+	else return fib(n - 1) + fib(n - 2);
+}
+
+void main(void)
+{	output(fib(27));
+}
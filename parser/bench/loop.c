@@ -0,0 +1,17 @@
+/* Nested loops: sum of (i*j mod 1000) over a 2000 x 1000 grid */
+
+void main(void)
+{	int i; int j; int s; int p;
+	s = 0;
+	i = 0;
+	while (i < 2000)
+	{	j = 0;
+		while (j < 1000)
+		{	p = i * j;
+			s = s + (p - p / 1000 * 1000);
+			j = j + 1;
+		}
+		i = i + 1;
+	}
+	output(s);
+}
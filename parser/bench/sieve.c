@@ -0,0 +1,36 @@
+/* Sieve of Eratosthenes, repeated to count primes below 100000 */
+
+int flags[100000];
+
+int sieve(int n)
+{	int i; int j; int count;
+	i = 0;
+	while (i < n)
+	{	flags[i] = 1;
+		i = i + 1;
+	}
+	count = 0;
+	i = 2;
+	while (i < n)
+	{	if (flags[i] == 1)
+		{	count = count + 1;
+			j = i + i;
+			while (j < n)
+			{	flags[j] = 0;
+				j = j + i;
+			}
+		}
+		i = i + 1;
+	}
+	return count;
+}
+
+void main(void)
+{	int k; int c;
+	k = 0;
+	while (k < 10)
+	{	c = sieve(100000);
+		k = k + 1;
+	}
+	output(c);
+}
@@ -0,0 +1,48 @@
+/* Bubble sort of 3000 pseudo-random numbers */
+
+int a[3000];
+
+void fill(int n)
+{	int i; int x;
+	x = 1;
+	i = 0;
+	while (i < n)
+	{	x = x * 75 + 74;
+		x = x - x / 65537 * 65537;
+		a[i] = x;
+		i = i + 1;
+	}
+}
+
+void sort(int v[], int n)
+{	int i; int j; int t;
+	i = 0;
+	while (i < n - 1)
+	{	j = 0;
+		while (j < n - 1 - i)
+		{	if (v[j] > v[j+1])
+			{	t = v[j];
+				v[j] = v[j+1];
+				v[j+1] = t;
+			}
+			j = j + 1;
+		}
+		i = i + 1;
+	}
+}
+
+void main(void)
+{	int i; int bad;
+	fill(3000);
+	sort(a, 3000);
+	bad = 0;
+	i = 1;
+	while (i < 3000)
+	{	if (a[i] < a[i-1]) bad = bad + 1;
+		i = i + 1;
+	}
+	output(bad);
+	output(a[0]);
+	output(a[1500]);
+	output(a[2999]);
+}
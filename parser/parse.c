@@ -3,6 +3,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include <time.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/resource.h>
+#endif
+#ifdef PROFILE
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#endif
 
 #define MAXRESERVED 6
 #define MAXTOKENLEN 40
@@ -21,7 +47,9 @@ typedef enum {
 	PLUS, MINUS, MUL, DIV, LT, LE, GT, GE, EQ, NE, ASSIGN, SEMI, COMMA,
 	LPAREN, RPAREN, LSQUARE, RSQUARE, LCURLY, RCURLY, LCOMMENT, RCOMMENT,
 	/* multicharacter tokens */
-	ID, NUM
+	ID, NUM,
+	/* operators made by the optimizer: shift by a constant */
+	SHL, SHR
 } TokenType;
 
 /* DFA state for scanner */
@@ -49,6 +77,19 @@ typedef struct treeNode {
 	int lineno;
 	int paramCheck;
 	int arraysize;
+	/* filled in by analyze() */
+	struct treeNode* decl; /* IdK, CallK: declaration the name refers to */
+	int memloc;            /* declarations: global address or frame slot,
+	                          FuncDeclK: code address set by a back end */
+	int level;             /* declarations: 0 for globals, 1 for locals */
+	int framesize;         /* FuncDeclK: number of slots of an activation */
+	/* set by the range analysis */
+	int inBounds;          /* IdK: subscript proven within the array */
+	/* set by the structural diff */
+	unsigned int hash;     /* Merkle hash of the node and all nodes below it */
+	/* set by the parser with -signatures */
+	int lazy;              /* FuncDeclK: number of the token range of a body
+	                          not parsed yet, 0 once it is */
 } TreeNode;
 
 /* reserved words talbe */
@@ -63,6 +104,77 @@ FILE* fpIn, * fpOut;
 int lineno = 0;         // source line number for listing
 TokenType token;
 int indentno = 0;
+int Error = FALSE;      // set when a syntax or semantic error is found
+
+/* flags set by command line options */
+int RunProgram = FALSE; // -run: execute the program after parsing
+int ShowTime = FALSE;   // -time: report execution speed to stderr
+int UseVM = FALSE;      // -vm: execute with the bytecode machine
+int GenTM = FALSE;      // -tm: write TM assembly to <input>.tm
+int GenX86 = FALSE;     // -x86: write x86-64 assembly to <input>.s
+int GenC = FALSE;       // -emitc: write portable C to <input>.gen.c
+int Optimize = FALSE;   // -O: optimize the syntax tree before running it
+int GenIR = FALSE;      // -ir: build and list the SSA form, run it with -run
+int Dataflow = FALSE;   // -dataflow: report unused variables and dead stores
+int RangeCheck = FALSE; // -range: prove subscripts in bounds, drop their checks
+int Inline = FALSE;     // -inline: inline calls of small leaf functions
+int PartialEval = FALSE; // -peval: evaluate pure calls with constant arguments
+int Prune = FALSE;      // -prune: drop functions main() cannot reach
+int HashCons = FALSE;   // -hashcons: share equal expressions, report repeats
+char* DiffFile = NULL;  // -diff <file>: report declarations changed since <file>
+char* EditFile = NULL;  // -edits <file>: apply edits, re-lex and reparse incrementally
+char* CacheDir = NULL;  // -cache <dir>: keep parsed trees in <dir>, keyed by the source
+int TokenInput = FALSE; // -tokens: the input file holds tokens written by scan -tokens
+int LazyBodies = FALSE; // -signatures: skip function bodies until they are needed
+int LazyReplay = FALSE; // getToken() returns the tokens kept for a skipped body
+char* IndexFile = NULL; // -index <file>: symbol index to update or query
+char* QueryName = NULL; // -query <name>: look name up in the index
+char* ServerSocket = NULL; // -server <socket>: compile the requests sent by client
+char* TraceFile = NULL; // -trace <file>: add the phases and declarations to a timeline
+int tracePid = 0;       // -trace: the compile server, when compiling for one
+char* StatsFile = NULL; // -stats <file>: write phase times and counters as JSON
+
+/* counters and phase times for -stats. STAT(x) does x; building with
+   -DNOSTATS removes every STAT() and the option */
+#ifndef NOSTATS
+#define STAT(x) do { x; } while (0)
+
+typedef enum { StParse, StList, StAnalyze, StEmit, StRun, StPhases } StatPhase;
+
+struct {
+	long chars, lines;          // read by getNextChar()
+	long tokens[SHR + 1];       // by type, scanned or read from a token file
+	long stmts[CallK + 1], exps[IdK + 1];   // nodes made by the parser
+	long bytes;                 // nodes and names allocated by the parser
+	int syntaxErrors;
+	double read, scan;          // wall seconds reading lines, in getToken()
+	double readStart, scanStart;
+	double wall[StPhases], cpu[StPhases];
+	double wallStart[StPhases], cpuStart[StPhases];
+} stats;
+#else
+#define STAT(x)
+#endif
+
+/* the grammar rule profiler of a build with -DPROFILE: every parsing
+   function starts with PROF_ENTER() and does PROF_LEAVE() before it
+   returns */
+#ifdef PROFILE
+typedef enum {
+	PrDeclarationList, PrDeclaration, PrVarDeclaration, PrParams, PrParamList, PrParam,
+	PrCompoundStmt, PrLocalDecl, PrStmtList, PrStmt, PrExpressionStmt, PrSelectionStmt,
+	PrIterationStmt, PrReturnStmt, PrExpr, PrSimpleExpr, PrAddExpr, PrTerm, PrFactor,
+	PrCall, PrArgsList, PrRules
+} ProfRule;
+
+#define PROF_ENTER(rule) profEnter(rule)
+#define PROF_LEAVE() profLeave()
+char* ProfileFile = NULL; // -profile <file>: write the folded call stacks of the parser
+long profTokens = 0;      // tokens returned by getToken()
+#else
+#define PROF_ENTER(rule)
+#define PROF_LEAVE()
+#endif
 
 /* macros to increase/decrease indentation */
 #define INDENT indentno+=2
@@ -76,6 +188,9 @@ char lineBuf[BUFLEN];
 int linepos = 0;        // current position in linebuf
 int bufsize = 0;        // current size of buffer string
 int EOF_flag = FALSE;
+int LineScan = FALSE;   // scan one source line alone: its end is the end of the input
+StateType scanState = START; // LineScan: state at the start, then at the end
+int Replay = FALSE;     // getToken() returns the tokens kept by the incremental parser
 
 /* !for scanner! declaration of funtion */
 TokenType reservedLookup(char* s);
@@ -118,42 +233,407 @@ static void printSpaces(void);
 char* typeName(ExpType type);
 void printTree(TreeNode* tree);
 
+/* !for semantic analysis! declaration of function */
+void semanticError(TreeNode* t, char* message);
+void analyze(TreeNode* syntaxTree);
+
+/* !for interpreter! declaration of function */
+void runtimeError(TreeNode* t, char* message);
+void interpret(TreeNode* syntaxTree);
+
+/* !for bytecode machine! declaration of function */
+void genBytecode(TreeNode* syntaxTree);
+void printBytecode(void);
+void vmRun(void);
+
+/* !for TM code generator! declaration of function */
+void codeGen(TreeNode* syntaxTree, char* codefile);
+
+/* !for x86-64 code generator! declaration of function */
+void x86Gen(TreeNode* syntaxTree, char* asmfile);
+
+/* !for C code generator! declaration of function */
+void emitC(TreeNode* syntaxTree, char* cfile, char* source);
+
+/* !for AST optimizer! declaration of function */
+void optimize(TreeNode* syntaxTree);
+
+/* !for SSA form IR! declaration of function */
+void irBuild(TreeNode* syntaxTree);
+void irRun(void);
+
+/* !for dataflow analysis! declaration of function */
+void dataflowReport(TreeNode* syntaxTree);
+
+/* !for range analysis! declaration of function */
+void rangeAnalysis(TreeNode* syntaxTree);
+
+/* !for inliner! declaration of function */
+void inlineCalls(TreeNode* syntaxTree);
+
+/* !for partial evaluator! declaration of function */
+void partialEval(TreeNode* syntaxTree);
+
+/* !for call graph! declaration of function */
+TreeNode* pruneFunctions(TreeNode* syntaxTree);
+
+/* !for hash-consing! declaration of function */
+void hashCons(TreeNode* syntaxTree, int share);
+
+/* !for structural diff! declaration of function */
+void astDiff(TreeNode* syntaxTree, char* oldFile);
+
+/* !for incremental parser! declaration of function */
+TokenType incNextToken(void);
+int incNextPiece(void);
+TreeNode* incrementalEdits(char* editFile);
+
+/* !for AST cache! declaration of function */
+TreeNode* cachedParse(char* dir);
+int cacheHolds(void* p);
+
+/* !for token file! declaration of function */
+void tokOpen(char* name);
+TokenType tokNextToken(void);
+
+/* !for compile server! declaration of function */
+void compileServer(char* path);
+
+/* !for lazy function bodies! declaration of function */
+TokenType lazyNextToken(void);
+void lazySkip(TreeNode* f);
+TreeNode* lazyBody(TreeNode* f);
+void lazyParseAll(TreeNode* syntaxTree);
+void printSignatures(TreeNode* syntaxTree);
+
+/* !for symbol index! declaration of function */
+void indexFiles(char* indexFile, int nfiles, char** files);
+void indexQuery(char* indexFile, char* name);
+
+/* !for grammar rule profiler! declaration of function */
+#ifdef PROFILE
+void profEnter(ProfRule rule);
+void profLeave(void);
+void profReport(char* file);
+#endif
+
+/* !for trace events! declaration of function */
+void traceStart(char* inputFile);
+double traceNow(void);
+void traceEvent(char* name, const char* cat, double start);
+
+/* !for statistics! declaration of function */
+#ifndef NOSTATS
+double statsNow(void);
+void statsBegin(StatPhase phase);
+void statsEnd(StatPhase phase);
+void statsReport(char* file, char* inputFile);
+#endif
+
+/* print command line usage and exit */
+static void usage(char* prog)
+{
+	fprintf(stderr, "usage: %s [options] <input_file.c> <output_file.txt>\n", prog);
+	fprintf(stderr, "       %s -server <socket>\n", prog);
+	fprintf(stderr, "       %s -index <index_file> <input_file.c>...\n", prog);
+	fprintf(stderr, "       %s -index <index_file> -query <name>\n", prog);
+	fprintf(stderr, "<input_file.c> - reads the source from stdin\n");
+	fprintf(stderr, "options:\n");
+	fprintf(stderr, "  -run     execute the program (input()/output() use stdin/stdout)\n");
+	fprintf(stderr, "  -vm      execute with the bytecode machine instead of the tree walker\n");
+	fprintf(stderr, "  -time    report execution speed to stderr\n");
+	fprintf(stderr, "  -tm      write TM assembly to <input_file>.tm\n");
+	fprintf(stderr, "  -x86     write x86-64 assembly (GNU as) to <input_file>.s\n");
+	fprintf(stderr, "  -emitc   write portable C to <input_file>.gen.c\n");
+	fprintf(stderr, "  -O       fold constants, drop dead branches, use shifts\n");
+	fprintf(stderr, "  -ir      list the optimized SSA form; with -run, execute it\n");
+	fprintf(stderr, "  -dataflow  report unused variables, dead stores and reads\n");
+	fprintf(stderr, "           before assignment (liveness, reaching definitions)\n");
+	fprintf(stderr, "  -range   prove array subscripts in bounds and drop their checks\n");
+	fprintf(stderr, "  -inline  inline calls of small functions that call no others\n");
+	fprintf(stderr, "  -peval   replace calls of pure functions with constant arguments\n");
+	fprintf(stderr, "           by their result\n");
+	fprintf(stderr, "  -prune   report the call graph and drop functions main() cannot reach\n");
+	fprintf(stderr, "  -hashcons  share equal expressions; report common subexpressions\n");
+	fprintf(stderr, "           and statements repeated in several functions\n");
+	fprintf(stderr, "  -diff <old_file>  report the declarations and statements changed\n");
+	fprintf(stderr, "           since <old_file>\n");
+	fprintf(stderr, "  -edits <edit_file>  apply the edits in <edit_file>, re-lexing and\n");
+	fprintf(stderr, "           reparsing only what they change; later options see the result\n");
+	fprintf(stderr, "  -cache <dir>  take the syntax tree from <dir> when the source is\n");
+	fprintf(stderr, "           unchanged, else parse it and store it there\n");
+	fprintf(stderr, "  -tokens  <input_file> is a token file written by scan -tokens\n");
+	fprintf(stderr, "  -signatures  list the function signatures instead of the tree;\n");
+	fprintf(stderr, "           bodies are only parsed when another option needs them\n");
+	fprintf(stderr, "  -index <index_file>  add the input files, if changed, to the index of\n");
+	fprintf(stderr, "           definitions, calls and globals used; with -query <name>,\n");
+	fprintf(stderr, "           print what the index has on name\n");
+	fprintf(stderr, "  -server <socket>  compile the requests client sends to <socket>,\n");
+	fprintf(stderr, "           each in a process forked from this one with its own options\n");
+	fprintf(stderr, "  -stats <file>  write phase times, token and node counts and peak\n");
+	fprintf(stderr, "           memory as JSON to <file> (- for stdout)\n");
+	fprintf(stderr, "  -trace <file>  append the times of the phases and of each declaration\n");
+	fprintf(stderr, "           to <file> as Chrome trace events\n");
+#ifdef PROFILE
+	fprintf(stderr, "  -profile <file>  write the cycles spent in each grammar rule as\n");
+	fprintf(stderr, "           folded stacks to <file>, and a table by rule to stderr\n");
+#endif
+	exit(1);
+}
+
+
+/* the options before main() reads any; a request to the compile server
+   starts from them, not from the options of the server */
+static void resetOptions(void)
+{
+	RunProgram = ShowTime = UseVM = GenTM = GenX86 = GenC = FALSE;
+	Optimize = GenIR = Dataflow = RangeCheck = Inline = PartialEval = FALSE;
+	Prune = HashCons = TokenInput = LazyBodies = LazyReplay = FALSE;
+	DiffFile = EditFile = CacheDir = IndexFile = QueryName = NULL;
+	ServerSocket = TraceFile = StatsFile = NULL;
+#ifdef PROFILE
+	ProfileFile = NULL;
+#endif
+}
+
 
 /* main */
 void main(int argc, char* argv[]) {
 	TreeNode* syntaxTree;
-	char inputFile[50], outputFile[50];
+	char inputFile[256], outputFile[256], codeFile[256];
+	int argi = 1, analyzing;
+	double phase;
 
-	if (argc != 3) {
-		fprintf(stderr, "usage: %s <input_file.c> <output_file.txt>\n", argv[0]);
-		exit(1);
+	/* options come before the file names. "-opt" and "--opt" are the same */
+	while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+		char* opt = argv[argi] + 1;
+		if (*opt == '-')
+			opt++;
+		if (!strcmp(opt, "run"))
+			RunProgram = TRUE;
+		else if (!strcmp(opt, "vm"))
+			RunProgram = UseVM = TRUE;
+		else if (!strcmp(opt, "time"))
+			ShowTime = TRUE;
+		else if (!strcmp(opt, "tm"))
+			GenTM = TRUE;
+		else if (!strcmp(opt, "x86"))
+			GenX86 = TRUE;
+		else if (!strcmp(opt, "emitc"))
+			GenC = TRUE;
+		else if (!strcmp(opt, "O"))
+			Optimize = TRUE;
+		else if (!strcmp(opt, "ir"))
+			GenIR = TRUE;
+		else if (!strcmp(opt, "dataflow"))
+			Dataflow = TRUE;
+		else if (!strcmp(opt, "range"))
+			RangeCheck = TRUE;
+		else if (!strcmp(opt, "inline"))
+			Inline = TRUE;
+		else if (!strcmp(opt, "peval"))
+			PartialEval = TRUE;
+		else if (!strcmp(opt, "prune"))
+			Prune = TRUE;
+		else if (!strcmp(opt, "hashcons"))
+			HashCons = TRUE;
+		else if (!strcmp(opt, "diff") && argi + 1 < argc)
+			DiffFile = argv[++argi];
+		else if (!strcmp(opt, "edits") && argi + 1 < argc)
+			EditFile = argv[++argi];
+		else if (!strcmp(opt, "cache") && argi + 1 < argc)
+			CacheDir = argv[++argi];
+		else if (!strcmp(opt, "tokens"))
+			TokenInput = TRUE;
+		else if (!strcmp(opt, "signatures"))
+			LazyBodies = TRUE;
+		else if (!strcmp(opt, "index") && argi + 1 < argc)
+			IndexFile = argv[++argi];
+		else if (!strcmp(opt, "query") && argi + 1 < argc)
+			QueryName = argv[++argi];
+		else if (!strcmp(opt, "server") && argi + 1 < argc)
+			ServerSocket = argv[++argi];
+		else if (!strcmp(opt, "trace") && argi + 1 < argc)
+			TraceFile = argv[++argi];
+		else if (!strcmp(opt, "stats") && argi + 1 < argc) {
+			StatsFile = argv[++argi];
+#ifdef NOSTATS
+			fprintf(stderr, "-stats: built with NOSTATS\n");
+			exit(1);
+#endif
+		}
+#ifdef PROFILE
+		else if (!strcmp(opt, "profile") && argi + 1 < argc)
+			ProfileFile = argv[++argi];
+#endif
+		else {
+			fprintf(stderr, "unknown option %s\n", argv[argi]);
+			usage(argv[0]);
+		}
+		argi++;
+	}
+	if (ServerSocket != NULL && argi == argc)
+		compileServer(ServerSocket);
+	if (IndexFile != NULL && QueryName != NULL && argi == argc) {
+		indexQuery(IndexFile, QueryName);
+		exit(0);
 	}
+	if (IndexFile != NULL && QueryName == NULL && argi < argc) {
+		indexFiles(IndexFile, argc - argi, argv + argi);
+		exit(0);
+	}
+	if (argc - argi != 2 || strlen(argv[argi]) > 200 || strlen(argv[argi + 1]) > 200)
+		usage(argv[0]);
 
 	/* check for file extension */
-	strcpy(inputFile, argv[1]);
-	if (strchr(inputFile, '.') == NULL)
+	strcpy(inputFile, argv[argi]);
+	if (!strcmp(inputFile, "-"))
+		strcpy(inputFile, "stdin.c");
+	else if (strchr(inputFile, '.') == NULL)
 		strcat(inputFile, ".c");
-	strcpy(outputFile, argv[2]);
+	strcpy(outputFile, argv[argi + 1]);
 	if (strchr(outputFile, '.') == NULL)
 		strcat(outputFile, ".txt");
 
-	fpIn = fopen(inputFile, "r");
+	if (!strcmp(argv[argi], "-")) {
+		/* the source from stdin, kept in a file that can be read again */
+		int c;
+		fpIn = tmpfile();
+		if (fpIn != NULL) {
+			while ((c = getchar()) != EOF)
+				putc(c, fpIn);
+			rewind(fpIn);
+		}
+	}
+	else
+		fpIn = fopen(inputFile, TokenInput ? "rb" : "r");
 	fpOut = fopen(outputFile, "w");
 	//fpOut = stdout; // for test
 	if (fpIn == NULL) {
 		fprintf(stderr, "File %s not found\n", inputFile);
 		exit(1);
 	}
+	if (TokenInput) {
+		if (EditFile != NULL) {
+			fprintf(stderr, "-edits needs the source text, not a token file\n");
+			exit(1);
+		}
+		tokOpen(inputFile);
+	}
 
 	fprintf(fpOut, "C- COMPILATION: %s\n", inputFile);
+	if (TraceFile != NULL)
+		traceStart(inputFile);
 
+	analyzing = RunProgram || GenTM || GenX86 || GenC || Optimize || GenIR || Dataflow
+		|| RangeCheck || Inline || PartialEval || Prune;
 	// while (getToken() != ENDFILE);
-	syntaxTree = parse();
-	fprintf(fpOut, "\nSyntax tree:\n");
-	printTree(syntaxTree);
+	/* a cached tree has its bodies, so the cache is for full parses */
+	phase = traceNow();
+	STAT(statsBegin(StParse));
+	if (CacheDir != NULL && !LazyBodies)
+		syntaxTree = cachedParse(CacheDir);
+	else
+		syntaxTree = parse();
+	STAT(statsEnd(StParse));
+	traceEvent("parse", "phase", phase);
+	phase = traceNow();
+	STAT(statsBegin(StList));
+	if (LazyBodies) {
+		printSignatures(syntaxTree);
+		STAT(statsEnd(StList));
+		traceEvent("list", "phase", phase);
+		phase = traceNow();
+		STAT(statsBegin(StParse));
+		if (analyzing || HashCons || DiffFile != NULL)
+			lazyParseAll(syntaxTree);
+		STAT(statsEnd(StParse));
+		traceEvent("parse bodies", "phase", phase);
+	}
+	else {
+		fprintf(fpOut, "\nSyntax tree:\n");
+		printTree(syntaxTree);
+		STAT(statsEnd(StList));
+		traceEvent("list", "phase", phase);
+	}
+
+	phase = traceNow();
+	STAT(statsBegin(StAnalyze));
+	if (EditFile != NULL && !Error)
+		syntaxTree = incrementalEdits(EditFile);
+	if (DiffFile != NULL && !Error)
+		astDiff(syntaxTree, DiffFile);
+	/* analyze() and the passes after it annotate nodes in place, so nodes
+	   are only shared when the tree is just listed */
+	if (HashCons && !Error)
+		hashCons(syntaxTree, !analyzing);
+	if (analyzing && !Error)
+		analyze(syntaxTree);
+	if (Dataflow && !Error)
+		dataflowReport(syntaxTree);
+	if (Inline && !Error)
+		inlineCalls(syntaxTree);
+	if (Optimize && !Error)
+		optimize(syntaxTree);
+	if (PartialEval && !Error)
+		partialEval(syntaxTree);
+	/* after inlining and partial evaluation, which can leave functions
+	   without callers */
+	if (Prune && !Error)
+		syntaxTree = pruneFunctions(syntaxTree);
+	if (RangeCheck && !Error)
+		rangeAnalysis(syntaxTree);
+	if (GenIR && !Error)
+		irBuild(syntaxTree);
+	STAT(statsEnd(StAnalyze));
+	traceEvent("analyze", "phase", phase);
+	phase = traceNow();
+	STAT(statsBegin(StEmit));
+	if ((GenTM || GenX86 || GenC) && !Error) {
+		/* code files: input file name with the extension replaced */
+		char* dot = strrchr(inputFile, '.');
+		char* slash = strrchr(inputFile, '/');
+		int baselen = (int)strlen(inputFile);
+		if (dot != NULL && (slash == NULL || dot > slash))
+			baselen = (int)(dot - inputFile);
+		if (GenTM) {
+			sprintf(codeFile, "%.*s.tm", baselen, inputFile);
+			codeGen(syntaxTree, codeFile);
+		}
+		if (GenX86) {
+			sprintf(codeFile, "%.*s.s", baselen, inputFile);
+			x86Gen(syntaxTree, codeFile);
+		}
+		if (GenC) {
+			sprintf(codeFile, "%.*s.gen.c", baselen, inputFile);
+			emitC(syntaxTree, codeFile, inputFile);
+		}
+	}
+	STAT(statsEnd(StEmit));
+	traceEvent("emit", "phase", phase);
+	phase = traceNow();
+	STAT(statsBegin(StRun));
+	if (RunProgram && !Error) {
+		if (UseVM) {
+			genBytecode(syntaxTree);
+			printBytecode();
+			vmRun();
+		}
+		else if (GenIR)
+			irRun();
+		else
+			interpret(syntaxTree);
+	}
+	STAT(statsEnd(StRun));
+	traceEvent("run", "phase", phase);
 
 	fclose(fpIn);
 	fclose(fpOut);
+	STAT(if (StatsFile != NULL) statsReport(StatsFile, inputFile));
+#ifdef PROFILE
+	if (ProfileFile != NULL)
+		profReport(ProfileFile);
+#endif
 }
 
 
@@ -170,15 +650,27 @@ TokenType reservedLookup(char* s) {
 /* lineBuf  ϳ а,
    linepos  ϳ char ȯ Ѵ. */
 int getNextChar() {
+	if (linepos >= bufsize && LineScan) {
+		/* a line scanned alone ends here; a long one goes on in its next piece */
+		if (!incNextPiece()) {
+			EOF_flag = TRUE;
+			return EOF;
+		}
+		return lineBuf[linepos++];
+	}
 	if (linepos >= bufsize) { //  ϳ  м   ο  б
 		lineno++;
+		STAT(if (StatsFile != NULL) stats.readStart = statsNow());
 		if (fgets(lineBuf, BUFLEN - 1, fpIn)) {
 			fprintf(fpOut, "%4d: %s", lineno, lineBuf);
 			bufsize = (int)strlen(lineBuf);
 			linepos = 0;
+			STAT(stats.chars += bufsize; stats.lines += lineBuf[bufsize - 1] == '\n';
+				if (StatsFile != NULL) stats.read += statsNow() - stats.readStart);
 			return lineBuf[linepos++];
 		}
 		else {
+			STAT(if (StatsFile != NULL) stats.read += statsNow() - stats.readStart);
 			EOF_flag = TRUE;
 			return EOF;
 		}
@@ -233,6 +725,8 @@ void printToken(TokenType token, const char* tokenString) {
 	case ERROR:
 		fprintf(fpOut, "ERROR: %s\n", tokenString);
 		break;
+	case SHL: fprintf(fpOut, "<<\n"); break;
+	case SHR: fprintf(fpOut, ">>\n"); break;
 	default: /* should never happen */
 		fprintf(fpOut, "Unknown token: %d\n", token);
 	}
@@ -242,8 +736,20 @@ void printToken(TokenType token, const char* tokenString) {
 TokenType getToken(void) {
 	int tokenStringIndex = 0;			// ū ڿ(tokenString) index
 	TokenType currentToken = STARTFILE;	//  ū
-	StateType state = START;			//  state ׻ START
+	StateType state = scanState;		// START, or INCOMMENT for a line starting in a comment
 	int save;							// tokenString ū  Ȯϴ flag
+
+#ifdef PROFILE
+	profTokens++;
+#endif
+	if (LazyReplay)
+		return lazyNextToken();
+	if (Replay)
+		return incNextToken();
+	if (TokenInput)
+		return tokNextToken();
+	STAT(if (StatsFile != NULL) stats.scanStart = statsNow());
+	scanState = START;
 	while (state != DONE)	// ū DONE ƴ   ݺ
 	{
 		int c = getNextChar();	//  character о
@@ -409,7 +915,13 @@ TokenType getToken(void) {
 			// * ƴ character   X
 			tokenStringIndex = 0;	// tokenString ̹  character(/) ϱ  ġ
 			save = FALSE;
-			if (c == EOF) {			// non-final state α׷ Ǹ  ޼ 
+			if (c == EOF && LineScan) {
+				/* the comment goes on in the next line */
+				scanState = INCOMMENT;
+				state = DONE;
+				currentToken = ENDFILE;
+			}
+			else if (c == EOF) {			// non-final state α׷ Ǹ  ޼ 
 				fprintf(fpOut, "ERROR: %s\n", "\"stop before ending\"");
 				exit(EXIT_FAILURE);
 			}
@@ -441,8 +953,12 @@ TokenType getToken(void) {
 				currentToken = reservedLookup(tokenString);
 		}
 	}
-	fprintf(fpOut, "\t%d: ", lineno);
-	printToken(currentToken, tokenString);
+	if (!LineScan) {
+		fprintf(fpOut, "\t%d: ", lineno);
+		printToken(currentToken, tokenString);
+	}
+	STAT(stats.tokens[currentToken]++;
+		if (StatsFile != NULL) stats.scan += statsNow() - stats.scanStart);
 
 	return currentToken;
 }
@@ -465,7 +981,15 @@ TreeNode* newStmtNode(StmtKind kind)
 		t->sibling = NULL;
 		t->nodekind = StmtK;
 		t->kind.stmt = kind;
+		STAT(stats.stmts[kind]++; stats.bytes += sizeof(TreeNode));
 		t->lineno = lineno;
+		t->type = Void;
+		t->attr.name = NULL;
+		t->arraysize = 0;
+		t->decl = NULL;
+		t->inBounds = FALSE;
+		t->hash = 0;
+		t->lazy = 0;
 	}
 	return t;
 }
@@ -482,9 +1006,18 @@ TreeNode* newExpNode(ExpKind kind)
 		t->sibling = NULL;
 		t->nodekind = ExpK;
 		t->kind.exp = kind;
+		STAT(stats.exps[kind]++; stats.bytes += sizeof(TreeNode));
 		t->lineno = lineno;
 		t->type = Void;
+		t->attr.name = NULL;
 		t->paramCheck = FALSE;
+		t->arraysize = 0;
+		t->decl = NULL;
+		t->memloc = 0;
+		t->level = 0;
+		t->inBounds = FALSE;
+		t->hash = 0;
+		t->lazy = 0;
 	}
 	return t;
 }
@@ -502,6 +1035,8 @@ void match(TokenType expected)
 
 void syntaxError(char* message)
 {
+	Error = TRUE;
+	STAT(stats.syntaxErrors++);
 	fprintf(fpOut, "\n>>> ");
 	fprintf(fpOut, "Syntax error at line %d: %s", lineno, message);
 }
@@ -535,6 +1070,7 @@ char* copyString(char* s)
 		fprintf(fpOut, "Out of memory error at line %d\n", lineno);
 	else
 		strcpy(t, s);
+	STAT(stats.bytes += n);
 	return t;
 }
 
@@ -550,6 +1086,7 @@ TreeNode* parse(void)
 
 TreeNode* declaration_list()
 {
+	PROF_ENTER(PrDeclarationList);
 	TreeNode* t = declaration();
 	TreeNode* p = t;
 	while (token != ENDFILE)
@@ -565,14 +1102,17 @@ TreeNode* declaration_list()
 			}
 		}
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 // ū ǵ⸦ ϴ  ̽  ̷ Ͽ.
 TreeNode* declaration() {
+	PROF_ENTER(PrDeclaration);
 	TreeNode* t = NULL;
 	ExpType type;
 	char* name;
+	double start = traceNow();
 
 	type = type_checker();
 	name = copyString(tokenString);
@@ -613,7 +1153,9 @@ TreeNode* declaration() {
 		if (t != NULL)
 			t->child[0] = params();
 		match(RPAREN);
-		if (t != NULL)
+		if (t != NULL && LazyBodies && token == LCURLY)
+			lazySkip(t);
+		else if (t != NULL)
 			t->child[1] = compound_stmt();
 		break;
 	default: syntaxError("unexpected token in declaration -> ");
@@ -621,6 +1163,8 @@ TreeNode* declaration() {
 		token = getToken();
 		break;
 	}
+	traceEvent(name, "declaration", start);
+	PROF_LEAVE();
 	return t;
 }
 
@@ -628,6 +1172,7 @@ TreeNode* declaration() {
 // fun_declaration Ŀ     X
 TreeNode* var_declaration(void)
 {
+	PROF_ENTER(PrVarDeclaration);
 	TreeNode* t = NULL;
 	ExpType type;
 	char* name;
@@ -665,11 +1210,13 @@ TreeNode* var_declaration(void)
 		token = getToken();
 		break;
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* params(void)
 {
+	PROF_ENTER(PrParams);
 	ExpType type;
 	TreeNode* t = NULL;
 
@@ -684,11 +1231,13 @@ TreeNode* params(void)
 	}
 	else
 		t = param_list(type);
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* param_list(ExpType type)
 {
+	PROF_ENTER(PrParamList);
 	TreeNode* t = param(type);
 	TreeNode* p = t;
 	TreeNode* q = NULL;
@@ -705,11 +1254,13 @@ TreeNode* param_list(ExpType type)
 			}
 		}
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* param(ExpType type)
 {
+	PROF_ENTER(PrParam);
 	TreeNode* t = NULL;
 	char* name;
 
@@ -729,21 +1280,25 @@ TreeNode* param(ExpType type)
 		t->type = type;
 		t->paramCheck = TRUE;
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* compound_stmt(void)
 {
+	PROF_ENTER(PrCompoundStmt);
 	TreeNode* t = newStmtNode(CompoundK);
 	match(LCURLY);
 	t->child[0] = local_decl();
 	t->child[1] = stmt_list();
 	match(RCURLY);
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* local_decl(void)
 {
+	PROF_ENTER(PrLocalDecl);
 	TreeNode* t = NULL;
 	TreeNode* p = NULL;
 
@@ -766,19 +1321,23 @@ TreeNode* local_decl(void)
 			}
 		}
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* stmt_list(void)
 {
+	PROF_ENTER(PrStmtList);
 	TreeNode* t = NULL;
 	TreeNode* p = NULL;
 
-	if (token == RCURLY)
+	if (token == RCURLY) {
+		PROF_LEAVE();
 		return NULL;
+	}
 	t = stmt();
 	p = t;
-	while (token != RCURLY)
+	while (token != RCURLY && token != ENDFILE)
 	{
 		TreeNode* q;
 		q = stmt();
@@ -792,11 +1351,13 @@ TreeNode* stmt_list(void)
 		}
 	}
 
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* stmt(void)
 {
+	PROF_ENTER(PrStmt);
 	TreeNode* t = NULL;
 	switch (token)
 	{
@@ -821,13 +1382,16 @@ TreeNode* stmt(void)
 	default: syntaxError("unexpected token(stmt) -> ");
 		printToken(token, tokenString);
 		token = getToken();
+		PROF_LEAVE();
 		return Void;
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* expression_stmt(void)
 {
+	PROF_ENTER(PrExpressionStmt);
 	TreeNode* t = NULL;
 
 	if (token == SEMI)
@@ -837,11 +1401,13 @@ TreeNode* expression_stmt(void)
 		t = expr();
 		match(SEMI);
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* selection_stmt(void)
 {
+	PROF_ENTER(PrSelectionStmt);
 	TreeNode* t = newStmtNode(SelectionK);
 
 	match(IF);
@@ -858,11 +1424,13 @@ TreeNode* selection_stmt(void)
 			t->child[2] = stmt();
 	}
 
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* iteration_stmt(void)
 {
+	PROF_ENTER(PrIterationStmt);
 	TreeNode* t = newStmtNode(IterationK);
 
 	match(WHILE);
@@ -872,22 +1440,26 @@ TreeNode* iteration_stmt(void)
 	match(RPAREN);
 	if (t != NULL)
 		t->child[1] = stmt();
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* return_stmt(void)
 {
+	PROF_ENTER(PrReturnStmt);
 	TreeNode* t = newStmtNode(ReturnK);
 
 	match(RETURN);
 	if (token != SEMI && t != NULL)
 		t->child[0] = expr();
 	match(SEMI);
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* expr(void)
 {
+	PROF_ENTER(PrExpr);
 	TreeNode* t = NULL;
 	TreeNode* q = NULL;
 	int flag = FALSE;
@@ -918,11 +1490,13 @@ TreeNode* expr(void)
 	}
 	else
 		t = simple_expr(q);
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* simple_expr(TreeNode* f)
 {
+	PROF_ENTER(PrSimpleExpr);
 	TreeNode* t = NULL, * q = NULL;
 	TokenType oper;
 	q = add_expr(f);
@@ -940,11 +1514,13 @@ TreeNode* simple_expr(TreeNode* f)
 	}
 	else
 		t = q;
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* add_expr(TreeNode* f)
 {
+	PROF_ENTER(PrAddExpr);
 	TreeNode* t = NULL;
 	TreeNode* q = NULL;
 
@@ -964,11 +1540,13 @@ TreeNode* add_expr(TreeNode* f)
 			}
 		}
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* term(TreeNode* f)
 {
+	PROF_ENTER(PrTerm);
 	TreeNode* t = NULL;
 	TreeNode* q = NULL;
 
@@ -988,15 +1566,19 @@ TreeNode* term(TreeNode* f)
 			}
 		}
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* factor(TreeNode* f)
 {
+	PROF_ENTER(PrFactor);
 	TreeNode* t = NULL;
 
-	if (f != NULL)
+	if (f != NULL) {
+		PROF_LEAVE();
 		return f;
+	}
 
 	switch (token)
 	{
@@ -1020,13 +1602,16 @@ TreeNode* factor(TreeNode* f)
 	default: syntaxError("unexpected token(factor) -> ");
 		printToken(token, tokenString);
 		token = getToken();
+		PROF_LEAVE();
 		return Void;
 	}
+	PROF_LEAVE();
 	return t;
 }
 
 TreeNode* call(void)
 {
+	PROF_ENTER(PrCall);
 	TreeNode* t = NULL;
 	char* name = "";
 
@@ -1066,6 +1651,7 @@ TreeNode* call(void)
 			t->type = Integer;
 		}
 	}
+	PROF_LEAVE();
 	return t;
 }
 
@@ -1079,6 +1665,7 @@ TreeNode* args(void)
 
 TreeNode* args_list(void)
 {
+	PROF_ENTER(PrArgsList);
 	TreeNode* t = NULL;
 	TreeNode* p = NULL;
 
@@ -1100,6 +1687,7 @@ TreeNode* args_list(void)
 			}
 		}
 	}
+	PROF_LEAVE();
 	return t;
 }
 
@@ -1169,6 +1757,11 @@ void printTree(TreeNode* tree)
 				fprintf(fpOut, "return:\n");
 				printTree(tree->child[0]);
 				break;
+			case CompoundK:
+				fprintf(fpOut, "Compound:\n");
+				printTree(tree->child[0]);
+				printTree(tree->child[1]);
+				break;
 			case CallK:
 				fprintf(fpOut, "Call: %s\n", tree->attr.name);
 				INDENT;
@@ -1249,4 +1842,9904 @@ void printTree(TreeNode* tree)
 		tree = tree->sibling;
 	}
 	UNINDENT;
-}
\ No newline at end of file
+}
+
+/*********************************************/
+/*************semantic analysis***************/
+/*********************************************/
+
+/* Names are resolved once, before execution: every IdK and CallK node gets
+   a pointer to its declaration, and every declaration gets its address
+   (global) or its slot in the activation record (local). */
+
+#define SYMSIZE 4093    // number of hash buckets
+#define SHIFT 4         // power of two used as multiplier in hash function
+
+typedef struct {
+	char* name;
+	TreeNode* decl;
+	int next;           // next entry in the same bucket, -1 at the end
+} SymEntry;
+
+static SymEntry* symTab = NULL;
+static int symCount = 0, symCapacity = 0;
+static int symBucket[SYMSIZE];
+static int scopeStart = 0;      // first entry of the innermost scope
+static int globalSize = 0;      // number of global slots
+static int localOffset = 0;     // next free slot of the current activation
+static int inFunction = FALSE;  // TRUE while declaring locals
+static int frameSize = 0;       // largest localOffset seen in the function
+
+TreeNode* inputDecl = NULL;     // built-in int input(void)
+TreeNode* outputDecl = NULL;    // built-in void output(int x)
+
+static int hash(char* key)
+{
+	int temp = 0;
+	int i = 0;
+	while (key[i] != '\0') {
+		temp = ((temp << SHIFT) + key[i]) % SYMSIZE;
+		++i;
+	}
+	return temp;
+}
+
+static TreeNode* st_lookup(char* name)
+{
+	int i = symBucket[hash(name)];
+	while (i >= 0 && strcmp(name, symTab[i].name) != 0)
+		i = symTab[i].next;
+	return i >= 0 ? symTab[i].decl : NULL;
+}
+
+static void st_insert(char* name, TreeNode* decl)
+{
+	int h = hash(name);
+	int i;
+	for (i = symBucket[h]; i >= scopeStart; i = symTab[i].next)
+		if (!strcmp(name, symTab[i].name)) {
+			semanticError(decl, "redeclaration of -> ");
+			return;
+		}
+	if (symCount == symCapacity) {
+		symCapacity = symCapacity ? symCapacity * 2 : 256;
+		symTab = (SymEntry*)realloc(symTab, symCapacity * sizeof(SymEntry));
+		if (symTab == NULL) {
+			fprintf(fpOut, "Out of memory error at line %d\n", decl->lineno);
+			exit(EXIT_FAILURE);
+		}
+	}
+	symTab[symCount].name = name;
+	symTab[symCount].decl = decl;
+	symTab[symCount].next = symBucket[h];
+	symBucket[h] = symCount++;
+}
+
+/* scopes nest like a stack, so leaving one just pops its entries */
+static int st_enterScope(void)
+{
+	int old = scopeStart;
+	scopeStart = symCount;
+	return old;
+}
+
+static void st_leaveScope(int old)
+{
+	while (symCount > scopeStart) {
+		symCount--;
+		symBucket[hash(symTab[symCount].name)] = symTab[symCount].next;
+	}
+	scopeStart = old;
+}
+
+void semanticError(TreeNode* t, char* message)
+{
+	Error = TRUE;
+	fprintf(fpOut, "\n>>> Semantic error at line %d: %s%s\n", t->lineno, message,
+		t->attr.name != NULL ? t->attr.name : "");
+}
+
+/* TRUE for the "void" placeholder that params() builds for f(void) */
+static int isVoidParam(TreeNode* t)
+{
+	return t->nodekind == ExpK && t->kind.exp == VarDeclK && t->type == Void;
+}
+
+/* give a variable declaration its place in memory */
+static void declareVar(TreeNode* t)
+{
+	int size = (t->kind.exp == VarArrayDeclK && !t->paramCheck) ? t->arraysize : 1;
+	if (inFunction) {
+		t->level = 1;
+		t->memloc = localOffset;
+		localOffset += size;
+	}
+	else {
+		t->level = 0;
+		t->memloc = globalSize;
+		globalSize += size;
+	}
+	st_insert(t->attr.name, t);
+}
+
+static void resolveNode(TreeNode* t);
+
+static void resolveList(TreeNode* t)
+{
+	while (t != NULL) {
+		resolveNode(t);
+		t = t->sibling;
+	}
+}
+
+static void resolveCompound(TreeNode* t)
+{
+	int scope = st_enterScope();
+	int offset = localOffset;
+	TreeNode* p;
+
+	for (p = t->child[0]; p != NULL; p = p->sibling)
+		declareVar(p);
+	if (localOffset > frameSize)
+		frameSize = localOffset;
+	resolveList(t->child[1]);
+	/* sibling blocks reuse the slots of this one */
+	localOffset = offset;
+	st_leaveScope(scope);
+}
+
+static void resolveNode(TreeNode* t)
+{
+	int i;
+
+	if (t->nodekind == StmtK) {
+		switch (t->kind.stmt) {
+		case CompoundK:
+			resolveCompound(t);
+			return;
+		case CallK:
+			t->decl = st_lookup(t->attr.name);
+			if (t->decl == NULL)
+				semanticError(t, "undeclared function -> ");
+			else if (t->decl->kind.exp != FuncDeclK) {
+				semanticError(t, "not a function -> ");
+				t->decl = NULL;
+			}
+			resolveList(t->child[0]);
+			return;
+		default:
+			break;
+		}
+	}
+	else if (t->kind.exp == IdK) {
+		t->decl = st_lookup(t->attr.name);
+		if (t->decl == NULL)
+			semanticError(t, "undeclared identifier -> ");
+		else if (t->decl->kind.exp == FuncDeclK) {
+			semanticError(t, "function used as a variable -> ");
+			t->decl = NULL;
+		}
+		else if (t->child[0] != NULL && t->decl->kind.exp != VarArrayDeclK)
+			semanticError(t, "subscripted variable is not an array -> ");
+	}
+	for (i = 0; i < MAXCHILDREN; i++)
+		if (t->child[i] != NULL)
+			resolveNode(t->child[i]);
+}
+
+static void resolveFunction(TreeNode* f)
+{
+	int scope = st_enterScope();
+	TreeNode* p;
+
+	localOffset = frameSize = 0;
+	inFunction = TRUE;
+	for (p = f->child[0]; p != NULL; p = p->sibling)
+		if (!isVoidParam(p))
+			declareVar(p);
+	if (localOffset > frameSize)
+		frameSize = localOffset;
+	if (f->child[1] != NULL)
+		resolveCompound(f->child[1]);
+	f->framesize = frameSize;
+	inFunction = FALSE;
+	st_leaveScope(scope);
+}
+
+static TreeNode* builtinFunc(char* name, ExpType type, TreeNode* param)
+{
+	TreeNode* t = newExpNode(FuncDeclK);
+	t->attr.name = name;
+	t->type = type;
+	t->lineno = 0;
+	t->child[0] = param;
+	t->framesize = param != NULL ? 1 : 0;
+	return t;
+}
+
+void analyze(TreeNode* syntaxTree)
+{
+	TreeNode* t;
+	int i;
+
+	for (i = 0; i < SYMSIZE; i++)
+		symBucket[i] = -1;
+	symCount = scopeStart = 0;
+	globalSize = 0;
+
+	if (inputDecl == NULL) {
+		TreeNode* x = newExpNode(VarDeclK);
+		x->attr.name = "x";
+		x->type = Integer;
+		x->paramCheck = TRUE;
+		x->level = 1;
+		x->lineno = 0;
+		inputDecl = builtinFunc("input", Integer, NULL);
+		outputDecl = builtinFunc("output", Void, x);
+	}
+	st_insert("input", inputDecl);
+	st_insert("output", outputDecl);
+
+	/* functions may be called before their declaration */
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK)
+			st_insert(t->attr.name, t);
+	for (t = syntaxTree; t != NULL; t = t->sibling) {
+		if (t->kind.exp == FuncDeclK)
+			resolveFunction(t);
+		else
+			declareVar(t);
+	}
+}
+
+
+/*********************************************/
+/*****************interpreter*****************/
+/*********************************************/
+
+/* Data memory is one int array. Globals live at the bottom, activation
+   records are stacked above them: the parameters first, then the locals,
+   with local arrays stored inline. An array parameter holds the address
+   of the first element. Nothing is allocated and no name is looked up
+   while the program runs. */
+
+#define MEMSIZE 4000000     // interpreter data memory in ints
+#define IOBUFSIZE 65536
+#define MAXCALLDEPTH 10000  // nested calls; each one also recurses on the C stack
+
+static int* mem = NULL;
+static int fp = 0;          // frame pointer
+static int sp = 0;          // first free slot above the current frame
+static int retval = 0;      // value of the last return statement
+static int callDepth = 0;   // calls in progress
+static long long steps = 0; // number of evaluated nodes
+
+static char inBuf[IOBUFSIZE];
+static int inPos = 0, inLen = 0;
+static char outBuf[IOBUFSIZE];
+static int outLen = 0;
+
+static void flushOutput(void)
+{
+	fwrite(outBuf, 1, outLen, stdout);
+	fflush(stdout);
+	outLen = 0;
+}
+
+static int readChar(void)
+{
+	if (inPos >= inLen) {
+		inLen = (int)fread(inBuf, 1, IOBUFSIZE, stdin);
+		inPos = 0;
+		if (inLen <= 0)
+			return EOF;
+	}
+	return (unsigned char)inBuf[inPos++];
+}
+
+/* input(): read one decimal integer from stdin */
+static int readInt(TreeNode* t)
+{
+	int c, neg = FALSE, v = 0;
+
+	do
+		c = readChar();
+	while (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+	if (c == '-') {
+		neg = TRUE;
+		c = readChar();
+	}
+	if (!isdigit(c))
+		runtimeError(t, "input() expects an integer");
+	while (isdigit(c)) {
+		v = v * 10 + (c - '0');
+		c = readChar();
+	}
+	return neg ? -v : v;
+}
+
+/* output(x): write x and a newline to stdout */
+static void writeInt(int v)
+{
+	char digits[12];
+	int n = 0;
+	unsigned int u = v < 0 ? 0u - (unsigned int)v : (unsigned int)v;
+
+	if (outLen > IOBUFSIZE - 16)
+		flushOutput();
+	if (v < 0)
+		outBuf[outLen++] = '-';
+	do {
+		digits[n++] = (char)('0' + u % 10);
+		u /= 10;
+	} while (u != 0);
+	while (n > 0)
+		outBuf[outLen++] = digits[--n];
+	outBuf[outLen++] = '\n';
+}
+
+void runtimeError(TreeNode* t, char* message)
+{
+	flushOutput();
+	fprintf(stderr, "Runtime error at line %d: %s\n", t->lineno, message);
+	exit(EXIT_FAILURE);
+}
+
+/* The optimizer's shifts: SHL is a multiplication and SHR a division
+   (rounding toward zero) by 2^k */
+static int shiftLeft(int a, int k)
+{
+	return (int)((unsigned int)a << k);
+}
+
+static int shiftRight(int a, int k)
+{
+	if (a < 0)
+		return -(int)((0u - (unsigned int)a) >> k);
+	return a >> k;
+}
+
+/* address of the first element of an array */
+static int arrayBase(TreeNode* decl)
+{
+	if (decl->paramCheck)
+		return mem[fp + decl->memloc];
+	return decl->level ? fp + decl->memloc : decl->memloc;
+}
+
+static int evalExp(TreeNode* t);
+
+/* address of the variable or array element named by an IdK node */
+static int varAddress(TreeNode* t)
+{
+	TreeNode* d = t->decl;
+	int index;
+
+	if (t->child[0] == NULL)
+		return d->level ? fp + d->memloc : d->memloc;
+	index = evalExp(t->child[0]);
+	if (!d->paramCheck) {
+		if (!t->inBounds && (index < 0 || index >= d->arraysize))
+			runtimeError(t, "array index out of bounds");
+		return arrayBase(d) + index;
+	}
+	index += arrayBase(d);
+	if (!t->inBounds && (index < 0 || index >= MEMSIZE))
+		runtimeError(t, "array index out of bounds");
+	return index;
+}
+
+static int execList(TreeNode* t);
+
+static int callFunction(TreeNode* t)
+{
+	TreeNode* f = t->decl;
+	TreeNode* p = f->child[0];
+	TreeNode* a = t->child[0];
+	int frame = sp, oldfp, i;
+
+	if (f == inputDecl)
+		return readInt(t);
+	if (f == outputDecl) {
+		writeInt(a != NULL ? evalExp(a) : 0);
+		return 0;
+	}
+	if (callDepth == MAXCALLDEPTH || frame + f->framesize > MEMSIZE)
+		runtimeError(t, "stack overflow");
+	for (i = 0; i < f->framesize; i++)
+		mem[frame + i] = 0;
+	/* arguments are evaluated in the caller's frame; calls among them
+	   allocate above the new frame */
+	sp = frame + f->framesize;
+	if (p != NULL && isVoidParam(p))
+		p = NULL;
+	for (; a != NULL; a = a->sibling) {
+		int v = evalExp(a);
+		if (p != NULL) {
+			mem[frame + p->memloc] = v;
+			p = p->sibling;
+		}
+	}
+	oldfp = fp;
+	fp = frame;
+	retval = 0;
+	callDepth++;
+	execList(f->child[1]);
+	callDepth--;
+	fp = oldfp;
+	sp = frame;
+	return retval;
+}
+
+static int evalExp(TreeNode* t)
+{
+	int a, b, addr;
+
+	steps++;
+	if (t->nodekind == StmtK)
+		return callFunction(t);
+	switch (t->kind.exp) {
+	case ConstK:
+		return t->attr.val;
+	case IdK:
+		if (t->child[0] == NULL && t->decl->kind.exp == VarArrayDeclK)
+			return arrayBase(t->decl);
+		return mem[varAddress(t)];
+	case AssignK:
+		addr = varAddress(t->child[0]);
+		a = evalExp(t->child[1]);
+		mem[addr] = a;
+		return a;
+	case OpK:
+		a = evalExp(t->child[0]);
+		b = evalExp(t->child[1]);
+		switch (t->attr.op) {
+		/* wrap around like the machine back ends */
+		case PLUS: return (int)((unsigned int)a + (unsigned int)b);
+		case MINUS: return (int)((unsigned int)a - (unsigned int)b);
+		case MUL: return (int)((unsigned int)a * (unsigned int)b);
+		case DIV:
+			if (b == 0)
+				runtimeError(t, "division by zero");
+			if (b == -1 && a == -2147483647 - 1)
+				runtimeError(t, "division overflow");
+			return a / b;
+		case LT: return a < b;
+		case LE: return a <= b;
+		case GT: return a > b;
+		case GE: return a >= b;
+		case EQ: return a == b;
+		case NE: return a != b;
+		case SHL: return shiftLeft(a, b);
+		case SHR: return shiftRight(a, b);
+		default: break;
+		}
+		break;
+	default:
+		break;
+	}
+	runtimeError(t, "cannot evaluate node");
+	return 0;
+}
+
+/* execute a statement list; returns TRUE once a return statement ran */
+static int execList(TreeNode* t)
+{
+	for (; t != NULL; t = t->sibling) {
+		steps++;
+		if (t->nodekind == StmtK) {
+			switch (t->kind.stmt) {
+			case CompoundK:
+				if (execList(t->child[1]))
+					return TRUE;
+				break;
+			case SelectionK:
+				if (evalExp(t->child[0])) {
+					if (execList(t->child[1]))
+						return TRUE;
+				}
+				else if (execList(t->child[2]))
+					return TRUE;
+				break;
+			case IterationK:
+				while (evalExp(t->child[0]))
+					if (execList(t->child[1]))
+						return TRUE;
+				break;
+			case ReturnK:
+				retval = t->child[0] != NULL ? evalExp(t->child[0]) : 0;
+				return TRUE;
+			case CallK:
+				callFunction(t);
+				break;
+			default:
+				break;
+			}
+		}
+		else if (t->kind.exp != VarDeclK && t->kind.exp != VarArrayDeclK)
+			evalExp(t);
+	}
+	return FALSE;
+}
+
+/* find the function main() among the top-level declarations */
+static TreeNode* findMain(TreeNode* syntaxTree)
+{
+	TreeNode* t;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK && !strcmp(t->attr.name, "main"))
+			return t;
+	return NULL;
+}
+
+void interpret(TreeNode* syntaxTree)
+{
+	TreeNode* m = findMain(syntaxTree);
+	TreeNode c;
+	clock_t start;
+	double secs;
+
+	if (m == NULL) {
+		fprintf(stderr, "Runtime error: no main function\n");
+		exit(EXIT_FAILURE);
+	}
+	if (mem == NULL)
+		mem = (int*)calloc(MEMSIZE, sizeof(int));
+	if (mem == NULL || globalSize >= MEMSIZE) {
+		fprintf(stderr, "Runtime error: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	fp = sp = globalSize;
+	steps = 0;
+	callDepth = 0;
+
+	/* a call node for main() */
+	memset(&c, 0, sizeof(c));
+	c.nodekind = StmtK;
+	c.kind.stmt = CallK;
+	c.decl = m;
+	c.lineno = m->lineno;
+
+	start = clock();
+	callFunction(&c);
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	flushOutput();
+	if (ShowTime)
+		fprintf(stderr, "interpreter: %lld nodes in %.3f s (%.2f M nodes/s)\n",
+			steps, secs, secs > 0 ? steps / secs / 1e6 : 0.0);
+}
+
+
+/*********************************************/
+/**************bytecode machine***************/
+/*********************************************/
+
+/* The tree is lowered to a dense int array: an opcode followed by its
+   operands. The machine keeps operands on a preallocated stack and the
+   activation records in the same memory layout the interpreter uses.
+   With gcc/clang each instruction jumps straight to the next one through
+   a table of label addresses (computed goto); other compilers get a
+   switch loop. */
+
+#if defined(__GNUC__) && !defined(NO_THREADED_CODE)
+#define THREADED_CODE
+#endif
+
+/* opcode, number of operands, change of the operand stack (for CALL
+   without its arguments) */
+#define OPCODES(X) \
+	X(HALT, 0, 0)   X(PUSHC, 1, 1)  X(POP, 0, -1)   X(DUP, 0, 1)    X(DUPX1, 0, 1) \
+	X(LDG, 1, 1)    X(LDL, 1, 1)    X(STG, 1, -1)   X(STL, 1, -1)   X(LEAL, 1, 1)  \
+	X(LDGX, 2, 0)   X(LDLX, 2, 0)   X(LDPX, 1, 0)   X(STGX, 2, -2)  X(STLX, 2, -2) X(STPX, 1, -2) \
+	X(LDGXU, 1, 0)  X(LDLXU, 1, 0)  X(LDPXU, 1, 0)  X(STGXU, 1, -2) X(STLXU, 1, -2) X(STPXU, 1, -2) \
+	X(CHKX, 1, 0)   X(CHKPX, 1, 0)  \
+	X(INCG, 2, 0)   X(INCL, 2, 0)   \
+	X(ADD, 0, -1)   X(SUB, 0, -1)   X(MUL, 0, -1)   X(DIV, 0, -1)   X(SHL, 1, 0)   X(SHR, 1, 0) \
+	X(LT, 0, -1)    X(LE, 0, -1)    X(GT, 0, -1)    X(GE, 0, -1)    X(EQ, 0, -1)   X(NE, 0, -1) \
+	X(JMP, 1, 0)    X(JZ, 1, -1)    X(JNZ, 1, -1)   \
+	X(JLT, 1, -2)   X(JLE, 1, -2)   X(JGT, 1, -2)   X(JGE, 1, -2)   X(JEQ, 1, -2)  X(JNE, 1, -2) \
+	X(CALL, 3, 1)   X(RET, 0, -1)   X(IN, 0, 1)     X(OUT, 0, -1)
+
+#define OPENUM(name, n, d) OP_##name,
+typedef enum { OPCODES(OPENUM) NUMOPCODES } OpCode;
+#undef OPENUM
+
+#define OPNAME(name, n, d) #name,
+static const char* opNames[] = { OPCODES(OPNAME) };
+#undef OPNAME
+
+#define OPSIZE(name, n, d) n,
+static const int opOperands[] = { OPCODES(OPSIZE) };
+#undef OPSIZE
+
+#define OPEFFECT(name, n, d) d,
+static const int opEffect[] = { OPCODES(OPEFFECT) };
+#undef OPEFFECT
+
+#define VMSTACKSIZE 1000000     // operand stack in ints
+#define VMCALLDEPTH 500000      // nested calls
+
+static int* code = NULL;        // instruction stream
+static int* codeLine = NULL;    // source line of every code word
+static int codeSize = 0, codeCapacity = 0;
+static int codeLineno = 0;      // line of the node being compiled
+static int vmEntry = 0;         // address of the startup code
+static int vmMaxDepth = 0;      // most operands a function pushes between calls
+
+typedef struct {
+	int at;                     // operand to patch
+	TreeNode* func;
+} CallPatch;
+
+static CallPatch* callPatches = NULL;
+static int numPatches = 0, patchCapacity = 0;
+
+static int emit(int word)
+{
+	if (codeSize == codeCapacity) {
+		codeCapacity = codeCapacity ? codeCapacity * 2 : 1024;
+		code = (int*)realloc(code, codeCapacity * sizeof(int));
+		codeLine = (int*)realloc(codeLine, codeCapacity * sizeof(int));
+		if (code == NULL || codeLine == NULL) {
+			fprintf(fpOut, "Out of memory error at line %d\n", codeLineno);
+			exit(EXIT_FAILURE);
+		}
+	}
+	codeLine[codeSize] = codeLineno;
+	code[codeSize] = word;
+	return codeSize++;
+}
+
+static int emitOp(OpCode op, int a)
+{
+	int at = emit(op);
+	if (opOperands[op] > 0)
+		emit(a);
+	return at;
+}
+
+static void emitOp2(OpCode op, int a, int b)
+{
+	emit(op);
+	emit(a);
+	emit(b);
+}
+
+static void emitCall(TreeNode* f, int nargs)
+{
+	if (numPatches == patchCapacity) {
+		patchCapacity = patchCapacity ? patchCapacity * 2 : 64;
+		callPatches = (CallPatch*)realloc(callPatches, patchCapacity * sizeof(CallPatch));
+		if (callPatches == NULL) {
+			fprintf(fpOut, "Out of memory error at line %d\n", codeLineno);
+			exit(EXIT_FAILURE);
+		}
+	}
+	emit(OP_CALL);
+	callPatches[numPatches].at = emit(0);
+	callPatches[numPatches++].func = f;
+	emit(nargs);
+	emit(f->framesize);
+}
+
+static void genExp(TreeNode* t, int keep);
+static void genList(TreeNode* t);
+
+static int isRelop(TreeNode* t)
+{
+	if (t->nodekind != ExpK || t->kind.exp != OpK)
+		return FALSE;
+	switch (t->attr.op) {
+	case LT: case LE: case GT: case GE: case EQ: case NE:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+/* jump to target when cond is true (when) or false (!when); returns the
+   address of the jump operand so the caller can patch it */
+static int genBranch(TreeNode* cond, int when, int target)
+{
+	OpCode op;
+
+	if (!isRelop(cond)) {
+		genExp(cond, TRUE);
+		emit(when ? OP_JNZ : OP_JZ);
+		return emit(target);
+	}
+	genExp(cond->child[0], TRUE);
+	genExp(cond->child[1], TRUE);
+	switch (cond->attr.op) {
+	case LT: op = when ? OP_JLT : OP_JGE; break;
+	case LE: op = when ? OP_JLE : OP_JGT; break;
+	case GT: op = when ? OP_JGT : OP_JLE; break;
+	case GE: op = when ? OP_JGE : OP_JLT; break;
+	case EQ: op = when ? OP_JEQ : OP_JNE; break;
+	default: op = when ? OP_JNE : OP_JEQ; break;
+	}
+	emit(op);
+	return emit(target);
+}
+
+/* push the value of IdK t */
+static void genLoad(TreeNode* t)
+{
+	TreeNode* d = t->decl;
+
+	if (t->child[0] == NULL) {
+		if (d->kind.exp == VarArrayDeclK && !d->paramCheck) {
+			/* an array passed as argument: push its address */
+			if (d->level)
+				emitOp(OP_LEAL, d->memloc);
+			else
+				emitOp(OP_PUSHC, d->memloc);
+		}
+		else
+			emitOp(d->level ? OP_LDL : OP_LDG, d->memloc);
+		return;
+	}
+	genExp(t->child[0], TRUE);
+	if (t->inBounds)
+		emitOp(d->paramCheck ? OP_LDPXU : d->level ? OP_LDLXU : OP_LDGXU, d->memloc);
+	else if (d->paramCheck)
+		emitOp(OP_LDPX, d->memloc);
+	else
+		emitOp2(d->level ? OP_LDLX : OP_LDGX, d->memloc, d->arraysize);
+}
+
+/* i = i + c and i = i - c become a single increment */
+static int isIncrement(TreeNode* t)
+{
+	TreeNode* lhs = t->child[0];
+	TreeNode* rhs = t->child[1];
+
+	return lhs->child[0] == NULL && rhs->nodekind == ExpK && rhs->kind.exp == OpK
+		&& (rhs->attr.op == PLUS || rhs->attr.op == MINUS)
+		&& rhs->child[0]->nodekind == ExpK && rhs->child[0]->kind.exp == IdK
+		&& rhs->child[0]->child[0] == NULL && rhs->child[0]->decl == lhs->decl
+		&& rhs->child[1]->nodekind == ExpK && rhs->child[1]->kind.exp == ConstK;
+}
+
+/* TRUE when evaluating t can be seen: it calls, assigns, or may stop
+   with a runtime error */
+static int evalObservable(TreeNode* t)
+{
+	int i;
+
+	if (t == NULL)
+		return FALSE;
+	if (t->nodekind == StmtK || t->kind.exp == AssignK)
+		return TRUE;
+	if (t->kind.exp == OpK && t->attr.op == DIV)
+		return TRUE;
+	if (t->kind.exp == IdK && t->child[0] != NULL && !t->inBounds)
+		return TRUE;
+	for (i = 0; i < MAXCHILDREN; i++)
+		if (evalObservable(t->child[i]))
+			return TRUE;
+	return FALSE;
+}
+
+static void genAssign(TreeNode* t, int keep)
+{
+	TreeNode* lhs = t->child[0];
+	TreeNode* d = lhs->decl;
+	int checkFirst;
+
+	if (!keep && isIncrement(t)) {
+		int k = t->child[1]->child[1]->attr.val;
+		emitOp2(d->level ? OP_INCL : OP_INCG, d->memloc,
+			t->child[1]->attr.op == PLUS ? k : (int)(0u - (unsigned int)k));
+		return;
+	}
+	if (lhs->child[0] == NULL) {
+		genExp(t->child[1], TRUE);
+		if (keep)
+			emit(OP_DUP);
+		emitOp(d->level ? OP_STL : OP_STG, d->memloc);
+		return;
+	}
+	genExp(lhs->child[0], TRUE);
+	/* the interpreter checks the subscript first: so must we when the
+	   value could print or stop with an error of its own */
+	checkFirst = !lhs->inBounds && evalObservable(t->child[1]);
+	if (checkFirst)
+		emitOp(d->paramCheck ? OP_CHKPX : OP_CHKX, d->paramCheck ? d->memloc : d->arraysize);
+	genExp(t->child[1], TRUE);
+	if (keep)
+		emit(OP_DUPX1);
+	if (lhs->inBounds || checkFirst)
+		emitOp(d->paramCheck ? OP_STPXU : d->level ? OP_STLXU : OP_STGXU, d->memloc);
+	else if (d->paramCheck)
+		emitOp(OP_STPX, d->memloc);
+	else
+		emitOp2(d->level ? OP_STLX : OP_STGX, d->memloc, d->arraysize);
+}
+
+static void genCall(TreeNode* t, int keep)
+{
+	TreeNode* f = t->decl;
+	TreeNode* p = f->child[0];
+	TreeNode* a;
+	int nargs = 0;
+
+	if (f == inputDecl) {
+		emit(OP_IN);
+		if (!keep)
+			emit(OP_POP);
+		return;
+	}
+	if (f == outputDecl) {
+		if (t->child[0] != NULL)
+			genExp(t->child[0], TRUE);
+		else
+			emitOp(OP_PUSHC, 0);
+		emit(OP_OUT);
+		if (keep)
+			emitOp(OP_PUSHC, 0);
+		return;
+	}
+	if (p != NULL && isVoidParam(p))
+		p = NULL;
+	for (a = t->child[0]; a != NULL; a = a->sibling) {
+		genExp(a, TRUE);
+		if (p != NULL) {
+			nargs++;
+			p = p->sibling;
+		}
+		else
+			emit(OP_POP);   /* surplus argument: evaluated, then dropped */
+	}
+	codeLineno = t->lineno;
+	emitCall(f, nargs);
+	if (!keep)
+		emit(OP_POP);
+}
+
+static void genExp(TreeNode* t, int keep)
+{
+	codeLineno = t->lineno;
+	if (t->nodekind == StmtK) {
+		genCall(t, keep);
+		return;
+	}
+	switch (t->kind.exp) {
+	case ConstK:
+		if (keep)
+			emitOp(OP_PUSHC, t->attr.val);
+		return;
+	case IdK:
+		genLoad(t);
+		break;
+	case AssignK:
+		genAssign(t, keep);
+		return;
+	case OpK:
+		genExp(t->child[0], TRUE);
+		codeLineno = t->lineno;
+		if (t->attr.op == SHL || t->attr.op == SHR) {
+			emitOp(t->attr.op == SHL ? OP_SHL : OP_SHR, t->child[1]->attr.val);
+			break;
+		}
+		genExp(t->child[1], TRUE);
+		codeLineno = t->lineno;
+		switch (t->attr.op) {
+		case PLUS: emit(OP_ADD); break;
+		case MINUS: emit(OP_SUB); break;
+		case MUL: emit(OP_MUL); break;
+		case DIV: emit(OP_DIV); break;
+		case LT: emit(OP_LT); break;
+		case LE: emit(OP_LE); break;
+		case GT: emit(OP_GT); break;
+		case GE: emit(OP_GE); break;
+		case EQ: emit(OP_EQ); break;
+		default: emit(OP_NE); break;
+		}
+		break;
+	default:
+		return;
+	}
+	if (!keep)
+		emit(OP_POP);
+}
+
+static void genList(TreeNode* t)
+{
+	int jump, top;
+
+	for (; t != NULL; t = t->sibling) {
+		codeLineno = t->lineno;
+		if (t->nodekind == ExpK) {
+			if (t->kind.exp != VarDeclK && t->kind.exp != VarArrayDeclK)
+				genExp(t, FALSE);
+			continue;
+		}
+		switch (t->kind.stmt) {
+		case CompoundK:
+			genList(t->child[1]);
+			break;
+		case SelectionK:
+			jump = genBranch(t->child[0], FALSE, 0);
+			genList(t->child[1]);
+			if (t->child[2] != NULL) {
+				int skip = emitOp(OP_JMP, 0) + 1;
+				code[jump] = codeSize;
+				genList(t->child[2]);
+				code[skip] = codeSize;
+			}
+			else
+				code[jump] = codeSize;
+			break;
+		case IterationK:
+			/* the test sits at the bottom: one jump per iteration */
+			jump = emitOp(OP_JMP, 0) + 1;
+			top = codeSize;
+			genList(t->child[1]);
+			code[jump] = codeSize;
+			genBranch(t->child[0], TRUE, top);
+			break;
+		case ReturnK:
+			if (t->child[0] != NULL)
+				genExp(t->child[0], TRUE);
+			else
+				emitOp(OP_PUSHC, 0);
+			emit(OP_RET);
+			break;
+		case CallK:
+			genCall(t, FALSE);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void genBytecode(TreeNode* syntaxTree)
+{
+	TreeNode* t;
+	int i, depth;
+
+	codeSize = numPatches = 0;
+	codeLineno = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK) {
+			t->memloc = codeSize;
+			codeLineno = t->lineno;
+			genList(t->child[1]);
+			emitOp(OP_PUSHC, 0);
+			emit(OP_RET);
+		}
+
+	/* startup: call main() and stop */
+	t = findMain(syntaxTree);
+	vmEntry = codeSize;
+	if (t != NULL) {
+		emitCall(t, 0);
+		emit(OP_POP);
+	}
+	emit(OP_HALT);
+
+	for (i = 0; i < numPatches; i++)
+		code[callPatches[i].at] = callPatches[i].func->memloc;
+
+	/* a statement leaves the operand stack as it found it and a function
+	   starts with an empty one, so one pass over the code finds the
+	   deepest stack relative to the start of a function */
+	vmMaxDepth = depth = 0;
+	for (i = 0; i < codeSize; i += 1 + opOperands[code[i]]) {
+		depth += opEffect[code[i]] - (code[i] == OP_CALL ? code[i + 2] : 0);
+		if (depth > vmMaxDepth)
+			vmMaxDepth = depth;
+	}
+}
+
+void printBytecode(void)
+{
+	int pc = 0, i;
+
+	fprintf(fpOut, "\nBytecode:\n");
+	while (pc < codeSize) {
+		OpCode op = (OpCode)code[pc];
+		fprintf(fpOut, "%6d: %-6s", pc, opNames[op]);
+		for (i = 1; i <= opOperands[op]; i++)
+			fprintf(fpOut, " %d", code[pc + i]);
+		fprintf(fpOut, "\t(line %d)\n", codeLine[pc]);
+		pc += 1 + opOperands[op];
+	}
+}
+
+typedef struct {
+	int* ret;                   // return address
+	int* fp;                    // caller's frame
+} VMFrame;
+
+static void vmError(int* pc, char* message)
+{
+	TreeNode t;
+	t.lineno = codeLine[pc - code];
+	runtimeError(&t, message);
+}
+
+void vmRun(void)
+{
+	/* CALL keeps the stack below VMSTACKSIZE, the callee pushes at most
+	   vmMaxDepth more before its own calls */
+	int* stack = (int*)malloc((VMSTACKSIZE + vmMaxDepth + 1) * sizeof(int));
+	VMFrame* calls = (VMFrame*)malloc(VMCALLDEPTH * sizeof(VMFrame));
+	VMFrame* call = calls;
+	int* memEnd;
+	int* pc = code + vmEntry;
+	int* op;                    // start of the current instruction
+	int* s;                     // top of the operand stack
+	int* fr;                    // current activation record
+	int* top;                   // first free slot above it
+	int a, b, i;
+	long long count = 0;
+	clock_t start;
+	double secs;
+#ifdef THREADED_CODE
+#define OPLABEL(name, n, d) &&L_##name,
+	static void* labels[] = { OPCODES(OPLABEL) };
+#undef OPLABEL
+#endif
+
+	if (mem == NULL)
+		mem = (int*)calloc(MEMSIZE, sizeof(int));
+	if (stack == NULL || calls == NULL || mem == NULL || globalSize >= MEMSIZE) {
+		fprintf(stderr, "Runtime error: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memEnd = mem + MEMSIZE;
+	fr = top = mem + globalSize;
+	s = stack;
+
+#ifdef THREADED_CODE
+#define VMCASE(name) L_##name:
+#define NEXT do { count++; op = pc; goto *labels[*pc++]; } while (0)
+#else
+#define VMCASE(name) case OP_##name:
+#define NEXT do { count++; goto dispatch; } while (0)
+#endif
+#define BINOP(name, expr) VMCASE(name) b = *s--; *s = (expr); NEXT;
+#define JUMPOP(name, cond) VMCASE(name) b = s[0]; a = s[-1]; s -= 2; \
+	pc = (cond) ? code + pc[0] : pc + 1; NEXT;
+#define CHECK(index, size) if ((unsigned int)(index) >= (unsigned int)(size)) \
+	vmError(op, "array index out of bounds")
+
+	start = clock();
+#ifdef THREADED_CODE
+	NEXT;
+#else
+dispatch:
+	op = pc;
+	switch (*pc++) {
+#endif
+	VMCASE(PUSHC) *++s = *pc++; NEXT;
+	VMCASE(POP) s--; NEXT;
+	VMCASE(DUP) s[1] = s[0]; s++; NEXT;
+	VMCASE(DUPX1) s[1] = s[0]; s[0] = s[-1]; s[-1] = s[1]; s++; NEXT;
+	VMCASE(LDG) *++s = mem[*pc++]; NEXT;
+	VMCASE(LDL) *++s = fr[*pc++]; NEXT;
+	VMCASE(STG) mem[*pc++] = *s--; NEXT;
+	VMCASE(STL) fr[*pc++] = *s--; NEXT;
+	VMCASE(LEAL) *++s = (int)(fr - mem) + *pc++; NEXT;
+	VMCASE(LDGX) CHECK(*s, pc[1]); *s = mem[pc[0] + *s]; pc += 2; NEXT;
+	VMCASE(LDLX) CHECK(*s, pc[1]); *s = fr[pc[0] + *s]; pc += 2; NEXT;
+	VMCASE(LDPX) a = (int)((unsigned int)fr[*pc++] + (unsigned int)*s); CHECK(a, MEMSIZE); *s = mem[a]; NEXT;
+	VMCASE(STGX) CHECK(s[-1], pc[1]); mem[pc[0] + s[-1]] = s[0]; s -= 2; pc += 2; NEXT;
+	VMCASE(STLX) CHECK(s[-1], pc[1]); fr[pc[0] + s[-1]] = s[0]; s -= 2; pc += 2; NEXT;
+	VMCASE(STPX) a = (int)((unsigned int)fr[*pc++] + (unsigned int)s[-1]); CHECK(a, MEMSIZE); mem[a] = s[0]; s -= 2; NEXT;
+	/* subscripts proven in bounds by the range analysis */
+	VMCASE(LDGXU) *s = mem[*pc++ + *s]; NEXT;
+	VMCASE(LDLXU) *s = fr[*pc++ + *s]; NEXT;
+	VMCASE(LDPXU) *s = mem[fr[*pc++] + *s]; NEXT;
+	VMCASE(STGXU) mem[*pc++ + s[-1]] = s[0]; s -= 2; NEXT;
+	VMCASE(STLXU) fr[*pc++ + s[-1]] = s[0]; s -= 2; NEXT;
+	VMCASE(STPXU) mem[fr[*pc++] + s[-1]] = s[0]; s -= 2; NEXT;
+	/* check a subscript before the value to store is computed */
+	VMCASE(CHKX) CHECK(*s, *pc); pc++; NEXT;
+	VMCASE(CHKPX) a = (int)((unsigned int)fr[*pc++] + (unsigned int)*s); CHECK(a, MEMSIZE); NEXT;
+	/* +, - and * wrap around, computed on unsigned int */
+	VMCASE(INCG) mem[pc[0]] = (int)((unsigned int)mem[pc[0]] + (unsigned int)pc[1]); pc += 2; NEXT;
+	VMCASE(INCL) fr[pc[0]] = (int)((unsigned int)fr[pc[0]] + (unsigned int)pc[1]); pc += 2; NEXT;
+	BINOP(ADD, (int)((unsigned int)*s + (unsigned int)b))
+	BINOP(SUB, (int)((unsigned int)*s - (unsigned int)b))
+	BINOP(MUL, (int)((unsigned int)*s * (unsigned int)b))
+	VMCASE(DIV) b = *s--;
+		if (b == 0)
+			vmError(op, "division by zero");
+		if (b == -1 && *s == -2147483647 - 1)
+			vmError(op, "division overflow");
+		*s = *s / b;
+		NEXT;
+	VMCASE(SHL) *s = shiftLeft(*s, *pc++); NEXT;
+	VMCASE(SHR) *s = shiftRight(*s, *pc++); NEXT;
+	BINOP(LT, *s < b)
+	BINOP(LE, *s <= b)
+	BINOP(GT, *s > b)
+	BINOP(GE, *s >= b)
+	BINOP(EQ, *s == b)
+	BINOP(NE, *s != b)
+	VMCASE(JMP) pc = code + *pc; NEXT;
+	VMCASE(JZ) pc = *s-- == 0 ? code + *pc : pc + 1; NEXT;
+	VMCASE(JNZ) pc = *s-- != 0 ? code + *pc : pc + 1; NEXT;
+	JUMPOP(JLT, a < b)
+	JUMPOP(JLE, a <= b)
+	JUMPOP(JGT, a > b)
+	JUMPOP(JGE, a >= b)
+	JUMPOP(JEQ, a == b)
+	JUMPOP(JNE, a != b)
+	VMCASE(CALL)
+		/* pc[0]: target, pc[1]: number of arguments, pc[2]: frame size */
+		if (top + pc[2] > memEnd || call == calls + VMCALLDEPTH || s - stack > VMSTACKSIZE)
+			vmError(op, "stack overflow");
+		s -= pc[1];
+		for (i = 0; i < pc[1]; i++)
+			top[i] = s[i + 1];
+		for (; i < pc[2]; i++)
+			top[i] = 0;
+		call->ret = pc + 3;
+		call->fp = fr;
+		call++;
+		fr = top;
+		top += pc[2];
+		pc = code + pc[0];
+		NEXT;
+	VMCASE(RET)
+		call--;
+		top = fr;
+		fr = call->fp;
+		pc = call->ret;
+		NEXT;
+	VMCASE(IN)
+		{
+			TreeNode t;
+			t.lineno = codeLine[op - code];
+			*++s = readInt(&t);
+		}
+		NEXT;
+	VMCASE(OUT) writeInt(*s--); NEXT;
+	VMCASE(HALT)
+#ifndef THREADED_CODE
+	default:
+		break;
+	}
+#endif
+#undef VMCASE
+#undef NEXT
+#undef BINOP
+#undef JUMPOP
+#undef CHECK
+
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	flushOutput();
+	if (ShowTime)
+		fprintf(stderr, "bytecode machine: %lld instructions in %.3f s (%.2f M instructions/s)\n",
+			count, secs, secs > 0 ? count / secs / 1e6 : 0.0);
+	free(stack);
+	free(calls);
+}
+
+
+/*********************************************/
+/**************TM code generator**************/
+/*********************************************/
+
+/* TM registers */
+#define ac 0    // accumulator
+#define ac1 1   // second accumulator
+#define sp 4    // stack pointer: first free cell, the stack grows down
+#define fpr 5   // frame pointer
+#define gp 6    // global pointer, always 0
+#define pc 7    // program counter
+
+/* An activation record, from high to low addresses:
+       fp+2+i        parameter i (array parameters hold an address)
+       fp+1          return address
+       fp            caller's fp
+       fp-L .. fp-1  locals (L = framesize - number of parameters)
+   The caller reserves the parameter cells, stores the arguments, links
+   the frame and jumps. The callee reserves its locals and on return
+   pops the whole record. The function value is returned in ac. */
+
+static FILE* codeFile = NULL;   // TM code output
+static int emitLoc = 0;         // next instruction location
+static int highEmitLoc = 0;     // highest location emitted so far
+
+typedef struct {
+	int loc;                    // location of the LDC that jumps
+	TreeNode* func;
+} TMCallPatch;
+
+static TMCallPatch* tmPatches = NULL;
+static int tmNumPatches = 0, tmPatchCapacity = 0;
+static TreeNode* tmFunc = NULL; // function being generated
+
+static void emitComment(char* c)
+{
+	fprintf(codeFile, "* %s\n", c);
+}
+
+/* register-only instruction: op r,s,t */
+static void emitRO(char* op, int r, int s, int t, char* c)
+{
+	fprintf(codeFile, "%3d:  %5s  %d,%d,%d \t%s\n", emitLoc++, op, r, s, t, c);
+	if (highEmitLoc < emitLoc)
+		highEmitLoc = emitLoc;
+}
+
+/* register-memory instruction: op r,d(s) */
+static void emitRM(char* op, int r, int d, int s, char* c)
+{
+	fprintf(codeFile, "%3d:  %5s  %d,%d(%d) \t%s\n", emitLoc++, op, r, d, s, c);
+	if (highEmitLoc < emitLoc)
+		highEmitLoc = emitLoc;
+}
+
+/* skip howMany locations for later backpatch; returns the first one */
+static int emitSkip(int howMany)
+{
+	int i = emitLoc;
+	emitLoc += howMany;
+	if (highEmitLoc < emitLoc)
+		highEmitLoc = emitLoc;
+	return i;
+}
+
+static void emitBackup(int loc)
+{
+	if (loc > highEmitLoc)
+		emitComment("BUG in emitBackup");
+	emitLoc = loc;
+}
+
+static void emitRestore(void)
+{
+	emitLoc = highEmitLoc;
+}
+
+/* op r,a with a an absolute location, converted to pc-relative */
+static void emitRM_Abs(char* op, int r, int a, char* c)
+{
+	emitRM(op, r, a - (emitLoc + 1), pc, c);
+}
+
+static void emitPush(char* c)
+{
+	emitRM("ST", ac, 0, sp, c);
+	emitRM("LDA", sp, -1, sp, "");
+}
+
+static void emitPop(int r, char* c)
+{
+	emitRM("LDA", sp, 1, sp, "");
+	emitRM("LD", r, 0, sp, c);
+}
+
+static int numParams(TreeNode* f)
+{
+	TreeNode* p;
+	int n = 0;
+	for (p = f->child[0]; p != NULL; p = p->sibling)
+		if (!isVoidParam(p))
+			n++;
+	return n;
+}
+
+/* fp-relative offset of local slot m of the current function */
+static int tmOffset(TreeNode* d)
+{
+	int n = numParams(tmFunc);
+	return d->memloc < n ? 2 + d->memloc : d->memloc - tmFunc->framesize;
+}
+
+static void tmGenExp(TreeNode* t);
+static void tmGenList(TreeNode* t);
+
+/* leave in ac the address of the first element of array d */
+static void tmArrayBase(TreeNode* d)
+{
+	if (d->paramCheck)
+		emitRM("LD", ac, tmOffset(d), fpr, "load array parameter");
+	else if (d->level)
+		emitRM("LDA", ac, tmOffset(d), fpr, "local array address");
+	else
+		emitRM("LDA", ac, d->memloc, gp, "global array address");
+}
+
+/* leave in ac the address of element t->child[0] of the array named by t */
+static void tmElementAddress(TreeNode* t)
+{
+	tmArrayBase(t->decl);
+	emitPush("push array base");
+	tmGenExp(t->child[0]);
+	emitPop(ac1, "pop array base");
+	emitRO("ADD", ac, ac1, ac, "element address");
+}
+
+static void tmEpilogue(void)
+{
+	emitRM("LDA", sp, numParams(tmFunc) + 1, fpr, "pop activation record");
+	emitRM("LD", ac1, 1, fpr, "load return address");
+	emitRM("LD", fpr, 0, fpr, "restore caller fp");
+	emitRM("LDA", pc, 0, ac1, "return");
+}
+
+static void tmCall(TreeNode* t)
+{
+	TreeNode* f = t->decl;
+	TreeNode* a;
+	int n, i = 0;
+
+	if (f == inputDecl) {
+		emitRO("IN", ac, 0, 0, "input()");
+		return;
+	}
+	if (f == outputDecl) {
+		if (t->child[0] != NULL)
+			tmGenExp(t->child[0]);
+		emitRO("OUT", ac, 0, 0, "output()");
+		return;
+	}
+	n = numParams(f);
+	emitComment("-> call");
+	if (n > 0)
+		emitRM("LDA", sp, -n, sp, "reserve parameters");
+	for (a = t->child[0]; a != NULL; a = a->sibling, i++) {
+		tmGenExp(a);
+		if (i < n)
+			emitRM("ST", ac, i + 1, sp, "store argument");
+	}
+	emitRM("ST", fpr, -1, sp, "save fp");
+	emitRM("LDA", fpr, -1, sp, "new frame");
+	emitRM("LDA", ac, 2, pc, "return address");
+	emitRM("ST", ac, 1, fpr, "store return address");
+	if (tmNumPatches == tmPatchCapacity) {
+		tmPatchCapacity = tmPatchCapacity ? tmPatchCapacity * 2 : 64;
+		tmPatches = (TMCallPatch*)realloc(tmPatches, tmPatchCapacity * sizeof(TMCallPatch));
+		if (tmPatches == NULL) {
+			fprintf(fpOut, "Out of memory error at line %d\n", t->lineno);
+			exit(EXIT_FAILURE);
+		}
+	}
+	tmPatches[tmNumPatches].loc = emitSkip(1);
+	tmPatches[tmNumPatches++].func = f;
+	emitComment("<- call");
+}
+
+static void tmGenExp(TreeNode* t)
+{
+	TreeNode* d;
+
+	if (t->nodekind == StmtK) {
+		tmCall(t);
+		return;
+	}
+	switch (t->kind.exp) {
+	case ConstK:
+		emitRM("LDC", ac, t->attr.val, 0, "load const");
+		break;
+	case IdK:
+		d = t->decl;
+		if (t->child[0] != NULL) {
+			tmElementAddress(t);
+			emitRM("LD", ac, 0, ac, "load array element");
+		}
+		else if (d->kind.exp == VarArrayDeclK)
+			tmArrayBase(d);
+		else if (d->level)
+			emitRM("LD", ac, tmOffset(d), fpr, "load local");
+		else
+			emitRM("LD", ac, d->memloc, gp, "load global");
+		break;
+	case AssignK:
+		emitComment("-> assign");
+		d = t->child[0]->decl;
+		if (t->child[0]->child[0] != NULL) {
+			tmElementAddress(t->child[0]);
+			emitPush("push element address");
+			tmGenExp(t->child[1]);
+			emitPop(ac1, "pop element address");
+			emitRM("ST", ac, 0, ac1, "assign: store array element");
+		}
+		else {
+			tmGenExp(t->child[1]);
+			if (d->level)
+				emitRM("ST", ac, tmOffset(d), fpr, "assign: store local");
+			else
+				emitRM("ST", ac, d->memloc, gp, "assign: store global");
+		}
+		emitComment("<- assign");
+		break;
+	case OpK:
+		emitComment("-> Op");
+		tmGenExp(t->child[0]);
+		if (t->attr.op == SHL || t->attr.op == SHR) {
+			/* TM has no shifts: multiply or divide by the power of two */
+			emitRM("LDC", ac1, 1 << t->child[1]->attr.val, 0, "load power of two");
+			if (t->attr.op == SHL)
+				emitRO("MUL", ac, ac, ac1, "op <<");
+			else
+				emitRO("DIV", ac, ac, ac1, "op >>");
+			emitComment("<- Op");
+			break;
+		}
+		emitPush("op: push left");
+		tmGenExp(t->child[1]);
+		emitPop(ac1, "op: load left");
+		switch (t->attr.op) {
+		case PLUS: emitRO("ADD", ac, ac1, ac, "op +"); break;
+		case MINUS: emitRO("SUB", ac, ac1, ac, "op -"); break;
+		case MUL: emitRO("MUL", ac, ac1, ac, "op *"); break;
+		case DIV: emitRO("DIV", ac, ac1, ac, "op /"); break;
+		default:
+			emitRO("SUB", ac, ac1, ac, "op compare");
+			switch (t->attr.op) {
+			case LT: emitRM("JLT", ac, 2, pc, "br if true"); break;
+			case LE: emitRM("JLE", ac, 2, pc, "br if true"); break;
+			case GT: emitRM("JGT", ac, 2, pc, "br if true"); break;
+			case GE: emitRM("JGE", ac, 2, pc, "br if true"); break;
+			case EQ: emitRM("JEQ", ac, 2, pc, "br if true"); break;
+			default: emitRM("JNE", ac, 2, pc, "br if true"); break;
+			}
+			emitRM("LDC", ac, 0, ac, "false case");
+			emitRM("LDA", pc, 1, pc, "unconditional jmp");
+			emitRM("LDC", ac, 1, ac, "true case");
+			break;
+		}
+		emitComment("<- Op");
+		break;
+	default:
+		break;
+	}
+}
+
+static void tmGenList(TreeNode* t)
+{
+	int savedLoc1, savedLoc2, currentLoc;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == ExpK) {
+			if (t->kind.exp != VarDeclK && t->kind.exp != VarArrayDeclK)
+				tmGenExp(t);
+			continue;
+		}
+		switch (t->kind.stmt) {
+		case CompoundK:
+			tmGenList(t->child[1]);
+			break;
+		case SelectionK:
+			emitComment("-> if");
+			tmGenExp(t->child[0]);
+			savedLoc1 = emitSkip(1);
+			emitComment("if: jump to else belongs here");
+			tmGenList(t->child[1]);
+			savedLoc2 = emitSkip(1);
+			emitComment("if: jump to end belongs here");
+			currentLoc = emitSkip(0);
+			emitBackup(savedLoc1);
+			emitRM_Abs("JEQ", ac, currentLoc, "if: jmp to else");
+			emitRestore();
+			tmGenList(t->child[2]);
+			currentLoc = emitSkip(0);
+			emitBackup(savedLoc2);
+			emitRM_Abs("LDA", pc, currentLoc, "jmp to end");
+			emitRestore();
+			emitComment("<- if");
+			break;
+		case IterationK:
+			emitComment("-> while");
+			savedLoc1 = emitSkip(0);
+			tmGenExp(t->child[0]);
+			savedLoc2 = emitSkip(1);
+			emitComment("while: jump to end belongs here");
+			tmGenList(t->child[1]);
+			emitRM_Abs("LDA", pc, savedLoc1, "while: jmp back to test");
+			currentLoc = emitSkip(0);
+			emitBackup(savedLoc2);
+			emitRM_Abs("JEQ", ac, currentLoc, "while: jmp to end");
+			emitRestore();
+			emitComment("<- while");
+			break;
+		case ReturnK:
+			emitComment("-> return");
+			if (t->child[0] != NULL)
+				tmGenExp(t->child[0]);
+			tmEpilogue();
+			emitComment("<- return");
+			break;
+		case CallK:
+			tmCall(t);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* locals start at zero, as in the other back ends: a few are cleared
+   one by one, more by a loop from fp-n up to fp */
+static void tmClearLocals(int n)
+{
+	int i;
+
+	if (n <= 8) {
+		for (i = 1; i <= n; i++)
+			emitRM("ST", gp, -i, fpr, "clear local");
+		return;
+	}
+	emitRM("LDA", ac, -n, fpr, "first local");
+	emitRM("ST", gp, 0, ac, "clear local");
+	emitRM("LDA", ac, 1, ac, "next local");
+	emitRO("SUB", ac1, ac, fpr, "locals left");
+	emitRM("JLT", ac1, -4, pc, "br if more");
+}
+
+void codeGen(TreeNode* syntaxTree, char* codefile)
+{
+	TreeNode* t;
+	TreeNode mainCall;
+	char s[BUFLEN];
+	int i, entry;
+
+	codeFile = fopen(codefile, "w");
+	if (codeFile == NULL) {
+		fprintf(stderr, "Unable to open %s\n", codefile);
+		exit(1);
+	}
+	emitLoc = highEmitLoc = tmNumPatches = 0;
+	sprintf(s, "File: %.200s", codefile);
+	emitComment("C- Compilation to TM Code");
+	emitComment(s);
+	/* generate standard prelude */
+	emitComment("Standard prelude:");
+	emitRM("LD", sp, 0, ac, "load maxaddress from location 0");
+	emitRM("ST", ac, 0, ac, "clear location 0");
+	emitComment("End of standard prelude.");
+	entry = emitSkip(1);
+
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK) {
+			sprintf(s, "-> function %.200s", t->attr.name);
+			emitComment(s);
+			tmFunc = t;
+			t->memloc = emitSkip(0);
+			emitRM("LDA", sp, -(t->framesize - numParams(t)) - 1, fpr, "reserve locals");
+			tmClearLocals(t->framesize - numParams(t));
+			tmGenList(t->child[1]);
+			emitRM("LDC", ac, 0, 0, "default return value");
+			tmEpilogue();
+			sprintf(s, "<- function %.200s", t->attr.name);
+			emitComment(s);
+		}
+
+	/* call main() and stop */
+	i = emitSkip(0);
+	emitBackup(entry);
+	emitRM_Abs("LDA", pc, i, "jump to startup code");
+	emitRestore();
+	memset(&mainCall, 0, sizeof(mainCall));
+	mainCall.nodekind = StmtK;
+	mainCall.kind.stmt = CallK;
+	mainCall.decl = findMain(syntaxTree);
+	if (mainCall.decl != NULL)
+		tmCall(&mainCall);
+	emitRO("HALT", 0, 0, 0, "");
+
+	/* fill in the call targets */
+	for (i = 0; i < tmNumPatches; i++) {
+		emitBackup(tmPatches[i].loc);
+		emitRM("LDC", pc, tmPatches[i].func->memloc, 0, "jump to function");
+	}
+	emitRestore();
+	emitComment("End of execution.");
+	fclose(codeFile);
+}
+
+#undef ac
+#undef ac1
+#undef sp
+#undef fpr
+#undef gp
+#undef pc
+
+
+/*********************************************/
+/************x86-64 code generator************/
+/*********************************************/
+
+/* Emits GNU as (AT&T syntax) for x86-64 Linux. The output is a complete
+   program: the runtime (_start, buffered input/output on raw system
+   calls) is appended, so "as -o p.o p.s && ld -o p p.o" builds it.
+
+   Functions follow the System V calling convention. Every variable slot
+   and array element is 8 bytes wide; values are 32-bit ints kept in the
+   low half. Expression temporaries live in the callee-saved registers
+   rbx, r12-r15, indexed by expression depth, so they survive calls and
+   only the ones a function uses are saved in its prologue. Right-hand
+   operands that are constants or scalar variables are used directly as
+   immediates or memory operands. */
+
+#define NPOOL 5
+
+static char* pool64[NPOOL] = { "%rbx", "%r12", "%r13", "%r14", "%r15" };
+static char* pool32[NPOOL] = { "%ebx", "%r12d", "%r13d", "%r14d", "%r15d" };
+static char* arg64[6] = { "%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9" };
+static char* arg32[6] = { "%edi", "%esi", "%edx", "%ecx", "%r8d", "%r9d" };
+
+static FILE* asmFile = NULL;
+static char* asmBuf = NULL;     // body of the function being generated
+static int asmLen = 0, asmCapacity = 0;
+static int labelCount = 0;
+static int poolUsed = 0;        // registers of the pool used by the function
+static int pushDepth = 0;       // 8-byte words pushed since the prologue
+static TreeNode* x86Func = NULL;
+
+static void asmEmit(const char* fmt, ...)
+{
+	va_list args;
+	int n;
+
+	for (;;) {
+		va_start(args, fmt);
+		n = vsnprintf(asmBuf + asmLen, asmCapacity - asmLen, fmt, args);
+		va_end(args);
+		if (n >= 0 && asmLen + n < asmCapacity)
+			break;
+		asmCapacity = asmCapacity ? asmCapacity * 2 : 65536;
+		asmBuf = (char*)realloc(asmBuf, asmCapacity);
+		if (asmBuf == NULL) {
+			fprintf(fpOut, "Out of memory error\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	asmLen += n;
+}
+
+static char* poolReg(int d, int wide)
+{
+	if (d + 1 > poolUsed)
+		poolUsed = d + 1;
+	return wide ? pool64[d] : pool32[d];
+}
+
+/* rbp-relative offset of slot m of the current function */
+static int x86Offset(TreeNode* d)
+{
+	return -8 * (x86Func->framesize - d->memloc);
+}
+
+/* operand text of a constant or scalar variable; FALSE for anything else */
+static int x86Operand(TreeNode* t, char* buf)
+{
+	TreeNode* d;
+
+	if (t->nodekind != ExpK)
+		return FALSE;
+	if (t->kind.exp == ConstK) {
+		sprintf(buf, "$%d", t->attr.val);
+		return TRUE;
+	}
+	if (t->kind.exp != IdK || t->child[0] != NULL)
+		return FALSE;
+	d = t->decl;
+	if (d->kind.exp == VarArrayDeclK)
+		return FALSE;
+	if (d->level)
+		sprintf(buf, "%d(%%rbp)", x86Offset(d));
+	else
+		sprintf(buf, "%.100s(%%rip)", d->attr.name);
+	return TRUE;
+}
+
+/* leave the address of the first element of array d in %rax */
+static void x86ArrayBase(TreeNode* d)
+{
+	if (d->paramCheck)
+		asmEmit("\tmovq %d(%%rbp), %%rax\n", x86Offset(d));
+	else if (d->level)
+		asmEmit("\tleaq %d(%%rbp), %%rax\n", x86Offset(d));
+	else
+		asmEmit("\tleaq %s(%%rip), %%rax\n", d->attr.name);
+}
+
+static void x86GenExp(TreeNode* t, int d);
+
+/* evaluate b into a register for depth d+1, spilling R[d] when the pool
+   is exhausted; returns the 32-bit register holding b */
+static char* x86GenSecond(TreeNode* b, int d)
+{
+	if (d + 1 < NPOOL) {
+		x86GenExp(b, d + 1);
+		return poolReg(d + 1, FALSE);
+	}
+	asmEmit("\tpushq %s\n", poolReg(d, TRUE));
+	pushDepth++;
+	x86GenExp(b, d);
+	asmEmit("\tmovl %s, %%ecx\n", poolReg(d, FALSE));
+	asmEmit("\tpopq %s\n", poolReg(d, TRUE));
+	pushDepth--;
+	return "%ecx";
+}
+
+static void x86Call(TreeNode* t, int d)
+{
+	TreeNode* f = t->decl;
+	TreeNode* a;
+	int n = 0, nstack, pad, i, pushed = 0;
+
+	if (f == inputDecl) {
+		asmEmit("\tcall cminus_input\n");
+		asmEmit("\tmovl %%eax, %s\n", poolReg(d, FALSE));
+		return;
+	}
+	if (f == outputDecl) {
+		if (t->child[0] != NULL) {
+			x86GenExp(t->child[0], d);
+			asmEmit("\tmovl %s, %%edi\n", poolReg(d, FALSE));
+		}
+		if (pushDepth % 2)
+			asmEmit("\tsubq $8, %%rsp\n");
+		asmEmit("\tcall cminus_output\n");
+		if (pushDepth % 2)
+			asmEmit("\taddq $8, %%rsp\n");
+		return;
+	}
+	for (a = t->child[0]; a != NULL; a = a->sibling)
+		n++;
+	nstack = n > 6 ? n - 6 : 0;
+	/* rsp must be a multiple of 16 at the call */
+	pad = (pushDepth + nstack) % 2;
+	if (pad + nstack > 0) {
+		asmEmit("\tsubq $%d, %%rsp\n", 8 * (pad + nstack));
+		pushDepth += pad + nstack;
+	}
+	for (a = t->child[0], i = 0; a != NULL; a = a->sibling, i++) {
+		x86GenExp(a, d);
+		if (i < 6) {
+			asmEmit("\tpushq %s\n", poolReg(d, TRUE));
+			pushDepth++;
+			pushed++;
+		}
+		else
+			asmEmit("\tmovq %s, %d(%%rsp)\n", poolReg(d, TRUE), 8 * (i - 6 + pushed));
+	}
+	for (i = pushed - 1; i >= 0; i--)
+		asmEmit("\tpopq %s\n", arg64[i]);
+	pushDepth -= pushed;
+	asmEmit("\tcall %s\n", f->attr.name);
+	if (pad + nstack > 0) {
+		asmEmit("\taddq $%d, %%rsp\n", 8 * (pad + nstack));
+		pushDepth -= pad + nstack;
+	}
+	asmEmit("\tmovl %%eax, %s\n", poolReg(d, FALSE));
+}
+
+static char* setcc(TokenType op)
+{
+	switch (op) {
+	case LT: return "l";
+	case LE: return "le";
+	case GT: return "g";
+	case GE: return "ge";
+	case EQ: return "e";
+	default: return "ne";
+	}
+}
+
+/* condition code for the negation of op */
+static char* setccNot(TokenType op)
+{
+	switch (op) {
+	case LT: return "ge";
+	case LE: return "g";
+	case GT: return "le";
+	case GE: return "l";
+	case EQ: return "ne";
+	default: return "e";
+	}
+}
+
+/* compare the operands of relational node t, leaving the flags set */
+static void x86Compare(TreeNode* t, int d)
+{
+	char operand[128];
+
+	x86GenExp(t->child[0], d);
+	if (x86Operand(t->child[1], operand))
+		asmEmit("\tcmpl %s, %s\n", operand, poolReg(d, FALSE));
+	else
+		asmEmit("\tcmpl %s, %s\n", x86GenSecond(t->child[1], d), poolReg(d, FALSE));
+}
+
+static void x86GenExp(TreeNode* t, int d)
+{
+	char operand[128];
+	char* r = poolReg(d, FALSE);
+	char* r2;
+	TreeNode* v;
+
+	if (t->nodekind == StmtK) {
+		x86Call(t, d);
+		return;
+	}
+	switch (t->kind.exp) {
+	case ConstK:
+		asmEmit("\tmovl $%d, %s\n", t->attr.val, r);
+		break;
+	case IdK:
+		v = t->decl;
+		if (x86Operand(t, operand))
+			asmEmit("\tmovl %s, %s\n", operand, r);
+		else if (t->child[0] == NULL) {
+			/* array passed as an argument: its address */
+			x86ArrayBase(v);
+			asmEmit("\tmovq %%rax, %s\n", poolReg(d, TRUE));
+		}
+		else {
+			x86GenExp(t->child[0], d);
+			asmEmit("\tmovslq %s, %s\n", r, poolReg(d, TRUE));
+			x86ArrayBase(v);
+			asmEmit("\tmovl (%%rax,%s,8), %s\n", poolReg(d, TRUE), r);
+		}
+		break;
+	case AssignK:
+		v = t->child[0]->decl;
+		if (t->child[0]->child[0] == NULL) {
+			x86GenExp(t->child[1], d);
+			if (v->level)
+				asmEmit("\tmovl %s, %d(%%rbp)\n", r, x86Offset(v));
+			else
+				asmEmit("\tmovl %s, %s(%%rip)\n", r, v->attr.name);
+		}
+		else {
+			x86GenExp(t->child[0]->child[0], d);
+			asmEmit("\tmovslq %s, %s\n", r, poolReg(d, TRUE));
+			if (x86Operand(t->child[1], operand) && t->child[1]->kind.exp == ConstK) {
+				x86ArrayBase(v);
+				asmEmit("\tmovl %s, (%%rax,%s,8)\n", operand, poolReg(d, TRUE));
+				asmEmit("\tmovl %s, %s\n", operand, r);
+			}
+			else {
+				r2 = x86GenSecond(t->child[1], d);
+				x86ArrayBase(v);
+				asmEmit("\tmovl %s, (%%rax,%s,8)\n", r2, poolReg(d, TRUE));
+				asmEmit("\tmovl %s, %s\n", r2, r);
+			}
+		}
+		break;
+	case OpK:
+		if (isRelop(t)) {
+			x86Compare(t, d);
+			asmEmit("\tset%s %%al\n", setcc(t->attr.op));
+			asmEmit("\tmovzbl %%al, %s\n", r);
+			break;
+		}
+		x86GenExp(t->child[0], d);
+		if (t->attr.op == SHL) {
+			asmEmit("\tsall $%d, %s\n", t->child[1]->attr.val, r);
+			break;
+		}
+		if (t->attr.op == SHR) {
+			/* round toward zero: add 2^k-1 to negative values first */
+			asmEmit("\tmovl %s, %%eax\n", r);
+			asmEmit("\tsarl $31, %%eax\n");
+			asmEmit("\tshrl $%d, %%eax\n", 32 - t->child[1]->attr.val);
+			asmEmit("\taddl %%eax, %s\n", r);
+			asmEmit("\tsarl $%d, %s\n", t->child[1]->attr.val, r);
+			break;
+		}
+		if (t->attr.op == DIV) {
+			r2 = x86GenSecond(t->child[1], d);
+			if (strcmp(r2, "%ecx") != 0)
+				asmEmit("\tmovl %s, %%ecx\n", r2);
+			asmEmit("\tmovl %s, %%eax\n", r);
+			asmEmit("\tcltd\n");
+			asmEmit("\tidivl %%ecx\n");
+			asmEmit("\tmovl %%eax, %s\n", r);
+			break;
+		}
+		if (!x86Operand(t->child[1], operand))
+			strcpy(operand, x86GenSecond(t->child[1], d));
+		switch (t->attr.op) {
+		case PLUS: asmEmit("\taddl %s, %s\n", operand, r); break;
+		case MINUS: asmEmit("\tsubl %s, %s\n", operand, r); break;
+		default: asmEmit("\timull %s, %s\n", operand, r); break;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/* jump to label when cond is true (when) or false (!when) */
+static void x86Branch(TreeNode* cond, int when, int label)
+{
+	if (isRelop(cond)) {
+		x86Compare(cond, 0);
+		asmEmit("\tj%s .L%d\n", when ? setcc(cond->attr.op) : setccNot(cond->attr.op), label);
+		return;
+	}
+	x86GenExp(cond, 0);
+	asmEmit("\ttestl %s, %s\n", poolReg(0, FALSE), poolReg(0, FALSE));
+	asmEmit("\tj%s .L%d\n", when ? "ne" : "e", label);
+}
+
+static void x86GenList(TreeNode* t)
+{
+	int l1, l2;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == ExpK) {
+			if (t->kind.exp != VarDeclK && t->kind.exp != VarArrayDeclK)
+				x86GenExp(t, 0);
+			continue;
+		}
+		switch (t->kind.stmt) {
+		case CompoundK:
+			x86GenList(t->child[1]);
+			break;
+		case SelectionK:
+			l1 = labelCount++;
+			x86Branch(t->child[0], FALSE, l1);
+			x86GenList(t->child[1]);
+			if (t->child[2] != NULL) {
+				l2 = labelCount++;
+				asmEmit("\tjmp .L%d\n", l2);
+				asmEmit(".L%d:\n", l1);
+				x86GenList(t->child[2]);
+				asmEmit(".L%d:\n", l2);
+			}
+			else
+				asmEmit(".L%d:\n", l1);
+			break;
+		case IterationK:
+			l1 = labelCount++;
+			l2 = labelCount++;
+			asmEmit("\tjmp .L%d\n", l2);
+			asmEmit(".L%d:\n", l1);
+			x86GenList(t->child[1]);
+			asmEmit(".L%d:\n", l2);
+			x86Branch(t->child[0], TRUE, l1);
+			break;
+		case ReturnK:
+			if (t->child[0] != NULL) {
+				x86GenExp(t->child[0], 0);
+				asmEmit("\tmovl %s, %%eax\n", poolReg(0, FALSE));
+			}
+			else
+				asmEmit("\txorl %%eax, %%eax\n");
+			asmEmit("\tjmp .Lret_%s\n", x86Func->attr.name);
+			break;
+		case CallK:
+			x86Call(t, 0);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void x86Function(TreeNode* f)
+{
+	TreeNode* p;
+	int frame, i = 0;
+
+	x86Func = f;
+	asmLen = 0;
+	poolUsed = pushDepth = 0;
+	x86GenList(f->child[1]);
+
+	/* the frame and the saved registers keep rsp 16-byte aligned */
+	frame = 8 * f->framesize;
+	if ((frame + 8 * poolUsed) % 16)
+		frame += 8;
+	fprintf(asmFile, "\n\t.globl %s\n\t.type %s, @function\n%s:\n", f->attr.name, f->attr.name, f->attr.name);
+	fprintf(asmFile, "\tpushq %%rbp\n\tmovq %%rsp, %%rbp\n");
+	if (frame > 0)
+		fprintf(asmFile, "\tsubq $%d, %%rsp\n", frame);
+	/* locals start at zero, as in the other back ends; rdi and rcx
+	   hold arguments, so rep stosq keeps them in r10 and r11 */
+	if (frame > 32)
+		fprintf(asmFile, "\tmovq %%rdi, %%r10\n\tmovq %%rcx, %%r11\n\txorl %%eax, %%eax\n"
+			"\tmovq %%rsp, %%rdi\n\tmovl $%d, %%ecx\n\trep stosq\n"
+			"\tmovq %%r10, %%rdi\n\tmovq %%r11, %%rcx\n", frame / 8);
+	else
+		for (i = 8; i <= frame; i += 8)
+			fprintf(asmFile, "\tmovq $0, %d(%%rbp)\n", -i);
+	for (i = 0; i < poolUsed; i++)
+		fprintf(asmFile, "\tpushq %s\n", pool64[i]);
+	i = 0;
+	for (p = f->child[0]; p != NULL; p = p->sibling) {
+		if (isVoidParam(p))
+			continue;
+		if (i < 6)
+			fprintf(asmFile, "\tmov%c %s, %d(%%rbp)\n", p->paramCheck && p->kind.exp == VarArrayDeclK ? 'q' : 'l',
+				p->kind.exp == VarArrayDeclK ? arg64[i] : arg32[i], x86Offset(p));
+		else
+			fprintf(asmFile, "\tmovq %d(%%rbp), %%rax\n\tmovq %%rax, %d(%%rbp)\n", 16 + 8 * (i - 6), x86Offset(p));
+		i++;
+	}
+	fwrite(asmBuf, 1, asmLen, asmFile);
+	fprintf(asmFile, "\txorl %%eax, %%eax\n");
+	fprintf(asmFile, ".Lret_%s:\n", f->attr.name);
+	if (poolUsed > 0) {
+		fprintf(asmFile, "\tleaq %d(%%rbp), %%rsp\n", -frame - 8 * poolUsed);
+		for (i = poolUsed - 1; i >= 0; i--)
+			fprintf(asmFile, "\tpopq %s\n", pool64[i]);
+	}
+	fprintf(asmFile, "\tleave\n\tret\n");
+}
+
+/* startup code and input/output runtime */
+static const char* x86Runtime =
+	"\n\t.globl _start\n"
+	"_start:\n"
+	"\txorl %ebp, %ebp\n"
+	"\tcall main\n"
+	"\tcall cminus_flush\n"
+	"\tmovl $60, %eax\n"
+	"\txorl %edi, %edi\n"
+	"\tsyscall\n"
+	"\n# next input byte in eax, -1 at end of input\n"
+	"cminus_getc:\n"
+	"\tmovl cminus_inpos(%rip), %eax\n"
+	"\tcmpl cminus_inlen(%rip), %eax\n"
+	"\tjl 1f\n"
+	"\txorl %eax, %eax\n"
+	"\txorl %edi, %edi\n"
+	"\tleaq cminus_inbuf(%rip), %rsi\n"
+	"\tmovl $65536, %edx\n"
+	"\tsyscall\n"
+	"\ttestq %rax, %rax\n"
+	"\tjle 2f\n"
+	"\tmovl %eax, cminus_inlen(%rip)\n"
+	"\txorl %eax, %eax\n"
+	"1:\tleaq cminus_inbuf(%rip), %rdx\n"
+	"\tmovzbl (%rdx,%rax), %ecx\n"
+	"\tincl %eax\n"
+	"\tmovl %eax, cminus_inpos(%rip)\n"
+	"\tmovl %ecx, %eax\n"
+	"\tret\n"
+	"2:\tmovl $-1, %eax\n"
+	"\tret\n"
+	"\n# int input(void)\n"
+	"\t.globl cminus_input\n"
+	"cminus_input:\n"
+	"\tpushq %rbx\n"
+	"\tpushq %r12\n"
+	"\tpushq %r13\n"
+	"\txorl %ebx, %ebx\n"
+	"\txorl %r12d, %r12d\n"
+	"1:\tcall cminus_getc\n"
+	"\tcmpl $32, %eax\n"
+	"\tje 1b\n"
+	"\tcmpl $9, %eax\n"
+	"\tje 1b\n"
+	"\tcmpl $10, %eax\n"
+	"\tje 1b\n"
+	"\tcmpl $13, %eax\n"
+	"\tje 1b\n"
+	"\tcmpl $45, %eax\n"
+	"\tjne 2f\n"
+	"\tmovl $1, %r12d\n"
+	"\tcall cminus_getc\n"
+	"2:\tsubl $48, %eax\n"
+	"\tcmpl $9, %eax\n"
+	"\tja cminus_badinput\n"
+	"3:\timull $10, %ebx, %ebx\n"
+	"\taddl %eax, %ebx\n"
+	"\tcall cminus_getc\n"
+	"\tsubl $48, %eax\n"
+	"\tcmpl $9, %eax\n"
+	"\tjbe 3b\n"
+	"\tmovl %ebx, %eax\n"
+	"\ttestl %r12d, %r12d\n"
+	"\tje 4f\n"
+	"\tnegl %eax\n"
+	"4:\tpopq %r13\n"
+	"\tpopq %r12\n"
+	"\tpopq %rbx\n"
+	"\tret\n"
+	"cminus_badinput:\n"
+	"\tcall cminus_flush\n"
+	"\tmovl $1, %eax\n"
+	"\tmovl $2, %edi\n"
+	"\tleaq cminus_inmsg(%rip), %rsi\n"
+	"\tmovl $43, %edx\n"
+	"\tsyscall\n"
+	"\tmovl $60, %eax\n"
+	"\tmovl $1, %edi\n"
+	"\tsyscall\n"
+	"\n# void output(int x)\n"
+	"\t.globl cminus_output\n"
+	"cminus_output:\n"
+	"\tcmpl $65500, cminus_outlen(%rip)\n"
+	"\tjl 1f\n"
+	"\tpushq %rdi\n"
+	"\tcall cminus_flush\n"
+	"\tpopq %rdi\n"
+	"1:\tmovl %edi, %eax\n"
+	"\tleaq cminus_numbuf+16(%rip), %rsi\n"
+	"\tmovl $10, %ecx\n"
+	"\ttestl %eax, %eax\n"
+	"\tjns 2f\n"
+	"\tnegl %eax\n"
+	"2:\txorl %edx, %edx\n"
+	"\tdivl %ecx\n"
+	"\taddl $48, %edx\n"
+	"\tdecq %rsi\n"
+	"\tmovb %dl, (%rsi)\n"
+	"\ttestl %eax, %eax\n"
+	"\tjne 2b\n"
+	"\ttestl %edi, %edi\n"
+	"\tjns 3f\n"
+	"\tdecq %rsi\n"
+	"\tmovb $45, (%rsi)\n"
+	"3:\tleaq cminus_numbuf+16(%rip), %rcx\n"
+	"\tleaq cminus_outbuf(%rip), %rdi\n"
+	"\tmovl cminus_outlen(%rip), %eax\n"
+	"\taddq %rax, %rdi\n"
+	"4:\tmovb (%rsi), %dl\n"
+	"\tmovb %dl, (%rdi)\n"
+	"\tincq %rsi\n"
+	"\tincq %rdi\n"
+	"\tcmpq %rcx, %rsi\n"
+	"\tjne 4b\n"
+	"\tmovb $10, (%rdi)\n"
+	"\tincq %rdi\n"
+	"\tleaq cminus_outbuf(%rip), %rcx\n"
+	"\tsubq %rcx, %rdi\n"
+	"\tmovl %edi, cminus_outlen(%rip)\n"
+	"\tret\n"
+	"\n# write the output buffer to stdout\n"
+	"cminus_flush:\n"
+	"\tleaq cminus_outbuf(%rip), %rsi\n"
+	"1:\tmovl cminus_outlen(%rip), %edx\n"
+	"\ttestl %edx, %edx\n"
+	"\tjle 2f\n"
+	"\tmovl $1, %eax\n"
+	"\tmovl $1, %edi\n"
+	"\tsyscall\n"
+	"\ttestq %rax, %rax\n"
+	"\tjle 2f\n"
+	"\taddq %rax, %rsi\n"
+	"\tsubl %eax, cminus_outlen(%rip)\n"
+	"\tjmp 1b\n"
+	"2:\tmovl $0, cminus_outlen(%rip)\n"
+	"\tret\n"
+	"\n\t.section .rodata\n"
+	"cminus_inmsg:\n"
+	"\t.ascii \"Runtime error: input() expects an integer\\n\"\n"
+	"\n\t.bss\n"
+	"\t.align 8\n"
+	"cminus_inbuf:\t.zero 65536\n"
+	"cminus_outbuf:\t.zero 65536\n"
+	"cminus_numbuf:\t.zero 16\n"
+	"cminus_inpos:\t.zero 4\n"
+	"cminus_inlen:\t.zero 4\n"
+	"cminus_outlen:\t.zero 4\n"
+	"\n\t.section .note.GNU-stack,\"\",@progbits\n";
+
+void x86Gen(TreeNode* syntaxTree, char* asmfile)
+{
+	TreeNode* t;
+
+	asmFile = fopen(asmfile, "w");
+	if (asmFile == NULL) {
+		fprintf(stderr, "Unable to open %s\n", asmfile);
+		exit(1);
+	}
+	fprintf(asmFile, "# C- compilation to x86-64: %s\n", asmfile);
+	fprintf(asmFile, "\t.text\n");
+	labelCount = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK)
+			x86Function(t);
+	fputs(x86Runtime, asmFile);
+
+	fprintf(asmFile, "\n\t.bss\n\t.align 8\n");
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp != FuncDeclK)
+			fprintf(asmFile, "\t.globl %s\n%s:\t.zero %d\n", t->attr.name, t->attr.name,
+				8 * (t->kind.exp == VarArrayDeclK ? t->arraysize : 1));
+	fclose(asmFile);
+}
+
+
+/*********************************************/
+/***************C code generator**************/
+/*********************************************/
+
+/* Writes the program as portable C for the host compiler. Every C- name
+   gets a "cm_" prefix (C- names cannot contain '_'), so nothing clashes
+   with C keywords or the runtime. Variables start at zero like in the
+   interpreter. #line directives map every statement back to the C-
+   source, so compiler messages and debuggers point at the original.
+   C leaves the order of operands and arguments open; where one of them
+   has side effects the others are first stored in temporaries t_1, t_2,
+   ... by comma expressions, so everything is evaluated left to right as
+   in the other back ends. */
+
+static FILE* cFile = NULL;
+static char* cSource = NULL;    // C- file name for #line
+static int cIndent = 0;
+static TreeNode* cFunc = NULL; // function being written
+static int cTemp = 0;           // temporaries used in the current statement
+
+/* s as the inside of a C string literal */
+static void cString(const char* s)
+{
+	int prev = 0;
+
+	for (; *s != '\0'; prev = *s++) {
+		if (*s == '"' || *s == '\\' || *s == '?')
+			fprintf(cFile, "\\%c", *s);
+		else if (!isprint((unsigned char)*s) || (*s == '/' && prev == '*'))
+			fprintf(cFile, "\\%03o", (unsigned char)*s);  /* after a star it would end the header comment */
+		else
+			fputc(*s, cFile);
+	}
+}
+
+static void cLine(TreeNode* t)
+{
+	fprintf(cFile, "#line %d \"", t->lineno);
+	cString(cSource);
+	fprintf(cFile, "\"\n");
+}
+
+static void cSpaces(void)
+{
+	int i;
+	for (i = 0; i < cIndent; i++)
+		fputc('\t', cFile);
+}
+
+static void cExp(TreeNode* t);
+
+static int cParams(TreeNode* f)
+{
+	TreeNode* p = f->child[0];
+	int n = 0;
+
+	if (p != NULL && isVoidParam(p))
+		return 0;
+	for (; p != NULL; p = p->sibling)
+		n++;
+	return n;
+}
+
+/* constants and array addresses: the same value whenever evaluated */
+static int cInert(TreeNode* t)
+{
+	return t->nodekind == ExpK && (t->kind.exp == ConstK || (t->kind.exp == IdK
+		&& t->child[0] == NULL && t->decl->kind.exp == VarArrayDeclK));
+}
+
+/* TRUE when t calls a function or assigns */
+static int cEffects(TreeNode* t)
+{
+	int i;
+
+	if (t == NULL)
+		return FALSE;
+	if (t->nodekind == StmtK || t->kind.exp == AssignK)
+		return TRUE;
+	for (i = 0; i < MAXCHILDREN; i++)
+		if (cEffects(t->child[i]))
+			return TRUE;
+	return FALSE;
+}
+
+/* the operands of t in source order: both sides of an operator, the
+   subscript and the value of an assignment, the arguments of a call */
+static TreeNode* cFirst(TreeNode* t)
+{
+	if (t->nodekind == StmtK)
+		return t->child[0];
+	if (t->kind.exp == AssignK)
+		return t->child[0]->child[0] != NULL ? t->child[0]->child[0] : t->child[1];
+	if (t->kind.exp == OpK && t->attr.op != SHL && t->attr.op != SHR)
+		return t->child[0];
+	return NULL;
+}
+
+static TreeNode* cNext(TreeNode* t, TreeNode* a)
+{
+	if (t->nodekind == StmtK)
+		return a->sibling;
+	return a == t->child[1] ? NULL : t->child[1];
+}
+
+/* TRUE when an operand of t has side effects another one could see */
+static int cSequenced(TreeNode* t)
+{
+	TreeNode* a, * b;
+
+	for (a = cFirst(t); a != NULL; a = cNext(t, a))
+		if (cEffects(a))
+			for (b = cFirst(t); b != NULL; b = cNext(t, b))
+				if (b != a && !cInert(b))
+					return TRUE;
+	return FALSE;
+}
+
+/* TRUE when a, the i-th operand of a sequenced t, goes to a temporary:
+   all but the last one, except surplus arguments, which are only
+   evaluated */
+static int cCaptured(TreeNode* t, TreeNode* a, int i)
+{
+	if (cInert(a) || cNext(t, a) == NULL)
+		return FALSE;
+	return t->nodekind == ExpK || i < cParams(t->decl);
+}
+
+/* number of temporaries cExp(t) uses */
+static int cTemps(TreeNode* t)
+{
+	TreeNode* a;
+	int n = 0, i;
+
+	for (i = 0; i < MAXCHILDREN; i++)
+		for (a = t->child[i]; a != NULL; a = a->sibling)
+			n += cTemps(a);
+	if (cSequenced(t))
+		for (a = cFirst(t), i = 0; a != NULL; a = cNext(t, a), i++)
+			if (cCaptured(t, a, i))
+				n++;
+	return n;
+}
+
+/* store the operands of t that need it in temporaries, each followed by
+   a comma; returns the number of the first one less one */
+static int cCapture(TreeNode* t)
+{
+	TreeNode* a;
+	int first = cTemp, k = cTemp, i;
+
+	/* the nested ones come after the block of t */
+	for (a = cFirst(t), i = 0; a != NULL; a = cNext(t, a), i++)
+		if (cCaptured(t, a, i))
+			cTemp++;
+	for (a = cFirst(t), i = 0; a != NULL; a = cNext(t, a), i++)
+		if (cCaptured(t, a, i)) {
+			fprintf(cFile, "t_%d = ", ++k);
+			cExp(a);
+			fprintf(cFile, ", ");
+		}
+	return first;
+}
+
+/* operand a, the i-th of t: its temporary or the expression itself; temp
+   is the last temporary of t used, -1 when t is not sequenced */
+static void cOperand(TreeNode* t, TreeNode* a, int i, int* temp)
+{
+	if (*temp >= 0 && cCaptured(t, a, i))
+		fprintf(cFile, "t_%d", ++*temp);
+	else
+		cExp(a);
+}
+
+static void cCall(TreeNode* t)
+{
+	TreeNode* f = t->decl;
+	TreeNode* p = f->child[0];
+	TreeNode* a = t->child[0];
+	TreeNode* q;
+	int first = TRUE, nparams = cParams(f), temp = -1, i;
+
+	if (p != NULL && isVoidParam(p))
+		p = NULL;
+	/* surplus arguments are still evaluated, before the call */
+	fputc('(', cFile);
+	if (cSequenced(t))
+		temp = cCapture(t);
+	for (q = a, i = 0; q != NULL; q = q->sibling, i++)
+		if (i >= nparams) {
+			fprintf(cFile, "(void)");
+			cExp(q);
+			fprintf(cFile, ", ");
+		}
+	if (f == inputDecl)
+		fprintf(cFile, "cminus_input(");
+	else if (f == outputDecl)
+		fprintf(cFile, "cminus_output(");
+	else
+		fprintf(cFile, "cm_%s(", f->attr.name);
+	for (i = 0; i < nparams; i++, p = p->sibling) {
+		if (!first)
+			fprintf(cFile, ", ");
+		first = FALSE;
+		if (a != NULL) {
+			cOperand(t, a, i, &temp);
+			a = a->sibling;
+		}
+		else
+			fprintf(cFile, p->kind.exp == VarArrayDeclK ? "(int*)0" : "0");
+	}
+	fprintf(cFile, "))");
+}
+
+static void cExp(TreeNode* t)
+{
+	int temp = -1;
+
+	if (t->nodekind == StmtK) {
+		cCall(t);
+		return;
+	}
+	switch (t->kind.exp) {
+	case ConstK:
+		if (t->attr.val < -2147483647)
+			fprintf(cFile, "(-2147483647 - 1)");
+		else
+			fprintf(cFile, "%d", t->attr.val);
+		break;
+	case IdK:
+		fprintf(cFile, "cm_%s", t->attr.name);
+		if (t->child[0] != NULL) {
+			fputc('[', cFile);
+			cExp(t->child[0]);
+			fputc(']', cFile);
+		}
+		break;
+	case AssignK:
+		fputc('(', cFile);
+		if (cSequenced(t))
+			temp = cCapture(t);
+		if (t->child[0]->child[0] != NULL) {
+			fprintf(cFile, "cm_%s[", t->child[0]->attr.name);
+			cOperand(t, t->child[0]->child[0], 0, &temp);
+			fputc(']', cFile);
+		}
+		else
+			cExp(t->child[0]);
+		fprintf(cFile, " = ");
+		cExp(t->child[1]);
+		fputc(')', cFile);
+		break;
+	case OpK:
+		fputc('(', cFile);
+		if (cSequenced(t))
+			temp = cCapture(t);
+		cOperand(t, t->child[0], 0, &temp);
+		if (t->attr.op == SHL || t->attr.op == SHR) {
+			/* C shifts of negative values are not portable */
+			fprintf(cFile, " %c %d)", t->attr.op == SHL ? '*' : '/', 1 << t->child[1]->attr.val);
+			break;
+		}
+		switch (t->attr.op) {
+		case PLUS: fprintf(cFile, " + "); break;
+		case MINUS: fprintf(cFile, " - "); break;
+		case MUL: fprintf(cFile, " * "); break;
+		case DIV: fprintf(cFile, " / "); break;
+		case LT: fprintf(cFile, " < "); break;
+		case LE: fprintf(cFile, " <= "); break;
+		case GT: fprintf(cFile, " > "); break;
+		case GE: fprintf(cFile, " >= "); break;
+		case EQ: fprintf(cFile, " == "); break;
+		default: fprintf(cFile, " != "); break;
+		}
+		cOperand(t, t->child[1], 1, &temp);
+		fputc(')', cFile);
+		break;
+	default:
+		break;
+	}
+}
+
+static void cVarDecl(TreeNode* t)
+{
+	cSpaces();
+	if (t->kind.exp == VarArrayDeclK)
+		fprintf(cFile, "int cm_%s[%d] = { 0 };\n", t->attr.name, t->arraysize);
+	else
+		fprintf(cFile, "int cm_%s = 0;\n", t->attr.name);
+}
+
+static void cStmt(TreeNode* t);
+
+/* a statement list as a braced block; the body of an int function
+   (ret) returns 0 at its end, like a function running off its end in
+   the interpreter */
+static void cBlock(TreeNode* decls, TreeNode* stmts, int ret)
+{
+	TreeNode* p;
+
+	cSpaces();
+	fprintf(cFile, "{\n");
+	cIndent++;
+	for (p = decls; p != NULL; p = p->sibling) {
+		cLine(p);
+		cVarDecl(p);
+	}
+	for (p = stmts; p != NULL; p = p->sibling)
+		cStmt(p);
+	if (ret) {
+		cSpaces();
+		fprintf(cFile, "return 0;\n");
+	}
+	cIndent--;
+	cSpaces();
+	fprintf(cFile, "}\n");
+}
+
+/* body of if/while: always braced */
+static void cBody(TreeNode* t)
+{
+	if (t != NULL && t->nodekind == StmtK && t->kind.stmt == CompoundK)
+		cBlock(t->child[0], t->child[1], FALSE);
+	else
+		cBlock(NULL, t, FALSE);
+}
+
+static void cPlainStmt(TreeNode* t)
+{
+	cLine(t);
+	if (t->nodekind == ExpK) {
+		cSpaces();
+		cExp(t);
+		fprintf(cFile, ";\n");
+		return;
+	}
+	switch (t->kind.stmt) {
+	case CompoundK:
+		cBlock(t->child[0], t->child[1], FALSE);
+		break;
+	case SelectionK:
+		cSpaces();
+		fprintf(cFile, "if (");
+		cExp(t->child[0]);
+		fprintf(cFile, ")\n");
+		cBody(t->child[1]);
+		if (t->child[2] != NULL) {
+			cSpaces();
+			fprintf(cFile, "else\n");
+			cBody(t->child[2]);
+		}
+		break;
+	case IterationK:
+		cSpaces();
+		fprintf(cFile, "while (");
+		cExp(t->child[0]);
+		fprintf(cFile, ")\n");
+		cBody(t->child[1]);
+		break;
+	case ReturnK:
+		cSpaces();
+		if (t->child[0] == NULL)
+			fprintf(cFile, "return%s;\n", cFunc->type == Integer ? " 0" : "");
+		else if (cFunc->type == Void) {
+			fprintf(cFile, "{ ");
+			cExp(t->child[0]);
+			fprintf(cFile, "; return; }\n");
+		}
+		else {
+			fprintf(cFile, "return ");
+			cExp(t->child[0]);
+			fprintf(cFile, ";\n");
+		}
+		break;
+	case CallK:
+		cSpaces();
+		cCall(t);
+		fprintf(cFile, ";\n");
+		break;
+	default:
+		break;
+	}
+}
+
+/* a statement, in a block declaring the temporaries its expression needs */
+static void cStmt(TreeNode* t)
+{
+	TreeNode* e = NULL;
+	int n = 0, i;
+
+	if (t->nodekind == ExpK || t->kind.stmt == CallK)
+		e = t;
+	else if (t->kind.stmt != CompoundK)
+		e = t->child[0];
+	if (e != NULL)
+		n = cTemps(e);
+	if (n == 0) {
+		cPlainStmt(t);
+		return;
+	}
+	cSpaces();
+	fprintf(cFile, "{\n");
+	cIndent++;
+	cSpaces();
+	for (i = 1; i <= n; i++)
+		fprintf(cFile, "%st_%d", i == 1 ? "int " : ", ", i);
+	fprintf(cFile, ";\n");
+	cTemp = 0;
+	cPlainStmt(t);
+	cIndent--;
+	cSpaces();
+	fprintf(cFile, "}\n");
+}
+
+static void cSignature(TreeNode* f)
+{
+	TreeNode* p;
+	int first = TRUE;
+
+	fprintf(cFile, "%s cm_%s(", f->type == Integer ? "int" : "void", f->attr.name);
+	for (p = f->child[0]; p != NULL; p = p->sibling) {
+		if (isVoidParam(p))
+			continue;
+		fprintf(cFile, "%sint cm_%s%s", first ? "" : ", ", p->attr.name,
+			p->kind.exp == VarArrayDeclK ? "[]" : "");
+		first = FALSE;
+	}
+	fprintf(cFile, "%s)", first ? "void" : "");
+}
+
+static const char* cRuntime =
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"\n"
+	"int cminus_input(void)\n"
+	"{\n"
+	"\tint v;\n"
+	"\tif (scanf(\"%d\", &v) != 1) {\n"
+	"\t\tfflush(stdout);\n"
+	"\t\tfprintf(stderr, \"Runtime error: input() expects an integer\\n\");\n"
+	"\t\texit(EXIT_FAILURE);\n"
+	"\t}\n"
+	"\treturn v;\n"
+	"}\n"
+	"\n"
+	"int cminus_output(int v)\n"
+	"{\n"
+	"\tprintf(\"%d\\n\", v);\n"
+	"\treturn 0;\n"
+	"}\n";
+
+void emitC(TreeNode* syntaxTree, char* cfile, char* source)
+{
+	TreeNode* t;
+
+	cFile = fopen(cfile, "w");
+	if (cFile == NULL) {
+		fprintf(stderr, "Unable to open %s\n", cfile);
+		exit(1);
+	}
+	cSource = source;
+	cIndent = 0;
+	fprintf(cFile, "/* C- compilation to C: ");
+	cString(source);
+	fprintf(cFile, " */\n");
+	fputs(cRuntime, cFile);
+
+	fprintf(cFile, "\n");
+	for (t = syntaxTree; t != NULL; t = t->sibling) {
+		if (t->kind.exp != FuncDeclK) {
+			cLine(t);
+			cVarDecl(t);
+			continue;
+		}
+		fprintf(cFile, "static ");
+		cSignature(t);
+		fprintf(cFile, ";\n");
+	}
+	for (t = syntaxTree; t != NULL; t = t->sibling) {
+		if (t->kind.exp != FuncDeclK)
+			continue;
+		cFunc = t;
+		fprintf(cFile, "\n");
+		cLine(t);
+		fprintf(cFile, "static ");
+		cSignature(t);
+		fprintf(cFile, "\n");
+		cBlock(t->child[1]->child[0], t->child[1]->child[1], t->type == Integer);
+	}
+
+	if (findMain(syntaxTree) != NULL)
+		fprintf(cFile, "\nint main(void)\n{\n\tcm_main();\n\tfflush(stdout);\n\treturn 0;\n}\n");
+	fclose(cFile);
+}
+
+
+/*********************************************/
+/*****************AST optimizer***************/
+/*********************************************/
+
+/* Rewrites the resolved tree in place: operators on constants are folded
+   (except a division by zero, which is left to fail at run time),
+   x+0, x-0, x*1 and x/1 become x, multiplication and division by a power
+   of two become SHL/SHR, and if/while statements whose condition folded
+   to a constant lose the branch that can never run. Removed statements in
+   a body position are replaced by an empty compound statement, so every
+   back end still sees the shapes the parser makes. */
+
+static int optFolded = 0;       // operators folded or simplified
+static int optDead = 0;         // if/while statements decided statically
+static int optShifts = 0;       // multiplications/divisions made shifts
+
+static int countNodes(TreeNode* t)
+{
+	int n = 0, i;
+
+	for (; t != NULL; t = t->sibling) {
+		n++;
+		for (i = 0; i < MAXCHILDREN; i++)
+			n += countNodes(t->child[i]);
+	}
+	return n;
+}
+
+static int isConst(TreeNode* t, int v)
+{
+	return t->nodekind == ExpK && t->kind.exp == ConstK && t->attr.val == v;
+}
+
+/* k when v is 2^k with k >= 1, otherwise 0 */
+static int powerOfTwo(TreeNode* t)
+{
+	int k;
+
+	if (t->nodekind != ExpK || t->kind.exp != ConstK)
+		return 0;
+	for (k = 1; k < 31; k++)
+		if (t->attr.val == 1 << k)
+			return k;
+	return 0;
+}
+
+/* fold a and b when the result is defined; FALSE for a division by zero */
+static int foldOp(TokenType op, int a, int b, int* v)
+{
+	unsigned int ua = (unsigned int)a, ub = (unsigned int)b;
+
+	switch (op) {
+	case PLUS: *v = (int)(ua + ub); break;
+	case MINUS: *v = (int)(ua - ub); break;
+	case MUL: *v = (int)(ua * ub); break;
+	case DIV:
+		if (b == 0 || (a == -2147483647 - 1 && b == -1))
+			return FALSE;
+		*v = a / b;
+		break;
+	case LT: *v = a < b; break;
+	case LE: *v = a <= b; break;
+	case GT: *v = a > b; break;
+	case GE: *v = a >= b; break;
+	case EQ: *v = a == b; break;
+	case NE: *v = a != b; break;
+	default: return FALSE;
+	}
+	return TRUE;
+}
+
+/* replace t by its operand r, keeping t's place in a sibling list */
+static TreeNode* replaceBy(TreeNode* t, TreeNode* r)
+{
+	r->sibling = t->sibling;
+	optFolded++;
+	return r;
+}
+
+static TreeNode* optExp(TreeNode* t);
+
+/* optimize every expression of a sibling list (call arguments) */
+static TreeNode* optExpList(TreeNode* t)
+{
+	TreeNode** p;
+
+	for (p = &t; *p != NULL; p = &(*p)->sibling)
+		*p = optExp(*p);
+	return t;
+}
+
+/* returns the node that takes the place of expression t */
+static TreeNode* optExp(TreeNode* t)
+{
+	TreeNode* a, * b;
+	int v, k;
+
+	if (t == NULL)
+		return NULL;
+	if (t->nodekind == StmtK) {
+		t->child[0] = optExpList(t->child[0]);
+		return t;
+	}
+	switch (t->kind.exp) {
+	case IdK:
+		t->child[0] = optExp(t->child[0]);
+		break;
+	case AssignK:
+		t->child[0] = optExp(t->child[0]);
+		t->child[1] = optExp(t->child[1]);
+		break;
+	case OpK:
+		a = t->child[0] = optExp(t->child[0]);
+		b = t->child[1] = optExp(t->child[1]);
+		if (a->nodekind == ExpK && a->kind.exp == ConstK
+			&& b->nodekind == ExpK && b->kind.exp == ConstK
+			&& foldOp(t->attr.op, a->attr.val, b->attr.val, &v)) {
+			t->kind.exp = ConstK;
+			t->attr.val = v;
+			t->child[0] = t->child[1] = NULL;
+			optFolded++;
+			break;
+		}
+		switch (t->attr.op) {
+		case PLUS:
+			if (isConst(b, 0))
+				return replaceBy(t, a);
+			if (isConst(a, 0))
+				return replaceBy(t, b);
+			break;
+		case MINUS:
+			if (isConst(b, 0))
+				return replaceBy(t, a);
+			break;
+		case MUL:
+			if (isConst(b, 1))
+				return replaceBy(t, a);
+			if (isConst(a, 1))
+				return replaceBy(t, b);
+			if (powerOfTwo(a) && !powerOfTwo(b)) {
+				t->child[0] = b;
+				t->child[1] = a;
+			}
+			if ((k = powerOfTwo(t->child[1])) != 0) {
+				t->attr.op = SHL;
+				t->child[1]->attr.val = k;
+				optShifts++;
+			}
+			break;
+		case DIV:
+			if (isConst(b, 1))
+				return replaceBy(t, a);
+			if ((k = powerOfTwo(b)) != 0) {
+				t->attr.op = SHR;
+				b->attr.val = k;
+				optShifts++;
+			}
+			break;
+		default:
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+	return t;
+}
+
+static TreeNode* optStmt(TreeNode* t);
+
+/* optimize a statement list, dropping the statements that vanish */
+static TreeNode* optList(TreeNode* t)
+{
+	TreeNode* head = NULL, ** link = &head;
+	TreeNode* next, * r;
+
+	for (; t != NULL; t = next) {
+		next = t->sibling;
+		t->sibling = NULL;
+		r = optStmt(t);
+		if (r == NULL)
+			continue;
+		*link = r;
+		link = &r->sibling;
+	}
+	return head;
+}
+
+/* body of if/while: never left empty */
+static TreeNode* optBody(TreeNode* t)
+{
+	TreeNode* r = optStmt(t);
+
+	if (r == NULL) {
+		lineno = t->lineno;
+		r = newStmtNode(CompoundK);
+	}
+	return r;
+}
+
+/* returns the statement that takes the place of t (sibling not set), or
+   NULL when t can never have an effect */
+static TreeNode* optStmt(TreeNode* t)
+{
+	if (t == NULL)
+		return NULL;
+	if (t->nodekind == ExpK)
+		return optExp(t);
+	switch (t->kind.stmt) {
+	case CompoundK:
+		t->child[1] = optList(t->child[1]);
+		break;
+	case SelectionK:
+		t->child[0] = optExp(t->child[0]);
+		if (t->child[0]->nodekind == ExpK && t->child[0]->kind.exp == ConstK) {
+			optDead++;
+			return optStmt(t->child[0]->attr.val ? t->child[1] : t->child[2]);
+		}
+		t->child[1] = optBody(t->child[1]);
+		t->child[2] = optStmt(t->child[2]);
+		break;
+	case IterationK:
+		t->child[0] = optExp(t->child[0]);
+		if (isConst(t->child[0], 0)) {
+			optDead++;
+			return NULL;
+		}
+		t->child[1] = optBody(t->child[1]);
+		break;
+	case ReturnK:
+		t->child[0] = optExp(t->child[0]);
+		break;
+	case CallK:
+		t->child[0] = optExpList(t->child[0]);
+		break;
+	default:
+		break;
+	}
+	return t;
+}
+
+void optimize(TreeNode* syntaxTree)
+{
+	TreeNode* t;
+	int before = countNodes(syntaxTree);
+
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->nodekind == ExpK && t->kind.exp == FuncDeclK && t->child[1] != NULL)
+			t->child[1] = optBody(t->child[1]);
+
+	fprintf(fpOut, "\nOptimized syntax tree:\n");
+	printTree(syntaxTree);
+	fprintf(fpOut, "\nOptimizer: %d nodes before, %d after (%d folded, %d dead branches, %d shifts)\n",
+		before, countNodes(syntaxTree), optFolded, optDead, optShifts);
+}
+
+
+/*********************************************/
+/******************SSA form IR****************/
+/*********************************************/
+
+/* Every function is lowered to a control flow graph of basic blocks and
+   put into SSA form. All of it lives in flat arrays indexed by int ids:
+   instructions (an instruction id is also the id of the value it
+   defines), blocks, operand lists and predecessor lists. The instructions
+   of a block are linked through next/prev so passes can delete and move
+   them in O(1). Scalar variables and array parameters become SSA values;
+   globals and arrays stay in memory behind load and store instructions.
+
+   Lowering first produces LDV/STV (read/write variable) instructions.
+   Phi functions are placed with dominance frontiers, and renaming along
+   the dominator tree removes LDV/STV. Then sparse conditional constant
+   propagation, dead code elimination and loop invariant code motion run
+   on each function. */
+
+#define IROPS(X) \
+	X(NOP, "nop")     X(CONST, "const") X(PARAM, "param") X(LDV, "ldv") \
+	X(STV, "stv")     X(PHI, "phi")     X(ADD, "add")     X(SUB, "sub") \
+	X(MUL, "mul")     X(DIV, "div")     X(SHL, "shl")     X(SHR, "shr") \
+	X(LT, "lt")       X(LE, "le")       X(GT, "gt")       X(GE, "ge") \
+	X(EQ, "eq")       X(NE, "ne")       X(LDG, "ldg")     X(STG, "stg") \
+	X(ADDRG, "addrg") X(ADDRL, "addrl") X(LDX, "ldx")     X(STX, "stx") \
+	X(CALL, "call")   X(IN, "in")       X(OUT, "out")     X(JMP, "jmp") \
+	X(BR, "br")       X(RET, "ret")
+
+#define IRENUM(name, text) IR_##name,
+typedef enum { IROPS(IRENUM) NUMIROPS } IrOp;
+#undef IRENUM
+
+#define IRNAME(name, text) text,
+static const char* irOpNames[] = { IROPS(IRNAME) };
+#undef IRNAME
+
+typedef struct {
+	int op;
+	int imm;        // CONST: value, PARAM: index, LDV/STV/PHI: variable,
+	                // LDG/STG/ADDRG: address, ADDRL: frame slot,
+	                // LDX/STX: array size, 0 (any memory address) or
+	                // -1 (proven in bounds), SHL/SHR: shift count,
+	                // CALL: function number
+	int args;       // operands are irArgs[args .. args+nargs-1]
+	int nargs;
+	int block;
+	int prev, next; // order within the block, -1 at the ends
+	int line;
+} IrInst;
+
+typedef struct {
+	int first, last;    // instructions
+	int succ[2];        // JMP: succ[0]; BR: succ[0] if true, succ[1] if false
+	int nsucc;
+	int preds;          // predecessors are irPreds[preds .. preds+npred-1],
+	int npred;          // in the order of the phi operands
+	int idom;           // immediate dominator, -1 for the entry
+	int rpo;            // reverse postorder number, -1 if unreachable
+	int dead;
+} IrBlock;
+
+typedef struct {
+	TreeNode* decl;
+	int firstBlock, nblocks;
+	int firstInst, ninst;   // the function's instruction (value) ids
+	int firstBody;          // first instruction after the initialization
+	int nvars;              // of parameters and locals
+} IrFunc;
+
+#define IRARG(i, k) irArgs[irInst[i].args + (k)]
+
+static IrInst* irInst = NULL;
+static int irNumInsts = 0, irInstCap = 0;
+static IrBlock* irBlock = NULL;
+static int irNumBlocks = 0, irBlockCap = 0;
+static int* irArgs = NULL;
+static int irNumArgs = 0, irArgCap = 0;
+static int* irPreds = NULL;
+static int irNumPreds = 0, irPredCap = 0;
+static IrFunc* irFunc = NULL;
+static int irNumFuncs = 0, irFuncCap = 0;
+static TreeNode** irGlobal = NULL;  // declaration at each global address
+static int irMain = -1;             // function number of main
+
+/* blocks of the function in reverse postorder */
+static int* irOrder = NULL;
+static int irOrderN = 0, irOrderCap = 0;
+
+/* statistics of the function being optimized */
+static int irConsts, irDead, irHoisted, irBlocksRemoved;
+
+static void* irGrow(void* p, int* cap, int need, int size)
+{
+	if (need <= *cap)
+		return p;
+	while (*cap < need)
+		*cap = *cap ? *cap * 2 : 256;
+	p = realloc(p, (size_t)*cap * size);
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+/*************** instructions and blocks ***************/
+
+static int irLine = 0;          // source line of the node being lowered
+
+/* a new instruction that is not in any block yet */
+static int irNewInst(int op, int imm, int nargs)
+{
+	IrInst* in;
+	int k;
+
+	irInst = (IrInst*)irGrow(irInst, &irInstCap, irNumInsts + 1, sizeof(IrInst));
+	irArgs = (int*)irGrow(irArgs, &irArgCap, irNumArgs + nargs, sizeof(int));
+	in = &irInst[irNumInsts];
+	in->op = op;
+	in->imm = imm;
+	in->args = irNumArgs;
+	in->nargs = nargs;
+	in->block = -1;
+	in->prev = in->next = -1;
+	in->line = irLine;
+	for (k = 0; k < nargs; k++)
+		irArgs[irNumArgs + k] = -1;
+	irNumArgs += nargs;
+	return irNumInsts++;
+}
+
+/* link instruction i into block b before instruction before (-1: append) */
+static void irInsert(int i, int b, int before)
+{
+	IrBlock* bl = &irBlock[b];
+	int prev = before >= 0 ? irInst[before].prev : bl->last;
+
+	irInst[i].block = b;
+	irInst[i].prev = prev;
+	irInst[i].next = before;
+	if (prev >= 0)
+		irInst[prev].next = i;
+	else
+		bl->first = i;
+	if (before >= 0)
+		irInst[before].prev = i;
+	else
+		bl->last = i;
+}
+
+static void irUnlink(int i)
+{
+	IrInst* in = &irInst[i];
+	IrBlock* bl = &irBlock[in->block];
+
+	if (in->prev >= 0)
+		irInst[in->prev].next = in->next;
+	else
+		bl->first = in->next;
+	if (in->next >= 0)
+		irInst[in->next].prev = in->prev;
+	else
+		bl->last = in->prev;
+	in->prev = in->next = -1;
+}
+
+static void irDelete(int i)
+{
+	irUnlink(i);
+	irInst[i].op = IR_NOP;
+	irInst[i].nargs = 0;
+}
+
+static int irNewBlock(void)
+{
+	IrBlock* b;
+
+	irBlock = (IrBlock*)irGrow(irBlock, &irBlockCap, irNumBlocks + 1, sizeof(IrBlock));
+	b = &irBlock[irNumBlocks];
+	b->first = b->last = -1;
+	b->nsucc = 0;
+	b->preds = b->npred = 0;
+	b->idom = -1;
+	b->rpo = -1;
+	b->dead = FALSE;
+	return irNumBlocks++;
+}
+
+/* index of p among the predecessors of s */
+static int irPredIndex(int s, int p)
+{
+	int j;
+
+	for (j = 0; irPreds[irBlock[s].preds + j] != p; j++)
+		;
+	return j;
+}
+
+/* drop the edge p->s from the predecessors of s and from its phis; the
+   caller updates the successors of p */
+static void irRemoveEdge(int p, int s)
+{
+	IrBlock* b = &irBlock[s];
+	int j = irPredIndex(s, p), k, i;
+
+	for (k = j; k < b->npred - 1; k++)
+		irPreds[b->preds + k] = irPreds[b->preds + k + 1];
+	b->npred--;
+	for (i = b->first; i >= 0 && irInst[i].op == IR_PHI; i = irInst[i].next) {
+		for (k = j; k < irInst[i].nargs - 1; k++)
+			IRARG(i, k) = IRARG(i, k + 1);
+		irInst[i].nargs--;
+	}
+}
+
+static void irKillBlock(int b)
+{
+	IrBlock* bl = &irBlock[b];
+	int k, i;
+
+	for (k = 0; k < bl->nsucc; k++)
+		irRemoveEdge(b, bl->succ[k]);
+	bl->nsucc = 0;
+	for (i = bl->first; i >= 0; i = irInst[i].next) {
+		irInst[i].op = IR_NOP;
+		irInst[i].nargs = 0;
+	}
+	bl->first = bl->last = -1;
+	bl->dead = TRUE;
+	irBlocksRemoved++;
+}
+
+/*************** lowering ***************/
+
+static int irCur;               // block receiving instructions
+static int irZero;              // CONST 0 in the entry block
+
+/* variable numbers of the current function: open hash on the decl */
+static TreeNode** irVarKey = NULL;
+static int* irVarNo = NULL;
+static int irVarCap = 0, irNumVars = 0;
+
+static int irVar(TreeNode* decl)
+{
+	unsigned int i;
+
+	if (2 * (irNumVars + 1) > irVarCap) {
+		TreeNode** oldKey = irVarKey;
+		int* oldNo = irVarNo;
+		int oldCap = irVarCap, k;
+
+		irVarCap = irVarCap ? 2 * irVarCap : 64;
+		irVarKey = (TreeNode**)calloc(irVarCap, sizeof(TreeNode*));
+		irVarNo = (int*)malloc(irVarCap * sizeof(int));
+		if (irVarKey == NULL || irVarNo == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		for (k = 0; k < oldCap; k++)
+			if (oldKey[k] != NULL) {
+				for (i = (unsigned int)((size_t)oldKey[k] >> 4) & (irVarCap - 1);
+					irVarKey[i] != NULL; i = (i + 1) & (irVarCap - 1))
+					;
+				irVarKey[i] = oldKey[k];
+				irVarNo[i] = oldNo[k];
+			}
+		free(oldKey);
+		free(oldNo);
+	}
+	for (i = (unsigned int)((size_t)decl >> 4) & (irVarCap - 1);
+		irVarKey[i] != NULL; i = (i + 1) & (irVarCap - 1))
+		if (irVarKey[i] == decl)
+			return irVarNo[i];
+	irVarKey[i] = decl;
+	irVarNo[i] = irNumVars;
+	return irNumVars++;
+}
+
+static int irEmit(int op, int imm, int nargs)
+{
+	int i = irNewInst(op, imm, nargs);
+	irInsert(i, irCur, -1);
+	return i;
+}
+
+static int irEmit1(int op, int imm, int a)
+{
+	int i = irEmit(op, imm, 1);
+	IRARG(i, 0) = a;
+	return i;
+}
+
+static int irEmit2(int op, int imm, int a, int b)
+{
+	int i = irEmit(op, imm, 2);
+	IRARG(i, 0) = a;
+	IRARG(i, 1) = b;
+	return i;
+}
+
+static void irJump(int target)
+{
+	irEmit(IR_JMP, 0, 0);
+	irBlock[irCur].succ[0] = target;
+	irBlock[irCur].nsucc = 1;
+}
+
+static void irBranch(int cond, int t, int f)
+{
+	irEmit1(IR_BR, 0, cond);
+	irBlock[irCur].succ[0] = t;
+	irBlock[irCur].succ[1] = f;
+	irBlock[irCur].nsucc = 2;
+}
+
+static int irExp(TreeNode* t);
+
+static int irArrayBase(TreeNode* d)
+{
+	if (d->paramCheck)
+		return irEmit(IR_LDV, irVar(d), 0);
+	return irEmit(d->level ? IR_ADDRL : IR_ADDRG, d->memloc, 0);
+}
+
+static int irCall(TreeNode* t)
+{
+	TreeNode* a;
+	int* vals;
+	int n = 0, i, k;
+
+	if (t->decl == inputDecl)
+		return irEmit(IR_IN, 0, 0);
+	for (a = t->child[0]; a != NULL; a = a->sibling)
+		n++;
+	vals = (int*)malloc((n + 1) * sizeof(int));
+	if (vals == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (a = t->child[0], k = 0; a != NULL; a = a->sibling)
+		vals[k++] = irExp(a);
+	irLine = t->lineno;
+	if (t->decl == outputDecl)
+		i = irEmit1(IR_OUT, 0, n > 0 ? vals[0] : irZero);
+	else {
+		i = irEmit(IR_CALL, t->decl->memloc, n);
+		for (k = 0; k < n; k++)
+			IRARG(i, k) = vals[k];
+	}
+	free(vals);
+	return i;
+}
+
+static int irExp(TreeNode* t)
+{
+	TreeNode* d;
+	int a, b, i;
+
+	irLine = t->lineno;
+	if (t->nodekind == StmtK)
+		return irCall(t);
+	switch (t->kind.exp) {
+	case ConstK:
+		return irEmit(IR_CONST, t->attr.val, 0);
+	case IdK:
+		d = t->decl;
+		if (d->kind.exp == VarArrayDeclK) {
+			if (t->child[0] == NULL)
+				return irArrayBase(d);
+			b = irExp(t->child[0]);
+			a = irArrayBase(d);
+			irLine = t->lineno;
+			return irEmit2(IR_LDX, t->inBounds ? -1 : d->paramCheck ? 0 : d->arraysize, a, b);
+		}
+		if (d->level)
+			return irEmit(IR_LDV, irVar(d), 0);
+		return irEmit(IR_LDG, d->memloc, 0);
+	case AssignK:
+		d = t->child[0]->decl;
+		if (t->child[0]->child[0] != NULL) {
+			b = irExp(t->child[0]->child[0]);
+			if (!t->child[0]->inBounds && evalObservable(t->child[1])) {
+				/* a load of the element checks the subscript before the
+				   value is computed, as the interpreter does */
+				irLine = t->lineno;
+				irEmit2(IR_LDX, d->paramCheck ? 0 : d->arraysize, irArrayBase(d), b);
+			}
+			i = irExp(t->child[1]);
+			a = irArrayBase(d);
+			irLine = t->lineno;
+			a = irEmit2(IR_STX, t->child[0]->inBounds ? -1
+				: d->paramCheck ? 0 : d->arraysize, a, b);
+			irArgs = (int*)irGrow(irArgs, &irArgCap, irNumArgs + 1, sizeof(int));
+			irInst[a].nargs = 3;
+			irArgs[irNumArgs++] = i;
+			return i;
+		}
+		i = irExp(t->child[1]);
+		irLine = t->lineno;
+		if (d->level)
+			irEmit1(IR_STV, irVar(d), i);
+		else
+			irEmit1(IR_STG, d->memloc, i);
+		return i;
+	case OpK:
+		a = irExp(t->child[0]);
+		irLine = t->lineno;
+		switch (t->attr.op) {
+		case SHL: return irEmit1(IR_SHL, t->child[1]->attr.val, a);
+		case SHR: return irEmit1(IR_SHR, t->child[1]->attr.val, a);
+		default: break;
+		}
+		b = irExp(t->child[1]);
+		irLine = t->lineno;
+		switch (t->attr.op) {
+		case PLUS: return irEmit2(IR_ADD, 0, a, b);
+		case MINUS: return irEmit2(IR_SUB, 0, a, b);
+		case MUL: return irEmit2(IR_MUL, 0, a, b);
+		case DIV: return irEmit2(IR_DIV, 0, a, b);
+		case LT: return irEmit2(IR_LT, 0, a, b);
+		case LE: return irEmit2(IR_LE, 0, a, b);
+		case GT: return irEmit2(IR_GT, 0, a, b);
+		case GE: return irEmit2(IR_GE, 0, a, b);
+		case EQ: return irEmit2(IR_EQ, 0, a, b);
+		default: return irEmit2(IR_NE, 0, a, b);
+		}
+	default:
+		break;
+	}
+	return irZero;
+}
+
+/* every local scalar starts at zero, as in the interpreter */
+static void irLocals(TreeNode* t)
+{
+	TreeNode* d;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind != StmtK)
+			continue;
+		switch (t->kind.stmt) {
+		case CompoundK:
+			for (d = t->child[0]; d != NULL; d = d->sibling)
+				if (d->kind.exp == VarDeclK)
+					irEmit1(IR_STV, irVar(d), irZero);
+			irLocals(t->child[1]);
+			break;
+		case SelectionK:
+			irLocals(t->child[1]);
+			irLocals(t->child[2]);
+			break;
+		case IterationK:
+			irLocals(t->child[1]);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void irList(TreeNode* t);
+
+static void irStmt(TreeNode* t)
+{
+	int c, b1, b2, join;
+
+	if (t == NULL)
+		return;
+	irLine = t->lineno;
+	if (t->nodekind == ExpK) {
+		irExp(t);
+		return;
+	}
+	switch (t->kind.stmt) {
+	case CompoundK:
+		irList(t->child[1]);
+		break;
+	case SelectionK:
+		c = irExp(t->child[0]);
+		b1 = irNewBlock();
+		join = irNewBlock();
+		b2 = t->child[2] != NULL ? irNewBlock() : join;
+		irBranch(c, b1, b2);
+		irCur = b1;
+		irStmt(t->child[1]);
+		irJump(join);
+		if (t->child[2] != NULL) {
+			irCur = b2;
+			irStmt(t->child[2]);
+			irJump(join);
+		}
+		irCur = join;
+		break;
+	case IterationK:
+		/* the block before the loop becomes its preheader */
+		b1 = irNewBlock();
+		irJump(b1);
+		irCur = b1;
+		c = irExp(t->child[0]);
+		b2 = irNewBlock();
+		join = irNewBlock();
+		irBranch(c, b2, join);
+		irCur = b2;
+		irStmt(t->child[1]);
+		irJump(b1);
+		irCur = join;
+		break;
+	case ReturnK:
+		if (t->child[0] != NULL)
+			irEmit1(IR_RET, 0, irExp(t->child[0]));
+		else
+			irEmit(IR_RET, 0, 0);
+		irCur = irNewBlock();   // unreachable, removed later
+		break;
+	case CallK:
+		irCall(t);
+		break;
+	default:
+		break;
+	}
+}
+
+static void irList(TreeNode* t)
+{
+	for (; t != NULL; t = t->sibling)
+		irStmt(t);
+}
+
+/* lower function f in pre-SSA form (LDV/STV) and compute predecessors */
+static int irLower(TreeNode* f)
+{
+	IrFunc* fn;
+	TreeNode* p;
+	int n = 0, b, k, s, end;
+
+	fn = &irFunc[f->memloc];
+	fn->firstBlock = irNumBlocks;
+	fn->firstInst = irNumInsts;
+	if (irVarKey != NULL)
+		memset(irVarKey, 0, irVarCap * sizeof(TreeNode*));
+	irNumVars = 0;
+
+	irLine = f->lineno;
+	irCur = irNewBlock();
+	irZero = irEmit(IR_CONST, 0, 0);
+	for (p = f->child[0]; p != NULL; p = p->sibling)
+		if (!isVoidParam(p))
+			irEmit1(IR_STV, irVar(p), irEmit(IR_PARAM, n++, 0));
+	irLocals(f->child[1]);
+	fn->firstBody = irNumInsts;
+	irList(f->child[1]->child[1]);
+	irLine = f->lineno;
+	if (f->type == Integer)
+		irEmit1(IR_RET, 0, irZero);
+	else
+		irEmit(IR_RET, 0, 0);
+
+	fn->nblocks = irNumBlocks - fn->firstBlock;
+	fn->ninst = irNumInsts - fn->firstInst;
+	fn->nvars = irNumVars;
+
+	end = fn->firstBlock + fn->nblocks;
+	for (b = fn->firstBlock; b < end; b++)
+		for (k = 0; k < irBlock[b].nsucc; k++)
+			irBlock[irBlock[b].succ[k]].npred++;
+	for (b = fn->firstBlock; b < end; b++) {
+		irBlock[b].preds = irNumPreds;
+		irNumPreds += irBlock[b].npred;
+		irBlock[b].npred = 0;
+	}
+	irPreds = (int*)irGrow(irPreds, &irPredCap, irNumPreds, sizeof(int));
+	for (b = fn->firstBlock; b < end; b++)
+		for (k = 0; k < irBlock[b].nsucc; k++) {
+			s = irBlock[b].succ[k];
+			irPreds[irBlock[s].preds + irBlock[s].npred++] = b;
+		}
+	return f->memloc;
+}
+
+/*************** control flow graph ***************/
+
+/* reverse postorder of the blocks reachable from the entry */
+static void irComputeRPO(IrFunc* fn)
+{
+	int n = fn->nblocks, sp = 1, post = n, b, s, k;
+	int* stack = (int*)malloc(n * sizeof(int));
+	int* edge = (int*)malloc(n * sizeof(int));
+
+	if (stack == NULL || edge == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	irOrder = (int*)irGrow(irOrder, &irOrderCap, n, sizeof(int));
+	for (b = fn->firstBlock; b < fn->firstBlock + n; b++)
+		irBlock[b].rpo = -1;
+	stack[0] = fn->firstBlock;
+	edge[0] = 0;
+	irBlock[fn->firstBlock].rpo = 0;
+	while (sp > 0) {
+		b = stack[sp - 1];
+		if (edge[sp - 1] < irBlock[b].nsucc) {
+			s = irBlock[b].succ[edge[sp - 1]++];
+			if (irBlock[s].rpo == -1) {
+				irBlock[s].rpo = 0;
+				stack[sp] = s;
+				edge[sp++] = 0;
+			}
+		}
+		else {
+			sp--;
+			irOrder[--post] = b;
+		}
+	}
+	irOrderN = n - post;
+	memmove(irOrder, irOrder + post, irOrderN * sizeof(int));
+	for (k = 0; k < irOrderN; k++)
+		irBlock[irOrder[k]].rpo = k;
+	free(stack);
+	free(edge);
+}
+
+static void irRemoveUnreachable(IrFunc* fn)
+{
+	int b;
+
+	irComputeRPO(fn);
+	for (b = fn->firstBlock; b < fn->firstBlock + fn->nblocks; b++)
+		if (irBlock[b].rpo == -1 && !irBlock[b].dead)
+			irKillBlock(b);
+}
+
+static int irIntersect(int a, int b)
+{
+	while (a != b) {
+		while (irBlock[a].rpo > irBlock[b].rpo)
+			a = irBlock[a].idom;
+		while (irBlock[b].rpo > irBlock[a].rpo)
+			b = irBlock[b].idom;
+	}
+	return a;
+}
+
+/* immediate dominators (Cooper, Harvey and Kennedy), over irOrder */
+static void irDominators(void)
+{
+	int entry = irOrder[0], changed = TRUE, k, j, b, p, d;
+
+	for (k = 0; k < irOrderN; k++)
+		irBlock[irOrder[k]].idom = -1;
+	irBlock[entry].idom = entry;
+	while (changed) {
+		changed = FALSE;
+		for (k = 1; k < irOrderN; k++) {
+			b = irOrder[k];
+			d = -1;
+			for (j = 0; j < irBlock[b].npred; j++) {
+				p = irPreds[irBlock[b].preds + j];
+				if (irBlock[p].idom == -1)
+					continue;
+				d = d == -1 ? p : irIntersect(p, d);
+			}
+			if (irBlock[b].idom != d) {
+				irBlock[b].idom = d;
+				changed = TRUE;
+			}
+		}
+	}
+	irBlock[entry].idom = -1;
+}
+
+/* does block a dominate block b? */
+static int irDominates(int a, int b)
+{
+	while (b != -1 && irBlock[b].rpo > irBlock[a].rpo)
+		b = irBlock[b].idom;
+	return b == a;
+}
+
+/*************** SSA construction ***************/
+
+/* arrays over the blocks of the function, indexed by block - firstBlock */
+static int irBase;              // firstBlock of the function
+static int* irDomStart;         // children in the dominator tree
+static int* irDomList;
+static int* irDfStart;          // dominance frontiers
+static int* irDfList;
+
+/* renaming: a stack of definitions per variable, undone on the way up */
+static int* irVarTop;
+static int* irStkVal, * irStkVar, * irStkPrev;
+static int irStkN;
+static int* irRepl;             // value replacing an instruction, or -1
+
+static int* irAlloc(int n)
+{
+	int* p = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+	if (p == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+/* counting sort of the pairs (key[k], val[k]) into start/list */
+static void irBuckets(int n, int npairs, int* key, int* val, int** start, int** list)
+{
+	int* s = irAlloc(n + 1);
+	int* l = irAlloc(npairs);
+	int k;
+
+	for (k = 0; k <= n; k++)
+		s[k] = 0;
+	for (k = 0; k < npairs; k++)
+		s[key[k] + 1]++;
+	for (k = 0; k < n; k++)
+		s[k + 1] += s[k];
+	for (k = 0; k < npairs; k++)
+		l[s[key[k]]++] = val[k];
+	for (k = n; k > 0; k--)
+		s[k] = s[k - 1];
+	s[0] = 0;
+	*start = s;
+	*list = l;
+}
+
+static void irPush(int var, int val)
+{
+	irStkVal[irStkN] = val;
+	irStkVar[irStkN] = var;
+	irStkPrev[irStkN] = irVarTop[var];
+	irVarTop[var] = irStkN++;
+}
+
+static void irRename(int b)
+{
+	int mark = irStkN, i, next, k, j, s;
+
+	for (i = irBlock[b].first; i >= 0; i = next) {
+		next = irInst[i].next;
+		if (irInst[i].op == IR_PHI) {
+			irPush(irInst[i].imm, i);
+			continue;
+		}
+		for (k = 0; k < irInst[i].nargs; k++)
+			if (irInst[IRARG(i, k)].op == IR_LDV)
+				IRARG(i, k) = irRepl[IRARG(i, k)];
+		if (irInst[i].op == IR_LDV) {
+			irRepl[i] = irStkVal[irVarTop[irInst[i].imm]];
+			irDelete(i);
+			irInst[i].op = IR_LDV;  // still recognized by its uses
+		}
+		else if (irInst[i].op == IR_STV) {
+			irPush(irInst[i].imm, IRARG(i, 0));
+			irDelete(i);
+		}
+	}
+	for (k = 0; k < irBlock[b].nsucc; k++) {
+		s = irBlock[b].succ[k];
+		j = irPredIndex(s, b);
+		for (i = irBlock[s].first; i >= 0 && irInst[i].op == IR_PHI; i = irInst[i].next)
+			IRARG(i, j) = irStkVal[irVarTop[irInst[i].imm]];
+	}
+	for (k = irDomStart[b - irBase]; k < irDomStart[b - irBase + 1]; k++)
+		irRename(irDomList[k]);
+	while (irStkN > mark) {
+		irStkN--;
+		irVarTop[irStkVar[irStkN]] = irStkPrev[irStkN];
+	}
+}
+
+static void irBuildSSA(IrFunc* fn)
+{
+	int n = fn->nblocks, nv = fn->nvars, np = 0, cap = 64, sp;
+	int* from = irAlloc(cap), * to = irAlloc(cap);
+	int* last = irAlloc(n), * hasPhi = irAlloc(n), * inWork = irAlloc(n);
+	int* work = irAlloc(n);
+	int* defStart, * defList;
+	int b, k, j, p, r, v, i, y;
+
+	irBase = fn->firstBlock;
+	irDominators();
+
+	/* dominator tree */
+	for (k = 1; k < irOrderN; k++) {
+		if (np == cap) {
+			cap *= 2;
+			from = (int*)realloc(from, cap * sizeof(int));
+			to = (int*)realloc(to, cap * sizeof(int));
+		}
+		from[np] = irBlock[irOrder[k]].idom - irBase;
+		to[np++] = irOrder[k];
+	}
+	irBuckets(n, np, from, to, &irDomStart, &irDomList);
+
+	/* dominance frontiers */
+	np = 0;
+	for (k = 0; k < n; k++)
+		last[k] = -1;
+	for (k = 0; k < irOrderN; k++) {
+		b = irOrder[k];
+		if (irBlock[b].npred < 2)
+			continue;
+		for (j = 0; j < irBlock[b].npred; j++)
+			for (r = irPreds[irBlock[b].preds + j]; r != irBlock[b].idom; r = irBlock[r].idom) {
+				if (last[r - irBase] == b)
+					continue;
+				last[r - irBase] = b;
+				if (np == cap) {
+					cap *= 2;
+					from = (int*)realloc(from, cap * sizeof(int));
+					to = (int*)realloc(to, cap * sizeof(int));
+				}
+				from[np] = r - irBase;
+				to[np++] = b;
+			}
+	}
+	irBuckets(n, np, from, to, &irDfStart, &irDfList);
+
+	/* blocks assigning each variable */
+	np = 0;
+	for (k = 0; k < irOrderN; k++)
+		for (i = irBlock[irOrder[k]].first; i >= 0; i = irInst[i].next)
+			if (irInst[i].op == IR_STV) {
+				if (np == cap) {
+					cap *= 2;
+					from = (int*)realloc(from, cap * sizeof(int));
+					to = (int*)realloc(to, cap * sizeof(int));
+				}
+				from[np] = irInst[i].imm;
+				to[np++] = irOrder[k];
+			}
+	irBuckets(nv, np, from, to, &defStart, &defList);
+
+	/* phi functions at the iterated dominance frontier of the assignments */
+	for (k = 0; k < n; k++)
+		hasPhi[k] = inWork[k] = -1;
+	for (v = 0; v < nv; v++) {
+		sp = 0;
+		for (k = defStart[v]; k < defStart[v + 1]; k++)
+			if (inWork[defList[k] - irBase] != v) {
+				inWork[defList[k] - irBase] = v;
+				work[sp++] = defList[k];
+			}
+		while (sp > 0) {
+			b = work[--sp];
+			for (k = irDfStart[b - irBase]; k < irDfStart[b - irBase + 1]; k++) {
+				y = irDfList[k];
+				if (hasPhi[y - irBase] == v)
+					continue;
+				hasPhi[y - irBase] = v;
+				i = irNewInst(IR_PHI, v, irBlock[y].npred);
+				irInst[i].line = irInst[irBlock[y].first].line;
+				irInsert(i, y, irBlock[y].first);
+				if (inWork[y - irBase] != v) {
+					inWork[y - irBase] = v;
+					work[sp++] = y;
+				}
+			}
+		}
+	}
+
+	/* renaming */
+	irRepl = irAlloc(irNumInsts);
+	for (i = 0; i < irNumInsts; i++)
+		irRepl[i] = -1;
+	irVarTop = irAlloc(nv);
+	for (v = 0; v < nv; v++)
+		irVarTop[v] = -1;
+	p = irNumInsts - fn->firstInst;
+	irStkVal = irAlloc(p);
+	irStkVar = irAlloc(p);
+	irStkPrev = irAlloc(p);
+	irStkN = 0;
+	irRename(irBase);
+	for (i = fn->firstInst; i < irNumInsts; i++)
+		if (irInst[i].op == IR_LDV)
+			irInst[i].op = IR_NOP;
+
+	free(from); free(to); free(last); free(hasPhi); free(inWork); free(work);
+	free(defStart); free(defList); free(irDomStart); free(irDomList);
+	free(irDfStart); free(irDfList);
+	free(irVarTop); free(irStkVal); free(irStkVar); free(irStkPrev);
+}
+
+/*************** optimizations ***************/
+
+static int irFind(int v)
+{
+	while (irRepl[v] >= 0)
+		v = irRepl[v];
+	return v;
+}
+
+/* rewrite every operand through irRepl */
+static void irResolve(IrFunc* fn)
+{
+	int i, k;
+
+	for (i = fn->firstInst; i < irNumInsts; i++)
+		for (k = 0; k < irInst[i].nargs; k++)
+			if (IRARG(i, k) >= 0)
+				IRARG(i, k) = irFind(IRARG(i, k));
+}
+
+/* a phi whose operands are all one value v (or itself) is v */
+static void irSimplifyPhis(IrFunc* fn)
+{
+	int changed = TRUE, i, k, v, a;
+
+	while (changed) {
+		changed = FALSE;
+		for (i = fn->firstInst; i < irNumInsts; i++) {
+			if (irInst[i].op != IR_PHI)
+				continue;
+			v = -1;
+			for (k = 0; k < irInst[i].nargs; k++) {
+				a = irFind(IRARG(i, k));
+				if (a == i || a == v)
+					continue;
+				if (v != -1)
+					break;
+				v = a;
+			}
+			if (k < irInst[i].nargs || v == -1)
+				continue;
+			irRepl[i] = v;
+			irDelete(i);
+			changed = TRUE;
+		}
+	}
+	irResolve(fn);
+}
+
+static int irIsArith(int op)
+{
+	return op >= IR_ADD && op <= IR_NE;
+}
+
+static int irFold(int op, int a, int b, int* v)
+{
+	switch (op) {
+	case IR_ADD: return foldOp(PLUS, a, b, v);
+	case IR_SUB: return foldOp(MINUS, a, b, v);
+	case IR_MUL: return foldOp(MUL, a, b, v);
+	case IR_DIV: return foldOp(DIV, a, b, v);
+	case IR_SHL: *v = shiftLeft(a, b); return TRUE;
+	case IR_SHR: *v = shiftRight(a, b); return TRUE;
+	case IR_LT: return foldOp(LT, a, b, v);
+	case IR_LE: return foldOp(LE, a, b, v);
+	case IR_GT: return foldOp(GT, a, b, v);
+	case IR_GE: return foldOp(GE, a, b, v);
+	case IR_EQ: return foldOp(EQ, a, b, v);
+	default: return foldOp(NE, a, b, v);
+	}
+}
+
+/* sparse conditional constant propagation (Wegman and Zadeck) */
+#define IRTOP 0
+#define IRCONST 1
+#define IRBOTTOM 2
+
+static int* irLatKind, * irLatVal;      // indexed by value - firstInst
+static int* irUseStart, * irUseList;
+static char* irEdgeExec;                // indexed by predecessor slot
+static char* irVisited;                 // indexed by block - firstBlock
+static int* irFlowWork, irFlowN, irFlowCap;
+static int* irSsaWork, irSsaN, irSsaCap;
+static int irFirst;                     // firstInst of the function
+
+#define LATK(v) irLatKind[(v) - irFirst]
+#define LATV(v) irLatVal[(v) - irFirst]
+
+static void irAddEdge(int p, int s)
+{
+	irFlowWork = (int*)irGrow(irFlowWork, &irFlowCap, irFlowN + 2, sizeof(int));
+	irFlowWork[irFlowN++] = p;
+	irFlowWork[irFlowN++] = s;
+}
+
+static void irVisit(int i)
+{
+	IrInst* in = &irInst[i];
+	int kind = IRTOP, v = 0, k, a, b;
+
+	switch (in->op) {
+	case IR_CONST:
+		kind = IRCONST;
+		v = in->imm;
+		break;
+	case IR_PHI:
+		for (k = 0; k < in->nargs; k++) {
+			if (!irEdgeExec[irBlock[in->block].preds + k])
+				continue;
+			a = IRARG(i, k);
+			if (LATK(a) == IRTOP)
+				continue;
+			if (LATK(a) == IRBOTTOM || (kind == IRCONST && LATV(a) != v)) {
+				kind = IRBOTTOM;
+				break;
+			}
+			kind = IRCONST;
+			v = LATV(a);
+		}
+		break;
+	case IR_BR:
+		a = IRARG(i, 0);
+		if (LATK(a) == IRCONST)
+			irAddEdge(in->block, irBlock[in->block].succ[LATV(a) ? 0 : 1]);
+		else if (LATK(a) == IRBOTTOM) {
+			irAddEdge(in->block, irBlock[in->block].succ[0]);
+			irAddEdge(in->block, irBlock[in->block].succ[1]);
+		}
+		return;
+	case IR_JMP:
+		irAddEdge(in->block, irBlock[in->block].succ[0]);
+		return;
+	default:
+		if (!irIsArith(in->op)) {
+			kind = IRBOTTOM;
+			break;
+		}
+		a = IRARG(i, 0);
+		b = in->nargs == 2 ? IRARG(i, 1) : a;
+		if (LATK(a) == IRBOTTOM || LATK(b) == IRBOTTOM)
+			kind = IRBOTTOM;
+		else if (LATK(a) == IRCONST && LATK(b) == IRCONST)
+			kind = irFold(in->op, LATV(a), in->nargs == 2 ? LATV(b) : in->imm, &v)
+				? IRCONST : IRBOTTOM;
+		break;
+	}
+	if (kind == LATK(i) && (kind != IRCONST || v == LATV(i)))
+		return;
+	LATK(i) = kind;
+	LATV(i) = v;
+	for (k = irUseStart[i - irFirst]; k < irUseStart[i - irFirst + 1]; k++) {
+		irSsaWork = (int*)irGrow(irSsaWork, &irSsaCap, irSsaN + 1, sizeof(int));
+		irSsaWork[irSsaN++] = irUseList[k];
+	}
+}
+
+static void irSCCP(IrFunc* fn)
+{
+	int n = irNumInsts - fn->firstInst, np = 0, i, k, j, p, s, b, next;
+	int* from, * to;
+
+	irFirst = fn->firstInst;
+	irLatKind = irAlloc(n);
+	irLatVal = irAlloc(n);
+	for (k = 0; k < n; k++)
+		irLatKind[k] = IRTOP;
+	for (i = irFirst; i < irNumInsts; i++)
+		np += irInst[i].nargs;
+	from = irAlloc(np);
+	to = irAlloc(np);
+	np = 0;
+	for (i = irFirst; i < irNumInsts; i++)
+		for (k = 0; k < irInst[i].nargs; k++) {
+			from[np] = IRARG(i, k) - irFirst;
+			to[np++] = i;
+		}
+	irBuckets(n, np, from, to, &irUseStart, &irUseList);
+	free(from);
+	free(to);
+	irEdgeExec = (char*)calloc(irNumPreds + 1, 1);
+	irVisited = (char*)calloc(fn->nblocks, 1);
+	if (irEdgeExec == NULL || irVisited == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	irFlowN = irSsaN = 0;
+	irAddEdge(-1, fn->firstBlock);
+	while (irFlowN > 0 || irSsaN > 0) {
+		if (irFlowN > 0) {
+			s = irFlowWork[--irFlowN];
+			p = irFlowWork[--irFlowN];
+			if (p >= 0) {
+				j = irBlock[s].preds + irPredIndex(s, p);
+				if (irEdgeExec[j])
+					continue;
+				irEdgeExec[j] = TRUE;
+			}
+			if (!irVisited[s - fn->firstBlock]) {
+				irVisited[s - fn->firstBlock] = TRUE;
+				for (i = irBlock[s].first; i >= 0; i = irInst[i].next)
+					irVisit(i);
+			}
+			else
+				for (i = irBlock[s].first; i >= 0 && irInst[i].op == IR_PHI; i = irInst[i].next)
+					irVisit(i);
+		}
+		else {
+			i = irSsaWork[--irSsaN];
+			if (irInst[i].block >= 0 && irVisited[irInst[i].block - fn->firstBlock])
+				irVisit(i);
+		}
+	}
+
+	/* branches decided statically, unreachable blocks, constant values */
+	for (k = 0; k < irOrderN; k++) {
+		b = irOrder[k];
+		i = irBlock[b].last;
+		if (!irVisited[b - fn->firstBlock] || irInst[i].op != IR_BR
+			|| LATK(IRARG(i, 0)) != IRCONST)
+			continue;
+		j = LATV(IRARG(i, 0)) ? 0 : 1;
+		irRemoveEdge(b, irBlock[b].succ[1 - j]);
+		irBlock[b].succ[0] = irBlock[b].succ[j];
+		irBlock[b].nsucc = 1;
+		irInst[i].op = IR_JMP;
+		irInst[i].nargs = 0;
+	}
+	for (b = fn->firstBlock; b < fn->firstBlock + fn->nblocks; b++)
+		if (!irBlock[b].dead && !irVisited[b - fn->firstBlock])
+			irKillBlock(b);
+	for (i = irFirst; i < irNumInsts; i++) {
+		if (LATK(i) != IRCONST || irInst[i].block < 0 || irInst[i].op == IR_CONST
+			|| (irInst[i].op != IR_PHI && !irIsArith(irInst[i].op)))
+			continue;
+		if (irInst[i].op == IR_PHI) {
+			/* constants go after the phis */
+			b = irInst[i].block;
+			irUnlink(i);
+			for (next = irBlock[b].first; next >= 0 && irInst[next].op == IR_PHI; next = irInst[next].next)
+				;
+			irInsert(i, b, next);
+		}
+		irInst[i].op = IR_CONST;
+		irInst[i].imm = LATV(i);
+		irInst[i].nargs = 0;
+		irConsts++;
+	}
+	free(irLatKind); free(irLatVal); free(irUseStart); free(irUseList);
+	free(irEdgeExec); free(irVisited);
+	irSimplifyPhis(fn);
+}
+
+static int irIsConst(int v, int* val)
+{
+	if (irInst[v].op != IR_CONST)
+		return FALSE;
+	*val = irInst[v].imm;
+	return TRUE;
+}
+
+/* can instruction i neither trap nor change anything? */
+static int irIsPure(int i)
+{
+	int op = irInst[i].op, v;
+
+	switch (op) {
+	case IR_DIV:
+		return irIsConst(IRARG(i, 1), &v) && v != 0 && v != -1;
+	case IR_LDX:
+		return irInst[i].imm < 0 || (irInst[i].imm > 0 && irIsConst(IRARG(i, 1), &v)
+			&& v >= 0 && v < irInst[i].imm);
+	case IR_CONST: case IR_PARAM: case IR_PHI: case IR_LDG:
+	case IR_ADDRG: case IR_ADDRL:
+		return TRUE;
+	default:
+		return irIsArith(op);
+	}
+}
+
+/* dead code elimination: everything not needed by an effect goes */
+static void irDCE(IrFunc* fn)
+{
+	int n = irNumInsts - fn->firstInst, sp = 0, i, k, a;
+	char* live = (char*)calloc(n, 1);
+	int* work = irAlloc(n);
+
+	if (live == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (i = fn->firstInst; i < irNumInsts; i++)
+		if (irInst[i].op != IR_NOP && irInst[i].block >= 0 && !irIsPure(i)) {
+			live[i - fn->firstInst] = TRUE;
+			work[sp++] = i;
+		}
+	while (sp > 0) {
+		i = work[--sp];
+		for (k = 0; k < irInst[i].nargs; k++) {
+			a = IRARG(i, k);
+			if (!live[a - fn->firstInst]) {
+				live[a - fn->firstInst] = TRUE;
+				work[sp++] = a;
+			}
+		}
+	}
+	for (i = fn->firstInst; i < irNumInsts; i++)
+		if (irInst[i].op != IR_NOP && irInst[i].block >= 0 && !live[i - fn->firstInst]) {
+			irDelete(i);
+			irDead++;
+		}
+	free(live);
+	free(work);
+}
+
+/* loop invariant code motion for the natural loops of while statements */
+static int* irLoopStart, * irLoopBlocks, * irLoopHead;
+
+static int irLoopCompare(const void* a, const void* b)
+{
+	int x = *(const int*)a, y = *(const int*)b;
+	return (irLoopStart[x + 1] - irLoopStart[x]) - (irLoopStart[y + 1] - irLoopStart[y]);
+}
+
+static void irLICM(IrFunc* fn)
+{
+	int n = fn->nblocks, nloops = 0, nb = 0, cap = 64, sp, changed;
+	int* inLoop = irAlloc(n), * work, * order;
+	int* stored = irAlloc(globalSize + 1);
+	int k, j, h, b, p, i, next, l, pre, hasCall, ok;
+
+	irComputeRPO(fn);
+	irDominators();
+	sp = n;
+	for (k = 0; k < irOrderN; k++)
+		sp += irBlock[irOrder[k]].npred;
+	work = irAlloc(sp);
+	irLoopStart = irAlloc(n + 1);
+	irLoopHead = irAlloc(n);
+	irLoopBlocks = irAlloc(cap);
+	for (k = 0; k < n; k++)
+		inLoop[k] = -1;
+	for (k = 0; k <= globalSize; k++)
+		stored[k] = -1;
+
+	/* natural loops: the blocks reaching a back edge without the header */
+	for (k = 0; k < irOrderN; k++) {
+		h = irOrder[k];
+		sp = 0;
+		for (j = 0; j < irBlock[h].npred; j++) {
+			p = irPreds[irBlock[h].preds + j];
+			if (irDominates(h, p))
+				work[sp++] = p;
+		}
+		if (sp == 0)
+			continue;
+		irLoopHead[nloops] = h;
+		irLoopStart[nloops] = nb;
+		inLoop[h - fn->firstBlock] = nloops;
+		irLoopBlocks = (int*)irGrow(irLoopBlocks, &cap, nb + 1, sizeof(int));
+		irLoopBlocks[nb++] = h;
+		while (sp > 0) {
+			b = work[--sp];
+			if (inLoop[b - fn->firstBlock] == nloops)
+				continue;
+			inLoop[b - fn->firstBlock] = nloops;
+			irLoopBlocks = (int*)irGrow(irLoopBlocks, &cap, nb + 1, sizeof(int));
+			irLoopBlocks[nb++] = b;
+			for (j = 0; j < irBlock[b].npred; j++)
+				work[sp++] = irPreds[irBlock[b].preds + j];
+		}
+		nloops++;
+	}
+	irLoopStart[nloops] = nb;
+
+	/* inner loops first, so their invariants can move on outwards */
+	order = irAlloc(nloops);
+	for (l = 0; l < nloops; l++)
+		order[l] = l;
+	qsort(order, nloops, sizeof(int), irLoopCompare);
+	for (k = 0; k < nloops; k++) {
+		l = order[k];
+		h = irLoopHead[l];
+		for (j = irLoopStart[l]; j < irLoopStart[l + 1]; j++)
+			inLoop[irLoopBlocks[j] - fn->firstBlock] = n + l;
+		pre = -1;
+		for (j = 0; j < irBlock[h].npred; j++) {
+			p = irPreds[irBlock[h].preds + j];
+			if (inLoop[p - fn->firstBlock] != n + l)
+				pre = pre == -1 ? p : -2;
+		}
+		if (pre < 0 || irBlock[pre].nsucc != 1)
+			continue;
+		hasCall = FALSE;
+		for (j = irLoopStart[l]; j < irLoopStart[l + 1]; j++)
+			for (i = irBlock[irLoopBlocks[j]].first; i >= 0; i = irInst[i].next)
+				if (irInst[i].op == IR_CALL)
+					hasCall = TRUE;
+				else if (irInst[i].op == IR_STG)
+					stored[irInst[i].imm] = l;
+		changed = TRUE;
+		while (changed) {
+			changed = FALSE;
+			for (j = irLoopStart[l]; j < irLoopStart[l + 1]; j++)
+				for (i = irBlock[irLoopBlocks[j]].first; i >= 0; i = next) {
+					next = irInst[i].next;
+					if (!irIsPure(i) || irInst[i].op == IR_PHI || irInst[i].op == IR_PARAM
+						|| irInst[i].op == IR_LDX)
+						continue;
+					if (irInst[i].op == IR_LDG && (hasCall || stored[irInst[i].imm] == l))
+						continue;
+					ok = TRUE;
+					for (p = 0; p < irInst[i].nargs; p++)
+						if (inLoop[irInst[IRARG(i, p)].block - fn->firstBlock] == n + l)
+							ok = FALSE;
+					if (!ok)
+						continue;
+					irUnlink(i);
+					irInsert(i, pre, irBlock[pre].last);
+					irHoisted++;
+					changed = TRUE;
+				}
+		}
+	}
+	free(inLoop); free(work); free(order); free(stored);
+	free(irLoopStart); free(irLoopHead); free(irLoopBlocks);
+}
+
+/*************** listing ***************/
+
+static int irCount(IrFunc* fn)
+{
+	int i, n = 0;
+
+	for (i = fn->firstInst; i < irNumInsts; i++)
+		if (irInst[i].op != IR_NOP && irInst[i].block >= 0)
+			n++;
+	return n;
+}
+
+static void irPrintValue(IrFunc* fn, int v)
+{
+	fprintf(fpOut, "v%d", v - fn->firstInst);
+}
+
+static void irPrintFunction(IrFunc* fn)
+{
+	IrInst* in;
+	int b, i, k;
+
+	fprintf(fpOut, "\nfunction %s:\n", fn->decl->attr.name);
+	for (b = fn->firstBlock; b < fn->firstBlock + fn->nblocks; b++) {
+		if (irBlock[b].dead)
+			continue;
+		fprintf(fpOut, "  B%d:", b - fn->firstBlock);
+		if (irBlock[b].npred > 0) {
+			fprintf(fpOut, "%*s; preds", b - fn->firstBlock < 10 ? 6 : 5, "");
+			for (k = 0; k < irBlock[b].npred; k++)
+				fprintf(fpOut, "%s B%d", k ? "," : "", irPreds[irBlock[b].preds + k] - fn->firstBlock);
+			if (irBlock[b].idom >= 0)
+				fprintf(fpOut, "; idom B%d", irBlock[b].idom - fn->firstBlock);
+		}
+		fprintf(fpOut, "\n");
+		for (i = irBlock[b].first; i >= 0; i = in->next) {
+			in = &irInst[i];
+			fprintf(fpOut, "    ");
+			if (in->op != IR_STG && in->op != IR_STX && in->op != IR_JMP
+				&& in->op != IR_BR && in->op != IR_RET && in->op != IR_OUT) {
+				irPrintValue(fn, i);
+				fprintf(fpOut, " = ");
+			}
+			fprintf(fpOut, "%s", irOpNames[in->op]);
+			switch (in->op) {
+			case IR_CONST: case IR_PARAM: case IR_ADDRL:
+				fprintf(fpOut, " %d", in->imm);
+				break;
+			case IR_LDG: case IR_STG: case IR_ADDRG:
+				fprintf(fpOut, " %s", irGlobal[in->imm]->attr.name);
+				if (in->op == IR_STG)
+					fprintf(fpOut, ",");
+				break;
+			case IR_CALL:
+				fprintf(fpOut, " %s", irFunc[in->imm].decl->attr.name);
+				break;
+			default:
+				break;
+			}
+			for (k = 0; k < in->nargs; k++) {
+				fprintf(fpOut, k ? ", " : " ");
+				irPrintValue(fn, IRARG(i, k));
+				if (in->op == IR_PHI)
+					fprintf(fpOut, " (B%d)", irPreds[irBlock[b].preds + k] - fn->firstBlock);
+			}
+			if (in->op == IR_SHL || in->op == IR_SHR)
+				fprintf(fpOut, ", %d", in->imm);
+			if (in->op == IR_JMP)
+				fprintf(fpOut, " B%d", irBlock[b].succ[0] - fn->firstBlock);
+			if (in->op == IR_BR)
+				fprintf(fpOut, ", B%d, B%d", irBlock[b].succ[0] - fn->firstBlock,
+					irBlock[b].succ[1] - fn->firstBlock);
+			fprintf(fpOut, "\n");
+		}
+	}
+}
+
+/* number the functions and record the global declarations */
+static void irInit(TreeNode* syntaxTree)
+{
+	TreeNode* t;
+
+	free(irGlobal);
+	irGlobal = (TreeNode**)calloc(globalSize + 1, sizeof(TreeNode*));
+	if (irGlobal == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	irNumFuncs = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK) {
+			irFunc = (IrFunc*)irGrow(irFunc, &irFuncCap, irNumFuncs + 1, sizeof(IrFunc));
+			irFunc[irNumFuncs].decl = t;
+			t->memloc = irNumFuncs++;
+		}
+		else
+			irGlobal[t->memloc] = t;
+}
+
+void irBuild(TreeNode* syntaxTree)
+{
+	TreeNode* t;
+	IrFunc* fn;
+	int f, before, total = 0, totalBefore = 0;
+
+	irInit(syntaxTree);
+	fprintf(fpOut, "\nSSA form:\n");
+	for (t = syntaxTree; t != NULL; t = t->sibling) {
+		if (t->kind.exp != FuncDeclK)
+			continue;
+		if (!strcmp(t->attr.name, "main"))
+			irMain = t->memloc;
+		f = irLower(t);
+		fn = &irFunc[f];
+		irConsts = irDead = irHoisted = irBlocksRemoved = 0;
+		irRemoveUnreachable(fn);
+		irBlocksRemoved = 0;
+		irBuildSSA(fn);
+		irSimplifyPhis(fn);
+		before = irCount(fn);
+		irSCCP(fn);
+		free(irRepl);
+		irDCE(fn);
+		irLICM(fn);
+		fn = &irFunc[f];
+		fn->ninst = irNumInsts - fn->firstInst;
+		irPrintFunction(fn);
+		fprintf(fpOut, "  ; %d instructions in SSA form, %d after optimization"
+			" (%d constants, %d dead, %d hoisted, %d blocks removed)\n",
+			before, irCount(fn), irConsts, irDead, irHoisted, irBlocksRemoved);
+		totalBefore += before;
+		total += irCount(fn);
+	}
+	fprintf(fpOut, "\nSSA form: %d instructions, %d after optimization\n", totalBefore, total);
+}
+
+/*************** execution ***************/
+
+/* Runs the optimized SSA form directly: every activation gets one slot
+   per value of its function and an area in mem for its local arrays. */
+
+#define IRVALSTACK 4000000
+
+static int* irVals = NULL, * irValTop, * irValEnd;
+static int irSp;                // first free word of mem
+static int irDepth;             // calls in progress, at most MAXCALLDEPTH
+static long long irSteps = 0;
+
+static void irRuntimeError(int i, char* message)
+{
+	TreeNode t;
+	t.lineno = irInst[i].line;
+	runtimeError(&t, message);
+}
+
+static int irExec(int f, int* argv, int nargs)
+{
+	IrFunc* fn = &irFunc[f];
+	int first = fn->firstInst;
+	int* val = irValTop;
+	int frame = irSp, from = -1, b = fn->firstBlock;
+	int i, j, k, n, a, result;
+	IrInst* in;
+
+#define V(x) val[(x) - first]
+	if (irDepth == MAXCALLDEPTH || irValTop + fn->ninst > irValEnd
+		|| irSp + fn->decl->framesize > MEMSIZE)
+		irRuntimeError(irBlock[b].first, "stack overflow");
+	irDepth++;
+	irValTop += fn->ninst;
+	irSp += fn->decl->framesize;
+	memset(mem + frame, 0, fn->decl->framesize * sizeof(int));
+	for (;;) {
+		i = irBlock[b].first;
+		if (from >= 0 && irInst[i].op == IR_PHI) {
+			/* all phis read their operands before any is written */
+			j = irPredIndex(b, from);
+			for (k = i, n = 0; irInst[k].op == IR_PHI; k = irInst[k].next) {
+				if (irValTop + n >= irValEnd)
+					irRuntimeError(k, "stack overflow");
+				irValTop[n++] = V(IRARG(k, j));
+			}
+			for (k = i, n = 0; irInst[k].op == IR_PHI; k = irInst[k].next)
+				V(k) = irValTop[n++];
+			i = k;
+		}
+		for (; i >= 0; i = in->next) {
+			in = &irInst[i];
+			irSteps++;
+			switch (in->op) {
+			case IR_CONST: V(i) = in->imm; break;
+			case IR_PARAM: V(i) = in->imm < nargs ? argv[in->imm] : 0; break;
+			/* wrapping around, as SCCP folds them */
+			case IR_ADD:
+			case IR_SUB:
+			case IR_MUL: irFold(in->op, V(IRARG(i, 0)), V(IRARG(i, 1)), &V(i)); break;
+			case IR_DIV:
+				if (V(IRARG(i, 1)) == 0)
+					irRuntimeError(i, "division by zero");
+				if (V(IRARG(i, 1)) == -1 && V(IRARG(i, 0)) == -2147483647 - 1)
+					irRuntimeError(i, "division overflow");
+				V(i) = V(IRARG(i, 0)) / V(IRARG(i, 1));
+				break;
+			case IR_SHL: V(i) = shiftLeft(V(IRARG(i, 0)), in->imm); break;
+			case IR_SHR: V(i) = shiftRight(V(IRARG(i, 0)), in->imm); break;
+			case IR_LT: V(i) = V(IRARG(i, 0)) < V(IRARG(i, 1)); break;
+			case IR_LE: V(i) = V(IRARG(i, 0)) <= V(IRARG(i, 1)); break;
+			case IR_GT: V(i) = V(IRARG(i, 0)) > V(IRARG(i, 1)); break;
+			case IR_GE: V(i) = V(IRARG(i, 0)) >= V(IRARG(i, 1)); break;
+			case IR_EQ: V(i) = V(IRARG(i, 0)) == V(IRARG(i, 1)); break;
+			case IR_NE: V(i) = V(IRARG(i, 0)) != V(IRARG(i, 1)); break;
+			case IR_LDG: V(i) = mem[in->imm]; break;
+			case IR_STG: mem[in->imm] = V(IRARG(i, 0)); break;
+			case IR_ADDRG: V(i) = in->imm; break;
+			case IR_ADDRL: V(i) = frame + in->imm; break;
+			case IR_LDX:
+			case IR_STX:
+				k = V(IRARG(i, 1));
+				a = (int)((unsigned int)V(IRARG(i, 0)) + (unsigned int)k);
+				if (in->imm >= 0 && (in->imm > 0 ? (unsigned int)k >= (unsigned int)in->imm
+					: (unsigned int)a >= MEMSIZE))
+					irRuntimeError(i, "array index out of bounds");
+				if (in->op == IR_LDX)
+					V(i) = mem[a];
+				else
+					mem[a] = V(IRARG(i, 2));
+				break;
+			case IR_CALL:
+				n = in->nargs;
+				if (irValTop + n > irValEnd)
+					irRuntimeError(i, "stack overflow");
+				for (k = 0; k < n; k++)
+					irValTop[k] = V(IRARG(i, k));
+				irValTop += n;
+				a = irExec(in->imm, irValTop - n, n);
+				irValTop -= n;
+				V(i) = a;
+				break;
+			case IR_IN:
+				{
+					TreeNode t;
+					t.lineno = in->line;
+					V(i) = readInt(&t);
+				}
+				break;
+			case IR_OUT:
+				writeInt(V(IRARG(i, 0)));
+				V(i) = 0;
+				break;
+			case IR_JMP:
+				from = b;
+				b = irBlock[b].succ[0];
+				break;
+			case IR_BR:
+				from = b;
+				b = irBlock[b].succ[V(IRARG(i, 0)) ? 0 : 1];
+				break;
+			case IR_RET:
+				result = in->nargs ? V(IRARG(i, 0)) : 0;
+				irValTop = val;
+				irSp = frame;
+				irDepth--;
+				return result;
+			default:
+				break;
+			}
+		}
+	}
+#undef V
+}
+
+void irRun(void)
+{
+	clock_t start;
+	double secs;
+
+	if (irMain < 0) {
+		fprintf(stderr, "Runtime error: no main function\n");
+		exit(EXIT_FAILURE);
+	}
+	if (mem == NULL)
+		mem = (int*)calloc(MEMSIZE, sizeof(int));
+	irVals = (int*)malloc(IRVALSTACK * sizeof(int));
+	if (mem == NULL || irVals == NULL || globalSize >= MEMSIZE) {
+		fprintf(stderr, "Runtime error: out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	irValTop = irVals;
+	irValEnd = irVals + IRVALSTACK;
+	irSp = globalSize;
+	irDepth = 0;
+	start = clock();
+	irExec(irMain, NULL, 0);
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	flushOutput();
+	if (ShowTime)
+		fprintf(stderr, "ir: %lld instructions in %.3f s (%.2f M instructions/s)\n",
+			irSteps, secs, secs > 0 ? irSteps / secs / 1e6 : 0.0);
+	free(irVals);
+}
+
+
+/*********************************************/
+/**************dataflow analysis**************/
+/*********************************************/
+
+/* An iterative bit-vector dataflow solver over the pre-SSA form of the
+   IR (the CFG of LDV/STV instructions that irLower builds from the
+   compound, selection and iteration statements). Sets are arrays of
+   32-bit words, one set per block, indexed by the position of the block
+   in reverse postorder. The solver sweeps the blocks in reverse
+   postorder (postorder for backward problems) and only evaluates the
+   blocks marked pending, so a function needs about loop depth + 2
+   sweeps. Liveness finds dead stores, reaching definitions finds reads
+   that only the implicit zero initialization can reach. */
+
+typedef unsigned int BitWord;
+
+#define BITSET(s, i) ((s)[(i) >> 5] |= 1u << ((i) & 31))
+#define BITCLEAR(s, i) ((s)[(i) >> 5] &= ~(1u << ((i) & 31)))
+#define BITTEST(s, i) (((s)[(i) >> 5] >> ((i) & 31)) & 1u)
+
+typedef struct {
+	int words;          // per set
+	int forward;        // direction of the problem
+	BitWord* gen;       // sets of block at position k start at k*words
+	BitWord* kill;
+	BitWord* in;
+	BitWord* out;
+	long long visits;   // block evaluations by the solver
+} DfProblem;
+
+static BitWord* dfSets(int nblocks, int words)
+{
+	BitWord* s = (BitWord*)calloc((size_t)nblocks * words + 1, sizeof(BitWord));
+	if (s == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return s;
+}
+
+static void dfInit(DfProblem* df, int nbits, int forward)
+{
+	df->words = (nbits + 31) / 32;
+	df->forward = forward;
+	df->gen = dfSets(irOrderN, df->words);
+	df->kill = dfSets(irOrderN, df->words);
+	df->in = dfSets(irOrderN, df->words);
+	df->out = dfSets(irOrderN, df->words);
+	df->visits = 0;
+}
+
+static void dfFree(DfProblem* df)
+{
+	free(df->gen);
+	free(df->kill);
+	free(df->in);
+	free(df->out);
+}
+
+/* union meet; forward: out = gen | (in & ~kill), backward the reverse */
+static void dfSolve(DfProblem* df)
+{
+	int n = irOrderN, w = df->words, pending = n, k, m, pos, j, b, x, changed;
+	char* mark = (char*)malloc(n + 1);
+	BitWord* meet, * result, * other, * gen, * kill, v;
+
+	if (mark == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	memset(mark, TRUE, n);
+	while (pending > 0)
+		for (k = 0; k < n; k++) {
+			pos = df->forward ? k : n - 1 - k;
+			if (!mark[pos])
+				continue;
+			mark[pos] = FALSE;
+			pending--;
+			df->visits++;
+			b = irOrder[pos];
+			meet = (df->forward ? df->in : df->out) + (size_t)pos * w;
+			result = (df->forward ? df->out : df->in) + (size_t)pos * w;
+			other = df->forward ? df->out : df->in;
+			memset(meet, 0, w * sizeof(BitWord));
+			if (df->forward)
+				for (j = 0; j < irBlock[b].npred; j++) {
+					x = irBlock[irPreds[irBlock[b].preds + j]].rpo;
+					for (m = 0; m < w; m++)
+						meet[m] |= other[(size_t)x * w + m];
+				}
+			else
+				for (j = 0; j < irBlock[b].nsucc; j++) {
+					x = irBlock[irBlock[b].succ[j]].rpo;
+					for (m = 0; m < w; m++)
+						meet[m] |= other[(size_t)x * w + m];
+				}
+			gen = df->gen + (size_t)pos * w;
+			kill = df->kill + (size_t)pos * w;
+			changed = FALSE;
+			for (m = 0; m < w; m++) {
+				v = gen[m] | (meet[m] & ~kill[m]);
+				if (v != result[m]) {
+					result[m] = v;
+					changed = TRUE;
+				}
+			}
+			if (!changed)
+				continue;
+			/* the blocks that read this result have to be evaluated again */
+			if (df->forward)
+				for (j = 0; j < irBlock[b].nsucc; j++) {
+					x = irBlock[irBlock[b].succ[j]].rpo;
+					if (!mark[x]) {
+						mark[x] = TRUE;
+						pending++;
+					}
+				}
+			else
+				for (j = 0; j < irBlock[b].npred; j++) {
+					x = irBlock[irPreds[irBlock[b].preds + j]].rpo;
+					if (!mark[x]) {
+						mark[x] = TRUE;
+						pending++;
+					}
+				}
+		}
+	free(mark);
+}
+
+/* findings, sorted by line before they are listed */
+typedef enum { DfUnused, DfNeverRead, DfUninitialized, DfDeadStore } DfKind;
+
+typedef struct {
+	int line;
+	DfKind kind;
+	TreeNode* decl;
+} DfFinding;
+
+static DfFinding* dfFindings = NULL;
+static int dfNumFindings = 0, dfFindingCap = 0;
+static TreeNode** dfVarDecl = NULL;     // declaration of each variable
+static int* dfReads = NULL, * dfWrites = NULL;
+
+static void dfReport(int line, DfKind kind, TreeNode* decl)
+{
+	dfFindings = (DfFinding*)irGrow(dfFindings, &dfFindingCap, dfNumFindings + 1, sizeof(DfFinding));
+	dfFindings[dfNumFindings].line = line;
+	dfFindings[dfNumFindings].kind = kind;
+	dfFindings[dfNumFindings++].decl = decl;
+}
+
+static int dfCompare(const void* a, const void* b)
+{
+	const DfFinding* x = (const DfFinding*)a;
+	const DfFinding* y = (const DfFinding*)b;
+
+	if (x->line != y->line)
+		return x->line - y->line;
+	return (int)x->kind - (int)y->kind;
+}
+
+/* give every local declaration of the statements t a variable number */
+static void dfNumberLocals(TreeNode* t)
+{
+	TreeNode* d;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind != StmtK)
+			continue;
+		switch (t->kind.stmt) {
+		case CompoundK:
+			for (d = t->child[0]; d != NULL; d = d->sibling)
+				irVar(d);
+			dfNumberLocals(t->child[1]);
+			break;
+		case SelectionK:
+			dfNumberLocals(t->child[1]);
+			dfNumberLocals(t->child[2]);
+			break;
+		case IterationK:
+			dfNumberLocals(t->child[1]);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* count the reads and writes of local variables and arrays */
+static void dfCountUses(TreeNode* t, int write)
+{
+	int i;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == ExpK && t->kind.exp == IdK && t->decl->level) {
+			if (write && t->decl->kind.exp == VarDeclK)
+				dfWrites[irVar(t->decl)]++;
+			else
+				dfReads[irVar(t->decl)]++;
+		}
+		if (t->nodekind == ExpK && t->kind.exp == AssignK) {
+			dfCountUses(t->child[0], TRUE);
+			dfCountUses(t->child[1], FALSE);
+		}
+		else
+			for (i = 0; i < MAXCHILDREN; i++)
+				dfCountUses(t->child[i], FALSE);
+		if (write)
+			break;
+	}
+}
+
+static void dfUnusedVariables(TreeNode* f)
+{
+	TreeNode* p;
+	int v;
+
+	for (p = f->child[0]; p != NULL; p = p->sibling)
+		if (!isVoidParam(p))
+			irVar(p);
+	dfNumberLocals(f->child[1]);
+	dfReads = (int*)calloc(irNumVars + 1, sizeof(int));
+	dfWrites = (int*)calloc(irNumVars + 1, sizeof(int));
+	dfVarDecl = (TreeNode**)calloc(irNumVars + 1, sizeof(TreeNode*));
+	if (dfReads == NULL || dfWrites == NULL || dfVarDecl == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (v = 0; v < irVarCap; v++)
+		if (irVarKey[v] != NULL)
+			dfVarDecl[irVarNo[v]] = irVarKey[v];
+	dfCountUses(f->child[1], FALSE);
+	for (v = 0; v < irNumVars; v++) {
+		if (dfReads[v] > 0)
+			continue;
+		dfReport(dfVarDecl[v]->lineno, dfWrites[v] > 0 ? DfNeverRead : DfUnused, dfVarDecl[v]);
+	}
+}
+
+/* dead stores: assignments to a variable that is not live after them */
+static void dfDeadStores(IrFunc* fn, DfProblem* live)
+{
+	BitWord* set = dfSets(1, live->words);
+	int k, i, w = live->words;
+
+	for (k = 0; k < irOrderN; k++) {
+		memcpy(set, live->out + (size_t)k * w, w * sizeof(BitWord));
+		for (i = irBlock[irOrder[k]].last; i >= 0; i = irInst[i].prev)
+			if (irInst[i].op == IR_STV) {
+				if (!BITTEST(set, irInst[i].imm) && i >= fn->firstBody
+					&& dfReads[irInst[i].imm] > 0)
+					dfReport(irInst[i].line, DfDeadStore, dfVarDecl[irInst[i].imm]);
+				BITCLEAR(set, irInst[i].imm);
+			}
+			else if (irInst[i].op == IR_LDV)
+				BITSET(set, irInst[i].imm);
+	}
+	free(set);
+}
+
+void dataflowReport(TreeNode* syntaxTree)
+{
+	TreeNode* t;
+	IrFunc* fn;
+	DfProblem live, reach;
+	BitWord* set;
+	int* defNo, * defVar, * defId, * defStart, * defList, * initDef, * seen;
+	int ndefs, k, i, v, j, b, f;
+	int nfuncs = 0, nblocks = 0, nvars = 0, totalDefs = 0;
+	long long visits = 0;
+
+	irInit(syntaxTree);
+	fprintf(fpOut, "\nDataflow report:\n");
+	for (t = syntaxTree; t != NULL; t = t->sibling) {
+		if (t->kind.exp != FuncDeclK)
+			continue;
+		f = irLower(t);
+		fn = &irFunc[f];
+		irRemoveUnreachable(fn);
+		dfNumFindings = 0;
+		dfUnusedVariables(t);
+
+		/* liveness of the variables */
+		dfInit(&live, irNumVars, FALSE);
+		for (k = 0; k < irOrderN; k++)
+			for (i = irBlock[irOrder[k]].first; i >= 0; i = irInst[i].next) {
+				v = irInst[i].imm;
+				if (irInst[i].op == IR_LDV && !BITTEST(live.kill + (size_t)k * live.words, v))
+					BITSET(live.gen + (size_t)k * live.words, v);
+				else if (irInst[i].op == IR_STV)
+					BITSET(live.kill + (size_t)k * live.words, v);
+			}
+		dfSolve(&live);
+		dfDeadStores(fn, &live);
+
+		/* reaching definitions: one bit per STV */
+		defNo = irAlloc(fn->ninst);
+		defVar = irAlloc(fn->ninst);
+		defId = irAlloc(fn->ninst);
+		initDef = irAlloc(irNumVars);
+		seen = irAlloc(irNumVars);
+		for (v = 0; v < irNumVars; v++)
+			initDef[v] = seen[v] = -1;
+		ndefs = 0;
+		for (k = 0; k < irOrderN; k++)
+			for (i = irBlock[irOrder[k]].first; i >= 0; i = irInst[i].next)
+				if (irInst[i].op == IR_STV) {
+					/* locals start at zero, parameters with the argument */
+					if (i < fn->firstBody && irInst[IRARG(i, 0)].op == IR_CONST)
+						initDef[irInst[i].imm] = ndefs;
+					defNo[i - fn->firstInst] = ndefs;
+					defVar[ndefs] = irInst[i].imm;
+					defId[ndefs] = ndefs;
+					ndefs++;
+				}
+		irBuckets(irNumVars, ndefs, defVar, defId, &defStart, &defList);
+		dfInit(&reach, ndefs, TRUE);
+		for (k = 0; k < irOrderN; k++) {
+			BitWord* gen = reach.gen + (size_t)k * reach.words;
+			BitWord* kill = reach.kill + (size_t)k * reach.words;
+			for (i = irBlock[irOrder[k]].first; i >= 0; i = irInst[i].next) {
+				if (irInst[i].op != IR_STV)
+					continue;
+				v = irInst[i].imm;
+				if (seen[v] != k) {
+					seen[v] = k;
+					for (j = defStart[v]; j < defStart[v + 1]; j++)
+						BITSET(kill, defList[j]);
+				}
+				for (j = defStart[v]; j < defStart[v + 1]; j++)
+					BITCLEAR(gen, defList[j]);
+				BITSET(gen, defNo[i - fn->firstInst]);
+			}
+		}
+		dfSolve(&reach);
+
+		/* reads reached by the implicit initialization of a local */
+		set = dfSets(1, reach.words);
+		for (v = 0; v < irNumVars; v++)
+			seen[v] = -1;
+		for (k = 0; k < irOrderN; k++) {
+			memcpy(set, reach.in + (size_t)k * reach.words, reach.words * sizeof(BitWord));
+			for (i = irBlock[irOrder[k]].first; i >= 0; i = irInst[i].next) {
+				v = irInst[i].imm;
+				if (irInst[i].op == IR_STV) {
+					for (j = defStart[v]; j < defStart[v + 1]; j++)
+						BITCLEAR(set, defList[j]);
+					BITSET(set, defNo[i - fn->firstInst]);
+				}
+				else if (irInst[i].op == IR_LDV && initDef[v] >= 0
+					&& BITTEST(set, initDef[v]) && seen[v] < 0) {
+					seen[v] = TRUE;
+					dfReport(irInst[i].line, DfUninitialized, dfVarDecl[v]);
+				}
+			}
+		}
+
+		if (dfNumFindings > 1)
+			qsort(dfFindings, dfNumFindings, sizeof(DfFinding), dfCompare);
+		for (k = 0; k < dfNumFindings; k++) {
+			DfFinding* d = &dfFindings[k];
+			fprintf(fpOut, "  line %d: %s: ", d->line, t->attr.name);
+			switch (d->kind) {
+			case DfUnused:
+				fprintf(fpOut, "%s %s is never used\n",
+					d->decl->kind.exp == VarArrayDeclK ? "array" : "variable", d->decl->attr.name);
+				break;
+			case DfNeverRead:
+				fprintf(fpOut, "variable %s is assigned but never read\n", d->decl->attr.name);
+				break;
+			case DfUninitialized:
+				fprintf(fpOut, "variable %s may be read before it is assigned\n", d->decl->attr.name);
+				break;
+			default:
+				fprintf(fpOut, "value assigned to %s is never read\n", d->decl->attr.name);
+				break;
+			}
+		}
+
+		b = 0;
+		for (k = fn->firstBlock; k < fn->firstBlock + fn->nblocks; k++)
+			if (!irBlock[k].dead)
+				b++;
+		nfuncs++;
+		nblocks += b;
+		nvars += irNumVars;
+		totalDefs += ndefs;
+		visits += live.visits + reach.visits;
+		dfFree(&live);
+		dfFree(&reach);
+		free(set); free(defNo); free(defVar); free(defId); free(initDef); free(seen);
+		free(defStart); free(defList);
+		free(dfReads); free(dfWrites); free(dfVarDecl);
+	}
+	fprintf(fpOut, "  %d functions, %d blocks, %d variables, %d definitions; "
+		"%lld block evaluations\n", nfuncs, nblocks, nvars, totalDefs, visits);
+}
+
+
+/*********************************************/
+/****************range analysis***************/
+/*********************************************/
+
+/* Interval analysis on the syntax tree. Every int value has a range
+   [lo, hi]. Locals are tracked by frame slot; global scalars, array
+   elements, input and return values are unknown. Both branches of an if
+   are analyzed and joined, the condition of an if or while narrows the
+   variables it compares, and a loop is iterated to a fixpoint with
+   widening and then narrowed once. Every change of a range is logged in
+   a trail, so undoing and joining a branch costs the variables it
+   assigns, not the whole frame. Arguments are joined over the call
+   sites, and the program is analyzed again until the parameter ranges
+   are stable. Arithmetic that may overflow gives an unknown result,
+   because the program wraps around. A subscript whose range lies within
+   its array is marked inBounds, and the interpreter, the bytecode
+   machine and the IR leave out its bounds check. */
+
+typedef struct {
+	int lo, hi;         // empty when lo > hi
+} Range;
+
+typedef struct {
+	int slot;
+	Range old;          // value before the change
+	Range now;          // rgCollect: value after the changes
+} RgChange;
+
+#define RGMIN (-2147483647 - 1)
+#define RGMAX 2147483647
+#define RGMAXDEPTH 5    // deeper loops only forget what they assign
+#define RGMAXROUNDS 20  // analyses of the whole program
+
+static const Range rgTop = { RGMIN, RGMAX };
+static const Range rgEmpty = { 1, 0 };
+static const Range rgZero = { 0, 0 };
+
+static Range* rgEnv = NULL;     // range per frame slot of the function
+static int* rgSeen = NULL;      // per slot: stamp of rgCollect/rgIf
+static int* rgIndex = NULL;     // per slot: position in a change list
+static int rgStamp = 0;
+static RgChange* rgTrail = NULL;
+static int rgTrailN = 0, rgTrailCap = 0;
+static int rgLive;              // FALSE where the code cannot be reached
+static int rgRecord;            // mark the subscripts in this pass
+static int rgDepth;             // loop nesting
+
+/* per function, numbered by FuncDeclK memloc */
+static int rgNumFuncs = 0;
+static int* rgParamBase = NULL; // first parameter in the arrays below
+static int* rgCalled, * rgCalledNext;
+static Range* rgParam, * rgParamNext;   // scalar parameters
+static int* rgSize, * rgSizeNext;       // array parameters: smallest argument
+static TreeNode* rgFunc;        // function being analyzed
+static TreeNode* rgMain;
+static int rgAccesses, rgProven;
+
+static Range rgMake(long long lo, long long hi)
+{
+	Range r;
+
+	if (lo < RGMIN || hi > RGMAX)
+		return rgTop;
+	r.lo = (int)lo;
+	r.hi = (int)hi;
+	return r;
+}
+
+static Range rgJoin(Range a, Range b)
+{
+	if (a.lo > a.hi)
+		return b;
+	if (b.lo > b.hi)
+		return a;
+	if (b.lo < a.lo)
+		a.lo = b.lo;
+	if (b.hi > a.hi)
+		a.hi = b.hi;
+	return a;
+}
+
+static int rgSame(Range a, Range b)
+{
+	if (a.lo > a.hi || b.lo > b.hi)
+		return a.lo > a.hi && b.lo > b.hi;
+	return a.lo == b.lo && a.hi == b.hi;
+}
+
+/* is a within b? */
+static int rgWithin(Range a, Range b)
+{
+	return a.lo > a.hi || (b.lo <= a.lo && a.hi <= b.hi);
+}
+
+/* r contains old: the bounds that moved go to infinity */
+static Range rgWiden(Range old, Range r)
+{
+	if (old.lo > old.hi)
+		return r;
+	if (r.lo < old.lo)
+		r.lo = RGMIN;
+	if (r.hi > old.hi)
+		r.hi = RGMAX;
+	return r;
+}
+
+static void rgSet(int slot, Range r)
+{
+	if (rgSame(rgEnv[slot], r))
+		return;
+	if (rgTrailN == rgTrailCap) {
+		rgTrailCap = rgTrailCap ? 2 * rgTrailCap : 1024;
+		rgTrail = (RgChange*)realloc(rgTrail, rgTrailCap * sizeof(RgChange));
+		if (rgTrail == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	rgTrail[rgTrailN].slot = slot;
+	rgTrail[rgTrailN].old = rgEnv[slot];
+	rgTrailN++;
+	rgEnv[slot] = r;
+}
+
+static void rgUndo(int mark)
+{
+	while (rgTrailN > mark) {
+		rgTrailN--;
+		rgEnv[rgTrail[rgTrailN].slot] = rgTrail[rgTrailN].old;
+	}
+}
+
+/* the slots changed since mark, with their value then and now */
+static int rgCollect(int mark, RgChange** list)
+{
+	RgChange* c = (RgChange*)malloc((rgTrailN - mark + 1) * sizeof(RgChange));
+	int n = 0, k, s;
+
+	if (c == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	rgStamp++;
+	for (k = mark; k < rgTrailN; k++) {
+		s = rgTrail[k].slot;
+		if (rgSeen[s] == rgStamp)
+			continue;
+		rgSeen[s] = rgStamp;
+		c[n].slot = s;
+		c[n].old = rgTrail[k].old;
+		c[n].now = rgEnv[s];
+		n++;
+	}
+	*list = c;
+	return n;
+}
+
+static Range rgDiv(Range a, Range b)
+{
+	long long q[4], lo, hi, m;
+	int k;
+
+	if (b.lo <= 0 && b.hi >= 0) {
+		/* whatever the divisor, |a / b| <= |a| */
+		m = -(long long)a.lo > a.hi ? -(long long)a.lo : a.hi;
+		return rgMake(-m, m);
+	}
+	/* a / b is monotonic in both operands while b keeps its sign */
+	q[0] = (long long)a.lo / b.lo;
+	q[1] = (long long)a.lo / b.hi;
+	q[2] = (long long)a.hi / b.lo;
+	q[3] = (long long)a.hi / b.hi;
+	lo = hi = q[0];
+	for (k = 1; k < 4; k++) {
+		if (q[k] < lo)
+			lo = q[k];
+		if (q[k] > hi)
+			hi = q[k];
+	}
+	return rgMake(lo, hi);
+}
+
+static Range rgArith(TokenType op, Range a, Range b)
+{
+	long long p[4], lo, hi;
+	int k, yes, no;
+
+	if (a.lo > a.hi || b.lo > b.hi)
+		return rgEmpty;
+	switch (op) {
+	case PLUS:
+		return rgMake((long long)a.lo + b.lo, (long long)a.hi + b.hi);
+	case MINUS:
+		return rgMake((long long)a.lo - b.hi, (long long)a.hi - b.lo);
+	case SHL:
+		b.lo = b.hi = 1 << b.lo;
+		/* fall through */
+	case MUL:
+		p[0] = (long long)a.lo * b.lo;
+		p[1] = (long long)a.lo * b.hi;
+		p[2] = (long long)a.hi * b.lo;
+		p[3] = (long long)a.hi * b.hi;
+		lo = hi = p[0];
+		for (k = 1; k < 4; k++) {
+			if (p[k] < lo)
+				lo = p[k];
+			if (p[k] > hi)
+				hi = p[k];
+		}
+		return rgMake(lo, hi);
+	case SHR:
+		b.lo = b.hi = 1 << b.lo;
+		/* fall through */
+	case DIV:
+		return rgDiv(a, b);
+	case LT: yes = a.hi < b.lo; no = a.lo >= b.hi; break;
+	case LE: yes = a.hi <= b.lo; no = a.lo > b.hi; break;
+	case GT: yes = a.lo > b.hi; no = a.hi <= b.lo; break;
+	case GE: yes = a.lo >= b.hi; no = a.hi < b.lo; break;
+	case EQ:
+		yes = a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+		no = a.hi < b.lo || b.hi < a.lo;
+		break;
+	case NE:
+		no = a.lo == a.hi && b.lo == b.hi && a.lo == b.lo;
+		yes = a.hi < b.lo || b.hi < a.lo;
+		break;
+	default:
+		return rgTop;
+	}
+	return rgMake(no ? 0 : yes, yes ? 1 : !no);
+}
+
+/* frame slot of a local scalar, -1 for anything else */
+static int rgSlot(TreeNode* t)
+{
+	if (t == NULL || t->nodekind != ExpK || t->kind.exp != IdK || t->child[0] != NULL)
+		return -1;
+	if (t->decl->kind.exp != VarDeclK || !t->decl->level)
+		return -1;
+	return t->decl->memloc;
+}
+
+/* an expression without assignments and calls */
+static int rgPure(TreeNode* t)
+{
+	int i;
+
+	if (t == NULL)
+		return TRUE;
+	if (t->nodekind == StmtK || t->kind.exp == AssignK)
+		return FALSE;
+	for (i = 0; i < MAXCHILDREN; i++)
+		if (!rgPure(t->child[i]))
+			return FALSE;
+	return TRUE;
+}
+
+static Range rgExp(TreeNode* t);
+
+/* number of elements of array d, 0 when unknown. A function that is not
+   called (yet) passes its array parameters on as infinitely large, so
+   recursion can keep the size */
+static int rgArraySize(TreeNode* d, int passed)
+{
+	if (!d->paramCheck)
+		return d->arraysize;
+	if (rgFunc == rgMain)
+		return 0;
+	if (!rgCalled[rgFunc->memloc])
+		return passed ? RGMAX : 0;
+	return rgSize[rgParamBase[rgFunc->memloc] + d->memloc];
+}
+
+static void rgSubscript(TreeNode* t)
+{
+	Range i = rgExp(t->child[0]);
+	int size = rgArraySize(t->decl, FALSE), ok;
+
+	if (!rgRecord)
+		return;
+	ok = size > 0 && i.lo >= 0 && i.hi < size;
+	/* a subscript reached more than once must be in bounds every time */
+	t->inBounds = t->inBounds < 0 ? ok : t->inBounds && ok;
+}
+
+static Range rgCall(TreeNode* t)
+{
+	TreeNode* f = t->decl;
+	TreeNode* p = f->child[0];
+	TreeNode* a = t->child[0];
+	Range r;
+	int k, size, user = f != inputDecl && f != outputDecl;
+
+	if (p != NULL && isVoidParam(p))
+		p = NULL;
+	/* missing arguments are zero */
+	while (a != NULL || p != NULL) {
+		r = a != NULL ? rgExp(a) : rgZero;
+		if (p != NULL && user) {
+			k = rgParamBase[f->memloc] + p->memloc;
+			if (p->kind.exp == VarArrayDeclK) {
+				size = 0;
+				if (a != NULL && a->nodekind == ExpK && a->kind.exp == IdK
+					&& a->child[0] == NULL && a->decl->kind.exp == VarArrayDeclK)
+					size = rgArraySize(a->decl, TRUE);
+				if (size < rgSizeNext[k])
+					rgSizeNext[k] = size;
+			}
+			else
+				rgParamNext[k] = rgJoin(rgParamNext[k], r);
+		}
+		if (a != NULL)
+			a = a->sibling;
+		if (p != NULL)
+			p = p->sibling;
+	}
+	if (user)
+		rgCalledNext[f->memloc] = TRUE;
+	return rgTop;
+}
+
+static Range rgExp(TreeNode* t)
+{
+	Range a, b;
+	int s;
+
+	if (t->nodekind == StmtK)
+		return rgCall(t);
+	switch (t->kind.exp) {
+	case ConstK:
+		a.lo = a.hi = t->attr.val;
+		return a;
+	case IdK:
+		if (t->child[0] != NULL) {
+			rgSubscript(t);
+			return rgTop;
+		}
+		s = rgSlot(t);
+		return s >= 0 ? rgEnv[s] : rgTop;
+	case AssignK:
+		if (t->child[0]->child[0] != NULL)
+			rgSubscript(t->child[0]);
+		a = rgExp(t->child[1]);
+		s = rgSlot(t->child[0]);
+		if (s >= 0)
+			rgSet(s, a);
+		return a;
+	case OpK:
+		a = rgExp(t->child[0]);
+		b = rgExp(t->child[1]);
+		return rgArith(t->attr.op, a, b);
+	default:
+		return rgTop;
+	}
+}
+
+/* narrow slot x to the values v with (v op y) */
+static void rgNarrow(int x, TokenType op, Range y)
+{
+	long long lo = rgEnv[x].lo, hi = rgEnv[x].hi;
+
+	switch (op) {
+	case LT: if (y.hi - 1LL < hi) hi = y.hi - 1LL; break;
+	case LE: if (y.hi < hi) hi = y.hi; break;
+	case GT: if (y.lo + 1LL > lo) lo = y.lo + 1LL; break;
+	case GE: if (y.lo > lo) lo = y.lo; break;
+	case EQ:
+		if (y.lo > lo)
+			lo = y.lo;
+		if (y.hi < hi)
+			hi = y.hi;
+		break;
+	case NE:
+		if (y.lo == y.hi && lo == y.lo)
+			lo++;
+		if (y.lo == y.hi && hi == y.lo)
+			hi--;
+		break;
+	default:
+		break;
+	}
+	if (lo > hi)
+		rgLive = FALSE;
+	else
+		rgSet(x, rgMake(lo, hi));
+}
+
+/* assume that condition c with range v is true (or false) */
+static void rgRefine(TreeNode* c, Range v, int truth)
+{
+	static const TokenType negated[] = { GE, GT, LE, LT, NE, EQ };
+	static const TokenType mirrored[] = { GT, GE, LT, LE, EQ, NE };
+	TokenType op;
+	Range a, b;
+	int x, y, rec;
+
+	if (truth ? v.lo == 0 && v.hi == 0 : v.lo > 0 || v.hi < 0) {
+		rgLive = FALSE;
+		return;
+	}
+	x = rgSlot(c);
+	if (x >= 0) {
+		rgNarrow(x, truth ? NE : EQ, rgZero);
+		return;
+	}
+	if (c->nodekind != ExpK || c->kind.exp != OpK || c->attr.op < LT || c->attr.op > NE
+		|| !rgPure(c))
+		return;
+	op = truth ? c->attr.op : negated[c->attr.op - LT];
+	rec = rgRecord;
+	rgRecord = FALSE;
+	a = rgExp(c->child[0]);
+	b = rgExp(c->child[1]);
+	rgRecord = rec;
+	x = rgSlot(c->child[0]);
+	y = rgSlot(c->child[1]);
+	if (x >= 0)
+		rgNarrow(x, op, b);
+	if (y >= 0 && rgLive)
+		rgNarrow(y, mirrored[op - LT], a);
+}
+
+static void rgStmt(TreeNode* t);
+
+static void rgList(TreeNode* t)
+{
+	for (; t != NULL && rgLive; t = t->sibling)
+		rgStmt(t);
+}
+
+static void rgIf(TreeNode* t)
+{
+	Range c = rgExp(t->child[0]);
+	RgChange* a, * b;
+	int mark = rgTrailN, na, nb, liveA, k;
+
+	rgRefine(t->child[0], c, TRUE);
+	rgStmt(t->child[1]);
+	liveA = rgLive;
+	na = rgCollect(mark, &a);
+	rgUndo(mark);
+	rgLive = TRUE;
+	rgRefine(t->child[0], c, FALSE);
+	rgStmt(t->child[2]);
+	if (!liveA) {
+		free(a);
+		return;
+	}
+	if (!rgLive) {
+		rgUndo(mark);
+		for (k = 0; k < na; k++)
+			rgSet(a[k].slot, a[k].now);
+		rgLive = TRUE;
+		free(a);
+		return;
+	}
+	/* join: slots changed in the then part, then those only in the else part */
+	nb = rgCollect(mark, &b);
+	rgStamp++;
+	for (k = 0; k < na; k++) {
+		rgSeen[a[k].slot] = rgStamp;
+		rgSet(a[k].slot, rgJoin(a[k].now, rgEnv[a[k].slot]));
+	}
+	for (k = 0; k < nb; k++)
+		if (rgSeen[b[k].slot] != rgStamp)
+			rgSet(b[k].slot, rgJoin(b[k].now, b[k].old));
+	free(a);
+	free(b);
+}
+
+/* every local scalar assigned in t becomes unknown */
+static void rgForget(TreeNode* t)
+{
+	int i;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == ExpK && t->kind.exp == AssignK && rgSlot(t->child[0]) >= 0)
+			rgSet(rgSlot(t->child[0]), rgTop);
+		for (i = 0; i < MAXCHILDREN; i++)
+			rgForget(t->child[i]);
+	}
+}
+
+/* condition and body once; TRUE when the end of the body is reached */
+static int rgLoopPass(TreeNode* t)
+{
+	Range c = rgExp(t->child[0]);
+
+	rgRefine(t->child[0], c, TRUE);
+	rgStmt(t->child[1]);
+	return rgLive;
+}
+
+static void rgWhile(TreeNode* t)
+{
+	RgChange* c, * e;
+	Range r, h, s;
+	int loopMark = rgTrailN, rec = rgRecord, mark, n, ne, k, changed, live, first = TRUE;
+
+	rgDepth++;
+	rgRecord = FALSE;
+	if (rgDepth > RGMAXDEPTH) {
+		rgForget(t->child[0]);
+		rgForget(t->child[1]);
+	}
+	else {
+		/* the ranges at the head: join the end of the body until stable */
+		do {
+			mark = rgTrailN;
+			live = rgLoopPass(t);
+			n = rgCollect(mark, &c);
+			rgUndo(mark);
+			rgLive = TRUE;
+			changed = FALSE;
+			for (k = 0; k < n && live; k++) {
+				r = rgJoin(c[k].old, c[k].now);
+				if (!rgSame(r, c[k].old)) {
+					changed = TRUE;
+					rgSet(c[k].slot, first ? r : rgWiden(c[k].old, r));
+				}
+			}
+			free(c);
+			first = FALSE;
+		} while (changed);
+
+		/* narrowing: infinite bounds are taken from one more pass */
+		ne = rgCollect(loopMark, &e);
+		mark = rgTrailN;
+		live = rgLoopPass(t);
+		n = rgCollect(mark, &c);
+		rgUndo(mark);
+		rgLive = TRUE;
+		for (k = 0; k < ne; k++)
+			rgIndex[e[k].slot] = k;
+		rgStamp++;
+		for (k = 0; k < ne; k++)
+			rgSeen[e[k].slot] = rgStamp;
+		for (k = 0; k < n && live; k++) {
+			h = c[k].old;
+			s = rgSeen[c[k].slot] == rgStamp ? e[rgIndex[c[k].slot]].old : h;
+			r = rgJoin(s, c[k].now);
+			if (h.lo == RGMIN)
+				h.lo = r.lo;
+			if (h.hi == RGMAX)
+				h.hi = r.hi;
+			rgSet(c[k].slot, h);
+		}
+		free(c);
+		free(e);
+	}
+	rgRecord = rec;
+	if (rgRecord) {
+		mark = rgTrailN;
+		rgLoopPass(t);
+		rgUndo(mark);
+		rgLive = TRUE;
+	}
+	rgRefine(t->child[0], rgExp(t->child[0]), FALSE);
+	rgDepth--;
+}
+
+static void rgStmt(TreeNode* t)
+{
+	TreeNode* d;
+
+	if (t == NULL || !rgLive)
+		return;
+	if (t->nodekind == ExpK) {
+		rgExp(t);
+		return;
+	}
+	switch (t->kind.stmt) {
+	case CompoundK:
+		/* locals of an inner block start unknown: the back ends differ */
+		for (d = t->child[0]; d != NULL; d = d->sibling)
+			if (d->kind.exp == VarDeclK)
+				rgSet(d->memloc, rgTop);
+		rgList(t->child[1]);
+		break;
+	case SelectionK:
+		rgIf(t);
+		break;
+	case IterationK:
+		rgWhile(t);
+		break;
+	case ReturnK:
+		if (t->child[0] != NULL)
+			rgExp(t->child[0]);
+		rgLive = FALSE;
+		break;
+	case CallK:
+		rgCall(t);
+		break;
+	default:
+		break;
+	}
+}
+
+static void rgFunction(TreeNode* f)
+{
+	TreeNode* p;
+	int k, i = f->memloc;
+
+	rgFunc = f;
+	for (k = 0; k < f->framesize; k++)
+		rgEnv[k] = rgZero;
+	for (p = f->child[0]; p != NULL; p = p->sibling)
+		if (!isVoidParam(p) && p->kind.exp == VarDeclK)
+			rgEnv[p->memloc] = f != rgMain && rgCalled[i]
+				? rgParam[rgParamBase[i] + p->memloc] : rgTop;
+	rgTrailN = 0;
+	rgLive = TRUE;
+	rgDepth = 0;
+	rgList(f->child[1]->child[1]);
+}
+
+/* clear: mark the subscripts unvisited, else count them */
+static void rgSubscripts(TreeNode* t, int clear)
+{
+	int i;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == ExpK && t->kind.exp == IdK && t->child[0] != NULL) {
+			if (clear)
+				t->inBounds = -1;
+			else {
+				if (t->inBounds < 0)
+					t->inBounds = FALSE;
+				rgAccesses++;
+				rgProven += t->inBounds;
+			}
+		}
+		for (i = 0; i < MAXCHILDREN; i++)
+			rgSubscripts(t->child[i], clear);
+	}
+}
+
+void rangeAnalysis(TreeNode* syntaxTree)
+{
+	TreeNode* t, * p;
+	int nparams = 0, maxframe = 1, round, stable, k, i, total = 0, proven = 0;
+	clock_t start = clock();
+
+	rgNumFuncs = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK)
+			rgNumFuncs++;
+	rgParamBase = (int*)malloc((rgNumFuncs + 1) * sizeof(int));
+	rgNumFuncs = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling) {
+		if (t->kind.exp != FuncDeclK)
+			continue;
+		t->memloc = rgNumFuncs;
+		rgParamBase[rgNumFuncs++] = nparams;
+		for (p = t->child[0]; p != NULL; p = p->sibling)
+			if (!isVoidParam(p))
+				nparams++;
+		if (t->framesize > maxframe)
+			maxframe = t->framesize;
+	}
+	rgMain = findMain(syntaxTree);
+	rgCalled = (int*)calloc(rgNumFuncs + 1, sizeof(int));
+	rgCalledNext = (int*)calloc(rgNumFuncs + 1, sizeof(int));
+	rgParam = (Range*)malloc((nparams + 1) * sizeof(Range));
+	rgParamNext = (Range*)malloc((nparams + 1) * sizeof(Range));
+	rgSize = (int*)malloc((nparams + 1) * sizeof(int));
+	rgSizeNext = (int*)malloc((nparams + 1) * sizeof(int));
+	rgEnv = (Range*)malloc(maxframe * sizeof(Range));
+	rgSeen = (int*)calloc(maxframe, sizeof(int));
+	rgIndex = (int*)calloc(maxframe, sizeof(int));
+	if (rgParamBase == NULL || rgCalled == NULL || rgCalledNext == NULL || rgParam == NULL
+		|| rgParamNext == NULL || rgSize == NULL || rgSizeNext == NULL || rgEnv == NULL
+		|| rgSeen == NULL || rgIndex == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (k = 0; k < nparams; k++) {
+		rgParam[k] = rgEmpty;
+		rgSize[k] = RGMAX;
+	}
+
+	/* analyze the whole program until the arguments are the parameter
+	   ranges; from the third round on, widen and stop as soon as they
+	   are contained in them */
+	rgRecord = FALSE;
+	for (round = 1; ; round++) {
+		for (i = 0; i < rgNumFuncs; i++)
+			rgCalledNext[i] = FALSE;
+		for (k = 0; k < nparams; k++) {
+			rgParamNext[k] = rgEmpty;
+			rgSizeNext[k] = RGMAX;
+		}
+		/* only what main reaches; without main, every function */
+		for (t = syntaxTree; t != NULL; t = t->sibling)
+			if (t->kind.exp == FuncDeclK
+				&& (t == rgMain || rgMain == NULL || rgCalled[t->memloc]))
+				rgFunction(t);
+		stable = TRUE;
+		for (i = 0; i < rgNumFuncs; i++)
+			if (round < 3 ? rgCalledNext[i] != rgCalled[i] : rgCalledNext[i] && !rgCalled[i])
+				stable = FALSE;
+		for (k = 0; k < nparams; k++)
+			if (round < 3 ? !rgSame(rgParamNext[k], rgParam[k]) || rgSizeNext[k] != rgSize[k]
+				: !rgWithin(rgParamNext[k], rgParam[k]) || rgSizeNext[k] < rgSize[k])
+				stable = FALSE;
+		if (stable)
+			break;
+		if (round == RGMAXROUNDS) {
+			/* give up: nothing is known about parameters */
+			for (i = 0; i < rgNumFuncs; i++)
+				rgCalled[i] = FALSE;
+			break;
+		}
+		for (i = 0; i < rgNumFuncs; i++)
+			rgCalled[i] = round < 3 ? rgCalledNext[i] : rgCalled[i] || rgCalledNext[i];
+		for (k = 0; k < nparams; k++)
+			if (round < 3) {
+				rgParam[k] = rgParamNext[k];
+				rgSize[k] = rgSizeNext[k];
+			}
+			else {
+				rgParam[k] = rgWiden(rgParam[k], rgJoin(rgParam[k], rgParamNext[k]));
+				if (rgSizeNext[k] < rgSize[k])
+					rgSize[k] = rgSizeNext[k];
+			}
+	}
+
+	/* one more round marks the subscripts */
+	fprintf(fpOut, "\nRange analysis:\n");
+	rgRecord = TRUE;
+	for (t = syntaxTree; t != NULL; t = t->sibling) {
+		if (t->kind.exp != FuncDeclK)
+			continue;
+		rgSubscripts(t->child[1], TRUE);
+		rgFunction(t);
+		rgAccesses = rgProven = 0;
+		rgSubscripts(t->child[1], FALSE);
+		if (rgAccesses > 0)
+			fprintf(fpOut, "  %s: %d of %d array accesses proven in bounds\n",
+				t->attr.name, rgProven, rgAccesses);
+		total += rgAccesses;
+		proven += rgProven;
+	}
+	fprintf(fpOut, "  %d of %d array accesses proven in bounds (%.1f%%), %d rounds\n",
+		proven, total, total > 0 ? 100.0 * proven / total : 100.0, round + 1);
+	if (ShowTime)
+		fprintf(stderr, "range: %d functions, %d rounds in %.3f s\n", rgNumFuncs, round + 1,
+			(double)(clock() - start) / CLOCKS_PER_SEC);
+
+	free(rgParamBase); free(rgCalled); free(rgCalledNext);
+	free(rgParam); free(rgParamNext); free(rgSize); free(rgSizeNext);
+	free(rgEnv); free(rgSeen); free(rgIndex); free(rgTrail);
+	rgTrail = NULL;
+	rgTrailN = rgTrailCap = 0;
+}
+
+
+/*********************************************/
+/*******************inliner*******************/
+/*********************************************/
+
+/* Replaces a call statement, x = f(...) or return f(...) by a copy of
+   the body of f when f is a leaf (it calls nothing but input/output), has
+   no local arrays, and returns only at its end. The copy becomes a
+   compound statement: parameters and locals are new variables with fresh
+   names ("name_N", which no C- identifier can be) and frame slots added
+   to the caller, scalar parameters are assigned the arguments in order,
+   array parameters are replaced by the array passed. Bodies of up to
+   INLINESIZE nodes are inlined anywhere, up to INLINELOOPSIZE inside a
+   loop, and the program may grow by half its size. Callers that become
+   leaves are themselves inlined in the next round. */
+
+#define INLINESIZE 30       // nodes of a body inlined anywhere
+#define INLINELOOPSIZE 120  // nodes of a body inlined inside a while
+#define INLINEROUNDS 4
+
+static TreeNode** inlFrom = NULL;   // callee declarations ...
+static TreeNode** inlTo = NULL;     // ... and what replaces them in the copy
+static int inlMapN = 0, inlMapCap = 0;
+static TreeNode* inlCaller;
+static int inlBudget;               // nodes the program may still grow by
+static int inlCount = 0;            // inlined calls, also numbers the names
+
+static void inlMap(TreeNode* from, TreeNode* to)
+{
+	if (inlMapN == inlMapCap) {
+		inlMapCap = inlMapCap ? 2 * inlMapCap : 64;
+		inlFrom = (TreeNode**)realloc(inlFrom, inlMapCap * sizeof(TreeNode*));
+		inlTo = (TreeNode**)realloc(inlTo, inlMapCap * sizeof(TreeNode*));
+		if (inlFrom == NULL || inlTo == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	inlFrom[inlMapN] = from;
+	inlTo[inlMapN++] = to;
+}
+
+static TreeNode* inlLookup(TreeNode* d)
+{
+	int i;
+
+	for (i = 0; i < inlMapN; i++)
+		if (inlFrom[i] == d)
+			return inlTo[i];
+	return d;
+}
+
+/* a new scalar local of the caller standing for d */
+static TreeNode* inlVar(TreeNode* d, int line)
+{
+	TreeNode* v = newExpNode(VarDeclK);
+	char name[MAXTOKENLEN + 16];
+
+	sprintf(name, "%s_%d", d->attr.name, inlCount);
+	v->attr.name = copyString(name);
+	v->type = Integer;
+	v->lineno = line;
+	v->level = 1;
+	v->memloc = inlCaller->framesize++;
+	inlMap(d, v);
+	return v;
+}
+
+static TreeNode* inlNode(TreeNode* t)
+{
+	TreeNode* c = (TreeNode*)malloc(sizeof(TreeNode));
+
+	if (c == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	*c = *t;
+	c->sibling = NULL;
+	c->child[0] = c->child[1] = c->child[2] = NULL;
+	return c;
+}
+
+/* copy of the list t with the mapped declarations replaced */
+static TreeNode* inlCopy(TreeNode* t)
+{
+	TreeNode* first = NULL, * last = NULL, * c, * d, ** dp;
+	int i;
+
+	for (; t != NULL; t = t->sibling) {
+		c = inlNode(t);
+		if (t->nodekind == StmtK && t->kind.stmt == CompoundK) {
+			dp = &c->child[0];
+			for (d = t->child[0]; d != NULL; d = d->sibling) {
+				*dp = inlVar(d, d->lineno);
+				dp = &(*dp)->sibling;
+			}
+			c->child[1] = inlCopy(t->child[1]);
+		}
+		else {
+			if (t->decl != NULL && (t->nodekind == ExpK && t->kind.exp == IdK)) {
+				c->decl = inlLookup(t->decl);
+				c->attr.name = c->decl->attr.name;
+			}
+			for (i = 0; i < MAXCHILDREN; i++)
+				c->child[i] = inlCopy(t->child[i]);
+		}
+		if (last == NULL)
+			first = c;
+		else
+			last->sibling = c;
+		last = c;
+	}
+	return first;
+}
+
+static int inlUses(TreeNode* t, TreeNode* d);
+
+/* does the node t refer to declaration d? */
+static int inlUsesNode(TreeNode* t, TreeNode* d)
+{
+	int i;
+
+	if (t->decl == d)
+		return TRUE;
+	for (i = 0; i < MAXCHILDREN; i++)
+		if (inlUses(t->child[i], d))
+			return TRUE;
+	return FALSE;
+}
+
+static int inlUses(TreeNode* t, TreeNode* d)
+{
+	for (; t != NULL; t = t->sibling)
+		if (inlUsesNode(t, d))
+			return TRUE;
+	return FALSE;
+}
+
+/* must local d be zeroed, or is it assigned before anything reads it? */
+static int inlNeedsZero(TreeNode* stmts, TreeNode* d)
+{
+	TreeNode* s;
+
+	for (s = stmts; s != NULL; s = s->sibling) {
+		if (s->nodekind == ExpK && s->kind.exp == AssignK && s->child[0]->decl == d
+			&& s->child[0]->child[0] == NULL)
+			return inlUses(s->child[1], d);
+		if (inlUsesNode(s, d))
+			return TRUE;
+	}
+	return FALSE;
+}
+
+/* is name declared in the list t? */
+static int inlDeclares(TreeNode* t, char* name)
+{
+	TreeNode* d;
+	int i;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == StmtK && t->kind.stmt == CompoundK)
+			for (d = t->child[0]; d != NULL; d = d->sibling)
+				if (!strcmp(d->attr.name, name))
+					return TRUE;
+		for (i = 0; i < MAXCHILDREN; i++)
+			if (inlDeclares(t->child[i], name))
+				return TRUE;
+	}
+	return FALSE;
+}
+
+static int inlShadows(TreeNode* f, char* name)
+{
+	TreeNode* p;
+
+	for (p = f->child[0]; p != NULL; p = p->sibling)
+		if (!isVoidParam(p) && !strcmp(p->attr.name, name))
+			return TRUE;
+	return inlDeclares(f->child[1], name);
+}
+
+/* counts calls (other than input/output), returns and local arrays in
+   the list t; FALSE when a global it uses is hidden in caller */
+static int inlScan(TreeNode* t, TreeNode* caller, int* calls, int* returns, int* arrays)
+{
+	TreeNode* d;
+	int i, ok = TRUE;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == StmtK && t->kind.stmt == CallK
+			&& t->decl != inputDecl && t->decl != outputDecl)
+			(*calls)++;
+		if (t->nodekind == StmtK && t->kind.stmt == ReturnK)
+			(*returns)++;
+		if (t->nodekind == StmtK && t->kind.stmt == CompoundK)
+			for (d = t->child[0]; d != NULL; d = d->sibling)
+				if (d->kind.exp == VarArrayDeclK)
+					(*arrays)++;
+		if (t->nodekind == ExpK && t->kind.exp == IdK && !t->decl->level
+			&& inlShadows(caller, t->attr.name))
+			ok = FALSE;
+		for (i = 0; i < MAXCHILDREN; i++)
+			if (!inlScan(t->child[i], caller, calls, returns, arrays))
+				ok = FALSE;
+	}
+	return ok;
+}
+
+/* size of the body of f if it can be inlined into caller, else -1 */
+static int inlCandidate(TreeNode* f, TreeNode* caller)
+{
+	TreeNode* body = f->child[1], * last;
+	int calls = 0, returns = 0, arrays = 0;
+
+	if (f == inputDecl || f == outputDecl || f == caller || body == NULL)
+		return -1;
+	if (!inlScan(body, caller, &calls, &returns, &arrays) || calls > 0 || arrays > 0)
+		return -1;
+	for (last = body->child[1]; last != NULL && last->sibling != NULL; last = last->sibling)
+		;
+	/* only a return at the very end */
+	if (returns > (last != NULL && last->nodekind == StmtK && last->kind.stmt == ReturnK))
+		return -1;
+	return countNodes(body);
+}
+
+static int inlUnstable;             // set by inlFirstCall
+
+static TreeNode** inlFirstList(TreeNode** tp);
+
+/* the slot holding the call that runs first in the expression at tp.
+   inlUnstable is set if anything evaluated before that call could see
+   its effects: only constants, operators, local scalars and array names
+   may be */
+static TreeNode** inlFirstCall(TreeNode** tp)
+{
+	TreeNode* t = *tp, ** r;
+	int i;
+
+	for (i = 0; i < MAXCHILDREN; i++)
+		if ((r = inlFirstList(&t->child[i])) != NULL)
+			return r;
+	if (t->nodekind == StmtK)
+		return tp;
+	if (t->kind.exp == AssignK || (t->kind.exp == IdK && (t->child[0] != NULL
+		|| (!t->decl->level && t->decl->kind.exp == VarDeclK))))
+		inlUnstable = TRUE;
+	return NULL;
+}
+
+static TreeNode** inlFirstList(TreeNode** tp)
+{
+	TreeNode** r;
+
+	for (; *tp != NULL; tp = &(*tp)->sibling)
+		if ((r = inlFirstCall(tp)) != NULL)
+			return r;
+	return NULL;
+}
+
+/* slot of the call in statement *sp the inliner may replace, or NULL */
+static TreeNode** inlCallSlot(TreeNode** sp)
+{
+	TreeNode* s = *sp, ** r;
+
+	inlUnstable = FALSE;
+	if (s->nodekind == StmtK && s->kind.stmt == CallK) {
+		/* the arguments are evaluated before the body in any case */
+		r = inlFirstList(&s->child[0]);
+		if (r == NULL)
+			return sp;
+	}
+	else if (s->nodekind == ExpK && s->kind.exp == AssignK) {
+		/* the target is written last; its subscript is read first */
+		r = inlFirstList(&s->child[0]->child[0]);
+		if (r == NULL)
+			r = inlFirstList(&s->child[1]);
+	}
+	else if (s->nodekind == ExpK)
+		r = inlFirstCall(sp);
+	else if (s->kind.stmt == ReturnK || s->kind.stmt == SelectionK)
+		r = inlFirstList(&s->child[0]);
+	else
+		return NULL;
+	/* the body runs before the whole statement */
+	return inlUnstable ? NULL : r;
+}
+
+/* a variable or constant: evaluating it alone does nothing */
+static int inlTrivial(TreeNode* t)
+{
+	return t->nodekind == ExpK && t->child[0] == NULL
+		&& (t->kind.exp == IdK || t->kind.exp == ConstK);
+}
+
+static TreeNode* inlAssign(TreeNode* lhs, TreeNode* rhs, int line)
+{
+	TreeNode* t = newExpNode(AssignK);
+
+	t->child[0] = lhs;
+	t->child[1] = rhs;
+	t->type = Integer;
+	t->lineno = line;
+	return t;
+}
+
+static TreeNode* inlId(TreeNode* d, int line)
+{
+	TreeNode* t = newExpNode(IdK);
+
+	t->attr.name = d->attr.name;
+	t->decl = d;
+	t->type = Integer;
+	t->lineno = line;
+	return t;
+}
+
+static TreeNode* inlConst(int v, int line)
+{
+	TreeNode* t = newExpNode(ConstK);
+
+	t->attr.val = v;
+	t->type = Integer;
+	t->lineno = line;
+	return t;
+}
+
+/* the compound statement replacing statement *sp, or NULL. It runs
+   the copied body and then the statement with the call replaced by the
+   returned expression */
+static TreeNode* inlSite(TreeNode** sp0, int loop)
+{
+	TreeNode* s = *sp0, * call, * f, * p, * a, * next, * v, * d, * body, * copy, * last;
+	TreeNode* block, * result = NULL, * decls = NULL, ** dp = &decls, * stmts = NULL;
+	TreeNode** sp = &stmts, ** cp;
+	int size, line = s->lineno;
+
+	cp = inlCallSlot(sp0);
+	if (cp == NULL)
+		return NULL;
+	call = *cp;
+	f = call->decl;
+	if (f == NULL || (call != s && f->type != Integer))
+		return NULL;
+	size = inlCandidate(f, inlCaller);
+	if (size < 0 || size > (loop ? INLINELOOPSIZE : INLINESIZE) || size > inlBudget)
+		return NULL;
+	p = f->child[0];
+	if (p != NULL && isVoidParam(p))
+		p = NULL;
+	for (a = call->child[0]; p != NULL; p = p->sibling) {
+		if (p->kind.exp == VarArrayDeclK && (a == NULL || a->nodekind != ExpK
+			|| a->kind.exp != IdK || a->child[0] != NULL || a->decl->kind.exp != VarArrayDeclK))
+			return NULL;
+		if (a != NULL)
+			a = a->sibling;
+	}
+
+	inlCount++;
+	inlMapN = 0;
+	body = f->child[1];
+	/* arguments in order: array parameters become the array passed,
+	   scalar parameters new variables; missing arguments are zero */
+	p = f->child[0];
+	if (p != NULL && isVoidParam(p))
+		p = NULL;
+	for (a = call->child[0]; a != NULL || p != NULL; a = next) {
+		next = a != NULL ? a->sibling : NULL;
+		if (a != NULL)
+			a->sibling = NULL;
+		if (p != NULL && p->kind.exp == VarArrayDeclK)
+			inlMap(p, a->decl);
+		else if (p != NULL) {
+			*dp = v = inlVar(p, line);
+			dp = &v->sibling;
+			*sp = inlAssign(inlId(v, line), a != NULL ? a : inlConst(0, line), line);
+			sp = &(*sp)->sibling;
+		}
+		else if (!inlTrivial(a)) {
+			/* surplus arguments are still evaluated */
+			*sp = a;
+			sp = &a->sibling;
+		}
+		if (p != NULL)
+			p = p->sibling;
+	}
+	for (d = body->child[0]; d != NULL; d = d->sibling) {
+		*dp = v = inlVar(d, d->lineno);
+		dp = &v->sibling;
+		if (inlNeedsZero(body->child[1], d)) {
+			*sp = inlAssign(inlId(v, line), inlConst(0, line), line);
+			sp = &(*sp)->sibling;
+		}
+	}
+	copy = inlCopy(body->child[1]);
+	for (last = copy; last != NULL && last->sibling != NULL; last = last->sibling)
+		;
+	if (last != NULL && last->nodekind == StmtK && last->kind.stmt == ReturnK) {
+		result = last->child[0];
+		if (last == copy)
+			copy = NULL;
+		else {
+			for (v = copy; v->sibling != last; v = v->sibling)
+				;
+			v->sibling = NULL;
+		}
+	}
+	*sp = copy;
+	while (*sp != NULL)
+		sp = &(*sp)->sibling;
+
+	/* the statement itself, using the value */
+	if (call != s) {
+		*cp = result != NULL ? result : inlConst(0, line);
+		(*cp)->sibling = call->sibling;
+		s->sibling = NULL;
+		*sp = s;
+	}
+	else if (result != NULL && !inlTrivial(result))
+		*sp = result;
+
+	block = newStmtNode(CompoundK);
+	block->lineno = line;
+	block->child[0] = decls;
+	block->child[1] = stmts;
+	inlBudget -= size;
+	fprintf(fpOut, "  line %d: %s inlined into %s (%d nodes)\n", line, f->attr.name,
+		inlCaller->attr.name, size);
+	return block;
+}
+
+static void inlStmts(TreeNode** pp, int loop)
+{
+	TreeNode* t, * r, * next;
+
+	for (; *pp != NULL; pp = &(*pp)->sibling) {
+		t = *pp;
+		next = t->sibling;
+		r = inlSite(pp, loop);
+		if (r != NULL) {
+			r->sibling = next;
+			*pp = r;
+			/* the statement may have more calls */
+			inlStmts(&r->child[1], loop);
+			continue;
+		}
+		if (t->nodekind != StmtK)
+			continue;
+		switch (t->kind.stmt) {
+		case CompoundK:
+			inlStmts(&t->child[1], loop);
+			break;
+		case SelectionK:
+			inlStmts(&t->child[1], loop);
+			inlStmts(&t->child[2], loop);
+			break;
+		case IterationK:
+			inlStmts(&t->child[1], loop + 1);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void inlineCalls(TreeNode* syntaxTree)
+{
+	TreeNode* t;
+	int before = countNodes(syntaxTree), round, count;
+
+	fprintf(fpOut, "\nInliner:\n");
+	inlBudget = before / 2;
+	for (round = 0; round < INLINEROUNDS; round++) {
+		count = inlCount;
+		for (t = syntaxTree; t != NULL; t = t->sibling)
+			if (t->kind.exp == FuncDeclK && t->child[1] != NULL) {
+				inlCaller = t;
+				inlStmts(&t->child[1]->child[1], 0);
+			}
+		if (inlCount == count)
+			break;
+	}
+	fprintf(fpOut, "  %d calls inlined, %d nodes before, %d after\n",
+		inlCount, before, countNodes(syntaxTree));
+	free(inlFrom);
+	free(inlTo);
+	inlFrom = inlTo = NULL;
+	inlMapN = inlMapCap = 0;
+}
+
+
+/*********************************************/
+/**************partial evaluator**************/
+/*********************************************/
+
+/* A function is pure when it uses no global variable, has no array
+   parameter and calls neither input/output nor an impure function; the
+   last condition is solved by iterating over the call graph until
+   nothing changes. A call of a pure int function whose arguments are
+   all constants is run at compile time by a small evaluator of its own
+   and replaced by the result. The evaluator follows the interpreter
+   (wrapping arithmetic, zeroed frames) and gives up on anything that
+   would be a run time error, on more than PEMAXSTEPS evaluated nodes,
+   and on calls nested deeper than PEMAXDEPTH. Results are memoized by
+   function and arguments, which is sound for pure functions and makes
+   recursions like fib linear. */
+
+#define PEMAXSTEPS 1000000      // nodes evaluated for one call in the program
+#define PEBUDGET 20000000       // nodes evaluated for the whole program
+#define PEMAXDEPTH 200          // nested calls
+#define PESTACK 1048576         // ints of frames
+
+typedef struct {
+	TreeNode* f;
+	int nargs;
+	int args;           // arguments are peArgPool[args .. args+nargs-1]
+	int value;
+} PeMemo;
+
+static char* pePure = NULL;     // per function, numbered by FuncDeclK memloc
+static int* peStack = NULL;
+static int peSp;
+static long long peSteps, peLimit, peTotal;
+static int peDepth;
+static char* peFailed;          // why the evaluation stopped, NULL if it did not
+static int peRet;
+static PeMemo* peMemo = NULL;
+static int peMemoCap = 0, peMemoN = 0;
+static int* peArgPool = NULL;
+static int peArgN = 0, peArgCap = 0;
+
+static int peIsPure(TreeNode* f)
+{
+	return f != inputDecl && f != outputDecl && pePure[f->memloc];
+}
+
+/* FALSE if the list t uses a global or calls an impure function */
+static int peScan(TreeNode* t)
+{
+	int i;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == StmtK && t->kind.stmt == CallK && !peIsPure(t->decl))
+			return FALSE;
+		if (t->nodekind == ExpK && t->kind.exp == IdK && !t->decl->level)
+			return FALSE;
+		for (i = 0; i < MAXCHILDREN; i++)
+			if (!peScan(t->child[i]))
+				return FALSE;
+	}
+	return TRUE;
+}
+
+static unsigned int peHash(TreeNode* f, int* args, int n)
+{
+	unsigned int h = (unsigned int)(size_t)f * 2654435761u;
+	int i;
+
+	for (i = 0; i < n; i++)
+		h = (h ^ (unsigned int)args[i]) * 16777619u;
+	return h;
+}
+
+static PeMemo* peFind(TreeNode* f, int* args, int n)
+{
+	unsigned int i = peHash(f, args, n) & (peMemoCap - 1);
+	PeMemo* m;
+
+	for (;; i = (i + 1) & (peMemoCap - 1)) {
+		m = &peMemo[i];
+		if (m->f == NULL || (m->f == f && m->nargs == n
+			&& !memcmp(peArgPool + m->args, args, n * sizeof(int))))
+			return m;
+	}
+}
+
+static void peRemember(TreeNode* f, int* args, int n, int value)
+{
+	PeMemo* old = peMemo, * m;
+	int oldCap = peMemoCap, i;
+
+	if (2 * (peMemoN + 1) > peMemoCap) {
+		peMemoCap *= 2;
+		peMemo = (PeMemo*)calloc(peMemoCap, sizeof(PeMemo));
+		if (peMemo == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		for (i = 0; i < oldCap; i++)
+			if (old[i].f != NULL)
+				*peFind(old[i].f, peArgPool + old[i].args, old[i].nargs) = old[i];
+		free(old);
+	}
+	if (peArgN + n > peArgCap) {
+		peArgCap = 2 * (peArgN + n) + 1024;
+		peArgPool = (int*)realloc(peArgPool, peArgCap * sizeof(int));
+		if (peArgPool == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	m = peFind(f, args, n);
+	m->f = f;
+	m->nargs = n;
+	m->args = peArgN;
+	m->value = value;
+	memcpy(peArgPool + peArgN, args, n * sizeof(int));
+	peArgN += n;
+	peMemoN++;
+}
+
+static int peExp(TreeNode* t, int* fr);
+static int peStmt(TreeNode* t, int* fr);
+
+static int peCall(TreeNode* t, int* fr)
+{
+	TreeNode* f = t->decl;
+	TreeNode* p = f->child[0];
+	TreeNode* a;
+	PeMemo* m;
+	int n = 0, i, v, * args, * frame;
+
+	if (p != NULL && isVoidParam(p))
+		p = NULL;
+	for (a = p; a != NULL; a = a->sibling)
+		n++;
+	if (peSp + n + f->framesize > PESTACK) {
+		peFailed = "out of stack";
+		return 0;
+	}
+	/* the arguments go above the caller's frame; missing ones are zero */
+	args = peStack + peSp;
+	for (i = 0; i < n; i++)
+		args[i] = 0;
+	for (a = t->child[0], i = 0; a != NULL && !peFailed; a = a->sibling, i++) {
+		v = peExp(a, fr);
+		if (i < n)
+			args[i] = v;
+	}
+	if (peFailed)
+		return 0;
+	m = peFind(f, args, n);
+	if (m->f != NULL)
+		return m->value;
+	if (++peDepth > PEMAXDEPTH) {
+		peFailed = "too deep recursion";
+		return 0;
+	}
+	peSp += n;
+	frame = peStack + peSp;
+	memset(frame, 0, f->framesize * sizeof(int));
+	for (i = 0; i < n; i++)
+		frame[i] = args[i];
+	peSp += f->framesize;
+	peRet = 0;
+	peStmt(f->child[1], frame);
+	v = peRet;
+	peSp -= f->framesize + n;
+	peDepth--;
+	if (!peFailed)
+		peRemember(f, args, n, v);
+	return v;
+}
+
+static int peExp(TreeNode* t, int* fr)
+{
+	TreeNode* d;
+	int a, b, v;
+
+	if (peFailed)
+		return 0;
+	if (++peSteps > peLimit) {
+		peFailed = "step limit";
+		return 0;
+	}
+	if (t->nodekind == StmtK)
+		return peCall(t, fr);
+	switch (t->kind.exp) {
+	case ConstK:
+		return t->attr.val;
+	case IdK:
+		d = t->decl;
+		if (t->child[0] == NULL)
+			return fr[d->memloc];
+		a = peExp(t->child[0], fr);
+		if (a < 0 || a >= d->arraysize) {
+			peFailed = "array index out of bounds";
+			return 0;
+		}
+		return fr[d->memloc + a];
+	case AssignK:
+		d = t->child[0]->decl;
+		a = 0;
+		if (t->child[0]->child[0] != NULL) {
+			a = peExp(t->child[0]->child[0], fr);
+			if (a < 0 || a >= d->arraysize) {
+				peFailed = "array index out of bounds";
+				return 0;
+			}
+		}
+		v = peExp(t->child[1], fr);
+		if (!peFailed)
+			fr[d->memloc + a] = v;
+		return v;
+	case OpK:
+		a = peExp(t->child[0], fr);
+		b = peExp(t->child[1], fr);
+		if (peFailed)
+			return 0;
+		if (t->attr.op == SHL)
+			return shiftLeft(a, b);
+		if (t->attr.op == SHR)
+			return shiftRight(a, b);
+		if (!foldOp(t->attr.op, a, b, &v)) {
+			peFailed = "division by zero";
+			return 0;
+		}
+		return v;
+	default:
+		return 0;
+	}
+}
+
+/* TRUE when a return statement was executed */
+static int peStmt(TreeNode* t, int* fr)
+{
+	TreeNode* s;
+
+	if (t == NULL || peFailed)
+		return FALSE;
+	if (t->nodekind == ExpK) {
+		peExp(t, fr);
+		return FALSE;
+	}
+	switch (t->kind.stmt) {
+	case CompoundK:
+		for (s = t->child[1]; s != NULL && !peFailed; s = s->sibling)
+			if (peStmt(s, fr))
+				return TRUE;
+		return FALSE;
+	case SelectionK:
+		if (peExp(t->child[0], fr))
+			return peStmt(t->child[1], fr);
+		return peStmt(t->child[2], fr);
+	case IterationK:
+		while (peExp(t->child[0], fr) && !peFailed)
+			if (peStmt(t->child[1], fr))
+				return TRUE;
+		return FALSE;
+	case ReturnK:
+		peRet = t->child[0] != NULL ? peExp(t->child[0], fr) : 0;
+		return TRUE;
+	case CallK:
+		peCall(t, fr);
+		return FALSE;
+	default:
+		return FALSE;
+	}
+}
+
+static int peReplaced, peKept;
+
+/* replace the calls in the list at tp, innermost first */
+static void peWalk(TreeNode** tp)
+{
+	TreeNode* t, * a, * c;
+	int i, v;
+
+	for (; *tp != NULL; tp = &(*tp)->sibling) {
+		t = *tp;
+		for (i = 0; i < MAXCHILDREN; i++)
+			peWalk(&t->child[i]);
+		if (t->nodekind != StmtK || t->kind.stmt != CallK || !peIsPure(t->decl)
+			|| t->decl->type != Integer)
+			continue;
+		for (a = t->child[0]; a != NULL; a = a->sibling)
+			if (a->nodekind != ExpK || a->kind.exp != ConstK)
+				break;
+		if (a != NULL)
+			continue;
+
+		fprintf(fpOut, "  line %d: %s(", t->lineno, t->decl->attr.name);
+		for (a = t->child[0]; a != NULL; a = a->sibling)
+			fprintf(fpOut, "%d%s", a->attr.val, a->sibling != NULL ? ", " : "");
+		peFailed = NULL;
+		peSteps = peDepth = peSp = 0;
+		peLimit = PEMAXSTEPS < PEBUDGET - peTotal ? PEMAXSTEPS : PEBUDGET - peTotal;
+		v = peExp(t, NULL);
+		peTotal += peSteps;
+		if (peFailed) {
+			fprintf(fpOut, ") is kept: %s\n", peFailed);
+			peKept++;
+			continue;
+		}
+		fprintf(fpOut, ") = %d (%lld steps)\n", v, peSteps);
+		c = newExpNode(ConstK);
+		c->attr.val = v;
+		c->type = Integer;
+		c->lineno = t->lineno;
+		c->sibling = t->sibling;
+		*tp = c;
+		peReplaced++;
+	}
+}
+
+void partialEval(TreeNode* syntaxTree)
+{
+	TreeNode* t, * p;
+	int n = 0, changed, first;
+
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK)
+			t->memloc = n++;
+	pePure = (char*)malloc(n + 1);
+	peStack = (int*)malloc(PESTACK * sizeof(int));
+	peMemoCap = 1024;
+	peMemo = (PeMemo*)calloc(peMemoCap, sizeof(PeMemo));
+	if (pePure == NULL || peStack == NULL || peMemo == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	/* assume every function pure, then remove the ones that are not
+	   until the call graph agrees */
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK) {
+			pePure[t->memloc] = t->child[1] != NULL;
+			for (p = t->child[0]; p != NULL; p = p->sibling)
+				if (p->kind.exp == VarArrayDeclK)
+					pePure[t->memloc] = FALSE;
+		}
+	do {
+		changed = FALSE;
+		for (t = syntaxTree; t != NULL; t = t->sibling)
+			if (t->kind.exp == FuncDeclK && pePure[t->memloc] && !peScan(t->child[1])) {
+				pePure[t->memloc] = FALSE;
+				changed = TRUE;
+			}
+	} while (changed);
+
+	fprintf(fpOut, "\nPartial evaluation:\n  pure functions:");
+	first = TRUE;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK && pePure[t->memloc]) {
+			fprintf(fpOut, "%s %s", first ? "" : ",", t->attr.name);
+			first = FALSE;
+		}
+	fprintf(fpOut, "%s\n", first ? " none" : "");
+	peReplaced = peKept = 0;
+	peTotal = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK && t->child[1] != NULL)
+			peWalk(&t->child[1]);
+	fprintf(fpOut, "  %d calls replaced by their value, %d kept; %lld nodes evaluated\n",
+		peReplaced, peKept, peTotal);
+
+	free(pePure);
+	free(peStack);
+	free(peMemo);
+	free(peArgPool);
+	pePure = NULL;
+	peMemo = NULL;
+	peArgPool = NULL;
+	peMemoCap = peMemoN = peArgN = peArgCap = 0;
+}
+
+
+/*********************************************/
+/*****************call graph******************/
+/*********************************************/
+
+/* One node per function, numbered by FuncDeclK memloc, and one edge per
+   distinct caller/callee pair found in the CallK nodes of the bodies.
+   Tarjan's algorithm gives the strongly connected components, so
+   recursion (a component with more than one function, or a function
+   calling itself) is reported. Functions main() cannot reach are taken
+   out of the top-level list, so the later passes and the back ends never
+   see them. */
+
+typedef struct {
+	TreeNode* f;
+	int* callees;
+	int ncallees, cap;
+	int index, low;     // Tarjan numbering, -1 before the visit
+	int onStack;
+	int scc;            // component number
+	int reached;
+} CgNode;
+
+static CgNode* cgNodes = NULL;
+static int cgCount, cgEdges;
+static int* cgStack = NULL;
+static int cgSp, cgIndex, cgSccs;
+
+static void cgAddEdge(CgNode* n, int callee)
+{
+	int i;
+
+	for (i = 0; i < n->ncallees; i++)
+		if (n->callees[i] == callee)
+			return;
+	if (n->ncallees == n->cap) {
+		n->cap = n->cap ? 2 * n->cap : 4;
+		n->callees = (int*)realloc(n->callees, n->cap * sizeof(int));
+		if (n->callees == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	n->callees[n->ncallees++] = callee;
+	cgEdges++;
+}
+
+static void cgCalls(CgNode* n, TreeNode* t)
+{
+	int i;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == StmtK && t->kind.stmt == CallK
+			&& t->decl != inputDecl && t->decl != outputDecl)
+			cgAddEdge(n, t->decl->memloc);
+		for (i = 0; i < MAXCHILDREN; i++)
+			cgCalls(n, t->child[i]);
+	}
+}
+
+static void cgTarjan(int v)
+{
+	CgNode* n = &cgNodes[v];
+	CgNode* m;
+	int i, w;
+
+	n->index = n->low = cgIndex++;
+	cgStack[cgSp++] = v;
+	n->onStack = TRUE;
+	for (i = 0; i < n->ncallees; i++) {
+		w = n->callees[i];
+		m = &cgNodes[w];
+		if (m->index < 0) {
+			cgTarjan(w);
+			if (m->low < n->low)
+				n->low = m->low;
+		}
+		else if (m->onStack && m->index < n->low)
+			n->low = m->index;
+	}
+	if (n->low == n->index) {
+		do {
+			w = cgStack[--cgSp];
+			cgNodes[w].onStack = FALSE;
+			cgNodes[w].scc = cgSccs;
+		} while (w != v);
+		cgSccs++;
+	}
+}
+
+static void cgReach(int v)
+{
+	int i;
+
+	if (cgNodes[v].reached)
+		return;
+	cgNodes[v].reached = TRUE;
+	for (i = 0; i < cgNodes[v].ncallees; i++)
+		cgReach(cgNodes[v].callees[i]);
+}
+
+/* TRUE if component c is recursive */
+static int cgRecursive(int c)
+{
+	int i, j, size = 0;
+
+	for (i = 0; i < cgCount; i++)
+		if (cgNodes[i].scc == c) {
+			size++;
+			for (j = 0; j < cgNodes[i].ncallees; j++)
+				if (cgNodes[i].callees[j] == i)
+					return TRUE;
+		}
+	return size > 1;
+}
+
+TreeNode* pruneFunctions(TreeNode* syntaxTree)
+{
+	TreeNode* t, ** tp;
+	TreeNode* m = findMain(syntaxTree);
+	int i, c, first, before, removed = 0, nodes = 0, recursive = 0;
+
+	cgCount = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK)
+			t->memloc = cgCount++;
+	cgNodes = (CgNode*)calloc(cgCount + 1, sizeof(CgNode));
+	cgStack = (int*)malloc((cgCount + 1) * sizeof(int));
+	if (cgNodes == NULL || cgStack == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	cgEdges = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK) {
+			cgNodes[t->memloc].f = t;
+			cgNodes[t->memloc].index = -1;
+			cgCalls(&cgNodes[t->memloc], t->child[1]);
+		}
+	cgSp = cgIndex = cgSccs = 0;
+	for (i = 0; i < cgCount; i++)
+		if (cgNodes[i].index < 0)
+			cgTarjan(i);
+
+	fprintf(fpOut, "\nCall graph:\n");
+	fprintf(fpOut, "  %d functions, %d call edges, %d strongly connected components\n",
+		cgCount, cgEdges, cgSccs);
+	for (c = 0; c < cgSccs; c++) {
+		if (!cgRecursive(c))
+			continue;
+		fprintf(fpOut, "  recursive:");
+		first = TRUE;
+		for (i = 0; i < cgCount; i++)
+			if (cgNodes[i].scc == c) {
+				fprintf(fpOut, "%s %s", first ? "" : ",", cgNodes[i].f->attr.name);
+				first = FALSE;
+			}
+		fprintf(fpOut, "\n");
+		recursive++;
+	}
+	if (!recursive)
+		fprintf(fpOut, "  no recursion\n");
+
+	if (m == NULL)
+		fprintf(fpOut, "  no main function: nothing pruned\n");
+	else {
+		cgReach(m->memloc);
+		before = countNodes(syntaxTree);
+		first = TRUE;
+		for (tp = &syntaxTree; *tp != NULL; ) {
+			t = *tp;
+			if (t->kind.exp != FuncDeclK || cgNodes[t->memloc].reached) {
+				tp = &t->sibling;
+				continue;
+			}
+			fprintf(fpOut, "%s %s", first ? "  unreachable from main:" : ",", t->attr.name);
+			first = FALSE;
+			/* countNodes follows siblings, so count the function alone */
+			*tp = t->sibling;
+			t->sibling = NULL;
+			nodes += countNodes(t);
+			removed++;
+		}
+		if (!first)
+			fprintf(fpOut, "\n");
+		fprintf(fpOut, "  %d of %d functions pruned, %d of %d nodes (%.1f%%) not analyzed or compiled\n",
+			removed, cgCount, nodes, before, before ? 100.0 * nodes / before : 0.0);
+	}
+
+	for (i = 0; i < cgCount; i++)
+		free(cgNodes[i].callees);
+	free(cgNodes);
+	free(cgStack);
+	cgNodes = NULL;
+	cgStack = NULL;
+	return syntaxTree;
+}
+
+
+/*********************************************/
+/****************hash-consing*****************/
+/*********************************************/
+
+/* Every side-effect-free expression (constants, variables, subscripts
+   and operators over them) is entered bottom up into a table keyed by
+   its kind, attribute and the canonical nodes of its children, so two
+   expressions are equal exactly when their canonical nodes are the same
+   pointer. With sharing on, each repeated expression is replaced by the
+   canonical one and freed, which turns the tree into a DAG; nodes that
+   have a sibling stay, since their sibling link is part of a list.
+
+   The table also gives the reports: an expression computed again in
+   straight-line code while none of its variables were assigned is a
+   common subexpression, and statements of HCCLONESIZE or more nodes
+   that occur in more than one function are clones. Names are compared
+   as written, so the reports work before analyze(). */
+
+#define HCCLONESIZE 12  // smallest statement reported as a clone
+
+typedef struct {
+	unsigned int hash;
+	TreeNode* id;       // first occurrence: the identity of the expression
+	TreeNode* share;    // first occurrence without a sibling: what is shared
+	TreeNode* c0, * c1; // canonical children
+	int uses;
+} HcEntry;
+
+typedef struct {
+	unsigned int hash;
+	TreeNode* t;
+	TreeNode* f;        // function the statement is in
+	int size;
+	int parent;         // enclosing candidate, -1 if none
+	int group;          // clone group, -1 if not reported
+} HcStmt;
+
+static HcEntry* hcTable = NULL;
+static int hcCap, hcN;
+static int hcShare;
+static int hcOccurrences, hcShared;
+static long hcBytes;
+static TreeNode* hcGlobals;     // top-level declarations
+static HcEntry** hcAvail = NULL; // available expressions, for the common
+static int* hcAvailLine = NULL;  // subexpression report
+static int hcNAvail, hcAvailCap, hcCse;
+static TreeNode* hcFunc;
+static HcStmt* hcStmts = NULL;
+static int hcNStmts, hcStmtCap;
+
+static int hcKind(TreeNode* t)
+{
+	return t->nodekind == ExpK
+		&& (t->kind.exp == ConstK || t->kind.exp == IdK || t->kind.exp == OpK);
+}
+
+static unsigned int hcMix(unsigned int h, unsigned int v)
+{
+	return (h ^ v) * 16777619u;
+}
+
+static unsigned int hcString(char* s)
+{
+	unsigned int h = 2166136261u;
+
+	while (*s)
+		h = hcMix(h, (unsigned char)*s++);
+	return h;
+}
+
+static unsigned int hcPointer(void* p)
+{
+	return (unsigned int)((size_t)p >> 4) * 2654435761u;
+}
+
+static unsigned int hcKey(TreeNode* t, TreeNode* c0, TreeNode* c1)
+{
+	unsigned int h = hcMix(2166136261u, t->kind.exp);
+
+	if (t->kind.exp == IdK)
+		h = hcMix(h, hcString(t->attr.name));
+	else
+		h = hcMix(h, (unsigned int)t->attr.val);
+	return hcMix(hcMix(h, hcPointer(c0)), hcPointer(c1));
+}
+
+/* the table slot for t with canonical children c0, c1: its entry or an
+   empty one */
+static HcEntry* hcSlot(TreeNode* t, TreeNode* c0, TreeNode* c1, unsigned int h)
+{
+	unsigned int i;
+	HcEntry* e;
+
+	for (i = h & (hcCap - 1);; i = (i + 1) & (hcCap - 1)) {
+		e = &hcTable[i];
+		if (e->id == NULL)
+			return e;
+		if (e->hash == h && e->c0 == c0 && e->c1 == c1 && e->id->kind.exp == t->kind.exp
+			&& (t->kind.exp == IdK ? !strcmp(e->id->attr.name, t->attr.name)
+				: e->id->attr.val == t->attr.val))
+			return e;
+	}
+}
+
+static void hcGrow(void)
+{
+	HcEntry* old = hcTable;
+	int oldCap = hcCap, i;
+
+	hcCap = hcCap ? 2 * hcCap : 1024;
+	hcTable = (HcEntry*)calloc(hcCap, sizeof(HcEntry));
+	if (hcTable == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < oldCap; i++)
+		if (old[i].id != NULL)
+			*hcSlot(old[i].id, old[i].c0, old[i].c1, old[i].hash) = old[i];
+	free(old);
+}
+
+/* the entry of an expression already entered, NULL if it is not pure */
+static HcEntry* hcFind(TreeNode* t)
+{
+	HcEntry* e0 = NULL, * e1 = NULL, * e;
+	TreeNode* c0, * c1;
+
+	if (!hcKind(t))
+		return NULL;
+	if (t->child[0] != NULL && (e0 = hcFind(t->child[0])) == NULL)
+		return NULL;
+	if (t->child[1] != NULL && (e1 = hcFind(t->child[1])) == NULL)
+		return NULL;
+	c0 = e0 != NULL ? e0->id : NULL;
+	c1 = e1 != NULL ? e1->id : NULL;
+	e = hcSlot(t, c0, c1, hcKey(t, c0, c1));
+	return e->id != NULL ? e : NULL;
+}
+
+static void hcList(TreeNode** tp);
+
+/* enter the expressions below the node at *tp and the node itself;
+   returns its canonical node, NULL if it is not a pure expression */
+static TreeNode* hcNode(TreeNode** tp)
+{
+	TreeNode* t = *tp;
+	TreeNode* c[MAXCHILDREN];
+	HcEntry* e;
+	unsigned int h;
+	int i, pure = hcKind(t);
+
+	for (i = 0; i < MAXCHILDREN; i++) {
+		c[i] = NULL;
+		if (t->child[i] == NULL)
+			continue;
+		if (t->child[i]->sibling == NULL)
+			c[i] = hcNode(&t->child[i]);
+		else
+			hcList(&t->child[i]);
+		if (c[i] == NULL)
+			pure = FALSE;
+	}
+	if (!pure)
+		return NULL;
+
+	if (2 * (hcN + 1) > hcCap)
+		hcGrow();
+	h = hcKey(t, c[0], c[1]);
+	e = hcSlot(t, c[0], c[1], h);
+	if (e->id == NULL) {
+		e->hash = h;
+		e->id = t;
+		e->c0 = c[0];
+		e->c1 = c[1];
+		hcN++;
+	}
+	if (!hcShare) {
+		hcOccurrences++;
+		e->uses++;
+		if (e->share == NULL && t->sibling == NULL)
+			e->share = t;
+	}
+	else if (t->sibling == NULL && e->share != t && e->id != t) {
+		*tp = e->share;
+		hcBytes += sizeof(TreeNode);
+		/* the nodes and names of a cached tree are not malloc()ed one by one */
+		if (t->kind.exp == IdK) {
+			hcBytes += strlen(t->attr.name) + 1;
+			if (!cacheHolds(t->attr.name))
+				free(t->attr.name);
+		}
+		if (!cacheHolds(t))
+			free(t);
+		hcShared++;
+	}
+	return e->id;
+}
+
+static void hcList(TreeNode** tp)
+{
+	for (; *tp != NULL; tp = &(*tp)->sibling)
+		hcNode(tp);
+}
+
+static void hcPrint(TreeNode* t, int nested)
+{
+	char* op;
+
+	switch (t->kind.exp) {
+	case ConstK:
+		fprintf(fpOut, "%d", t->attr.val);
+		break;
+	case IdK:
+		fprintf(fpOut, "%s", t->attr.name);
+		if (t->child[0] != NULL) {
+			fprintf(fpOut, "[");
+			hcPrint(t->child[0], FALSE);
+			fprintf(fpOut, "]");
+		}
+		break;
+	default:
+		switch (t->attr.op) {
+		case PLUS: op = "+"; break;
+		case MINUS: op = "-"; break;
+		case MUL: op = "*"; break;
+		case DIV: op = "/"; break;
+		case LT: op = "<"; break;
+		case LE: op = "<="; break;
+		case GT: op = ">"; break;
+		case GE: op = ">="; break;
+		case EQ: op = "=="; break;
+		case NE: op = "!="; break;
+		case SHL: op = "<<"; break;
+		default: op = ">>"; break;
+		}
+		fprintf(fpOut, "%s", nested ? "(" : "");
+		hcPrint(t->child[0], TRUE);
+		fprintf(fpOut, " %s ", op);
+		hcPrint(t->child[1], TRUE);
+		fprintf(fpOut, "%s", nested ? ")" : "");
+		break;
+	}
+}
+
+/* TRUE if the pure expression t reads the variable name, or with name
+   NULL, an array element or a global */
+static int hcReads(TreeNode* t, char* name)
+{
+	TreeNode* g;
+
+	if (t == NULL)
+		return FALSE;
+	if (t->kind.exp == IdK) {
+		if (name != NULL && !strcmp(t->attr.name, name))
+			return TRUE;
+		if (name == NULL) {
+			if (t->child[0] != NULL)
+				return TRUE;
+			for (g = hcGlobals; g != NULL; g = g->sibling)
+				if (g->kind.exp != FuncDeclK && !strcmp(g->attr.name, t->attr.name))
+					return TRUE;
+		}
+	}
+	return hcReads(t->child[0], name) || hcReads(t->child[1], name);
+}
+
+/* forget the available expressions an assignment to name, or with name
+   NULL a call, can change */
+static void hcKill(char* name)
+{
+	int i, n = 0;
+
+	for (i = 0; i < hcNAvail; i++)
+		if (!hcReads(hcAvail[i]->id, name)) {
+			hcAvail[n] = hcAvail[i];
+			hcAvailLine[n++] = hcAvailLine[i];
+		}
+	hcNAvail = n;
+}
+
+static void hcCseList(TreeNode* t);
+
+static void hcCseExp(TreeNode* t)
+{
+	HcEntry* e;
+	int i;
+
+	if (t->nodekind == ExpK && (t->kind.exp == OpK || (t->kind.exp == IdK && t->child[0] != NULL))
+		&& (e = hcFind(t)) != NULL) {
+		for (i = 0; i < hcNAvail; i++)
+			if (hcAvail[i] == e) {
+				fprintf(fpOut, "    line %d in %s: ", t->lineno, hcFunc->attr.name);
+				hcPrint(t, FALSE);
+				fprintf(fpOut, " (computed at line %d)\n", hcAvailLine[i]);
+				hcCse++;
+				return;
+			}
+		if (hcNAvail == hcAvailCap) {
+			hcAvailCap = hcAvailCap ? 2 * hcAvailCap : 64;
+			hcAvail = (HcEntry**)realloc(hcAvail, hcAvailCap * sizeof(HcEntry*));
+			hcAvailLine = (int*)realloc(hcAvailLine, hcAvailCap * sizeof(int));
+			if (hcAvail == NULL || hcAvailLine == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+		}
+		hcAvail[hcNAvail] = e;
+		hcAvailLine[hcNAvail++] = t->lineno;
+	}
+	if (t->nodekind == ExpK && t->kind.exp == AssignK) {
+		if (t->child[0]->child[0] != NULL)
+			hcCseExp(t->child[0]->child[0]);
+		hcCseExp(t->child[1]);
+		hcKill(t->child[0]->attr.name);
+		return;
+	}
+	if (t->nodekind == StmtK && t->kind.stmt == CallK) {
+		hcCseList(t->child[0]);
+		hcKill(NULL);
+		return;
+	}
+	for (i = 0; i < MAXCHILDREN; i++)
+		hcCseList(t->child[i]);
+}
+
+static void hcCseList(TreeNode* t)
+{
+	for (; t != NULL; t = t->sibling)
+		hcCseExp(t);
+}
+
+/* only straight-line code is followed: branches and loops start and
+   end with nothing available */
+static void hcCseStmt(TreeNode* t)
+{
+	TreeNode* d;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == ExpK) {
+			hcCseExp(t);
+			continue;
+		}
+		switch (t->kind.stmt) {
+		case CompoundK:
+			/* local names hide outer ones with the same name */
+			for (d = t->child[0]; d != NULL; d = d->sibling)
+				hcKill(d->attr.name);
+			hcCseStmt(t->child[1]);
+			for (d = t->child[0]; d != NULL; d = d->sibling)
+				hcKill(d->attr.name);
+			break;
+		case SelectionK:
+			hcCseExp(t->child[0]);
+			hcNAvail = 0;
+			hcCseStmt(t->child[1]);
+			hcNAvail = 0;
+			hcCseStmt(t->child[2]);
+			hcNAvail = 0;
+			break;
+		case IterationK:
+			hcNAvail = 0;
+			hcCseExp(t->child[0]);
+			hcCseStmt(t->child[1]);
+			hcNAvail = 0;
+			break;
+		case ReturnK:
+			if (t->child[0] != NULL)
+				hcCseExp(t->child[0]);
+			break;
+		default:
+			hcCseExp(t);
+			break;
+		}
+	}
+}
+
+/* the name a node carries, NULL if it has none */
+static char* hcName(TreeNode* t)
+{
+	if (t->nodekind == StmtK)
+		return t->kind.stmt == CallK ? t->attr.name : NULL;
+	if (t->kind.exp == AssignK || t->kind.exp == OpK || t->kind.exp == ConstK || isVoidParam(t))
+		return NULL;
+	return t->attr.name;
+}
+
+/* structural hash of any node, the canonical node for pure expressions */
+static unsigned int hcShape(TreeNode* t, int* size)
+{
+	HcEntry* e = hcFind(t);
+	TreeNode* c;
+	unsigned int h;
+	int i, n;
+
+	if (e != NULL) {
+		*size = countNodes(e->id->child[0]) + countNodes(e->id->child[1]) + 1;
+		return hcPointer(e->id);
+	}
+	h = hcMix(hcMix(2166136261u, t->nodekind), t->nodekind == StmtK ? t->kind.stmt : t->kind.exp);
+	if (hcName(t) != NULL)
+		h = hcMix(h, hcString(hcName(t)));
+	else if (t->nodekind == ExpK && t->kind.exp == OpK)
+		h = hcMix(h, t->attr.op);
+	h = hcMix(hcMix(h, t->type), t->arraysize);
+	*size = 1;
+	for (i = 0; i < MAXCHILDREN; i++) {
+		h = hcMix(h, 0x9e3779b9u);
+		for (c = t->child[i]; c != NULL; c = c->sibling) {
+			h = hcMix(h, hcShape(c, &n));
+			*size += n;
+		}
+	}
+	return h;
+}
+
+static int hcSame(TreeNode* a, TreeNode* b)
+{
+	HcEntry* e = hcFind(a);
+	TreeNode* p, * q;
+	int i;
+
+	if (e != NULL)
+		return e == hcFind(b);
+	if (a->nodekind != b->nodekind || a->type != b->type || a->arraysize != b->arraysize
+		|| (a->nodekind == StmtK ? a->kind.stmt != b->kind.stmt : a->kind.exp != b->kind.exp))
+		return FALSE;
+	if (hcName(a) != NULL ? strcmp(hcName(a), hcName(b))
+		: a->nodekind == ExpK && a->kind.exp == OpK && a->attr.op != b->attr.op)
+		return FALSE;
+	for (i = 0; i < MAXCHILDREN; i++) {
+		for (p = a->child[i], q = b->child[i]; p != NULL && q != NULL; p = p->sibling, q = q->sibling)
+			if (!hcSame(p, q))
+				return FALSE;
+		if (p != NULL || q != NULL)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* record the statements of the list t that are large enough to report */
+static void hcCollect(TreeNode* t, int parent)
+{
+	HcStmt* s;
+	int size, self;
+	unsigned int h;
+
+	for (; t != NULL; t = t->sibling) {
+		h = hcShape(t, &size);
+		self = parent;
+		if (size >= HCCLONESIZE) {
+			if (hcNStmts == hcStmtCap) {
+				hcStmtCap = hcStmtCap ? 2 * hcStmtCap : 256;
+				hcStmts = (HcStmt*)realloc(hcStmts, hcStmtCap * sizeof(HcStmt));
+				if (hcStmts == NULL) {
+					fprintf(stderr, "out of memory\n");
+					exit(1);
+				}
+			}
+			s = &hcStmts[hcNStmts];
+			s->hash = h;
+			s->t = t;
+			s->f = hcFunc;
+			s->size = size;
+			s->parent = parent;
+			s->group = -1;
+			self = hcNStmts++;
+		}
+		if (t->nodekind != StmtK)
+			continue;
+		if (t->kind.stmt == CompoundK)
+			hcCollect(t->child[1], self);
+		else if (t->kind.stmt == SelectionK || t->kind.stmt == IterationK) {
+			hcCollect(t->child[1], self);
+			hcCollect(t->child[2], self);
+		}
+	}
+}
+
+/* larger statements first, equal shapes next to each other */
+static int hcCompare(const void* a, const void* b)
+{
+	const HcStmt* s = (const HcStmt*)a;
+	const HcStmt* t = (const HcStmt*)b;
+
+	if (s->size != t->size)
+		return t->size - s->size;
+	if (s->hash != t->hash)
+		return s->hash < t->hash ? -1 : 1;
+	if (s->f != t->f)
+		return s->f->lineno - t->f->lineno;
+	return s->t->lineno - t->t->lineno;
+}
+
+/* TRUE if a statement around candidate i is already reported */
+static int hcCovered(int i)
+{
+	for (i = hcStmts[i].parent; i >= 0; i = hcStmts[i].parent)
+		if (hcStmts[i].group >= 0)
+			return TRUE;
+	return FALSE;
+}
+
+/* report the groups of equal statements found in more than one
+   function; a statement inside a reported one is not reported again */
+static int hcClones(void)
+{
+	int* where, * members;
+	int i, j, k, m, n, groups = 0, other;
+
+	where = (int*)malloc((hcNStmts + 1) * sizeof(int));
+	members = (int*)malloc((hcNStmts + 1) * sizeof(int));
+	if (where == NULL || members == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	/* sorting moves the candidates; parents follow through where[],
+	   the new position of each old one */
+	for (i = 0; i < hcNStmts; i++)
+		hcStmts[i].group = i;
+	qsort(hcStmts, hcNStmts, sizeof(HcStmt), hcCompare);
+	for (i = 0; i < hcNStmts; i++)
+		where[hcStmts[i].group] = i;
+	for (i = 0; i < hcNStmts; i++) {
+		hcStmts[i].group = -1;
+		if (hcStmts[i].parent >= 0)
+			hcStmts[i].parent = where[hcStmts[i].parent];
+	}
+
+	for (i = 0; i < hcNStmts; i = j) {
+		for (j = i; j < hcNStmts && hcStmts[j].size == hcStmts[i].size
+			&& hcStmts[j].hash == hcStmts[i].hash; j++)
+			;
+		for (k = i; k < j; k++) {
+			if (hcStmts[k].group >= 0 || hcCovered(k))
+				continue;
+			n = 0;
+			members[n++] = k;
+			other = FALSE;
+			for (m = k + 1; m < j; m++)
+				if (hcStmts[m].group < 0 && !hcCovered(m) && hcSame(hcStmts[k].t, hcStmts[m].t)) {
+					members[n++] = m;
+					if (hcStmts[m].f != hcStmts[k].f)
+						other = TRUE;
+				}
+			if (!other)
+				continue;
+			fprintf(fpOut, "    %d nodes:", hcStmts[k].size);
+			for (m = 0; m < n; m++) {
+				hcStmts[members[m]].group = groups;
+				fprintf(fpOut, "%s %s (line %d)", m ? "," : "",
+					hcStmts[members[m]].f->attr.name, hcStmts[members[m]].t->lineno);
+			}
+			fprintf(fpOut, "\n");
+			groups++;
+		}
+	}
+	free(where);
+	free(members);
+	return groups;
+}
+
+void hashCons(TreeNode* syntaxTree, int share)
+{
+	TreeNode* t;
+	int groups;
+
+	hcShare = FALSE;
+	hcOccurrences = hcShared = hcN = 0;
+	hcBytes = 0;
+	hcGrow();
+	hcGlobals = syntaxTree;
+	/* top-level declarations are never shared, so syntaxTree stays */
+	hcList(&syntaxTree);
+
+	fprintf(fpOut, "\nHash-consing:\n");
+	fprintf(fpOut, "  common subexpressions:\n");
+	hcCse = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK && t->child[1] != NULL) {
+			hcFunc = t;
+			hcNAvail = 0;
+			hcCseStmt(t->child[1]);
+		}
+	fprintf(fpOut, "  %d common subexpressions in straight-line code\n", hcCse);
+
+	fprintf(fpOut, "  statements of %d or more nodes found in several functions:\n", HCCLONESIZE);
+	hcNStmts = 0;
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->kind.exp == FuncDeclK && t->child[1] != NULL) {
+			hcFunc = t;
+			hcCollect(t->child[1], -1);
+		}
+	groups = hcClones();
+	fprintf(fpOut, "  %d clone groups\n", groups);
+
+	/* the reports need the line numbers of every node, so nodes are
+	   shared only now, in a second walk over the entered table */
+	fprintf(fpOut, "  %d expression nodes, %d distinct", hcOccurrences, hcN);
+	if (share) {
+		hcShare = TRUE;
+		hcList(&syntaxTree);
+		fprintf(fpOut, "; %d nodes shared, %ld bytes freed\n", hcShared, hcBytes);
+	}
+	else
+		fprintf(fpOut, "; not shared, later passes annotate the tree\n");
+
+	free(hcTable);
+	free(hcAvail);
+	free(hcAvailLine);
+	free(hcStmts);
+	hcTable = NULL;
+	hcAvail = NULL;
+	hcAvailLine = NULL;
+	hcStmts = NULL;
+	hcCap = hcAvailCap = hcStmtCap = 0;
+}
+
+
+/*********************************************/
+/***************structural diff**************/
+/*********************************************/
+
+/* Compares the program with an older version of it. Every node gets a
+   Merkle hash of its kind, attributes and the hashes of its children,
+   without line numbers, so equal hashes mean equal subtrees wherever
+   they are in the files. Top-level declarations are matched by name;
+   in a changed one, statement lists are compared by cutting the common
+   prefix and suffix, matching the statements left by hash (statements
+   that only moved), and pairing the rest in order when their kinds
+   agree. A pair is compared further down, everything else is inserted
+   or deleted. Each step looks at every node a constant number of
+   times, so the diff is linear in the size of both trees. */
+
+static long difNodes;
+static int difChanges;
+
+static unsigned int difHash(TreeNode* t)
+{
+	TreeNode* c;
+	unsigned int h;
+	int i;
+
+	h = hcMix(hcMix(2166136261u, t->nodekind), t->nodekind == StmtK ? t->kind.stmt : t->kind.exp);
+	if (hcName(t) != NULL)
+		h = hcMix(h, hcString(hcName(t)));
+	else if (t->nodekind == ExpK && (t->kind.exp == ConstK || t->kind.exp == OpK))
+		h = hcMix(h, (unsigned int)t->attr.val);
+	h = hcMix(hcMix(h, t->type), t->arraysize);
+	for (i = 0; i < MAXCHILDREN; i++) {
+		h = hcMix(h, 0x9e3779b9u);
+		for (c = t->child[i]; c != NULL; c = c->sibling)
+			h = hcMix(h, difHash(c));
+	}
+	difNodes++;
+	return t->hash = h;
+}
+
+static int difKind(TreeNode* t)
+{
+	return t->nodekind == StmtK ? t->kind.stmt : 16 + t->kind.exp;
+}
+
+static char* difWhat(TreeNode* t)
+{
+	if (t->nodekind == StmtK)
+		switch (t->kind.stmt) {
+		case CompoundK: return "block";
+		case SelectionK: return "if";
+		case IterationK: return "while";
+		case ReturnK: return "return";
+		default: return "call";
+		}
+	switch (t->kind.exp) {
+	case VarDeclK: case VarArrayDeclK: return "declaration";
+	case AssignK: return "assignment";
+	default: return "expression";
+	}
+}
+
+static TreeNode** difArray(TreeNode* t, int* n)
+{
+	TreeNode** v;
+	TreeNode* p;
+	int i = 0;
+
+	for (p = t; p != NULL; p = p->sibling)
+		i++;
+	v = (TreeNode**)malloc((i + 1) * sizeof(TreeNode*));
+	if (v == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (i = 0, p = t; p != NULL; p = p->sibling)
+		v[i++] = p;
+	*n = i;
+	return v;
+}
+
+static void difNode(TreeNode* o, TreeNode* t);
+
+/* compare the old statement list a with the new one b */
+static void difList(TreeNode* a, TreeNode* b)
+{
+	TreeNode** x, ** y;
+	int* table, * match;
+	char* used;
+	int n, m, lo = 0, cap, i, j, k;
+
+	x = difArray(a, &n);
+	y = difArray(b, &m);
+	while (lo < n && lo < m && x[lo]->hash == y[lo]->hash)
+		lo++;
+	while (n > lo && m > lo && x[n - 1]->hash == y[m - 1]->hash) {
+		n--;
+		m--;
+	}
+	/* what is left of the old list goes into a table by hash */
+	for (cap = 16; cap < 2 * (n - lo); cap *= 2)
+		;
+	table = (int*)malloc(cap * sizeof(int));
+	match = (int*)malloc((m + 1) * sizeof(int));
+	used = (char*)calloc(n + 1, 1);
+	if (table == NULL || match == NULL || used == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (k = 0; k < cap; k++)
+		table[k] = -1;
+	for (i = lo; i < n; i++) {
+		for (k = x[i]->hash & (cap - 1); table[k] >= 0; k = (k + 1) & (cap - 1))
+			;
+		table[k] = i;
+	}
+	for (j = lo; j < m; j++) {
+		match[j] = -1;
+		for (k = y[j]->hash & (cap - 1); table[k] >= 0; k = (k + 1) & (cap - 1))
+			if (!used[table[k]] && x[table[k]]->hash == y[j]->hash) {
+				match[j] = table[k];
+				used[table[k]] = TRUE;
+				break;
+			}
+	}
+
+	for (i = lo, j = lo; j < m; j++) {
+		if (match[j] >= 0)
+			continue;
+		while (i < n && used[i])
+			i++;
+		if (i < n && difKind(x[i]) == difKind(y[j])) {
+			used[i] = TRUE;
+			difNode(x[i++], y[j]);
+		}
+		else {
+			fprintf(fpOut, "    line %d: %s inserted\n", y[j]->lineno, difWhat(y[j]));
+			difChanges++;
+		}
+	}
+	for (i = lo; i < n; i++)
+		if (!used[i]) {
+			fprintf(fpOut, "    old line %d: %s deleted\n", x[i]->lineno, difWhat(x[i]));
+			difChanges++;
+		}
+	free(x);
+	free(y);
+	free(table);
+	free(match);
+	free(used);
+}
+
+/* o and t are of the same kind and differ */
+static void difNode(TreeNode* o, TreeNode* t)
+{
+	if (t->nodekind == StmtK && t->kind.stmt == CompoundK) {
+		difList(o->child[0], t->child[0]);
+		difList(o->child[1], t->child[1]);
+		return;
+	}
+	if (t->nodekind == StmtK && (t->kind.stmt == SelectionK || t->kind.stmt == IterationK)) {
+		if (o->child[0]->hash != t->child[0]->hash) {
+			fprintf(fpOut, "    line %d: condition of %s changed (old line %d)\n",
+				t->lineno, difWhat(t), o->lineno);
+			difChanges++;
+		}
+		difList(o->child[1], t->child[1]);
+		difList(o->child[2], t->child[2]);
+		return;
+	}
+	fprintf(fpOut, "    line %d: %s changed (old line %d)\n", t->lineno, difWhat(t), o->lineno);
+	difChanges++;
+}
+
+/* parse another file with the scanner and parser of the program; its
+   listing is thrown away */
+static TreeNode* difParse(FILE* in, int* error)
+{
+	FILE* out = fpOut, * saveIn = fpIn;
+	int saveLineno = lineno, saveError = Error, saveTokens = TokenInput;
+	TreeNode* t;
+
+	fpIn = in;
+	fpOut = tmpfile();
+	if (fpOut == NULL)
+		fpOut = out;
+	lineno = linepos = bufsize = 0;
+	EOF_flag = FALSE;
+	Error = FALSE;
+	TokenInput = FALSE;     // the other file is source text
+	t = parse();
+	*error = Error;
+	if (fpOut != out)
+		fclose(fpOut);
+	fpIn = saveIn;
+	fpOut = out;
+	lineno = saveLineno;
+	Error = saveError;
+	TokenInput = saveTokens;
+	EOF_flag = TRUE;
+	return t;
+}
+
+void astDiff(TreeNode* syntaxTree, char* oldFile)
+{
+	TreeNode* old, * t, * o, * p, * q;
+	TreeNode** names;
+	FILE* in;
+	char* seen;
+	int error, n = 0, cap, k, same;
+	int unchanged = 0, modified = 0, inserted = 0, deleted = 0;
+	clock_t start = clock();
+	double secs;
+
+	fprintf(fpOut, "\nStructural diff against %s:\n", oldFile);
+	in = fopen(oldFile, "r");
+	if (in == NULL) {
+		fprintf(stderr, "File %s not found\n", oldFile);
+		exit(1);
+	}
+	old = difParse(in, &error);
+	fclose(in);
+	if (error) {
+		fprintf(fpOut, "  %s has syntax errors: nothing compared\n", oldFile);
+		return;
+	}
+	difNodes = 0;
+	difChanges = 0;
+	for (t = old; t != NULL; t = t->sibling, n++)
+		difHash(t);
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		difHash(t);
+
+	/* old declarations by name; the first one wins */
+	for (cap = 16; cap < 2 * n; cap *= 2)
+		;
+	names = (TreeNode**)calloc(cap, sizeof(TreeNode*));
+	seen = (char*)calloc(cap, 1);
+	if (names == NULL || seen == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (o = old; o != NULL; o = o->sibling) {
+		for (k = hcString(o->attr.name) & (cap - 1); names[k] != NULL; k = (k + 1) & (cap - 1))
+			if (!strcmp(names[k]->attr.name, o->attr.name))
+				break;
+		if (names[k] == NULL)
+			names[k] = o;
+	}
+
+	for (t = syntaxTree; t != NULL; t = t->sibling) {
+		for (k = hcString(t->attr.name) & (cap - 1); names[k] != NULL; k = (k + 1) & (cap - 1))
+			if (!strcmp(names[k]->attr.name, t->attr.name))
+				break;
+		o = names[k];
+		if (o == NULL || seen[k]) {
+			fprintf(fpOut, "  %s %s: inserted (line %d)\n",
+				t->kind.exp == FuncDeclK ? "function" : "variable", t->attr.name, t->lineno);
+			inserted++;
+			continue;
+		}
+		seen[k] = TRUE;
+		if (o->hash == t->hash) {
+			unchanged++;
+			continue;
+		}
+		modified++;
+		if (t->kind.exp != FuncDeclK || o->kind.exp != FuncDeclK) {
+			fprintf(fpOut, "  %s %s: changed (line %d, old line %d)\n",
+				t->kind.exp == FuncDeclK ? "function" : "variable", t->attr.name,
+				t->lineno, o->lineno);
+			continue;
+		}
+		same = o->type == t->type;
+		for (p = o->child[0], q = t->child[0]; same && p != NULL && q != NULL;
+			p = p->sibling, q = q->sibling)
+			same = p->hash == q->hash;
+		same = same && p == NULL && q == NULL;
+		fprintf(fpOut, "  function %s: %s (line %d, old line %d)\n", t->attr.name,
+			same ? "modified" : "signature changed", t->lineno, o->lineno);
+		difList(o->child[1], t->child[1]);
+	}
+	for (o = old; o != NULL; o = o->sibling) {
+		for (k = hcString(o->attr.name) & (cap - 1); names[k] != o; k = (k + 1) & (cap - 1))
+			if (!strcmp(names[k]->attr.name, o->attr.name))
+				break;
+		if (names[k] == o && !seen[k]) {
+			fprintf(fpOut, "  %s %s: deleted (old line %d)\n",
+				o->kind.exp == FuncDeclK ? "function" : "variable", o->attr.name, o->lineno);
+			deleted++;
+		}
+	}
+	fprintf(fpOut, "  %d declarations unchanged, %d modified, %d inserted, %d deleted;"
+		" %d statement changes\n", unchanged, modified, inserted, deleted, difChanges);
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	if (ShowTime)
+		fprintf(stderr, "diff: %ld nodes hashed and compared in %.3f s\n", difNodes, secs);
+	free(names);
+	free(seen);
+}
+
+
+/*********************************************/
+/*************incremental parser**************/
+/*********************************************/
+
+/* Keeps the source as lines, the tokens of every line and the scanner
+   state at every line start (START, or INCOMMENT inside a comment), and
+   the token range of every top-level declaration. Lines are the pieces
+   getNextChar() reads, at most BUFLEN - 2 characters each, so line
+   numbers agree with a full scan; a token may go on into the next piece
+   of a long source line, so the scanner is started only at the first
+   piece of a source line and runs to its end. An edit replaces some
+   lines; they are
+   scanned again by getToken() in LineScan mode, and so are the lines
+   after them until the state at a line start is the one kept from
+   before (a new or removed comment start changes all lines up to the
+   comment end). The parser is then run on the kept tokens (Replay mode)
+   from the first declaration the new tokens touch, and stops as soon as
+   the next token is the first one of an old declaration past the edit:
+   that declaration and all after it are kept as they are, moved by the
+   number of lines the edit added.
+
+   Edit files have one edit per line, "line column count text": remove
+   count characters at line and column (both from 1, a line end counts
+   as one character) and insert text there. In text \n is a line end,
+   \t a tab and \\ a backslash. */
+
+#define INCLINE (BUFLEN - 2)    // longest line getNextChar() reads
+
+typedef struct {
+	TokenType type;
+	char* str;          // tokenString
+	int past;           // ends the line: getNextChar() read the next one
+} IncToken;
+
+typedef struct {
+	char* text;         // with its '\n', not terminated
+	int len;
+	StateType start;    // scanner state at the start of a source line
+	StateType end;      // and at the end of its last piece
+	IncToken* toks;
+	int ntoks, cap;
+} IncLine;
+
+typedef struct {
+	TreeNode* t;        // NULL after a syntax error
+	int line, tok;      // first token
+	int lastLine;       // line of the last token
+} IncDecl;
+
+static IncLine* incLines = NULL;
+static int incNLines, incLineCap;
+static IncDecl* incDecls = NULL;
+static int incNDecls, incDeclCap;
+static int incLine, incTok;     // Replay: next token
+static int incAtLine, incAtTok; // Replay: the token last returned
+static int incPrevLine;         // Replay: line of the token before that one
+static int incScan, incScanEnd; // LineScan: piece in lineBuf, piece after the source line
+static long incRelexed;
+static int incReparsed;
+
+TokenType incNextToken(void)
+{
+	IncToken* k;
+
+	incPrevLine = incAtLine;
+	while (incLine < incNLines && incTok >= incLines[incLine].ntoks) {
+		incLine++;
+		incTok = 0;
+	}
+	incAtLine = incLine;
+	incAtTok = incTok;
+	if (incLine >= incNLines) {
+		/* getNextChar() counts a line for every read past the end */
+		lineno = lineno > incNLines ? lineno + 1 : incNLines + 1;
+		tokenString[0] = '\0';
+		return ENDFILE;
+	}
+	k = &incLines[incLine].toks[incTok++];
+	lineno = incLine + 1 + k->past;
+	strcpy(tokenString, k->str);
+	return k->type;
+}
+
+static void* incGrow(void* v, int* cap, int need, int size)
+{
+	if (need <= *cap)
+		return v;
+	*cap = 2 * need + 16;
+	v = realloc(v, (size_t)*cap * size);
+	if (v == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return v;
+}
+
+static void incLoad(int ln)
+{
+	IncLine* l = &incLines[ln];
+
+	memcpy(lineBuf, l->text, l->len);
+	lineBuf[l->len] = '\0';
+	bufsize = l->len;
+	linepos = 0;
+	lineno = ln + 1;
+	incScan = ln;
+}
+
+/* getNextChar() at the end of a piece: FALSE at the end of the source line */
+int incNextPiece(void)
+{
+	if (incScan + 1 >= incScanEnd)
+		return FALSE;
+	incLoad(incScan + 1);
+	return TRUE;
+}
+
+/* scan the source line from piece ln again, from its start state; returns
+   the state at its end, and the piece after it in *next. A token is kept
+   in the piece lineno is at when getToken() returns it. */
+static StateType incLex(int ln, int* next)
+{
+	IncLine* l;
+	TokenType tok;
+	int i, e;
+
+	for (e = ln + 1; e < incNLines && incLines[e - 1].text[incLines[e - 1].len - 1] != '\n'; e++)
+		;
+	for (i = ln; i < e; i++) {
+		for (l = &incLines[i]; l->ntoks > 0; )
+			free(l->toks[--l->ntoks].str);
+	}
+	incScanEnd = e;
+	incLoad(ln);
+	EOF_flag = FALSE;
+	LineScan = TRUE;
+	scanState = incLines[ln].start;
+	while ((tok = getToken()) != ENDFILE) {
+		l = &incLines[lineno - 1];
+		l->toks = (IncToken*)incGrow(l->toks, &l->cap, l->ntoks + 1, sizeof(IncToken));
+		l->toks[l->ntoks].type = tok;
+		l->toks[l->ntoks].past = EOF_flag;
+		l->toks[l->ntoks++].str = copyString(tokenString);
+	}
+	LineScan = FALSE;
+	incLines[e - 1].end = scanState;
+	scanState = START;
+	incRelexed += e - ln;
+	*next = e;
+	return incLines[e - 1].end;
+}
+
+/* replace lines first .. first+count-1 by the lines of s, cut like
+   getNextChar() cuts them; returns the number of new lines */
+static int incSetLines(int first, int count, char* s, int len)
+{
+	int n = 0, i, k, m;
+	IncLine* l;
+
+	for (i = 0; i < len; i += k, n++)
+		for (k = 0; i + k < len && k < INCLINE; )
+			if (s[i + k++] == '\n')
+				break;
+	for (i = first; i < first + count; i++) {
+		for (k = 0; k < incLines[i].ntoks; k++)
+			free(incLines[i].toks[k].str);
+		free(incLines[i].toks);
+		free(incLines[i].text);
+	}
+	incLines = (IncLine*)incGrow(incLines, &incLineCap, incNLines - count + n, sizeof(IncLine));
+	memmove(incLines + first + n, incLines + first + count,
+		(incNLines - first - count) * sizeof(IncLine));
+	incNLines += n - count;
+	for (i = 0, m = first; i < len; i += k, m++) {
+		for (k = 0; i + k < len && k < INCLINE; )
+			if (s[i + k++] == '\n')
+				break;
+		l = &incLines[m];
+		l->text = (char*)malloc(k + 1);
+		if (l->text == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		memcpy(l->text, s + i, k);
+		l->len = k;
+		l->start = l->end = START;
+		l->toks = NULL;
+		l->ntoks = l->cap = 0;
+	}
+	return n;
+}
+
+static void incFree(TreeNode* t)
+{
+	TreeNode* next;
+	int i;
+
+	for (; t != NULL; t = next) {
+		next = t->sibling;
+		for (i = 0; i < MAXCHILDREN; i++)
+			incFree(t->child[i]);
+		if (hcName(t) != NULL)
+			free(hcName(t));
+		free(t);
+	}
+}
+
+static void incShift(TreeNode* t, int shift)
+{
+	int i;
+
+	for (; t != NULL; t = t->sibling) {
+		t->lineno += shift;
+		for (i = 0; i < MAXCHILDREN; i++)
+			incShift(t->child[i], shift);
+	}
+}
+
+/* parse again from declaration i0, whose tokens start at line/tok, and
+   keep the old declarations that start at line end or later (before
+   the edit, which moved them by shift lines) */
+static void incParse(int i0, int line, int tok, int end, int shift)
+{
+	IncDecl* fresh = NULL;
+	int nfresh = 0, freshCap = 0, j, k, saveLineno = lineno;
+
+	for (j = i0; j < incNDecls && incDecls[j].line < end; j++)
+		;
+	Replay = TRUE;
+	incLine = line;
+	incTok = tok;
+	incAtLine = line;
+	token = getToken();
+	while (token != ENDFILE) {
+		while (j < incNDecls && (incDecls[j].line + shift < incAtLine
+			|| (incDecls[j].line + shift == incAtLine && incDecls[j].tok < incAtTok)))
+			j++;
+		if (j < incNDecls && incDecls[j].line + shift == incAtLine && incDecls[j].tok == incAtTok)
+			break;
+		fresh = (IncDecl*)incGrow(fresh, &freshCap, nfresh + 1, sizeof(IncDecl));
+		fresh[nfresh].line = incAtLine;
+		fresh[nfresh].tok = incAtTok;
+		fresh[nfresh].t = declaration();
+		/* one cut short by the end of the text goes on with what is added */
+		fresh[nfresh++].lastLine = token == ENDFILE ? incAtLine : incPrevLine;
+	}
+	Replay = FALSE;
+	lineno = saveLineno;
+	if (token == ENDFILE)
+		j = incNDecls;  // the declarations left were parsed into the new ones
+
+	/* the sibling links are made again by incTree() */
+	for (k = i0; k < incNDecls; k++)
+		if (incDecls[k].t != NULL)
+			incDecls[k].t->sibling = NULL;
+	for (k = i0; k < j; k++)
+		incFree(incDecls[k].t);
+	for (k = j; k < incNDecls; k++) {
+		incDecls[k].line += shift;
+		incDecls[k].lastLine += shift;
+		if (shift)
+			incShift(incDecls[k].t, shift);
+	}
+	incDecls = (IncDecl*)incGrow(incDecls, &incDeclCap, incNDecls - (j - i0) + nfresh,
+		sizeof(IncDecl));
+	memmove(incDecls + i0 + nfresh, incDecls + j, (incNDecls - j) * sizeof(IncDecl));
+	if (nfresh)
+		memcpy(incDecls + i0, fresh, nfresh * sizeof(IncDecl));
+	incNDecls += nfresh - (j - i0);
+	incReparsed += nfresh;
+	free(fresh);
+}
+
+/* the declarations as the sibling list of a syntax tree */
+static TreeNode* incTree(void)
+{
+	TreeNode* t = NULL, * last = NULL;
+	int i;
+
+	for (i = 0; i < incNDecls; i++)
+		if (incDecls[i].t != NULL) {
+			if (last == NULL)
+				t = incDecls[i].t;
+			else
+				last->sibling = incDecls[i].t;
+			last = incDecls[i].t;
+			last->sibling = NULL;
+		}
+	return t;
+}
+
+/* apply one edit; FALSE if it is outside the text */
+static int incEdit(int line, int col, int count, char* text)
+{
+	int first = line - 1, last, len = 0, cap = 0, n, i, end, shift, i0;
+	char* s = NULL;
+	StateType state;
+
+	if (first < 0 || first > incNLines || col < 1 || count < 0
+		|| (first < incNLines && col > incLines[first].len + 1)
+		|| (first == incNLines && col != 1))
+		return FALSE;
+	/* the edited text starts at the first piece of a source line */
+	while (first > 0 && incLines[first - 1].text[incLines[first - 1].len - 1] != '\n')
+		col += incLines[--first].len;
+	/* the edited text runs to the end of a physical line, since where
+	   getNextChar() cuts a long line depends on what comes before */
+	for (last = first; last < incNLines; ) {
+		s = (char*)incGrow(s, &cap, len + incLines[last].len + 1, 1);
+		memcpy(s + len, incLines[last].text, incLines[last].len);
+		len += incLines[last++].len;
+		if (len >= col - 1 + count && s[len - 1] == '\n')
+			break;
+	}
+	if (col - 1 + count > len)
+		count = len - (col - 1);
+	n = (int)strlen(text);
+	s = (char*)incGrow(s, &cap, len + n + 1, 1);
+	memmove(s + col - 1 + n, s + col - 1 + count, len - (col - 1 + count));
+	memcpy(s + col - 1, text, n);
+	len += n - count;
+	/* a removed line end joins the next line to this one */
+	while (len > 0 && s[len - 1] != '\n' && last < incNLines) {
+		s = (char*)incGrow(s, &cap, len + incLines[last].len + 1, 1);
+		memcpy(s + len, incLines[last].text, incLines[last].len);
+		len += incLines[last++].len;
+	}
+
+	/* the lines before first and their tokens stay */
+	if (first < incNLines)
+		state = incLines[first].start;
+	else
+		state = first > 0 ? incLines[first - 1].end : START;
+	n = incSetLines(first, last - first, s, len);
+	free(s);
+	shift = n - (last - first);
+	for (i = first; i < first + n; ) {
+		incLines[i].start = state;
+		state = incLex(i, &i);
+	}
+	while (i < incNLines && incLines[i].start != state) {
+		incLines[i].start = state;
+		state = incLex(i, &i);
+	}
+	end = i - shift;    // first line not scanned again, before the edit
+
+	/* the first declaration with a token at line first or later; the
+	   tokens from the end of the one before belong to it */
+	for (i0 = 0; i0 < incNDecls && incDecls[i0].lastLine < first; i0++)
+		;
+	if (i0 < incNDecls && incDecls[i0].line < first)
+		incParse(i0, incDecls[i0].line, incDecls[i0].tok, end, shift);
+	else if (i0 > 0)
+		incParse(i0, incDecls[i0 - 1].lastLine + 1, 0, end, shift);
+	else
+		incParse(0, 0, 0, end, shift);
+	return TRUE;
+}
+
+static void incUnescape(char* s)
+{
+	char* d = s;
+
+	for (; *s != '\0' && *s != '\n' && *s != '\r'; s++) {
+		if (*s == '\\' && s[1] != '\0') {
+			s++;
+			*d++ = *s == 'n' ? '\n' : *s == 't' ? '\t' : *s;
+		}
+		else
+			*d++ = *s;
+	}
+	*d = '\0';
+}
+
+/* TRUE if the trees agree in their line numbers too */
+static int incSameLines(TreeNode* a, TreeNode* b)
+{
+	int i;
+
+	for (; a != NULL && b != NULL; a = a->sibling, b = b->sibling) {
+		if (a->lineno != b->lineno)
+			return FALSE;
+		for (i = 0; i < MAXCHILDREN; i++)
+			if (!incSameLines(a->child[i], b->child[i]))
+				return FALSE;
+	}
+	return a == NULL && b == NULL;
+}
+
+TreeNode* incrementalEdits(char* editFile)
+{
+	FILE* ef = fopen(editFile, "r");
+	FILE* tmp;
+	char buf[4096];
+	char* text;
+	TreeNode* full, * t, * u;
+	int line, col, count, k, edits = 0, error, same;
+	StateType state = START;
+	clock_t start;
+	double secs, total = 0, longest = 0;
+
+	if (ef == NULL) {
+		fprintf(stderr, "File %s not found\n", editFile);
+		exit(1);
+	}
+	/* the source as getNextChar() reads it, scanned line by line */
+	incNLines = incNDecls = 0;
+	rewind(fpIn);
+	while (fgets(buf, BUFLEN - 1, fpIn))
+		incSetLines(incNLines, 0, buf, (int)strlen(buf));
+	for (k = 0; k < incNLines; ) {
+		incLines[k].start = state;
+		state = incLex(k, &k);
+	}
+	incParse(0, 0, 0, 0, 0);
+
+	fprintf(fpOut, "\nIncremental edits from %s:\n", editFile);
+	while (fgets(buf, sizeof(buf), ef)) {
+		if (sscanf(buf, "%d %d %d%n", &line, &col, &count, &k) != 3)
+			continue;
+		text = buf + k;
+		if (*text == ' ')
+			text++;
+		incUnescape(text);
+		edits++;
+		incRelexed = 0;
+		incReparsed = 0;
+		start = clock();
+		if (!incEdit(line, col, count, text)) {
+			fprintf(fpOut, "  edit %d: line %d column %d is outside the text\n", edits, line, col);
+			continue;
+		}
+		secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+		total += secs;
+		if (secs > longest)
+			longest = secs;
+		fprintf(fpOut, "  edit %d: line %d: %ld lines scanned, %d of %d declarations parsed\n",
+			edits, line, incRelexed, incReparsed, incNDecls);
+	}
+	fclose(ef);
+	t = incTree();
+	if (incNLines > 0 && incLines[incNLines - 1].end == INCOMMENT) {
+		/* a full scan stops here with this error */
+		fprintf(fpOut, "ERROR: %s\n", "\"stop before ending\"");
+		Error = TRUE;
+		return t;
+	}
+
+	/* check the result against a full scan and parse of the new text */
+	tmp = tmpfile();
+	if (tmp == NULL) {
+		fprintf(fpOut, "  %d edits, %d lines; not checked\n", edits, incNLines);
+		return t;
+	}
+	for (k = 0; k < incNLines; k++)
+		fwrite(incLines[k].text, 1, incLines[k].len, tmp);
+	rewind(tmp);
+	start = clock();
+	full = difParse(tmp, &error);
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	fclose(tmp);
+	same = TRUE;
+	for (u = full; u != NULL; u = u->sibling)
+		difHash(u);
+	for (u = t; u != NULL; u = u->sibling)
+		difHash(u);
+	for (u = full; same && u != NULL && t != NULL; u = u->sibling, t = t->sibling)
+		same = u->hash == t->hash;
+	same = same && u == NULL && t == NULL && incSameLines(full, incTree());
+	incFree(full);
+	fprintf(fpOut, "  %d edits, %d lines, %d declarations; %s a full parse\n",
+		edits, incNLines, incNDecls, same ? "same tree as" : "DIFFERENT TREE FROM");
+	if (ShowTime)
+		fprintf(stderr, "incremental: %d edits, %.1f us average, %.1f us longest;"
+			" full parse %.1f us\n", edits, edits ? total / edits * 1e6 : 0.0,
+			longest * 1e6, secs * 1e6);
+	return incTree();
+}
+
+
+/*********************************************/
+/******************AST cache******************/
+/*********************************************/
+
+/* Parsed trees are kept in a directory, one file per source text, named
+   by a 64-bit hash of the source bytes. A file holds a header, the nodes
+   as fixed-size records that refer to each other by record number, the
+   names as a table of strings, and the listing the scanner and parser
+   wrote. Nothing in it is a pointer, so it is used where it is mapped:
+   a hit writes the listing from the mapping, makes the nodes in one
+   block with one pass over the records, and leaves the names in the
+   mapping. Files are written under a temporary name and renamed, so a
+   reader sees a whole file or none. A file of another format version or
+   byte order is parsed again and replaced. When the files pass CACHEMAX
+   bytes, the ones used longest ago are removed. */
+
+#define CACHEVERSION 1
+#define CACHEMAX (64L << 20)    // bytes kept in the cache directory
+#define CACHESTALE 600          // seconds before a left-over temporary file is removed
+
+typedef struct {
+	char magic[8];      // "C-AST"
+	int version;        // CACHEVERSION
+	int order;          // 0x01020304 in the byte order of the writer
+	int recSize;        // sizeof(CacheNode)
+	int error;          // the parse found syntax errors
+	int srcLen;         // length of the source
+	int nodes, root;    // number of records, record of the first declaration
+	int strBytes;       // size of the name table
+	int listBytes;      // size of the listing
+} CacheHeader;
+
+typedef struct {
+	int child[MAXCHILDREN], sibling;    // record numbers, -1 for none
+	int nodekind, kind;
+	int attr;           // op or val, or the offset of the name (-1 for none)
+	int type, lineno, paramCheck, arraysize;
+} CacheNode;
+
+static CacheNode* cacheRecs = NULL;
+static int cacheN, cacheCap;
+static char* cacheStrs = NULL;
+static int cacheStrN, cacheStrCap;
+static TreeNode* cacheBlock = NULL;     // nodes of a tree from the cache
+static int cacheBlockN;
+static char* cacheMap = NULL;           // the mapped cache file
+static long cacheMapSize;
+
+/* TRUE for memory of a tree from the cache, which is not to be freed */
+int cacheHolds(void* p)
+{
+	char* c = (char*)p;
+
+	return (cacheBlock != NULL && c >= (char*)cacheBlock && c < (char*)(cacheBlock + cacheBlockN))
+		|| (cacheMap != NULL && c >= cacheMap && c < cacheMap + cacheMapSize);
+}
+
+static unsigned long long cacheHash(const unsigned char* s, long n)
+{
+	unsigned long long h = 0x9e3779b97f4a7c15ULL ^ (unsigned long long)n, w;
+	long i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		memcpy(&w, s + i, 8);
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	for (w = 0; i < n; i++)
+		w = w << 8 | s[i];
+	h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+	return h ^ h >> 29;
+}
+
+static int cacheHasName(TreeNode* t)
+{
+	if (t->nodekind == StmtK)
+		return t->kind.stmt == CallK;
+	return t->kind.exp != AssignK && t->kind.exp != OpK && t->kind.exp != ConstK;
+}
+
+/* records for t and its siblings; returns the record of t */
+static int cachePut(TreeNode* t)
+{
+	int first = -1, prev = -1, k, i, c, len;
+
+	for (; t != NULL; t = t->sibling) {
+		cacheRecs = (CacheNode*)incGrow(cacheRecs, &cacheCap, cacheN + 1, sizeof(CacheNode));
+		k = cacheN++;
+		cacheRecs[k].sibling = -1;
+		cacheRecs[k].nodekind = t->nodekind;
+		cacheRecs[k].kind = t->nodekind == StmtK ? (int)t->kind.stmt : (int)t->kind.exp;
+		cacheRecs[k].type = t->type;
+		cacheRecs[k].lineno = t->lineno;
+		cacheRecs[k].paramCheck = t->nodekind == ExpK ? t->paramCheck : FALSE;
+		cacheRecs[k].arraysize = t->arraysize;
+		if (!cacheHasName(t))
+			cacheRecs[k].attr = t->nodekind == ExpK && t->kind.exp == ConstK ? t->attr.val : (int)t->attr.op;
+		else if (t->attr.name == NULL)
+			cacheRecs[k].attr = -1;
+		else {
+			len = (int)strlen(t->attr.name) + 1;
+			cacheStrs = (char*)incGrow(cacheStrs, &cacheStrCap, cacheStrN + len, 1);
+			memcpy(cacheStrs + cacheStrN, t->attr.name, len);
+			cacheRecs[k].attr = cacheStrN;
+			cacheStrN += len;
+		}
+		for (i = 0; i < MAXCHILDREN; i++) {
+			c = cachePut(t->child[i]);
+			cacheRecs[k].child[i] = c;
+		}
+		if (prev >= 0)
+			cacheRecs[prev].sibling = k;
+		else
+			first = k;
+		prev = k;
+	}
+	return first;
+}
+
+/* the tree of a mapped file; NULL if the records are not consistent */
+static TreeNode* cacheTree(CacheHeader* h)
+{
+	CacheNode* r = (CacheNode*)(h + 1);
+	char* strs = (char*)(r + h->nodes);
+	TreeNode* b, * t;
+	char* linked;
+	int i, k, bad = FALSE;
+
+	if (h->nodes == 0)
+		return NULL;
+	if (h->strBytes > 0 && strs[h->strBytes - 1] != '\0')
+		return NULL;
+	b = (TreeNode*)calloc(h->nodes, sizeof(TreeNode));
+	linked = (char*)calloc(h->nodes, 1);
+	if (b == NULL || linked == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	/* record numbers and name offsets are checked; a bad one is a miss.
+	   cachePut() links a record only from an earlier one and only once,
+	   so anything else (a cycle, a shared node) is damage too */
+#define CACHEREF(n) ((n) < 0 ? NULL : (n) > i && (n) < h->nodes && !linked[n] \
+	? (linked[n] = TRUE, b + (n)) : (bad = TRUE, (TreeNode*)NULL))
+	for (i = 0; i < h->nodes; i++, r++) {
+		t = b + i;
+		for (k = 0; k < MAXCHILDREN; k++)
+			t->child[k] = CACHEREF(r->child[k]);
+		t->sibling = CACHEREF(r->sibling);
+		t->nodekind = (NodeKind)r->nodekind;
+		if (t->nodekind == StmtK)
+			t->kind.stmt = (StmtKind)r->kind;
+		else
+			t->kind.exp = (ExpKind)r->kind;
+		t->type = (ExpType)r->type;
+		t->lineno = r->lineno;
+		t->paramCheck = r->paramCheck;
+		t->arraysize = r->arraysize;
+		if (!cacheHasName(t)) {
+			if (t->nodekind == ExpK && t->kind.exp == ConstK)
+				t->attr.val = r->attr;
+			else
+				t->attr.op = (TokenType)r->attr;
+		}
+		else if (r->attr >= h->strBytes)
+			bad = TRUE;
+		else
+			t->attr.name = r->attr < 0 ? NULL : strs + r->attr;
+	}
+#undef CACHEREF
+	if (bad || h->root < 0 || h->root >= h->nodes || linked[h->root]) {
+		free(b);
+		free(linked);
+		return NULL;
+	}
+	free(linked);
+	cacheBlock = b;
+	cacheBlockN = h->nodes;
+	return b + h->root;
+}
+
+/* the whole cache file, mapped where there is mmap() */
+static char* cacheLoad(char* path, long* size)
+{
+	char* p;
+#ifdef _WIN32
+	FILE* f = fopen(path, "rb");
+
+	if (f == NULL)
+		return NULL;
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	rewind(f);
+	p = (char*)malloc(*size > 0 ? *size : 1);
+	if (p == NULL || *size <= 0 || fread(p, 1, *size, f) != (size_t)*size) {
+		free(p);
+		p = NULL;
+	}
+	fclose(f);
+#else
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+	*size = (long)st.st_size;
+	p = (char*)mmap(NULL, (size_t)*size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == (char*)MAP_FAILED)
+		p = NULL;
+#endif
+	return p;
+}
+
+static void cacheUnload(char* p, long size)
+{
+#ifdef _WIN32
+	free(p);
+#else
+	munmap(p, (size_t)size);
+#endif
+}
+
+#ifndef _WIN32
+typedef struct {
+	char name[64];
+	long size;
+	time_t used;
+} CacheFile;
+
+static int cacheOlder(const void* a, const void* b)
+{
+	time_t x = ((CacheFile*)a)->used, y = ((CacheFile*)b)->used;
+	return x < y ? -1 : x > y;
+}
+#endif
+
+/* remove the files used longest ago until the rest fit in CACHEMAX */
+static void cacheEvict(char* dir, char* keep)
+{
+#ifndef _WIN32
+	DIR* d = opendir(dir);
+	struct dirent* e;
+	struct stat st;
+	CacheFile* files = NULL;
+	char path[1024];
+	int n = 0, cap = 0, i, len;
+	long total = 0;
+	time_t now = time(NULL);
+
+	if (d == NULL)
+		return;
+	while ((e = readdir(d)) != NULL) {
+		len = (int)strlen(e->d_name);
+		if (len >= (int)sizeof(files->name))
+			continue;
+		sprintf(path, "%s/%s", dir, e->d_name);
+		if (stat(path, &st) != 0)
+			continue;
+		/* a writer that stopped before its rename left this */
+		if (strstr(e->d_name, ".ast.tmp") != NULL) {
+			if (now - st.st_mtime > CACHESTALE)
+				remove(path);
+			continue;
+		}
+		if (len < 4 || strcmp(e->d_name + len - 4, ".ast") != 0)
+			continue;
+		files = (CacheFile*)incGrow(files, &cap, n + 1, sizeof(CacheFile));
+		strcpy(files[n].name, e->d_name);
+		files[n].size = (long)st.st_size;
+		files[n++].used = st.st_mtime;
+		total += (long)st.st_size;
+	}
+	closedir(d);
+	qsort(files, n, sizeof(CacheFile), cacheOlder);
+	for (i = 0; i < n && total > CACHEMAX; i++)
+		if (strcmp(files[i].name, keep) != 0) {
+			sprintf(path, "%s/%s", dir, files[i].name);
+			if (remove(path) == 0)
+				total -= files[i].size;
+		}
+	free(files);
+#endif
+}
+
+/* write the tree and its listing under name in dir */
+static void cacheStore(char* dir, char* name, TreeNode* t, FILE* listing, long srcLen)
+{
+	CacheHeader h;
+	char path[1024], tmp[1100], buf[4096];
+	FILE* f;
+	size_t n;
+	int ok;
+
+	cacheN = cacheStrN = 0;
+	memset(&h, 0, sizeof(h));
+	strcpy(h.magic, "C-AST");
+	h.version = CACHEVERSION;
+	h.order = 0x01020304;
+	h.recSize = sizeof(CacheNode);
+	h.error = Error;
+	h.srcLen = (int)srcLen;
+	h.root = cachePut(t);
+	h.nodes = cacheN;
+	h.strBytes = cacheStrN;
+	h.listBytes = (int)ftell(listing);
+
+	sprintf(path, "%s/%s", dir, name);
+	sprintf(tmp, "%s.tmp.%d", path, (int)getpid());
+	f = fopen(tmp, "wb");
+	if (f == NULL)
+		return;
+	ok = fwrite(&h, sizeof(h), 1, f) == 1
+		&& fwrite(cacheRecs, sizeof(CacheNode), cacheN, f) == (size_t)cacheN
+		&& fwrite(cacheStrs, 1, cacheStrN, f) == (size_t)cacheStrN;
+	rewind(listing);
+	while (ok && (n = fread(buf, 1, sizeof(buf), listing)) > 0)
+		ok = fwrite(buf, 1, n, f) == n;
+	if (fclose(f) != 0)
+		ok = FALSE;
+	/* rename() replaces an old file at once; where it does not, the
+	   file there has the same content */
+	if (!ok || rename(tmp, path) != 0)
+		remove(tmp);
+	else
+		cacheEvict(dir, name);
+}
+
+/* parse() through the cache in dir */
+TreeNode* cachedParse(char* dir)
+{
+	char name[64], path[1024], buf[4096];
+	unsigned char* src;
+	long srcLen, size = 0;
+	CacheHeader* h;
+	TreeNode* t;
+	FILE* listing, * out;
+	clock_t start = clock();
+	size_t n;
+
+	/* the key: the source bytes as fread() gives them */
+	fseek(fpIn, 0, SEEK_END);
+	srcLen = ftell(fpIn);
+	rewind(fpIn);
+	src = (unsigned char*)malloc(srcLen > 0 ? srcLen : 1);
+	if (src == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	srcLen = (long)fread(src, 1, srcLen, fpIn);
+	rewind(fpIn);
+	sprintf(name, "%016llx.ast", cacheHash(src, srcLen));
+	free(src);
+	sprintf(path, "%s/%s", dir, name);
+
+	cacheMap = cacheLoad(path, &size);
+	if (cacheMap != NULL) {
+		h = (CacheHeader*)cacheMap;
+		cacheMapSize = size;
+		t = NULL;
+		if (size >= (long)sizeof(CacheHeader) && !memcmp(h->magic, "C-AST", 6)
+			&& h->version == CACHEVERSION && h->order == 0x01020304
+			&& h->recSize == (int)sizeof(CacheNode) && h->srcLen == srcLen
+			&& h->nodes >= 0 && h->strBytes >= 0 && h->listBytes >= 0
+			&& size == (long)sizeof(CacheHeader) + (long)h->nodes * (long)sizeof(CacheNode)
+				+ h->strBytes + h->listBytes
+			&& (h->nodes == 0 || (t = cacheTree(h)) != NULL)) {
+			fwrite(cacheMap + size - h->listBytes, 1, h->listBytes, fpOut);
+			if (h->error)
+				Error = TRUE;
+#ifndef _WIN32
+			utime(path, NULL);  // used now, for the eviction
+#endif
+			if (ShowTime)
+				fprintf(stderr, "cache: hit %s, %d nodes in %.1f us\n", name, h->nodes,
+					(double)(clock() - start) / CLOCKS_PER_SEC * 1e6);
+			return t;
+		}
+		cacheUnload(cacheMap, size);
+		cacheMap = NULL;
+	}
+
+	/* a miss: parse, with the listing kept for the cache file */
+	listing = tmpfile();
+	if (listing == NULL)
+		return parse();
+	out = fpOut;
+	fpOut = listing;
+	t = parse();
+	fpOut = out;
+	fflush(listing);
+	rewind(listing);
+	while ((n = fread(buf, 1, sizeof(buf), listing)) > 0)
+		fwrite(buf, 1, n, fpOut);
+	cacheStore(dir, name, t, listing, srcLen);
+	fclose(listing);
+	if (ShowTime)
+		fprintf(stderr, "cache: miss %s, %d nodes parsed and stored in %.1f us\n", name, cacheN,
+			(double)(clock() - start) / CLOCKS_PER_SEC * 1e6);
+	return t;
+}
+
+
+/*********************************************/
+/*****************token file******************/
+/*********************************************/
+
+/* Reads the tokens scan -tokens wrote instead of scanning source text,
+   so scanning and parsing can run at different times or places. After
+   a 6-byte "C-TOK" header and the format version, every token is a
+   varint (7-bit groups, low group first, the high bit set when another
+   follows) holding the line minus the line of the token before times 32
+   plus the token kind, and for ID, NUM and ERROR a varint lexeme
+   number. A number not used before is followed by the lexeme's length
+   and characters. The listing gets the token lines the scanner would
+   write; the source lines are not in the file. A file that ends before
+   the ENDFILE token is one where the scanner stopped in a comment. */
+
+#define TOKVERSION 1
+
+static char* tokName;
+static char** tokLex = NULL;    // lexemes by number
+static int tokNLex, tokLexCap;
+static int tokLine;
+
+static void tokBad(void)
+{
+	fprintf(stderr, "%s: bad token file\n", tokName);
+	exit(1);
+}
+
+static unsigned int tokVarint(void)
+{
+	unsigned int v = 0;
+	int c, shift = 0;
+
+	do {
+		c = getc(fpIn);
+		if (c == EOF || shift > 28)
+			tokBad();
+		v |= (unsigned int)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return v;
+}
+
+void tokOpen(char* name)
+{
+	char magic[6];
+
+	tokName = name;
+	if (fread(magic, 1, 6, fpIn) != 6 || memcmp(magic, "C-TOK", 6) != 0) {
+		fprintf(stderr, "%s is not a token file\n", name);
+		exit(1);
+	}
+	if (tokVarint() != TOKVERSION) {
+		fprintf(stderr, "%s: token file of another version\n", name);
+		exit(1);
+	}
+	tokNLex = 0;
+	tokLine = 0;
+}
+
+TokenType tokNextToken(void)
+{
+	unsigned int v, ref, len;
+	TokenType token;
+	int c, i;
+
+	c = getc(fpIn);
+	if (c == EOF) {
+		fprintf(fpOut, "ERROR: %s\n", "\"stop before ending\"");
+		exit(EXIT_FAILURE);
+	}
+	ungetc(c, fpIn);
+	v = tokVarint();
+	token = (TokenType)(v & 31);
+	tokLine += (int)(v >> 5);
+	lineno = tokLine;
+	tokenString[0] = '\0';
+	if (token == ID || token == NUM || token == ERROR) {
+		ref = tokVarint();
+		if (ref > (unsigned int)tokNLex)
+			tokBad();
+		if (ref == (unsigned int)tokNLex) {
+			len = tokVarint();
+			if (len > MAXTOKENLEN)
+				tokBad();
+			tokLex = (char**)incGrow(tokLex, &tokLexCap, tokNLex + 1, sizeof(char*));
+			tokLex[tokNLex] = (char*)malloc(len + 1);
+			if (tokLex[tokNLex] == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+			if (fread(tokLex[tokNLex], 1, len, fpIn) != len)
+				tokBad();
+			tokLex[tokNLex++][len] = '\0';
+		}
+		strcpy(tokenString, tokLex[ref]);
+	}
+	else
+		for (i = 0; i < MAXRESERVED; i++)
+			if (reservedWords[i].tok == token)
+				strcpy(tokenString, reservedWords[i].str);
+	fprintf(fpOut, "\t%d: ", lineno);
+	printToken(token, tokenString);
+	STAT(stats.tokens[token]++);
+	return token;
+}
+
+
+/*********************************************/
+/****************compile server***************/
+/*********************************************/
+
+/* A long-lived parse listening on a Unix domain socket. client sends its
+   working directory and command line, with its stdin, stdout and stderr
+   as file descriptors (SCM_RIGHTS), and gets the exit status back. For
+   every connection the server forks a handler, and the handler forks
+   the compiler, which takes over the descriptors, changes to the
+   directory and runs main() on the arguments; so requests are served
+   at the same time, each with fresh globals, and an exit() on an error
+   only ends that request. What stays warm is what the forked processes
+   share: the loaded and initialized program, and the files of a -cache
+   directory, which stay in the page cache across requests. A request
+   has its own options, not those the server was started with. The
+   request is a 4-byte length and then strings ended by '\0'. */
+
+#ifndef _WIN32
+
+#define SRVMAXREQ 65536
+#define SRVMAXARGS 256
+
+/* read a request; FALSE if it is cut short or badly formed */
+static int srvRecv(int conn, char* buf, int* len, int* fds)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr* cm;
+	char control[CMSG_SPACE(3 * sizeof(int))];
+	int n, got, total;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = SRVMAXREQ;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	got = (int)recvmsg(conn, &msg, 0);
+	cm = CMSG_FIRSTHDR(&msg);
+	if (got < 4 || cm == NULL || cm->cmsg_type != SCM_RIGHTS
+		|| cm->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+		return FALSE;
+	memcpy(fds, CMSG_DATA(cm), 3 * sizeof(int));
+	memcpy(&total, buf, 4);
+	if (total < 4 || total > SRVMAXREQ)
+		return FALSE;
+	while (got < total) {
+		n = (int)read(conn, buf + got, total - got);
+		if (n <= 0)
+			return FALSE;
+		got += n;
+	}
+	*len = total;
+	return buf[total - 1] == '\0';
+}
+
+static void srvHandle(int conn)
+{
+	static char buf[SRVMAXREQ];
+	char* argv[SRVMAXARGS + 1];
+	char* cwd, * p;
+	int fds[3], len, argc = 0, status, code, i;
+	pid_t pid;
+
+	signal(SIGCHLD, SIG_DFL);
+	if (!srvRecv(conn, buf, &len, fds))
+		return;
+	cwd = buf + 4;
+	argv[argc++] = "parse";
+	for (p = cwd + strlen(cwd) + 1; p < buf + len && argc < SRVMAXARGS; p += strlen(p) + 1)
+		argv[argc++] = p;
+	argv[argc] = NULL;
+
+	pid = fork();
+	if (pid == 0) {
+		close(conn);
+		dup2(fds[0], 0);
+		dup2(fds[1], 1);
+		dup2(fds[2], 2);
+		close(fds[0]);
+		close(fds[1]);
+		close(fds[2]);
+		if (p < buf + len) {
+			fprintf(stderr, "A request takes at most %d arguments\n", SRVMAXARGS - 1);
+			exit(1);
+		}
+		/* a request must not start a server or rewrite an index with
+		   the rights of this one */
+		for (i = 1; i < argc; i++)
+			if (strcmp(argv[i], "-server") == 0 || strcmp(argv[i], "-index") == 0) {
+				fprintf(stderr, "%s is not allowed in a request\n", argv[i]);
+				exit(1);
+			}
+		if (chdir(cwd) != 0) {
+			fprintf(stderr, "Unable to change to %s\n", cwd);
+			exit(1);
+		}
+		resetOptions();
+		main(argc, argv);
+		exit(0);
+	}
+	close(fds[0]);
+	close(fds[1]);
+	close(fds[2]);
+	if (pid < 0 || waitpid(pid, &status, 0) != pid)
+		code = 1;
+	else if (WIFEXITED(status))
+		code = WEXITSTATUS(status);
+	else
+		code = 128 + WTERMSIG(status);
+	if (write(conn, &code, sizeof(code)) != sizeof(code))
+		return;
+}
+
+void compileServer(char* path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int s, conn, ok;
+	mode_t mask;
+	pid_t pid;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path %s is too long\n", path);
+		exit(1);
+	}
+	strcpy(addr.sun_path, path);
+	if (lstat(path, &st) == 0 && !S_ISSOCK(st.st_mode)) {
+		fprintf(stderr, "%s exists and is not a socket\n", path);
+		exit(1);
+	}
+	s = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(path);   // a socket left by a server before
+	/* requests open and write files with the rights of the server, so
+	   only its owner may connect: the socket gets no group or other
+	   permissions */
+	mask = umask(077);
+	ok = s >= 0 && bind(s, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+	umask(mask);
+	if (!ok || listen(s, 64) != 0) {
+		fprintf(stderr, "Unable to listen on %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	signal(SIGCHLD, SIG_IGN);  // handlers need not be waited for
+	tracePid = (int)getpid();
+	fprintf(stderr, "parse: serving on %s\n", path);
+	for (;;) {
+		conn = accept(s, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			fprintf(stderr, "accept: %s\n", strerror(errno));
+			exit(1);
+		}
+		pid = fork();
+		if (pid == 0) {
+			close(s);
+			srvHandle(conn);
+			close(conn);
+			_exit(0);
+		}
+		close(conn);
+	}
+}
+
+#else
+
+void compileServer(char* path)
+{
+	fprintf(stderr, "-server needs Unix domain sockets\n");
+	exit(1);
+}
+
+#endif
+
+
+/*********************************************/
+/*************lazy function bodies************/
+/*********************************************/
+
+/* With -signatures the parser does not build function bodies. At the
+   '{' of a body it only reads tokens, counting braces, up to the token
+   after the matching '}', and keeps them (kind, line, and the lexeme of
+   ID, NUM and ERROR) as the body's token range. The tokens are scanned
+   and listed as in a full parse, so the cost is that of the scanner.
+   lazyBody() builds a body the first time it is asked for, by running
+   compound_stmt() on the kept tokens. For a program without syntax
+   errors the result is the tree a full parse builds; an error inside a
+   body is found when the body is built, and the recovery may differ
+   from a full parse, which can read past the matching '}'. */
+
+typedef struct {
+	TokenType type;
+	int lineno;
+	int str;            // offset of the lexeme in lazyStrs, -1 for none
+} LazyToken;
+
+typedef struct {
+	int first, end;     // tokens after the '{'
+	int lineno;         // lineno when the '{' was read
+} LazyRange;
+
+static LazyToken* lazyToks = NULL;
+static int lazyNToks, lazyTokCap;
+static char* lazyStrs = NULL;
+static int lazyNStrs, lazyStrCap;
+static LazyRange* lazyRanges = NULL;
+static int lazyNRanges, lazyRangeCap;
+static int lazyAt, lazyEnd;     // LazyReplay: next token, end of the range
+
+static void lazyPut(TokenType type)
+{
+	LazyToken* k;
+	int len;
+
+	lazyToks = (LazyToken*)incGrow(lazyToks, &lazyTokCap, lazyNToks + 1, sizeof(LazyToken));
+	k = &lazyToks[lazyNToks++];
+	k->type = type;
+	k->lineno = lineno;
+	k->str = -1;
+	if (type == ID || type == NUM || type == ERROR) {
+		len = (int)strlen(tokenString) + 1;
+		lazyStrs = (char*)incGrow(lazyStrs, &lazyStrCap, lazyNStrs + len, 1);
+		memcpy(lazyStrs + lazyNStrs, tokenString, len);
+		k->str = lazyNStrs;
+		lazyNStrs += len;
+	}
+}
+
+/* at the '{' of the body of f: read to the token after the matching '}' */
+void lazySkip(TreeNode* f)
+{
+	LazyRange* r;
+	int depth = 0;
+
+	lazyRanges = (LazyRange*)incGrow(lazyRanges, &lazyRangeCap, lazyNRanges + 1, sizeof(LazyRange));
+	r = &lazyRanges[lazyNRanges];
+	r->first = lazyNToks;
+	r->lineno = lineno;
+	do {
+		if (token == LCURLY)
+			depth++;
+		else if (token == RCURLY)
+			depth--;
+		token = getToken();
+		lazyPut(token);
+	} while (depth > 0 && token != ENDFILE);
+	r->end = lazyNToks;
+	f->lazy = ++lazyNRanges;
+}
+
+TokenType lazyNextToken(void)
+{
+	LazyToken* k;
+	int i;
+
+	if (lazyAt >= lazyEnd)
+		return ENDFILE;
+	k = &lazyToks[lazyAt++];
+	lineno = k->lineno;
+	if (k->str >= 0)
+		strcpy(tokenString, lazyStrs + k->str);
+	else {
+		tokenString[0] = '\0';
+		for (i = 0; i < MAXRESERVED; i++)
+			if (reservedWords[i].tok == k->type)
+				strcpy(tokenString, reservedWords[i].str);
+	}
+	return k->type;
+}
+
+/* the body of function f, parsed now if it was skipped */
+TreeNode* lazyBody(TreeNode* f)
+{
+	LazyRange* r;
+	TokenType saveToken = token;
+	char saveString[MAXTOKENLEN + 1];
+	int saveLineno = lineno;
+
+	if (f->lazy == 0)
+		return f->child[1];
+	r = &lazyRanges[f->lazy - 1];
+	strcpy(saveString, tokenString);
+	lazyAt = r->first;
+	lazyEnd = r->end;
+	token = LCURLY;
+	strcpy(tokenString, "{");
+	lineno = r->lineno;
+	LazyReplay = TRUE;
+	f->child[1] = compound_stmt();
+	LazyReplay = FALSE;
+	f->lazy = 0;
+	token = saveToken;
+	strcpy(tokenString, saveString);
+	lineno = saveLineno;
+	return f->child[1];
+}
+
+/* build every body that was skipped, for the passes that read them */
+void lazyParseAll(TreeNode* syntaxTree)
+{
+	TreeNode* t;
+
+	for (t = syntaxTree; t != NULL; t = t->sibling)
+		if (t->nodekind == ExpK && t->kind.exp == FuncDeclK)
+			lazyBody(t);
+}
+
+void printSignatures(TreeNode* syntaxTree)
+{
+	TreeNode* t, * p;
+	int funcs = 0, skipped = 0;
+
+	fprintf(fpOut, "\nFunction signatures:\n");
+	for (t = syntaxTree; t != NULL; t = t->sibling) {
+		if (t->nodekind != ExpK || t->kind.exp != FuncDeclK)
+			continue;
+		funcs++;
+		if (t->lazy)
+			skipped++;
+		fprintf(fpOut, "  line %d: %s %s(", t->lineno, t->type == Integer ? "int" : "void",
+			t->attr.name != NULL ? t->attr.name : "?");
+		for (p = t->child[0]; p != NULL; p = p->sibling) {
+			if (isVoidParam(p)) {
+				fprintf(fpOut, "void");
+				continue;
+			}
+			fprintf(fpOut, "%s%s %s%s", p == t->child[0] ? "" : ", ",
+				p->type == Integer ? "int" : "void", p->attr.name != NULL ? p->attr.name : "?",
+				p->kind.exp == VarArrayDeclK ? "[]" : "");
+		}
+		fprintf(fpOut, ")\n");
+	}
+	fprintf(fpOut, "  %d functions, %d bodies not parsed\n", funcs, skipped);
+}
+
+
+/*********************************************/
+/****************symbol index*****************/
+/*********************************************/
+
+/* An index over many files of where functions and globals are defined,
+   where functions are called, and which globals each function uses.
+   The file has a header, the files with a hash of their contents, the
+   symbols sorted by name, the postings of every symbol one after the
+   other, sorted by file and line, and the strings. All references are
+   numbers or offsets, so a query maps the file and finds a name by
+   binary search without reading anything else. Updating it parses only
+   the files whose contents changed; the postings of the others are
+   copied from the old index. The new index is written under another
+   name and renamed, so a reader never sees half of one. */
+
+#define IXVERSION 1
+
+typedef enum { IxFunc, IxVar, IxArray, IxCall, IxUses, IxUsedBy } IxKind;
+
+typedef struct {
+	char magic[8];      // "C-IDX"
+	int version;        // IXVERSION
+	int order;          // 0x01020304 in the byte order of the writer
+	int nfiles, nsyms, nposts;
+	int strBytes;
+} IxHeader;
+
+typedef struct {
+	int path;           // offset in the strings
+	unsigned int hash[2];   // cacheHash() of the contents
+} IxFile;
+
+typedef struct {
+	int name;           // offset in the strings
+	int first, count;   // postings
+} IxSym;
+
+typedef struct {
+	int file, line;
+	int kind;           // IxKind
+	int other;          // IxCall: calling function, IxUses: global used,
+	                    // IxUsedBy: function using it, else -1
+} IxPost;
+
+/* postings while the index is made, with names instead of numbers */
+typedef struct {
+	char* sym;
+	char* other;
+	int file, line, kind;
+} IxRaw;
+
+static IxRaw* ixRaw = NULL;
+static int ixNRaw, ixRawCap;
+static char** ixNames = NULL;   // sorted names of the new index
+static int ixNNames;
+
+static void ixAdd(char* sym, int file, int line, IxKind kind, char* other)
+{
+	if (sym == NULL)
+		return;
+	ixRaw = (IxRaw*)incGrow(ixRaw, &ixRawCap, ixNRaw + 1, sizeof(IxRaw));
+	ixRaw[ixNRaw].sym = sym;
+	ixRaw[ixNRaw].other = other;
+	ixRaw[ixNRaw].file = file;
+	ixRaw[ixNRaw].line = line;
+	ixRaw[ixNRaw++].kind = kind;
+}
+
+/* names declared in the function being walked, innermost last */
+static char** ixScope = NULL;
+static int ixNScope, ixScopeCap;
+static int ixUsesFrom;          // first IxUses posting of the function
+
+static void ixDeclare(TreeNode* t)
+{
+	for (; t != NULL; t = t->sibling)
+		if (t->attr.name != NULL && !isVoidParam(t)) {
+			ixScope = (char**)incGrow(ixScope, &ixScopeCap, ixNScope + 1, sizeof(char*));
+			ixScope[ixNScope++] = t->attr.name;
+		}
+}
+
+static int ixLocal(char* name)
+{
+	int i;
+
+	for (i = ixNScope - 1; i >= 0; i--)
+		if (!strcmp(ixScope[i], name))
+			return TRUE;
+	return FALSE;
+}
+
+/* calls and uses of globals in the body of function f */
+static void ixWalk(TreeNode* t, TreeNode* f, int file)
+{
+	int i, mark;
+
+	for (; t != NULL; t = t->sibling) {
+		if (t->nodekind == StmtK && t->kind.stmt == CompoundK) {
+			mark = ixNScope;
+			ixDeclare(t->child[0]);
+			ixWalk(t->child[1], f, file);
+			ixNScope = mark;
+			continue;
+		}
+		if (t->nodekind == StmtK && t->kind.stmt == CallK)
+			ixAdd(t->attr.name, file, t->lineno, IxCall, f->attr.name);
+		if (t->nodekind == ExpK && t->kind.exp == IdK && t->attr.name != NULL
+			&& !ixLocal(t->attr.name)) {
+			/* one posting for each global a function uses, at its first use */
+			for (i = ixUsesFrom; i < ixNRaw; i++)
+				if (ixRaw[i].kind == IxUses && !strcmp(ixRaw[i].other, t->attr.name))
+					break;
+			if (i == ixNRaw) {
+				ixAdd(f->attr.name, file, t->lineno, IxUses, t->attr.name);
+				ixAdd(t->attr.name, file, t->lineno, IxUsedBy, f->attr.name);
+			}
+		}
+		for (i = 0; i < MAXCHILDREN; i++)
+			ixWalk(t->child[i], f, file);
+	}
+}
+
+static void ixExtract(TreeNode* tree, int file)
+{
+	TreeNode* t;
+
+	for (t = tree; t != NULL; t = t->sibling) {
+		if (t->nodekind != ExpK)
+			continue;
+		if (t->kind.exp == VarDeclK)
+			ixAdd(t->attr.name, file, t->lineno, IxVar, NULL);
+		else if (t->kind.exp == VarArrayDeclK)
+			ixAdd(t->attr.name, file, t->lineno, IxArray, NULL);
+		else if (t->kind.exp == FuncDeclK && t->attr.name != NULL) {
+			ixAdd(t->attr.name, file, t->lineno, IxFunc, NULL);
+			ixNScope = 0;
+			ixDeclare(t->child[0]);
+			ixUsesFrom = ixNRaw;
+			ixWalk(t->child[1], t, file);
+		}
+	}
+}
+
+static int ixCmpName(const void* a, const void* b)
+{
+	return strcmp(*(char**)a, *(char**)b);
+}
+
+static int ixId(char* name)
+{
+	char** p;
+
+	if (name == NULL)
+		return -1;
+	p = (char**)bsearch(&name, ixNames, ixNNames, sizeof(char*), ixCmpName);
+	return (int)(p - ixNames);
+}
+
+static int ixCmpRaw(const void* a, const void* b)
+{
+	const IxRaw* x = (const IxRaw*)a, * y = (const IxRaw*)b;
+	int c = strcmp(x->sym, y->sym);
+
+	if (c != 0)
+		return c;
+	if (x->file != y->file)
+		return x->file < y->file ? -1 : 1;
+	if (x->line != y->line)
+		return x->line < y->line ? -1 : 1;
+	return x->kind - y->kind;
+}
+
+/* the header of a mapped index; NULL if it is not one of this version */
+static IxHeader* ixCheck(char* map, long size)
+{
+	IxHeader* h = (IxHeader*)map;
+
+	if (map == NULL || size < (long)sizeof(IxHeader) || memcmp(h->magic, "C-IDX", 6) != 0
+		|| h->version != IXVERSION || h->order != 0x01020304
+		|| h->nfiles < 0 || h->nsyms < 0 || h->nposts < 0 || h->strBytes <= 0
+		|| size != (long)sizeof(IxHeader) + (long)h->nfiles * (long)sizeof(IxFile)
+			+ (long)h->nsyms * (long)sizeof(IxSym) + (long)h->nposts * (long)sizeof(IxPost) + h->strBytes
+		|| map[size - 1] != '\0')
+		return NULL;
+	return h;
+}
+
+void indexFiles(char* indexFile, int nfiles, char** files)
+{
+	char* map;
+	long size = 0, srcLen;
+	IxHeader* h = NULL, hdr;
+	IxFile* oldFiles = NULL, * newFiles;
+	IxSym* oldSyms = NULL, * syms;
+	IxPost* oldPosts = NULL, * posts;
+	char* oldStrs = NULL, * strs;
+	char** paths;
+	unsigned char* src;
+	unsigned long long hash;
+	int nOld = 0, n, i, k, s, error, parsed = 0, kept = 0, len, strBytes, * pathOff;
+	char tmp[1100];
+	FILE* in, * f;
+	TreeNode* tree;
+	clock_t start = clock();
+
+	map = cacheLoad(indexFile, &size);
+	h = ixCheck(map, size);
+	if (h != NULL) {
+		nOld = h->nfiles;
+		oldFiles = (IxFile*)(h + 1);
+		oldSyms = (IxSym*)(oldFiles + h->nfiles);
+		oldPosts = (IxPost*)(oldSyms + h->nsyms);
+		oldStrs = (char*)(oldPosts + h->nposts);
+	}
+	else if (map != NULL)
+		fprintf(stderr, "%s is not an index of this version; it is made again\n", indexFile);
+
+	/* the files of the old index, then the new ones */
+	paths = (char**)malloc((nOld + nfiles) * sizeof(char*));
+	newFiles = (IxFile*)calloc(nOld + nfiles, sizeof(IxFile));
+	if (paths == NULL || newFiles == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (n = 0; n < nOld; n++) {
+		paths[n] = oldStrs + oldFiles[n].path;
+		newFiles[n] = oldFiles[n];
+	}
+	for (i = 0; i < nfiles; i++) {
+		for (k = 0; k < n && strcmp(paths[k], files[i]); k++)
+			;
+		if (k == n) {
+			paths[n] = files[i];
+			newFiles[n].path = -1;  // no contents yet
+			n++;
+		}
+	}
+
+	/* parse the files given whose contents changed; a file that is gone
+	   is dropped */
+	ixNRaw = 0;
+	for (k = 0; k < n; k++) {
+		for (i = 0; i < nfiles && strcmp(paths[k], files[i]); i++)
+			;
+		if (i == nfiles)
+			continue;
+		in = fopen(paths[k], "r");
+		if (in == NULL) {
+			newFiles[k].path = -2;
+			continue;
+		}
+		fseek(in, 0, SEEK_END);
+		srcLen = ftell(in);
+		rewind(in);
+		src = (unsigned char*)malloc(srcLen > 0 ? srcLen : 1);
+		if (src == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		srcLen = (long)fread(src, 1, srcLen, in);
+		hash = cacheHash(src, srcLen);
+		free(src);
+		if (newFiles[k].path >= 0 && newFiles[k].hash[0] == (unsigned int)hash
+			&& newFiles[k].hash[1] == (unsigned int)(hash >> 32)) {
+			fclose(in);
+			continue;
+		}
+		newFiles[k].path = -3;  // parsed below
+		newFiles[k].hash[0] = (unsigned int)hash;
+		newFiles[k].hash[1] = (unsigned int)(hash >> 32);
+		rewind(in);
+		tree = difParse(in, &error);
+		fclose(in);
+		if (error)
+			fprintf(stderr, "%s: syntax errors; indexed as far as it was parsed\n", paths[k]);
+		ixExtract(tree, k);
+		parsed++;
+	}
+	/* the postings of the files not parsed again come from the old index */
+	for (s = 0; s < (h != NULL ? h->nsyms : 0); s++)
+		for (i = oldSyms[s].first; i < oldSyms[s].first + oldSyms[s].count; i++) {
+			k = oldPosts[i].file;
+			if (newFiles[k].path < 0)
+				continue;
+			ixAdd(oldStrs + oldSyms[s].name, k, oldPosts[i].line, (IxKind)oldPosts[i].kind,
+				oldPosts[i].other < 0 ? NULL : oldStrs + oldSyms[oldPosts[i].other].name);
+		}
+	for (k = 0; k < n; k++)
+		if (newFiles[k].path >= 0)
+			kept++;
+
+	/* number the files left, then the names in order */
+	pathOff = (int*)malloc(n * sizeof(int));
+	for (k = i = 0; k < n; k++)
+		pathOff[k] = newFiles[k].path == -2 ? -1 : i++;
+	for (k = 0; k < ixNRaw; k++)
+		ixRaw[k].file = pathOff[ixRaw[k].file];
+	qsort(ixRaw, ixNRaw, sizeof(IxRaw), ixCmpRaw);
+	ixNames = (char**)malloc((2 * ixNRaw + 1) * sizeof(char*));
+	for (k = ixNNames = 0; k < ixNRaw; k++) {
+		ixNames[ixNNames++] = ixRaw[k].sym;
+		if (ixRaw[k].other != NULL)
+			ixNames[ixNNames++] = ixRaw[k].other;
+	}
+	qsort(ixNames, ixNNames, sizeof(char*), ixCmpName);
+	for (k = i = 0; k < ixNNames; k++)
+		if (i == 0 || strcmp(ixNames[i - 1], ixNames[k]))
+			ixNames[i++] = ixNames[k];
+	ixNNames = i;
+
+	/* the strings: the names in order, then the paths */
+	strBytes = 0;
+	for (k = 0; k < ixNNames; k++)
+		strBytes += (int)strlen(ixNames[k]) + 1;
+	for (k = 0; k < n; k++)
+		if (pathOff[k] >= 0)
+			strBytes += (int)strlen(paths[k]) + 1;
+	strs = (char*)malloc(strBytes > 0 ? strBytes : 1);
+	syms = (IxSym*)calloc(ixNNames + 1, sizeof(IxSym));
+	posts = (IxPost*)malloc((ixNRaw + 1) * sizeof(IxPost));
+	if (strs == NULL || syms == NULL || posts == NULL || pathOff == NULL || ixNames == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (k = len = 0; k < ixNNames; k++) {
+		syms[k].name = len;
+		strcpy(strs + len, ixNames[k]);
+		len += (int)strlen(ixNames[k]) + 1;
+	}
+	for (k = i = 0; k < n; k++)
+		if (pathOff[k] >= 0) {
+			newFiles[i].hash[0] = newFiles[k].hash[0];
+			newFiles[i].hash[1] = newFiles[k].hash[1];
+			newFiles[i++].path = len;
+			strcpy(strs + len, paths[k]);
+			len += (int)strlen(paths[k]) + 1;
+		}
+	for (k = 0; k < ixNRaw; k++) {
+		s = ixId(ixRaw[k].sym);
+		if (syms[s].count++ == 0)
+			syms[s].first = k;
+		posts[k].file = ixRaw[k].file;
+		posts[k].line = ixRaw[k].line;
+		posts[k].kind = ixRaw[k].kind;
+		posts[k].other = ixId(ixRaw[k].other);
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	strcpy(hdr.magic, "C-IDX");
+	hdr.version = IXVERSION;
+	hdr.order = 0x01020304;
+	hdr.nfiles = i;
+	hdr.nsyms = ixNNames;
+	hdr.nposts = ixNRaw;
+	hdr.strBytes = strBytes;
+	sprintf(tmp, "%.1000s.tmp.%d", indexFile, (int)getpid());
+	f = fopen(tmp, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "Unable to open %s\n", tmp);
+		exit(1);
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1
+		|| fwrite(newFiles, sizeof(IxFile), hdr.nfiles, f) != (size_t)hdr.nfiles
+		|| fwrite(syms, sizeof(IxSym), hdr.nsyms, f) != (size_t)hdr.nsyms
+		|| fwrite(posts, sizeof(IxPost), hdr.nposts, f) != (size_t)hdr.nposts
+		|| fwrite(strs, 1, strBytes, f) != (size_t)strBytes
+		|| fclose(f) != 0 || rename(tmp, indexFile) != 0) {
+		remove(tmp);
+		fprintf(stderr, "Unable to write %s\n", indexFile);
+		exit(1);
+	}
+	if (map != NULL)
+		cacheUnload(map, size);
+	printf("%s: %d files (%d parsed, %d unchanged), %d names, %d postings\n", indexFile,
+		hdr.nfiles, parsed, kept, hdr.nsyms, hdr.nposts);
+	if (ShowTime)
+		fprintf(stderr, "index: %.1f ms\n", (double)(clock() - start) / CLOCKS_PER_SEC * 1e3);
+}
+
+static void ixList(IxHeader* h, IxSym* sym, IxKind kind, char* title)
+{
+	IxFile* files = (IxFile*)(h + 1);
+	IxSym* syms = (IxSym*)(files + h->nfiles);
+	IxPost* p = (IxPost*)(syms + h->nsyms) + sym->first;
+	char* strs = (char*)((IxPost*)(syms + h->nsyms) + h->nposts);
+	int i, first = TRUE;
+
+	for (i = 0; i < sym->count; i++, p++) {
+		if (p->kind != (int)kind && !(kind == IxFunc && p->kind <= IxArray))
+			continue;
+		if (first)
+			printf("  %s:\n", title);
+		first = FALSE;
+		printf("    %s:%d", strs + files[p->file].path, p->line);
+		if (kind == IxFunc)
+			printf(" %s", p->kind == IxFunc ? "function" : p->kind == IxVar ? "variable" : "array");
+		else if (p->other >= 0)
+			printf(" %s", strs + syms[p->other].name);
+		printf("\n");
+	}
+}
+
+void indexQuery(char* indexFile, char* name)
+{
+	long size = 0;
+	char* map = cacheLoad(indexFile, &size);
+	IxHeader* h = ixCheck(map, size);
+	IxSym* syms, * sym = NULL;
+	char* strs;
+	int lo, hi, mid, c;
+	clock_t start = clock();
+
+	if (h == NULL) {
+		fprintf(stderr, "%s is not an index of this version\n", indexFile);
+		exit(1);
+	}
+	syms = (IxSym*)((IxFile*)(h + 1) + h->nfiles);
+	strs = (char*)((IxPost*)(syms + h->nsyms) + h->nposts);
+	for (lo = 0, hi = h->nsyms - 1; lo <= hi; ) {
+		mid = (lo + hi) / 2;
+		c = strcmp(name, strs + syms[mid].name);
+		if (c == 0) {
+			sym = &syms[mid];
+			break;
+		}
+		if (c < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	printf("%s:\n", name);
+	if (sym == NULL || sym->count == 0)
+		printf("  not in %s\n", indexFile);
+	else {
+		ixList(h, sym, IxFunc, "defined");
+		ixList(h, sym, IxCall, "called in");
+		ixList(h, sym, IxUses, "uses globals");
+		ixList(h, sym, IxUsedBy, "used in");
+	}
+	if (ShowTime)
+		fprintf(stderr, "query: %.1f us\n", (double)(clock() - start) / CLOCKS_PER_SEC * 1e6);
+	cacheUnload(map, size);
+}
+
+
+/*********************************************/
+/*****************statistics******************/
+/*********************************************/
+
+/* -stats: where the time of a compilation goes and how much it makes.
+   The phases are timed in main(); reading lines and scanning tokens are
+   timed inside parsing only when -stats is given, since that takes a
+   clock reading per token. The report is one JSON object. */
+
+#ifndef NOSTATS
+
+static const char* stTokenNames[SHR + 1] = {
+	"STARTFILE", "ENDFILE", "ERROR",
+	"ELSE", "IF", "INT", "RETURN", "VOID", "WHILE",
+	"PLUS", "MINUS", "MUL", "DIV", "LT", "LE", "GT", "GE", "EQ", "NE", "ASSIGN", "SEMI", "COMMA",
+	"LPAREN", "RPAREN", "LSQUARE", "RSQUARE", "LCURLY", "RCURLY", "LCOMMENT", "RCOMMENT",
+	"ID", "NUM",
+	"SHL", "SHR"
+};
+static const char* stStmtNames[CallK + 1] = {
+	"ExpressionK", "CompoundK", "SelectionK", "IterationK", "ReturnK", "CallK"
+};
+static const char* stExpNames[IdK + 1] = {
+	"VarDeclK", "VarArrayDeclK", "FuncDeclK", "AssignK", "OpK", "ConstK", "IdK"
+};
+static const char* stPhaseNames[StPhases] = { "parse", "list", "analyze", "emit", "run" };
+
+/* wall clock in seconds */
+double statsNow(void)
+{
+#ifdef _WIN32
+	return (double)clock() / CLOCKS_PER_SEC;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+void statsBegin(StatPhase phase)
+{
+	if (StatsFile == NULL)
+		return;
+	stats.wallStart[phase] = statsNow();
+	stats.cpuStart[phase] = (double)clock() / CLOCKS_PER_SEC;
+}
+
+void statsEnd(StatPhase phase)
+{
+	if (StatsFile == NULL)
+		return;
+	stats.wall[phase] += statsNow() - stats.wallStart[phase];
+	stats.cpu[phase] += (double)clock() / CLOCKS_PER_SEC - stats.cpuStart[phase];
+}
+
+static void stString(FILE* f, char* s)
+{
+	fputc('"', f);
+	for (; *s != '\0'; s++)
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if ((unsigned char)*s < ' ')
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	fputc('"', f);
+}
+
+static void stCounts(FILE* f, const char** names, long* counts, int n)
+{
+	long total = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		total += counts[i];
+	fprintf(f, "{\"total\": %ld", total);
+	for (i = 0; i < n; i++)
+		fprintf(f, ", \"%s\": %ld", names[i], counts[i]);
+	fprintf(f, "}");
+}
+
+void statsReport(char* file, char* inputFile)
+{
+	FILE* f = !strcmp(file, "-") ? stdout : fopen(file, "w");
+	long rss = -1;
+	int i;
+#ifndef _WIN32
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) == 0)
+#ifdef __APPLE__
+		rss = ru.ru_maxrss / 1024;
+#else
+		rss = ru.ru_maxrss;
+#endif
+#endif
+
+	if (f == NULL) {
+		fprintf(stderr, "Unable to open %s\n", file);
+		exit(1);
+	}
+	fprintf(f, "{\n  \"file\": ");
+	stString(f, inputFile);
+	fprintf(f, ",\n  \"phases\": {");
+	for (i = 0; i < StPhases; i++) {
+		fprintf(f, "%s\n    \"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f", i ? "," : "",
+			stPhaseNames[i], stats.wall[i] * 1e3, stats.cpu[i] * 1e3);
+		if (i == StParse)
+			fprintf(f, ", \"read_ms\": %.3f, \"scan_ms\": %.3f",
+				stats.read * 1e3, (stats.scan - stats.read) * 1e3);
+		fprintf(f, "}");
+	}
+	fprintf(f, "\n  },\n  \"chars\": %ld,\n  \"lines\": %ld,\n  \"tokens\": ", stats.chars, stats.lines);
+	stCounts(f, stTokenNames, stats.tokens, SHR + 1);
+	fprintf(f, ",\n  \"stmt_nodes\": ");
+	stCounts(f, stStmtNames, stats.stmts, CallK + 1);
+	fprintf(f, ",\n  \"exp_nodes\": ");
+	stCounts(f, stExpNames, stats.exps, IdK + 1);
+	fprintf(f, ",\n  \"parser_bytes\": %ld,\n  \"peak_rss_kb\": ", stats.bytes);
+	if (rss < 0)
+		fprintf(f, "null");
+	else
+		fprintf(f, "%ld", rss);
+	fprintf(f, ",\n  \"syntax_errors\": %d\n}\n", stats.syntaxErrors);
+	if (f != stdout)
+		fclose(f);
+}
+
+#endif
+
+
+/*********************************************/
+/*************grammar rule profiler***********/
+/*********************************************/
+
+/* Built with -DPROFILE, the parser counts for every grammar rule the
+   calls, the cycles spent in it with and without the rules it calls,
+   and the tokens read while it was active. The call stacks are kept in
+   a tree, each node with the cycles spent in its rule itself, and are
+   written as folded stacks ("declaration;compound_stmt;stmt 1234"), the
+   input of flamegraph.pl and speedscope. A rule called inside itself
+   adds its inclusive cycles and tokens once, for the outermost call. */
+
+#ifdef PROFILE
+
+static const char* prNames[PrRules] = {
+	"declaration_list", "declaration", "var_declaration", "params", "param_list", "param",
+	"compound_stmt", "local_decl", "stmt_list", "stmt", "expression_stmt", "selection_stmt",
+	"iteration_stmt", "return_stmt", "expr", "simple_expr", "add_expr", "term", "factor",
+	"call", "args_list"
+};
+
+typedef struct {
+	int rule;           // -1 for the root
+	int parent, child, next;
+	unsigned long long self;
+} ProfNode;
+
+typedef struct {
+	int node;
+	unsigned long long start, children;
+	long tokens;
+} ProfFrame;
+
+static ProfNode* prNodes = NULL;
+static int prNNodes, prNodeCap;
+static ProfFrame* prStack = NULL;
+static int prDepth, prStackCap;
+static long prCalls[PrRules], prTokens[PrRules];
+static unsigned long long prIncl[PrRules], prExcl[PrRules];
+static int prActive[PrRules];
+
+static unsigned long long profCycles(void)
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(_WIN32)
+	return (unsigned long long)clock();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void profEnter(ProfRule rule)
+{
+	int parent, n;
+
+	if (prNNodes == 0) {
+		prNodes = (ProfNode*)incGrow(prNodes, &prNodeCap, 1, sizeof(ProfNode));
+		prNodes[0].rule = -1;
+		prNodes[0].parent = prNodes[0].child = prNodes[0].next = -1;
+		prNodes[0].self = 0;
+		prNNodes = 1;
+	}
+	parent = prDepth > 0 ? prStack[prDepth - 1].node : 0;
+	for (n = prNodes[parent].child; n >= 0 && prNodes[n].rule != (int)rule; n = prNodes[n].next)
+		;
+	if (n < 0) {
+		prNodes = (ProfNode*)incGrow(prNodes, &prNodeCap, prNNodes + 1, sizeof(ProfNode));
+		n = prNNodes++;
+		prNodes[n].rule = rule;
+		prNodes[n].parent = parent;
+		prNodes[n].child = -1;
+		prNodes[n].next = prNodes[parent].child;
+		prNodes[n].self = 0;
+		prNodes[parent].child = n;
+	}
+	prStack = (ProfFrame*)incGrow(prStack, &prStackCap, prDepth + 1, sizeof(ProfFrame));
+	prStack[prDepth].node = n;
+	prStack[prDepth].children = 0;
+	prStack[prDepth].tokens = profTokens;
+	prCalls[rule]++;
+	prActive[rule]++;
+	prStack[prDepth++].start = profCycles();
+}
+
+void profLeave(void)
+{
+	unsigned long long total = profCycles();
+	ProfFrame* f = &prStack[--prDepth];
+	int rule = prNodes[f->node].rule;
+
+	total -= f->start;
+	prNodes[f->node].self += total - f->children;
+	prExcl[rule] += total - f->children;
+	if (--prActive[rule] == 0) {
+		prIncl[rule] += total;
+		prTokens[rule] += profTokens - f->tokens;
+	}
+	if (prDepth > 0)
+		prStack[prDepth - 1].children += total;
+}
+
+void profReport(char* file)
+{
+	FILE* f = fopen(file, "w");
+	int* path = (int*)malloc((prNNodes + 1) * sizeof(int));
+	unsigned long long all = 0;
+	int n, p, depth, r;
+
+	if (f == NULL || path == NULL) {
+		fprintf(stderr, "Unable to open %s\n", file);
+		exit(1);
+	}
+	for (n = 1; n < prNNodes; n++) {
+		if (prNodes[n].self == 0)
+			continue;
+		for (depth = 0, p = n; p > 0; p = prNodes[p].parent)
+			path[depth++] = prNodes[p].rule;
+		while (--depth >= 0)
+			fprintf(f, "%s%c", prNames[path[depth]], depth > 0 ? ';' : ' ');
+		fprintf(f, "%llu\n", prNodes[n].self);
+	}
+	fclose(f);
+	free(path);
+
+	for (r = 0; r < PrRules; r++)
+		all += prExcl[r];
+	fprintf(stderr, "%-16s %10s %14s %14s %6s %10s\n",
+		"rule", "calls", "incl cycles", "excl cycles", "excl%", "tokens");
+	for (r = 0; r < PrRules; r++)
+		if (prCalls[r] > 0)
+			fprintf(stderr, "%-16s %10ld %14llu %14llu %5.1f%% %10ld\n", prNames[r], prCalls[r],
+				prIncl[r], prExcl[r], all ? 100.0 * prExcl[r] / all : 0.0, prTokens[r]);
+}
+
+#endif
+
+
+/*********************************************/
+/****************trace events*****************/
+/*********************************************/
+
+/* -trace <file>: the times of the phases of a compilation and of every
+   top-level declaration as Chrome trace events (chrome://tracing,
+   Perfetto). The events go into a ring buffer of the process without
+   any locking, since the compiler has a single thread; the buffer is
+   written with one append when it is full and at exit, so compilations
+   in many processes, from a script or the compile server, can trace to
+   the same file. The file is a JSON array that is never closed, which
+   the trace viewers accept. Compiles of the server show as threads of
+   the server process, named after their input file. */
+
+#define TRACESIZE 4096      // events kept before they are written
+
+typedef struct {
+	char name[MAXTOKENLEN + 8];
+	const char* cat;
+	double ts, dur;         // microseconds
+} TraceEvent;
+
+static TraceEvent trRing[TRACESIZE];
+static unsigned int trHead = 0, trTail = 0;  // next event to add, to write
+static char trInput[256];   // file being compiled
+static int trNamed = FALSE; // the thread name was written
+
+double traceNow(void)
+{
+	if (TraceFile == NULL)
+		return 0;
+#ifdef _WIN32
+	return (double)clock() * 1e6 / CLOCKS_PER_SEC;
+#else
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+	}
+#endif
+}
+
+/* the JSON text of a string, without the quotes */
+static int trEscape(char* out, const char* s, int max)
+{
+	int n = 0;
+
+	for (; *s != '\0' && n < max - 6; s++)
+		if (*s == '"' || *s == '\\')
+			n += sprintf(out + n, "\\%c", *s);
+		else if ((unsigned char)*s < ' ')
+			n += sprintf(out + n, "\\u%04x", *s);
+		else
+			out[n++] = *s;
+	out[n] = '\0';
+	return n;
+}
+
+static void trFlush(void)
+{
+	static char buf[TRACESIZE * 200 + 600];
+	char name[520];
+	int n = 0, pid = (int)getpid(), group = tracePid ? tracePid : pid;
+	TraceEvent* e;
+	FILE* f;
+
+	if (trTail == trHead && trNamed)
+		return;
+	if (!trNamed) {
+		trEscape(name, trInput, sizeof(name));
+		n += sprintf(buf + n, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+			"\"args\":{\"name\":\"%s\"}},\n", group, pid, name);
+		trNamed = TRUE;
+	}
+	for (; trTail != trHead; trTail++) {
+		e = &trRing[trTail % TRACESIZE];
+		trEscape(name, e->name, sizeof(name));
+		n += sprintf(buf + n, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+			"\"dur\":%.3f,\"pid\":%d,\"tid\":%d},\n", name, e->cat, e->ts, e->dur, group, pid);
+	}
+#ifdef _WIN32
+	f = fopen(TraceFile, "ab");
+	if (f == NULL) {
+		fprintf(stderr, "Unable to open %s\n", TraceFile);
+		return;
+	}
+	if (ftell(f) == 0)
+		fputs("[\n", f);
+	fwrite(buf, 1, n, f);
+	fclose(f);
+#else
+	{
+		/* whoever makes the file starts the array; the events of one
+		   process go in one write, so those of others cannot come between */
+		int fd = open(TraceFile, O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0644);
+		if (fd >= 0 && write(fd, "[\n", 2) != 2)
+			fd = -1;
+		if (fd < 0)
+			fd = open(TraceFile, O_WRONLY | O_APPEND);
+		if (fd < 0 || write(fd, buf, n) != n)
+			fprintf(stderr, "Unable to write %s\n", TraceFile);
+		if (fd >= 0)
+			close(fd);
+	}
+	(void)f;
+#endif
+}
+
+/* start the events of a compilation; they are written at exit, however
+   the compilation ends */
+void traceStart(char* inputFile)
+{
+	static int registered = FALSE;
+
+	sprintf(trInput, "%.250s", inputFile);
+	trNamed = FALSE;
+	trHead = trTail = 0;
+	if (!registered)
+		atexit(trFlush);
+	registered = TRUE;
+}
+
+/* an event from start to now */
+void traceEvent(char* name, const char* cat, double start)
+{
+	TraceEvent* e;
+
+	if (TraceFile == NULL)
+		return;
+	if (trHead - trTail == TRACESIZE)
+		trFlush();
+	e = &trRing[trHead % TRACESIZE];
+	sprintf(e->name, "%.*s", MAXTOKENLEN + 7, name != NULL ? name : "?");
+	e->cat = cat;
+	e->ts = start;
+	e->dur = traceNow() - start;
+	trHead++;
+}
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Tests of -cache. Every source is listed without the cache, then twice
+# with it (once storing the tree, once taking it); the listings and the
+# output of -run must not change. The sources are parser/1.c, parser/2.c,
+# parser/bench/*.c and the programs in this directory.
+#
+# usage: cache.sh [<parse>]     builds parse from parse.c when not given;
+#                               $CC chooses the C compiler
+
+dir=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+CC=${CC:-cc}
+if [ $# -gt 0 ]; then
+	parse=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+else
+	parse=$tmp/parse
+	$CC -O2 -o "$parse" "$dir/../parse.c" 2>/dev/null || { echo "cannot build parse"; exit 1; }
+fi
+fail=0
+
+# check <source>
+check() {
+	src=$1; name=$(basename "$src" .c)
+	in=/dev/null
+	[ -f "$dir/$name.in" ] && in=$dir/$name.in
+	rm -rf "$tmp/cache"; mkdir "$tmp/cache"
+	"$parse" -run "$src" "$tmp/plain.txt" <"$in" >"$tmp/plain.out" 2>&1
+	for pass in store take; do
+		rm -f "$tmp/$pass.txt"
+		"$parse" -cache "$tmp/cache" -run "$src" "$tmp/$pass.txt" <"$in" >"$tmp/$pass.out" 2>&1
+		if ! cmp -s "$tmp/plain.txt" "$tmp/$pass.txt" || ! cmp -s "$tmp/plain.out" "$tmp/$pass.out"; then
+			printf "FAIL %s: %s\n" "$name" "$pass"; diff "$tmp/plain.txt" "$tmp/$pass.txt" | head; fail=1; return
+		fi
+	done
+	if [ -z "$(ls "$tmp/cache")" ]; then
+		printf "FAIL %s: nothing stored\n" "$name"; fail=1; return
+	fi
+	printf "ok   %s\n" "$name"
+}
+
+for src in "$dir/../1.c" "$dir/../2.c" "$dir"/../bench/*.c "$dir"/*.c; do
+	check "$src"
+done
+exit $fail
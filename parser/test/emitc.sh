@@ -0,0 +1,50 @@
+#!/bin/sh
+# Tests of the C back end. Every program is written as C by parse -emitc,
+# compiled with the host compiler and run; what it prints must be the
+# same as <name>.expected, with <name>.in as its input when there is one.
+# The sources are parser/1.c, parser/2.c, parser/bench/*.c and the
+# programs in this directory.
+#
+# usage: emitc.sh [<parse>]     builds parse from parse.c when not given;
+#                               $CC and $CFLAGS choose the C compiler
+
+dir=$(cd "$(dirname "$0")" && pwd)
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+if [ $# -gt 0 ]; then
+	parse=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+else
+	parse=$tmp/parse
+	$CC -O2 -o "$parse" "$dir/../parse.c" 2>/dev/null || { echo "cannot build parse"; exit 1; }
+fi
+fail=0
+
+# check <source> <name>: <name> is where the source is copied to
+check() {
+	src=$1; name=$2; base=$(basename "$src" .c)
+	mkdir -p "$(dirname "$tmp/$name")"
+	cp "$src" "$tmp/$name.c"
+	in=/dev/null
+	[ -f "$dir/$base.in" ] && in=$dir/$base.in
+	if ! "$parse" -emitc "$tmp/$name.c" "$tmp/out.txt" >/dev/null 2>&1; then
+		printf "FAIL %s: parse -emitc\n" "$name"; fail=1; return
+	fi
+	if ! $CC $CFLAGS -o "$tmp/prog" "$tmp/$name.gen.c" 2>"$tmp/cc.txt"; then
+		printf "FAIL %s: %s\n" "$name" "$CC"; cat "$tmp/cc.txt"; fail=1; return
+	fi
+	"$tmp/prog" <"$in" >"$tmp/got.txt" 2>&1
+	if cmp -s "$tmp/got.txt" "$dir/$base.expected"; then
+		printf "ok   %s\n" "$name"
+	else
+		printf "FAIL %s\n" "$name"; diff "$dir/$base.expected" "$tmp/got.txt" | head; fail=1
+	fi
+}
+
+for src in "$dir/../1.c" "$dir/../2.c" "$dir"/../bench/*.c "$dir"/*.c; do
+	check "$src" "$(basename "$src" .c)"
+done
+# a path that must be escaped in #line and in the header comment
+check "$dir/order.c" 'dir*/or"d\er??='
+exit $fail
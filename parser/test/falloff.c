@@ -0,0 +1,13 @@
+/* an int function running off its end returns 0 */
+int sign(int x)
+{	if (x > 0)
+		return 1;
+	if (x < 0)
+		return 0 - 1;
+}
+
+void main(void)
+{	output(sign(5));
+	output(sign(0 - 5));
+	output(sign(0));
+}
@@ -0,0 +1,41 @@
+/* operands and arguments with side effects are evaluated left to right */
+int g;
+int a[4];
+
+int set(int v)
+{	g = v;
+	return v;
+}
+
+int bump(void)
+{	g = g + 1;
+	return g;
+}
+
+int pair(int x, int y)
+{	return x * 10 + y;
+}
+
+int at(int v[], int i)
+{	return v[i];
+}
+
+void main(void)
+{	g = 1;
+	output(g + set(5));
+	output(set(2) * 10 + g);
+	output(pair(bump(), bump()));
+	output(pair(g, set(9)));
+	g = 0;
+	a[bump()] = bump() * 100;
+	output(a[1]);
+	output(pair(bump(), 7, set(50)));
+	output(g);
+	output(bump() - bump());
+	output((g = 3) + g * 2);
+	while (g < set(g + 1) * 0 + 6)
+		output(g);
+	a[2] = 8;
+	output(at(a, bump() - 5));
+	output(pair(a[2], set(1)));
+}
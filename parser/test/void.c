@@ -0,0 +1,17 @@
+/* functions declared with (void) parameters; their placeholder
+   parameter has no name */
+int seven(void)
+{
+	return 7;
+}
+
+void show(int x)
+{
+	output(x);
+}
+
+void main(void)
+{
+	show(seven());
+	show(seven() * 6);
+}
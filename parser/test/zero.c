@@ -0,0 +1,31 @@
+/* locals start at zero on every call, whatever the last call left in
+   the frame */
+int f(int n)
+{
+	int x;
+	int a[3];
+	if (n) {
+		x = 7;
+		a[1] = 9;
+	}
+	output(x);
+	output(a[1]);
+	return 0;
+}
+
+int g(int p, int q, int r, int s, int t, int u, int v)
+{
+	int a[10];
+	if (p)
+		a[9] = p + q + r + s + t + u + v;
+	output(a[9]);
+	return 0;
+}
+
+void main(void)
+{
+	f(1);
+	f(0);
+	g(1, 2, 3, 4, 5, 6, 7);
+	g(0, 1, 1, 1, 1, 1, 1);
+}
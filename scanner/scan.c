@@ -59,6 +59,16 @@ int linepos = 0;        // current position in linebuf
 int bufsize = 0;        // current size of buffer string
 int EOF_flag = FALSE;
 
+/* variables related to the token file (-tokens) */
+#define TOKVERSION 1
+FILE* tokFile = NULL;
+int tokLine = 0;        // line of the token written last
+char** lexemes = NULL;  // lexemes written so far, by number
+int nLexemes = 0;
+int lexCap = 0;
+int* lexHash = NULL;    // lexeme numbers by hash, -1 for an empty slot
+int lexHashCap = 0;
+
 /* lineBuf  ϳ а,
    linepos  ϳ char ȯ Ѵ. */
 int getNextChar() {
@@ -130,6 +140,88 @@ void printToken(TokenType token, const char* tokenString) {
 	}
 }
 
+/* write v in 7-bit groups, the low group first.
+   the high bit of a byte means another group follows */
+void putVarint(unsigned int v) {
+	while (v >= 0x80) {
+		putc((int)(v & 0x7f) | 0x80, tokFile);
+		v >>= 7;
+	}
+	putc((int)v, tokFile);
+}
+
+unsigned int lexemeHash(char* s) {
+	unsigned int h = 2166136261u;
+	while (*s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h;
+}
+
+/* number of lexeme s. isNew is set when s gets a new number */
+int lexemeRef(char* s, int* isNew) {
+	int i, k;
+
+	if (2 * (nLexemes + 1) > lexHashCap) {
+		lexHashCap = lexHashCap ? 2 * lexHashCap : 1024;
+		free(lexHash);
+		lexHash = (int*)malloc(lexHashCap * sizeof(int));
+		if (lexHash == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		for (i = 0; i < lexHashCap; i++)
+			lexHash[i] = -1;
+		for (k = 0; k < nLexemes; k++) {
+			for (i = lexemeHash(lexemes[k]) & (lexHashCap - 1); lexHash[i] >= 0; i = (i + 1) & (lexHashCap - 1))
+				;
+			lexHash[i] = k;
+		}
+	}
+	for (i = lexemeHash(s) & (lexHashCap - 1); lexHash[i] >= 0; i = (i + 1) & (lexHashCap - 1))
+		if (!strcmp(lexemes[lexHash[i]], s)) {
+			*isNew = FALSE;
+			return lexHash[i];
+		}
+	if (nLexemes == lexCap) {
+		lexCap = lexCap ? 2 * lexCap : 256;
+		lexemes = (char**)realloc(lexemes, lexCap * sizeof(char*));
+		if (lexemes == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	lexemes[nLexemes] = (char*)malloc(strlen(s) + 1);
+	if (lexemes[nLexemes] == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	strcpy(lexemes[nLexemes], s);
+	lexHash[i] = nLexemes;
+	*isNew = TRUE;
+	return nLexemes++;
+}
+
+/* one record of the token file: the line minus the line of the token
+   before times 32 plus the token kind (there are 32 kinds up to NUM),
+   so most records start with one byte, and for ID, NUM and ERROR the
+   lexeme number. the first use of a number is followed by the length
+   and the characters */
+void writeToken(TokenType token) {
+	int ref, isNew, len;
+
+	putVarint((unsigned int)(lineno - tokLine) << 5 | (unsigned int)token);
+	tokLine = lineno;
+	if (token == ID || token == NUM || token == ERROR) {
+		ref = lexemeRef(tokenString, &isNew);
+		putVarint((unsigned int)ref);
+		if (isNew) {
+			len = (int)strlen(tokenString);
+			putVarint((unsigned int)len);
+			fwrite(tokenString, 1, len, tokFile);
+		}
+	}
+}
+
 /* return next token in source file */
 TokenType getToken(void) {
 	int tokenStringIndex = 0;			// ū ڿ(tokenString) index
@@ -335,6 +427,8 @@ TokenType getToken(void) {
 	}
 	fprintf(fpOut, "\t%d: ", lineno);
 	printToken(currentToken, tokenString);
+	if (tokFile != NULL)
+		writeToken(currentToken);
 
 	return currentToken;
 }
@@ -342,17 +436,24 @@ TokenType getToken(void) {
 /* main */
 void main(int argc, char* argv[]) {
 	char inputFile[50], outputFile[50];
+	char* tokName = NULL;
+	int argi = 1;
 
-	if (argc != 3) {
-		fprintf(stderr, "usage: %s <input_file.c> <output_file.txt>\n", argv[0]);
+	if (argc > 2 && !strcmp(argv[1], "-tokens")) {
+		tokName = argv[2];
+		argi = 3;
+	}
+	if (argc - argi != 2 || strlen(argv[argi]) > 45 || strlen(argv[argi + 1]) > 45) {
+		fprintf(stderr, "usage: %s [-tokens <token_file>] <input_file.c> <output_file.txt>\n", argv[0]);
+		fprintf(stderr, "  -tokens  also write the tokens to <token_file> for parse -tokens\n");
 		exit(1);
 	}
 
 	/* check for file extension */
-	strcpy(inputFile, argv[1]);
+	strcpy(inputFile, argv[argi]);
 	if (strchr(inputFile, '.') == NULL)
 		strcat(inputFile, ".c");
-	strcpy(outputFile, argv[2]);
+	strcpy(outputFile, argv[argi + 1]);
 	if (strchr(outputFile, '.') == NULL)
 		strcat(outputFile, ".txt");
 
@@ -364,10 +465,22 @@ void main(int argc, char* argv[]) {
 		exit(1);
 	}
 
+	if (tokName != NULL) {
+		tokFile = fopen(tokName, "wb");
+		if (tokFile == NULL) {
+			fprintf(stderr, "Unable to open %s\n", tokName);
+			exit(1);
+		}
+		fwrite("C-TOK", 1, 6, tokFile);
+		putVarint(TOKVERSION);
+	}
+
 	fprintf(fpOut, "C- COMPILATION: %s\n", inputFile);
 
 	while (getToken() != ENDFILE);
 
 	fclose(fpIn);
 	fclose(fpOut);
+	if (tokFile != NULL)
+		fclose(tokFile);
 }
\ No newline at end of file
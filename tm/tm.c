@@ -0,0 +1,323 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+/* TM (Tiny Machine) simulator.
+   The program text is parsed once into an array of decoded instructions;
+   execution then only looks at that array. */
+
+#define IADDR_SIZE 1048576  /* instruction memory */
+#define DADDR_SIZE 4000000  /* data memory */
+#define NO_REGS 8
+#define PC_REG 7
+#define LINESIZE 256
+#define TRUE 1
+#define FALSE 0
+
+/* instruction classes */
+typedef enum {
+	opclRR,     /* reg operands r,s,t */
+	opclRM,     /* reg r, mem d+s */
+	opclRA      /* reg r, int d+s */
+} OPCLASS;
+
+typedef enum {
+	/* RR instructions */
+	opHALT, opIN, opOUT, opADD, opSUB, opMUL, opDIV, opRRLim,
+	/* RM instructions */
+	opLD, opST, opRMLim,
+	/* RA instructions */
+	opLDA, opLDC, opJLT, opJLE, opJGT, opJGE, opJEQ, opJNE, opRALim
+} OPCODE;
+
+typedef enum {
+	srOKAY, srHALT, srIMEM_ERR, srDMEM_ERR, srZERODIVIDE, srIN_ERR
+} STEPRESULT;
+
+typedef struct {
+	int iop;
+	int iarg1;
+	int iarg2;
+	int iarg3;
+} INSTRUCTION;
+
+static char* opCodeTab[] = {
+	"HALT", "IN", "OUT", "ADD", "SUB", "MUL", "DIV", "????",
+	"LD", "ST", "????",
+	"LDA", "LDC", "JLT", "JLE", "JGT", "JGE", "JEQ", "JNE", "????"
+};
+
+static char* stepResultTab[] = {
+	"OK", "Halted", "Instruction Memory Fault", "Data Memory Fault",
+	"Division by 0", "Bad input"
+};
+
+/* global variables */
+INSTRUCTION* iMem;
+int* dMem;
+int reg[NO_REGS];
+FILE* pgm;
+int traceflag = FALSE;
+int timeflag = FALSE;
+int lineNo = 0;
+
+static OPCLASS opClass(int c)
+{
+	if (c <= opRRLim)
+		return opclRR;
+	else if (c <= opRMLim)
+		return opclRM;
+	else
+		return opclRA;
+}
+
+static void writeInstruction(int loc)
+{
+	INSTRUCTION* in = &iMem[loc];
+	fprintf(stderr, "%5d: %5s  ", loc, opCodeTab[in->iop]);
+	if (opClass(in->iop) == opclRR)
+		fprintf(stderr, "%d,%d,%d\n", in->iarg1, in->iarg2, in->iarg3);
+	else
+		fprintf(stderr, "%d,%d(%d)\n", in->iarg1, in->iarg2, in->iarg3);
+}
+
+static int loadError(char* message)
+{
+	fprintf(stderr, "Line %d: %s\n", lineNo, message);
+	return FALSE;
+}
+
+/* read an optionally signed decimal number at *p */
+static int getNum(char** p, int* value)
+{
+	char* s = *p;
+	int sign = 1, v = 0;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+	if (*s == '+' || *s == '-') {
+		if (*s == '-')
+			sign = -1;
+		s++;
+	}
+	if (!isdigit((unsigned char)*s))
+		return FALSE;
+	while (isdigit((unsigned char)*s))
+		v = v * 10 + (*s++ - '0');
+	*value = sign * v;
+	*p = s;
+	return TRUE;
+}
+
+static int skipCh(char** p, char c)
+{
+	while (**p == ' ' || **p == '\t')
+		(*p)++;
+	if (**p != c)
+		return FALSE;
+	(*p)++;
+	return TRUE;
+}
+
+/* parse the program text into iMem */
+static int readInstructions(void)
+{
+	char line[LINESIZE];
+	char word[8];
+	int loc, op, arg1, arg2, arg3, n;
+
+	for (loc = 0; loc < IADDR_SIZE; loc++) {
+		iMem[loc].iop = opHALT;
+		iMem[loc].iarg1 = iMem[loc].iarg2 = iMem[loc].iarg3 = 0;
+	}
+	while (fgets(line, LINESIZE, pgm)) {
+		char* p = line;
+		lineNo++;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '*' || *p == '\n' || *p == '\r' || *p == '\0')
+			continue;
+		if (!getNum(&p, &loc))
+			return loadError("Bad location");
+		if (loc < 0 || loc >= IADDR_SIZE)
+			return loadError("Location too large");
+		if (!skipCh(&p, ':'))
+			return loadError("Missing colon");
+		while (*p == ' ' || *p == '\t')
+			p++;
+		n = 0;
+		while (isalpha((unsigned char)*p) && n < (int)sizeof(word) - 1)
+			word[n++] = *p++;
+		word[n] = '\0';
+		for (op = opHALT; op < opRALim; op++)
+			if (!strcmp(opCodeTab[op], word))
+				break;
+		if (op == opRALim || !strcmp(word, "????"))
+			return loadError("Illegal opcode");
+		if (!getNum(&p, &arg1) || arg1 < 0 || arg1 >= NO_REGS)
+			return loadError("Bad first register");
+		if (!skipCh(&p, ','))
+			return loadError("Missing comma");
+		if (opClass(op) == opclRR) {
+			if (!getNum(&p, &arg2) || arg2 < 0 || arg2 >= NO_REGS)
+				return loadError("Bad second register");
+			if (!skipCh(&p, ','))
+				return loadError("Missing comma");
+			if (!getNum(&p, &arg3) || arg3 < 0 || arg3 >= NO_REGS)
+				return loadError("Bad third register");
+		}
+		else {
+			if (!getNum(&p, &arg2))
+				return loadError("Bad displacement");
+			if (!skipCh(&p, '('))
+				return loadError("Missing LParen");
+			if (!getNum(&p, &arg3) || arg3 < 0 || arg3 >= NO_REGS)
+				return loadError("Bad second register");
+			if (!skipCh(&p, ')'))
+				return loadError("Missing RParen");
+		}
+		/* a later line for the same location replaces the earlier one */
+		iMem[loc].iop = op;
+		iMem[loc].iarg1 = arg1;
+		iMem[loc].iarg2 = arg2;
+		iMem[loc].iarg3 = arg3;
+	}
+	return TRUE;
+}
+
+/* run until HALT or an error; count receives the executed instructions */
+static STEPRESULT run(long long* count)
+{
+	int* r = reg;
+	int* m = dMem;
+	INSTRUCTION* in;
+	int pc = r[PC_REG];
+	int a;
+	long long n = 0;
+	STEPRESULT result = srOKAY;
+
+	while (result == srOKAY) {
+		if (pc < 0 || pc >= IADDR_SIZE) {
+			result = srIMEM_ERR;
+			break;
+		}
+		in = &iMem[pc];
+		if (traceflag)
+			writeInstruction(pc);
+		r[PC_REG] = ++pc;
+		n++;
+		switch (in->iop) {
+		case opHALT:
+			result = srHALT;
+			break;
+		case opIN:
+			if (scanf("%d", &r[in->iarg1]) != 1)
+				result = srIN_ERR;
+			break;
+		case opOUT:
+			printf("%d\n", r[in->iarg1]);
+			break;
+		case opADD: r[in->iarg1] = r[in->iarg2] + r[in->iarg3]; break;
+		case opSUB: r[in->iarg1] = r[in->iarg2] - r[in->iarg3]; break;
+		case opMUL: r[in->iarg1] = r[in->iarg2] * r[in->iarg3]; break;
+		case opDIV:
+			if (r[in->iarg3] != 0)
+				r[in->iarg1] = r[in->iarg2] / r[in->iarg3];
+			else
+				result = srZERODIVIDE;
+			break;
+		case opLD:
+			a = in->iarg2 + r[in->iarg3];
+			if (a < 0 || a >= DADDR_SIZE)
+				result = srDMEM_ERR;
+			else
+				r[in->iarg1] = m[a];
+			break;
+		case opST:
+			a = in->iarg2 + r[in->iarg3];
+			if (a < 0 || a >= DADDR_SIZE)
+				result = srDMEM_ERR;
+			else
+				m[a] = r[in->iarg1];
+			break;
+		case opLDA: r[in->iarg1] = in->iarg2 + r[in->iarg3]; break;
+		case opLDC: r[in->iarg1] = in->iarg2; break;
+		case opJLT: if (r[in->iarg1] < 0) r[PC_REG] = in->iarg2 + r[in->iarg3]; break;
+		case opJLE: if (r[in->iarg1] <= 0) r[PC_REG] = in->iarg2 + r[in->iarg3]; break;
+		case opJGT: if (r[in->iarg1] > 0) r[PC_REG] = in->iarg2 + r[in->iarg3]; break;
+		case opJGE: if (r[in->iarg1] >= 0) r[PC_REG] = in->iarg2 + r[in->iarg3]; break;
+		case opJEQ: if (r[in->iarg1] == 0) r[PC_REG] = in->iarg2 + r[in->iarg3]; break;
+		case opJNE: if (r[in->iarg1] != 0) r[PC_REG] = in->iarg2 + r[in->iarg3]; break;
+		}
+		/* the pc register may have been written by the instruction */
+		pc = r[PC_REG];
+	}
+	if (result != srHALT)
+		r[PC_REG] = pc - 1;
+	*count = n;
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	char pgmName[256];
+	int argi = 1, i;
+	long long count;
+	STEPRESULT result;
+	clock_t start;
+	double secs;
+
+	while (argi < argc && argv[argi][0] == '-') {
+		if (!strcmp(argv[argi], "-t"))
+			timeflag = TRUE;
+		else if (!strcmp(argv[argi], "-trace"))
+			traceflag = TRUE;
+		else
+			break;
+		argi++;
+	}
+	if (argc - argi != 1 || strlen(argv[argi]) > 200) {
+		fprintf(stderr, "usage: %s [-t] [-trace] <filename>\n", argv[0]);
+		fprintf(stderr, "  -t      report executed instructions and speed to stderr\n");
+		fprintf(stderr, "  -trace  print every executed instruction to stderr\n");
+		exit(1);
+	}
+	strcpy(pgmName, argv[argi]);
+	if (strchr(pgmName, '.') == NULL)
+		strcat(pgmName, ".tm");
+	pgm = fopen(pgmName, "r");
+	if (pgm == NULL) {
+		fprintf(stderr, "file '%s' not found\n", pgmName);
+		exit(1);
+	}
+
+	iMem = (INSTRUCTION*)malloc(IADDR_SIZE * sizeof(INSTRUCTION));
+	dMem = (int*)calloc(DADDR_SIZE, sizeof(int));
+	if (iMem == NULL || dMem == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	if (!readInstructions())
+		exit(1);
+	fclose(pgm);
+
+	for (i = 0; i < NO_REGS; i++)
+		reg[i] = 0;
+	dMem[0] = DADDR_SIZE - 1;
+
+	start = clock();
+	result = run(&count);
+	secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+	fflush(stdout);
+	if (result != srHALT) {
+		fprintf(stderr, "%s at instruction %d\n", stepResultTab[result], reg[PC_REG]);
+		writeInstruction(reg[PC_REG] >= 0 && reg[PC_REG] < IADDR_SIZE ? reg[PC_REG] : 0);
+	}
+	if (timeflag)
+		fprintf(stderr, "tm: %lld instructions in %.3f s (%.2f M instructions/s)\n",
+			count, secs, secs > 0 ? count / secs / 1e6 : 0.0);
+	return result == srHALT ? 0 : 1;
+}